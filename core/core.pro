@@ -20,6 +20,7 @@ HEADERS += \
     src/graphicscontrollerprivate.h \
     src/abstractcontrollerprivate.h \
     src/modelnodeprivate.h \
+    src/animationgraph.h \
     src/drawables.h \
     src/resources.h \
     src/importexport.h \
@@ -38,7 +39,14 @@ HEADERS += \
     src/noderendershadowmapvisitor.h \
     src/noderendervisitor.h \
     src/nodepickvisitor.h \
-    src/particlesystemnodeprivate.h
+    src/particlesystemnodeprivate.h \
+    src/threadpool.h \
+    src/messagequeue.h \
+    src/messagepool.h \
+    src/posecache.h \
+    src/simd.h \
+    src/particlesimulation.h \
+    src/meshbvh.h
 
 SOURCES += \
     src/hdrloader/hdrloader.cpp \
@@ -55,6 +63,7 @@ SOURCES += \
     src/coreprivate.cpp \
     src/modelnode.cpp \
     src/modelnodeprivate.cpp \
+    src/animationgraph.cpp \
     src/drawables.cpp \
     src/importexport.cpp \
     src/scene.cpp \
@@ -77,7 +86,15 @@ SOURCES += \
     src/primitivenode.cpp \
     src/nodeintersectionvisitor.cpp \
     src/particlesystemnode.cpp \
-    src/particlesystemnodeprivate.cpp
+    src/particlesystemnodeprivate.cpp \
+    src/threadpool.cpp \
+    src/nodeupdatevisitor.cpp \
+    src/messagepool.cpp \
+    src/posecache.cpp \
+    src/particlesimulation.cpp \
+    src/meshbvh.cpp \
+    src/rayquery.cpp \
+    src/nodegeometryvisitor.cpp
 
 LIBS += \
 #    -lassimp-vc140-mt
@@ -0,0 +1,50 @@
+uniform samplerBuffer u_bonesPalette;
+
+#ifndef BONES_OFFSET
+uniform int u_bonesOffset;
+#define BONES_OFFSET (u_bonesOffset)
+#endif
+
+#ifdef HAS_DUAL_QUATERNION_SKINNING
+
+mat2x4 boneDualQuaternion(in int boneID) {
+    int texel = BONES_OFFSET + 2 * boneID;
+    return mat2x4(texelFetch(u_bonesPalette, texel), texelFetch(u_bonesPalette, texel + 1));
+}
+
+// dual quaternions are blended in the hemisphere of the first bone and converted to the same matrix as linear blend skinning produces
+mat3x4 skinningMatrix(in vec4 boneIDs, in vec4 boneWeights) {
+    mat2x4 dq0 = boneDualQuaternion(int(boneIDs[0]));
+    mat2x4 dq = dq0 * boneWeights[0];
+    for (int i = 1; i < 4; ++i) {
+        mat2x4 dqi = boneDualQuaternion(int(boneIDs[i]));
+        dq += dqi * (dot(dq0[0], dqi[0]) < 0.0 ? -boneWeights[i] : boneWeights[i]);
+    }
+
+    float invLength = 1.0 / length(dq[0]);
+    vec4 r = dq[0] * invLength;
+    vec4 d = dq[1] * invLength;
+    vec3 t = 2.0 * (r.w * d.xyz - d.w * r.xyz + cross(r.xyz, d.xyz));
+
+    return mat3x4(
+            vec4(1.0 - 2.0 * (r.y * r.y + r.z * r.z), 2.0 * (r.x * r.y - r.w * r.z), 2.0 * (r.x * r.z + r.w * r.y), t.x),
+            vec4(2.0 * (r.x * r.y + r.w * r.z), 1.0 - 2.0 * (r.x * r.x + r.z * r.z), 2.0 * (r.y * r.z - r.w * r.x), t.y),
+            vec4(2.0 * (r.x * r.z - r.w * r.y), 2.0 * (r.y * r.z + r.w * r.x), 1.0 - 2.0 * (r.x * r.x + r.y * r.y), t.z));
+}
+
+#else
+
+mat3x4 boneMatrix(in int boneID) {
+    int texel = BONES_OFFSET + 3 * boneID;
+    return mat3x4(texelFetch(u_bonesPalette, texel), texelFetch(u_bonesPalette, texel + 1), texelFetch(u_bonesPalette, texel + 2));
+}
+
+mat3x4 skinningMatrix(in vec4 boneIDs, in vec4 boneWeights) {
+    return
+            boneMatrix(int(boneIDs[0])) * boneWeights[0] +
+            boneMatrix(int(boneIDs[1])) * boneWeights[1] +
+            boneMatrix(int(boneIDs[2])) * boneWeights[2] +
+            boneMatrix(int(boneIDs[3])) * boneWeights[3];
+}
+
+#endif
@@ -5,6 +5,10 @@
 layout (location = 0) in vec3 a_position;
 layout (location = 1) in vec3 a_normal;
 
+#ifdef HAS_INSTANCING
+#include<instancing.glsl>
+#endif
+
 #ifdef HAS_TEXCOORDS
 layout (location = 2) in vec3 a_texCoord;
 #endif
@@ -12,7 +16,7 @@ layout (location = 2) in vec3 a_texCoord;
 #ifdef HAS_BONES
 layout (location = 3) in vec4 a_boneIDs;
 layout (location = 4) in vec4 a_boneWeights;
-layout (std140) uniform u_bonesBuffer { mat3x4 u_bones[128]; };
+#include<bones.glsl>
 #endif
 
 #if defined(HAS_TANGENTS)
@@ -23,8 +27,13 @@ layout (location = 5) in vec3 a_tangent;
 layout (location = 6) in vec3 a_color;
 #endif
 
+#ifdef HAS_INSTANCING
+uniform mat4 u_viewProjMatrix;
+uniform mat4 u_viewMatrix;
+#else
 uniform mat4 u_modelViewProjMatrix;
 uniform mat3 u_normalViewMatrix;
+#endif
 
 out vec3 v_normal;
 
@@ -43,25 +52,30 @@ out vec3 v_color;
 
 void main(void)
 {
+#ifdef HAS_INSTANCING
+    mat4 modelMatrix = instanceModelMatrix();
+    mat4 modelViewProjMatrix = u_viewProjMatrix * modelMatrix;
+    mat3 normalViewMatrix = mat3(u_viewMatrix) * instanceNormalMatrix(modelMatrix);
+#else
+    mat4 modelViewProjMatrix = u_modelViewProjMatrix;
+    mat3 normalViewMatrix = u_normalViewMatrix;
+#endif
+
     vec4 pos = vec4(a_position, 1.0);
 
 #ifdef HAS_BONES
-    mat3x4 bonesMatrix =
-            u_bones[int(a_boneIDs[0])] * a_boneWeights[0] +
-            u_bones[int(a_boneIDs[1])] * a_boneWeights[1] +
-            u_bones[int(a_boneIDs[2])] * a_boneWeights[2] +
-            u_bones[int(a_boneIDs[3])] * a_boneWeights[3];
+    mat3x4 bonesMatrix = skinningMatrix(a_boneIDs, a_boneWeights);
 
     pos = vec4(pos * bonesMatrix, 1.0);
 #endif
 
-    gl_Position = u_modelViewProjMatrix * pos;
+    gl_Position = modelViewProjMatrix * pos;
 
     v_normal = normalize(a_normal);
 #ifdef HAS_BONES
     v_normal = normalize(vec4(v_normal, 0.0) * bonesMatrix);
 #endif
-    v_normal = normalize(u_normalViewMatrix * v_normal);
+    v_normal = normalize(normalViewMatrix * v_normal);
 
 #ifdef HAS_TEXCOORDS
     v_texCoord = a_texCoord.xy;
@@ -72,7 +86,7 @@ void main(void)
 #ifdef HAS_BONES
     v_tangent = normalize(vec4(v_tangent, 0.0) * bonesMatrix);
 #endif
-    v_tangent = normalize(u_normalViewMatrix * v_tangent);
+    v_tangent = normalize(normalViewMatrix * v_tangent);
     v_binormal = normalize(cross(v_normal, v_tangent));
 #endif
 
@@ -8,10 +8,7 @@ layout (location = 4) in vec4 a_boneWeights;
 uniform mat4 u_modelViewProjMatrix;
 
 #ifdef HAS_BONES
-layout (std140) uniform u_bonesBuffer
-{
-    mat3x4 u_bones[128];
-};
+#include<bones.glsl>
 #endif
 
 void main(void)
@@ -19,12 +16,7 @@ void main(void)
     vec4 pos = vec4(a_position, 1.0);
 
 #ifdef HAS_BONES
-        mat3x4 bonesMatrix;
-        bonesMatrix =
-                u_bones[int(a_boneIDs[0])] * a_boneWeights[0] +
-                u_bones[int(a_boneIDs[1])] * a_boneWeights[1] +
-                u_bones[int(a_boneIDs[2])] * a_boneWeights[2] +
-                u_bones[int(a_boneIDs[3])] * a_boneWeights[3];
+        mat3x4 bonesMatrix = skinningMatrix(a_boneIDs, a_boneWeights);
 
         pos = vec4(pos * bonesMatrix, 1.0);
 #endif
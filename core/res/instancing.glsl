@@ -0,0 +1,16 @@
+layout (location = 10) in vec4 a_modelMatrixRow0;
+layout (location = 11) in vec4 a_modelMatrixRow1;
+layout (location = 12) in vec4 a_modelMatrixRow2;
+layout (location = 13) in float a_bonesOffset;
+
+#define BONES_OFFSET (int(a_bonesOffset))
+
+mat4 instanceModelMatrix() {
+    return transpose(mat4(a_modelMatrixRow0, a_modelMatrixRow1, a_modelMatrixRow2, vec4(0.0, 0.0, 0.0, 1.0)));
+}
+
+// model matrices are built from scale, rotation and translation so the inverse transpose only rescales the columns
+mat3 instanceNormalMatrix(in mat4 modelMatrix) {
+    mat3 m = mat3(modelMatrix);
+    return mat3(m[0] / dot(m[0], m[0]), m[1] / dot(m[1], m[1]), m[2] / dot(m[2], m[2]));
+}
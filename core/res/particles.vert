@@ -1,6 +1,23 @@
-layout (location = 0) in vec4 a_position;
 layout (location = 2) in vec2 a_texCoord;
-layout (location = 6) in vec4 a_color;
+
+#ifdef GPU_PARTICLES
+layout (location = 8) in vec4 a_positionLifetime;
+layout (location = 9) in vec4 a_velocity;
+
+// color and opacity, size of each curve sample
+uniform samplerBuffer u_particlesData;
+
+// samples per second, last sample index, opacity map frames per second, number of frames
+uniform vec4 u_particleCurves;
+
+// step which wrote the drawn particles, slots of older steps are left behind the alive ones
+uniform float u_particleStep;
+#else
+layout (location = 7) in float a_particleIndex;
+
+// position and size, color and frame number of each particle
+uniform samplerBuffer u_particlesData;
+#endif
 
 uniform mat4 u_modelViewMatrix;
 uniform mat4 u_projMatrix;
@@ -16,17 +33,31 @@ out float v_viewDepth;
 #endif
 
 #ifdef HAS_OPACITYMAPPING
-layout (location = 3) in vec2 a_frameNumber;
 out vec2 v_texCoord;
 flat out vec2 v_frameNumber;
 #endif
 
 void main(void)
 {
-    vec4 pos = vec4(a_position.xyz, 1.0);
-    float scale = a_position.w;
+#ifdef GPU_PARTICLES
+    float lifetime = a_positionLifetime.w;
+    float t = min(lifetime * u_particleCurves.x, u_particleCurves.y);
+    int k = min(int(t), int(u_particleCurves.y) - 1);
+    float f = t - float(k);
 
-    v_color = a_color;
+    vec4 pos = vec4(a_positionLifetime.xyz, 1.0);
+    float scale = a_velocity.w == u_particleStep ? mix(texelFetch(u_particlesData, 2 * k + 1).x, texelFetch(u_particlesData, 2 * k + 3).x, f) : 0.0;
+
+    v_color = mix(texelFetch(u_particlesData, 2 * k), texelFetch(u_particlesData, 2 * k + 2), f);
+#else
+    int index = 3 * int(a_particleIndex);
+    vec4 positionSize = texelFetch(u_particlesData, index);
+
+    vec4 pos = vec4(positionSize.xyz, 1.0);
+    float scale = positionSize.w;
+
+    v_color = texelFetch(u_particlesData, index + 1);
+#endif
     v_offset = a_texCoord * 2.0 - 1.0;
     v_isAlive = scale > 0.0 ? 1 : 0;
 
@@ -41,6 +72,12 @@ void main(void)
 
 #ifdef HAS_OPACITYMAPPING
     v_texCoord = a_texCoord;
-    v_frameNumber = a_frameNumber;
+#ifdef GPU_PARTICLES
+    float frame = lifetime * u_particleCurves.z;
+    float frameIndex = floor(frame);
+    v_frameNumber = vec2(u_particleCurves.w - mod(frameIndex, u_particleCurves.w) - 1.0, 1.0 - (frame - frameIndex));
+#else
+    v_frameNumber = texelFetch(u_particlesData, index + 2).xy;
+#endif
 #endif
 }
@@ -0,0 +1,85 @@
+layout (location = 8) in vec4 a_positionLifetime;
+layout (location = 9) in vec4 a_velocity;
+
+// [0] time step, upper bound of the number of alive particles, seed, step
+// (steps are counted modulo 2^23, so they are exact in floats and particles written by the previous step are told apart)
+// [1] lifetime range, attractor strength
+// [2] initial velocity
+// [3] attractor scale
+// [4] attractor offset
+// [5] acceleration
+uniform vec4 u_particleSimulation[6];
+
+out vec4 g_positionLifetime;
+out vec4 g_velocity;
+
+uint randomState = 0u;
+
+// PCG hash
+uint hash(uint value)
+{
+    uint state = value * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+float random()
+{
+    randomState = hash(randomState);
+    return float(randomState >> 8u) * (1.0 / 16777216.0);
+}
+
+vec3 emit()
+{
+    const float pi = 3.14159265;
+#if defined(EMITTER_TYPE_QUAD)
+    return vec3(random() - 0.5, 0.0, random() - 0.5);
+#elif defined(EMITTER_TYPE_CIRCLE)
+    float a = 2.0 * pi * random();
+    float r = 0.5 * sqrt(random());
+    return vec3(r * cos(a), 0.0, r * sin(a));
+#elif defined(EMITTER_TYPE_BOX)
+    return vec3(random(), random(), random()) - vec3(0.5);
+#elif defined(EMITTER_TYPE_SPHERE)
+    float a = 2.0 * pi * random();
+    float b = pi * (random() - 0.5);
+    float r = 0.5 * sqrt(random());
+    return r * vec3(cos(a) * cos(b), sin(b), sin(a) * cos(b));
+#else
+    return vec3(0.0);
+#endif
+}
+
+void main(void)
+{
+    float dt = u_particleSimulation[0].x;
+    vec3 position = a_positionLifetime.xyz;
+    float lifetime = a_positionLifetime.w;
+    vec3 velocity = a_velocity.xyz;
+
+    // the count of the particles written by the previous step isn't read back yet, so the slots behind them are stale
+    float previousStep = mod(u_particleSimulation[0].w + 8388607.0, 8388608.0);
+    if (a_velocity.w != previousStep)
+        lifetime = 0.0;
+
+    if (gl_VertexID >= int(u_particleSimulation[0].y))
+    {
+        // new particles are spread over the time step to avoid visible bursts
+        randomState = hash(uint(gl_VertexID) ^ hash(uint(u_particleSimulation[0].z)));
+        float age = dt * random();
+        velocity = u_particleSimulation[2].xyz;
+        position = emit() + age * velocity;
+        lifetime = max(mix(u_particleSimulation[1].x, u_particleSimulation[1].y, random()) - age, 0.001);
+    }
+    else
+    {
+        vec3 attractor = position * u_particleSimulation[3].xyz + u_particleSimulation[4].xyz;
+        vec3 acceleration = u_particleSimulation[1].z * attractor * inversesqrt(max(dot(attractor, attractor), 1e-12)) + u_particleSimulation[5].xyz;
+        velocity += dt * acceleration;
+        position += dt * velocity;
+        lifetime -= dt;
+    }
+
+    g_positionLifetime = vec4(position, lifetime);
+    g_velocity = vec4(velocity, u_particleSimulation[0].w);
+}
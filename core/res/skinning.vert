@@ -0,0 +1,39 @@
+layout (location = 0) in vec3 a_position;
+
+#ifdef HAS_NORMALS
+layout (location = 1) in vec3 a_normal;
+#endif
+
+layout (location = 3) in vec4 a_boneIDs;
+layout (location = 4) in vec4 a_boneWeights;
+
+#if defined(HAS_NORMALS) && defined(HAS_TANGENTS)
+layout (location = 5) in vec3 a_tangent;
+#endif
+
+#include<bones.glsl>
+
+out vec3 v_position;
+
+#ifdef HAS_NORMALS
+out vec3 v_normal;
+#endif
+
+#if defined(HAS_NORMALS) && defined(HAS_TANGENTS)
+out vec3 v_tangent;
+#endif
+
+void main(void)
+{
+    mat3x4 bonesMatrix = skinningMatrix(a_boneIDs, a_boneWeights);
+
+    v_position = vec4(a_position, 1.0) * bonesMatrix;
+
+#ifdef HAS_NORMALS
+    v_normal = normalize(vec4(normalize(a_normal), 0.0) * bonesMatrix);
+#endif
+
+#if defined(HAS_NORMALS) && defined(HAS_TANGENTS)
+    v_tangent = normalize(vec4(normalize(a_tangent), 0.0) * bonesMatrix);
+#endif
+}
@@ -1,5 +1,7 @@
 #include <core/abstractcontroller.h>
 
+#include <atomic>
+
 #include "abstractcontrollerprivate.h"
 
 namespace trash
@@ -7,9 +9,16 @@ namespace trash
 namespace core
 {
 
+namespace
+{
+
+std::atomic<uint64_t> numProcessedMessagesCounter(0u);
+
+}
+
 void AbstractController::sendMessage(std::shared_ptr<AbstractController::Message> msg)
 {
-    m_->messages.push_back(msg);
+    m_->messages.push(std::move(msg));
 }
 
 AbstractController::AbstractController(AbstractControllerPrivate *p)
@@ -19,14 +28,19 @@ AbstractController::AbstractController(AbstractControllerPrivate *p)
 
 void AbstractController::process()
 {
-    while (!m_->messages.empty())
+    std::shared_ptr<Message> msg;
+    while (m_->messages.pop(msg))
     {
-        auto msg = m_->messages.front();
-        m_->messages.pop_front();
         doWork(msg);
+        numProcessedMessagesCounter.fetch_add(1u, std::memory_order_relaxed);
     }
 }
 
+uint64_t AbstractController::numProcessedMessages()
+{
+    return numProcessedMessagesCounter.load(std::memory_order_relaxed);
+}
+
 ControllerMessageType AbstractController::Message::type() const
 {
     return m_type;
@@ -1,10 +1,12 @@
 #ifndef ABSTRACTCONTROLLERPRIVATE_H
 #define ABSTRACTCONTROLLERPRIVATE_H
 
-#include <deque>
+#include <memory>
 
 #include <core/abstractcontroller.h>
 
+#include "messagequeue.h"
+
 namespace trash
 {
 namespace core
@@ -15,7 +17,7 @@ class AbstractControllerPrivate
 public:
     virtual ~AbstractControllerPrivate() = default;
 
-    std::deque<std::shared_ptr<AbstractController::Message>> messages;
+    MessageQueue<std::shared_ptr<AbstractController::Message>, 256> messages;
 };
 
 } // namespace
@@ -0,0 +1,700 @@
+#include <queue>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+#include <glm/matrix.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "animationgraph.h"
+#include "simd.h"
+
+namespace trash
+{
+namespace core
+{
+
+namespace
+{
+
+using namespace simd;
+
+// Hamilton product of two quaternions given by components
+inline void mulQuat(F4 ax, F4 ay, F4 az, F4 aw, F4 bx, F4 by, F4 bz, F4 bw, F4& rx, F4& ry, F4& rz, F4& rw)
+{
+    rx = aw * bx + ax * bw + ay * bz - az * by;
+    ry = aw * by - ax * bz + ay * bw + az * bx;
+    rz = aw * bz + ax * by - ay * bx + az * bw;
+    rw = aw * bw - ax * bx - ay * by - az * bz;
+}
+
+inline void normalizeQuat(F4& x, F4& y, F4& z, F4& w)
+{
+    const F4 invLen = invSqrt(x * x + y * y + z * z + w * w);
+    x = x * invLen;
+    y = y * invLen;
+    z = z * invLen;
+    w = w * invLen;
+}
+
+// Rows of a row-major affine matrix are stored in glm::mat3x4 columns
+inline void mulAffine(const glm::mat3x4& a, const glm::mat3x4& b, glm::mat3x4& r)
+{
+    const glm::vec4 a0 = a[0], a1 = a[1], a2 = a[2];
+    r[0] = a0.x * b[0] + a0.y * b[1] + a0.z * b[2] + glm::vec4(0.0f, 0.0f, 0.0f, a0.w);
+    r[1] = a1.x * b[0] + a1.y * b[1] + a1.z * b[2] + glm::vec4(0.0f, 0.0f, 0.0f, a1.w);
+    r[2] = a2.x * b[0] + a2.y * b[1] + a2.z * b[2] + glm::vec4(0.0f, 0.0f, 0.0f, a2.w);
+}
+
+template <typename T, typename Interpolate>
+T sampleKeys(const std::vector<std::pair<float, T>>& keys, float time, Interpolate interpolate)
+{
+    if ((keys.size() == 1) || (time <= keys.front().first))
+        return keys.front().second;
+    if (time >= keys.back().first)
+        return keys.back().second;
+
+    auto next = std::upper_bound(keys.begin(), keys.end(), time, [](float t, const std::pair<float, T>& key) { return t < key.first; });
+    auto prev = next - 1;
+    const float factor = (time - prev->first) / (next->first - prev->first);
+    return interpolate(prev->second, next->second, factor);
+}
+
+} // namespace
+
+void Pose::resize(size_t numJoints)
+{
+    const size_t paddedSize = (numJoints + 3u) & ~static_cast<size_t>(3u);
+    rx.resize(paddedSize, 0.0f);
+    ry.resize(paddedSize, 0.0f);
+    rz.resize(paddedSize, 0.0f);
+    rw.resize(paddedSize, 1.0f);
+    sx.resize(paddedSize, 1.0f);
+    sy.resize(paddedSize, 1.0f);
+    sz.resize(paddedSize, 1.0f);
+    tx.resize(paddedSize, 0.0f);
+    ty.resize(paddedSize, 0.0f);
+    tz.resize(paddedSize, 0.0f);
+}
+
+Skeleton::Skeleton(const Model& model)
+{
+    std::queue<std::pair<std::shared_ptr<Model::Node>, int32_t>> nodes;
+    if (model.rootNode)
+        nodes.push(std::make_pair(model.rootNode, -1));
+
+    std::vector<utils::Transform> localTransforms;
+    while (!nodes.empty())
+    {
+        auto node = nodes.front().first;
+        const int32_t parent = nodes.front().second;
+        nodes.pop();
+
+        const int32_t index = static_cast<int32_t>(m_parents.size());
+        m_parents.push_back(parent);
+        m_boneIndices.push_back(node->boneIndex);
+        m_names.push_back(node->boneIndex >= 0 ? model.boneNames[static_cast<size_t>(node->boneIndex)] : "");
+        localTransforms.push_back(node->transform);
+
+        for (auto child : node->children())
+            nodes.push(std::make_pair(child, index));
+    }
+
+    m_bindPose.resize(localTransforms.size());
+    for (size_t i = 0; i < localTransforms.size(); ++i)
+    {
+        const auto& t = localTransforms[i];
+        m_bindPose.rx[i] = t.rotation.x; m_bindPose.ry[i] = t.rotation.y; m_bindPose.rz[i] = t.rotation.z; m_bindPose.rw[i] = t.rotation.w;
+        m_bindPose.sx[i] = t.scale.x; m_bindPose.sy[i] = t.scale.y; m_bindPose.sz[i] = t.scale.z;
+        m_bindPose.tx[i] = t.translation.x; m_bindPose.ty[i] = t.translation.y; m_bindPose.tz[i] = t.translation.z;
+    }
+
+    m_offsets.resize(model.numBones());
+    for (size_t i = 0; i < m_offsets.size(); ++i)
+        m_offsets[i] = glm::mat3x4(glm::transpose(model.boneTransforms[i].operator glm::mat4x4()));
+
+    // skinned vertices are convex combinations of their positions transformed by each bone, so the union of the bones boxes bounds them
+    m_boneBoundingBoxes.resize(m_offsets.size());
+    std::queue<std::shared_ptr<Model::Node>> meshNodes;
+    if (model.rootNode)
+        meshNodes.push(model.rootNode);
+
+    while (!meshNodes.empty())
+    {
+        auto node = meshNodes.front();
+        meshNodes.pop();
+
+        for (auto child : node->children())
+            meshNodes.push(child);
+
+        for (auto& modelMesh : node->meshes)
+        {
+            auto positions = modelMesh->mesh->vertexBuffer(VertexAttribute::Position);
+            auto bonesIDs = modelMesh->mesh->vertexBuffer(VertexAttribute::BonesIDs);
+            auto bonesWeights = modelMesh->mesh->vertexBuffer(VertexAttribute::BonesWeights);
+            if (!positions || !bonesIDs || !bonesWeights)
+                continue;
+
+            const float *positionsData = static_cast<const float*>(positions->cpuData());
+            const float *bonesIDsData = static_cast<const float*>(bonesIDs->cpuData());
+            const float *bonesWeightsData = static_cast<const float*>(bonesWeights->cpuData());
+
+            for (uint32_t v = 0; v < positions->numVertices; ++v)
+            {
+                glm::vec4 position(0.0f, 0.0f, 0.0f, 1.0f);
+                for (uint32_t k = 0; k < glm::min(positions->numComponents, 3u); ++k)
+                    position[static_cast<glm::length_t>(k)] = positionsData[v * positions->numComponents + k];
+
+                for (uint32_t k = 0; k < glm::min(bonesIDs->numComponents, bonesWeights->numComponents); ++k)
+                {
+                    const auto bone = static_cast<size_t>(bonesIDsData[v * bonesIDs->numComponents + k]);
+                    if ((bonesWeightsData[v * bonesWeights->numComponents + k] <= 0.0f) || (bone >= m_offsets.size()))
+                        continue;
+
+                    const auto& offset = m_offsets[bone];
+                    const glm::vec3 bonePosition(glm::dot(offset[0], position), glm::dot(offset[1], position), glm::dot(offset[2], position));
+                    m_boneBoundingBoxes[bone] += utils::BoundingBox(bonePosition, bonePosition);
+                }
+            }
+        }
+    }
+}
+
+int32_t Skeleton::jointIndex(const std::string& name) const
+{
+    auto it = std::find(m_names.begin(), m_names.end(), name);
+    return (name.empty() || (it == m_names.end())) ? -1 : static_cast<int32_t>(it - m_names.begin());
+}
+
+void Skeleton::resolveChannels(const Model::Animation& animation, std::vector<const Model::Animation::Channels*>& channels) const
+{
+    channels.assign(numJoints(), nullptr);
+    for (size_t i = 0; i < numJoints(); ++i)
+    {
+        if (m_boneIndices[i] < 0)
+            continue;
+
+        auto it = animation.transforms.find(m_names[i]);
+        if (it != animation.transforms.end())
+            channels[i] = &it->second;
+    }
+}
+
+void Skeleton::sample(const Model::Animation& animation, const std::vector<const Model::Animation::Channels*>& channels, float timeInSecs, Pose& pose) const
+{
+    pose = m_bindPose;
+
+    const float ticksPerSecond = animation.framesPerSecond > 0.0f ? animation.framesPerSecond : 25.0f;
+    const float animTime = animation.duration > 0.0f ? std::fmod(timeInSecs * ticksPerSecond, animation.duration) : 0.0f;
+
+    for (size_t i = 0; i < channels.size(); ++i)
+    {
+        if (!channels[i])
+            continue;
+
+        auto& scales = std::get<0>(*channels[i]);
+        if (!scales.empty())
+        {
+            const glm::vec3 s = sampleKeys(scales, animTime, [](const glm::vec3& a, const glm::vec3& b, float f) { return glm::mix(a, b, f); });
+            pose.sx[i] = s.x; pose.sy[i] = s.y; pose.sz[i] = s.z;
+        }
+
+        auto& rotations = std::get<1>(*channels[i]);
+        if (!rotations.empty())
+        {
+            const glm::quat r = sampleKeys(rotations, animTime, [](const glm::quat& a, const glm::quat& b, float f) { return glm::slerp(a, b, f); });
+            pose.rx[i] = r.x; pose.ry[i] = r.y; pose.rz[i] = r.z; pose.rw[i] = r.w;
+        }
+
+        auto& translations = std::get<2>(*channels[i]);
+        if (!translations.empty())
+        {
+            const glm::vec3 t = sampleKeys(translations, animTime, [](const glm::vec3& a, const glm::vec3& b, float f) { return glm::mix(a, b, f); });
+            pose.tx[i] = t.x; pose.ty[i] = t.y; pose.tz[i] = t.z;
+        }
+    }
+}
+
+utils::BoundingBox Skeleton::calcBoundingBox(const std::vector<glm::mat3x4>& modelMatrices) const
+{
+    utils::BoundingBox result;
+
+    // the boxes are in the bind spaces of the bones already, so they are moved by the model matrices of the joints without the offsets
+    for (size_t i = 0; i < glm::min(modelMatrices.size(), m_boneIndices.size()); ++i)
+    {
+        const int32_t bone = m_boneIndices[i];
+        if (bone < 0)
+            continue;
+
+        const auto& box = m_boneBoundingBoxes[static_cast<size_t>(bone)];
+        if (box.empty())
+            continue;
+
+        const auto& transform = modelMatrices[i];
+        const glm::vec4 center(box.center(), 1.0f);
+        const glm::vec3 halfSize = box.halfSize();
+
+        const glm::vec3 transformedCenter(glm::dot(transform[0], center), glm::dot(transform[1], center), glm::dot(transform[2], center));
+        const glm::vec3 transformedHalfSize(glm::dot(glm::abs(glm::vec3(transform[0])), halfSize),
+                                            glm::dot(glm::abs(glm::vec3(transform[1])), halfSize),
+                                            glm::dot(glm::abs(glm::vec3(transform[2])), halfSize));
+
+        result += utils::BoundingBox(transformedCenter - transformedHalfSize, transformedCenter + transformedHalfSize);
+    }
+
+    return result;
+}
+
+const utils::BoundingBox& Skeleton::clipBoundingBox(const Model::Animation& animation) const
+{
+    auto it = m_clipBoundingBoxes.find(&animation);
+    if (it != m_clipBoundingBoxes.end())
+        return it->second;
+
+    // the clip is sampled more densely than it's usually keyed, so the bounds hold between the samples too
+    static const float samplingStep = 1.0f / 60.0f;
+
+    const float ticksPerSecond = animation.framesPerSecond > 0.0f ? animation.framesPerSecond : 25.0f;
+    const float duration = animation.duration / ticksPerSecond;
+    const auto numSamples = static_cast<size_t>(glm::max(std::ceil(duration / samplingStep), 1.0f));
+
+    std::vector<const Model::Animation::Channels*> channels;
+    resolveChannels(animation, channels);
+
+    Pose pose;
+    std::vector<glm::mat3x4> transforms, modelMatrices;
+    utils::BoundingBox result;
+    for (size_t i = 0; i < numSamples; ++i)
+    {
+        sample(animation, channels, static_cast<float>(i) * samplingStep, pose);
+        calcSkinningMatrices(pose, transforms, modelMatrices);
+        result += calcBoundingBox(modelMatrices);
+    }
+
+    return m_clipBoundingBoxes.insert({&animation, result}).first->second;
+}
+
+void Skeleton::buildMask(int32_t rootJoint, std::vector<float>& mask) const
+{
+    mask.assign(m_bindPose.size(), rootJoint < 0 ? 1.0f : 0.0f);
+    if (rootJoint < 0)
+        return;
+
+    mask[static_cast<size_t>(rootJoint)] = 1.0f;
+    for (size_t i = static_cast<size_t>(rootJoint) + 1; i < numJoints(); ++i)
+        if (m_parents[i] >= 0)
+            mask[i] = mask[static_cast<size_t>(m_parents[i])];
+}
+
+void Skeleton::calcSkinningMatrices(const Pose& pose, std::vector<glm::mat3x4>& transforms, std::vector<glm::mat3x4>& modelMatrices) const
+{
+    transforms.resize(numBones(), glm::mat3x4(1.0f));
+    modelMatrices.resize(pose.size());
+
+    const F4 one = splat(1.0f), two = splat(2.0f);
+    glm::mat3x4 local[4];
+
+    for (size_t j = 0; j < numJoints(); j += 4)
+    {
+        // local matrices T * R * S of four joints at once
+        const F4 x = load(&pose.rx[j]), y = load(&pose.ry[j]), z = load(&pose.rz[j]), w = load(&pose.rw[j]);
+        const F4 sx = load(&pose.sx[j]), sy = load(&pose.sy[j]), sz = load(&pose.sz[j]);
+
+        const F4 xx = x * x, yy = y * y, zz = z * z;
+        const F4 xy = x * y, xz = x * z, yz = y * z;
+        const F4 wx = w * x, wy = w * y, wz = w * z;
+
+        F4 m00 = (one - two * (yy + zz)) * sx, m01 = two * (xy - wz) * sy, m02 = two * (xz + wy) * sz, m03 = load(&pose.tx[j]);
+        F4 m10 = two * (xy + wz) * sx, m11 = (one - two * (xx + zz)) * sy, m12 = two * (yz - wx) * sz, m13 = load(&pose.ty[j]);
+        F4 m20 = two * (xz - wy) * sx, m21 = two * (yz + wx) * sy, m22 = (one - two * (xx + yy)) * sz, m23 = load(&pose.tz[j]);
+
+        transpose(m00, m01, m02, m03);
+        transpose(m10, m11, m12, m13);
+        transpose(m20, m21, m22, m23);
+
+        store(&local[0][0][0], m00); store(&local[0][1][0], m10); store(&local[0][2][0], m20);
+        store(&local[1][0][0], m01); store(&local[1][1][0], m11); store(&local[1][2][0], m21);
+        store(&local[2][0][0], m02); store(&local[2][1][0], m12); store(&local[2][2][0], m22);
+        store(&local[3][0][0], m03); store(&local[3][1][0], m13); store(&local[3][2][0], m23);
+
+        // local -> model -> skinning. Parents always precede children, so they are already computed.
+        const size_t count = std::min(static_cast<size_t>(4u), numJoints() - j);
+        for (size_t k = 0; k < count; ++k)
+        {
+            const size_t joint = j + k;
+            const int32_t parent = m_parents[joint];
+            if (parent >= 0)
+                mulAffine(modelMatrices[static_cast<size_t>(parent)], local[k], modelMatrices[joint]);
+            else
+                modelMatrices[joint] = local[k];
+
+            const int32_t bone = m_boneIndices[joint];
+            if (bone >= 0)
+                mulAffine(modelMatrices[joint], m_offsets[static_cast<size_t>(bone)], transforms[static_cast<size_t>(bone)]);
+        }
+    }
+}
+
+size_t SharedPoseKeyHash::operator ()(const SharedPoseKey& key) const
+{
+    size_t result = std::hash<const void*>()(key.model);
+    result ^= std::hash<const void*>()(key.animation) + 0x9e3779b9 + (result << 6) + (result >> 2);
+    result ^= std::hash<int64_t>()(key.frame) + 0x9e3779b9 + (result << 6) + (result >> 2);
+    result ^= std::hash<uint32_t>()(castFromSkinningType(key.skinningType)) + 0x9e3779b9 + (result << 6) + (result >> 2);
+    return result;
+}
+
+void blendPoses(const Pose& a, const Pose& b, const float *weights, Pose& result)
+{
+    assert(a.size() == b.size());
+    result.resize(a.size());
+
+    const F4 one = splat(1.0f);
+    for (size_t j = 0; j < a.size(); j += 4)
+    {
+        const F4 wb = load(weights + j), wa = one - wb;
+
+        // nlerp over the shortest arc
+        F4 ax = load(&a.rx[j]), ay = load(&a.ry[j]), az = load(&a.rz[j]), aw = load(&a.rw[j]);
+        F4 bx = load(&b.rx[j]), by = load(&b.ry[j]), bz = load(&b.rz[j]), bw = load(&b.rw[j]);
+        const F4 sign = signOf(ax * bx + ay * by + az * bz + aw * bw);
+        F4 rx = ax * wa + xorSign(bx, sign) * wb;
+        F4 ry = ay * wa + xorSign(by, sign) * wb;
+        F4 rz = az * wa + xorSign(bz, sign) * wb;
+        F4 rw = aw * wa + xorSign(bw, sign) * wb;
+        normalizeQuat(rx, ry, rz, rw);
+        store(&result.rx[j], rx); store(&result.ry[j], ry); store(&result.rz[j], rz); store(&result.rw[j], rw);
+
+        store(&result.sx[j], load(&a.sx[j]) * wa + load(&b.sx[j]) * wb);
+        store(&result.sy[j], load(&a.sy[j]) * wa + load(&b.sy[j]) * wb);
+        store(&result.sz[j], load(&a.sz[j]) * wa + load(&b.sz[j]) * wb);
+        store(&result.tx[j], load(&a.tx[j]) * wa + load(&b.tx[j]) * wb);
+        store(&result.ty[j], load(&a.ty[j]) * wa + load(&b.ty[j]) * wb);
+        store(&result.tz[j], load(&a.tz[j]) * wa + load(&b.tz[j]) * wb);
+    }
+}
+
+void makeAdditivePose(const Pose& pose, const Pose& reference, Pose& result)
+{
+    assert(pose.size() == reference.size());
+    result.resize(pose.size());
+
+    const F4 zero = splat(0.0f);
+    for (size_t j = 0; j < pose.size(); j += 4)
+    {
+        // delta = inverse(reference) * pose
+        F4 rx, ry, rz, rw;
+        mulQuat(zero - load(&reference.rx[j]), zero - load(&reference.ry[j]), zero - load(&reference.rz[j]), load(&reference.rw[j]),
+                load(&pose.rx[j]), load(&pose.ry[j]), load(&pose.rz[j]), load(&pose.rw[j]),
+                rx, ry, rz, rw);
+        store(&result.rx[j], rx); store(&result.ry[j], ry); store(&result.rz[j], rz); store(&result.rw[j], rw);
+
+        store(&result.sx[j], load(&pose.sx[j]) / load(&reference.sx[j]));
+        store(&result.sy[j], load(&pose.sy[j]) / load(&reference.sy[j]));
+        store(&result.sz[j], load(&pose.sz[j]) / load(&reference.sz[j]));
+        store(&result.tx[j], load(&pose.tx[j]) - load(&reference.tx[j]));
+        store(&result.ty[j], load(&pose.ty[j]) - load(&reference.ty[j]));
+        store(&result.tz[j], load(&pose.tz[j]) - load(&reference.tz[j]));
+    }
+}
+
+void addPose(const Pose& base, const Pose& additive, const float *weights, Pose& result)
+{
+    assert(base.size() == additive.size());
+    result.resize(base.size());
+
+    const F4 one = splat(1.0f);
+    for (size_t j = 0; j < base.size(); j += 4)
+    {
+        const F4 w = load(weights + j), iw = one - w;
+
+        // scale the delta rotation by nlerp from identity and apply it on top of the base
+        F4 dx = load(&additive.rx[j]), dy = load(&additive.ry[j]), dz = load(&additive.rz[j]), dw = load(&additive.rw[j]);
+        const F4 sign = signOf(dw);
+        dx = xorSign(dx, sign) * w;
+        dy = xorSign(dy, sign) * w;
+        dz = xorSign(dz, sign) * w;
+        dw = iw + xorSign(dw, sign) * w;
+        normalizeQuat(dx, dy, dz, dw);
+
+        F4 rx, ry, rz, rw;
+        mulQuat(load(&base.rx[j]), load(&base.ry[j]), load(&base.rz[j]), load(&base.rw[j]), dx, dy, dz, dw, rx, ry, rz, rw);
+        normalizeQuat(rx, ry, rz, rw);
+        store(&result.rx[j], rx); store(&result.ry[j], ry); store(&result.rz[j], rz); store(&result.rw[j], rw);
+
+        store(&result.sx[j], load(&base.sx[j]) * (iw + load(&additive.sx[j]) * w));
+        store(&result.sy[j], load(&base.sy[j]) * (iw + load(&additive.sy[j]) * w));
+        store(&result.sz[j], load(&base.sz[j]) * (iw + load(&additive.sz[j]) * w));
+        store(&result.tx[j], load(&base.tx[j]) + load(&additive.tx[j]) * w);
+        store(&result.ty[j], load(&base.ty[j]) + load(&additive.ty[j]) * w);
+        store(&result.tz[j], load(&base.tz[j]) + load(&additive.tz[j]) * w);
+    }
+}
+
+void buildLinearBlendPalette(const std::vector<glm::mat3x4>& transforms, std::vector<glm::vec4>& palette)
+{
+    palette.resize(3 * transforms.size());
+    for (size_t i = 0; i < transforms.size(); ++i)
+    {
+        palette[3 * i + 0] = transforms[i][0];
+        palette[3 * i + 1] = transforms[i][1];
+        palette[3 * i + 2] = transforms[i][2];
+    }
+}
+
+bool buildDualQuaternionPalette(const std::vector<glm::mat3x4>& transforms, std::vector<glm::vec4>& palette)
+{
+    static const float scaleTolerance = 1e-3f;
+
+    palette.resize(2 * transforms.size());
+    for (size_t i = 0; i < transforms.size(); ++i)
+    {
+        const glm::mat3x4& transform = transforms[i];
+        const glm::mat3 rotation(glm::vec3(transform[0].x, transform[1].x, transform[2].x),
+                                 glm::vec3(transform[0].y, transform[1].y, transform[2].y),
+                                 glm::vec3(transform[0].z, transform[1].z, transform[2].z));
+
+        // unit columns and unit determinant mean there is neither scale nor shear nor mirroring
+        for (glm::length_t c = 0; c < 3; ++c)
+            if (glm::abs(glm::dot(rotation[c], rotation[c]) - 1.0f) > scaleTolerance)
+                return false;
+        if (glm::abs(glm::determinant(rotation) - 1.0f) > scaleTolerance)
+            return false;
+
+        const glm::quat real = glm::normalize(glm::quat_cast(rotation));
+        const glm::quat dual = glm::quat(0.0f, transform[0].w, transform[1].w, transform[2].w) * real * 0.5f;
+
+        palette[2 * i + 0] = glm::vec4(real.x, real.y, real.z, real.w);
+        palette[2 * i + 1] = glm::vec4(dual.x, dual.y, dual.z, dual.w);
+    }
+
+    return true;
+}
+
+AnimationGraph::AnimationGraph(std::shared_ptr<Model> model)
+    : m_model(model)
+    , m_crossFadeTime(0.0f)
+    , m_crossFadeStartTime(0.0f)
+    , m_crossFadeFactor(1.0f)
+    , m_skinningType(SkinningType::LinearBlend)
+    , m_isDirty(true)
+{
+}
+
+void AnimationGraph::setCrossFadeTime(float value)
+{
+    m_crossFadeTime = std::max(value, 0.0f);
+}
+
+void AnimationGraph::setSkinningType(SkinningType value)
+{
+    if (m_skinningType != value)
+    {
+        m_skinningType = value;
+        m_isDirty = true;
+    }
+}
+
+void AnimationGraph::play(const std::string& name, std::shared_ptr<Model::Animation> animation, float time)
+{
+    if (m_currentClip.name == name)
+    {
+        if (m_currentClip.time == time)
+            return;
+
+        if (time < m_crossFadeStartTime)
+            m_previousClip.animation = nullptr;
+    }
+    else
+    {
+        if ((m_crossFadeTime > 0.0f) && m_currentClip.animation)
+        {
+            m_previousClip = std::move(m_currentClip);
+            m_crossFadeStartTime = time;
+        }
+        else
+            m_previousClip.animation = nullptr;
+
+        setClip(m_currentClip, name, animation);
+    }
+
+    m_currentClip.time = time;
+    m_isDirty = true;
+}
+
+void AnimationGraph::setLayer(uint32_t index, const std::string& name, std::shared_ptr<Model::Animation> animation, float time, float weight, bool isAdditive, const std::string& maskRootName)
+{
+    auto layerIt = m_layers.find(index);
+    if (layerIt == m_layers.end())
+        layerIt = m_layers.insert(std::make_pair(index, Layer())).first;
+    else if ((layerIt->second.clip.name == name) &&
+             (layerIt->second.clip.time == time) &&
+             (layerIt->second.weight == weight) &&
+             (layerIt->second.isAdditive == isAdditive) &&
+             (layerIt->second.maskRootName == maskRootName))
+        return;
+
+    auto& layer = layerIt->second;
+    if ((layer.clip.name != name) || !layer.clip.animation)
+        setClip(layer.clip, name, animation);
+
+    if ((layer.maskRootName != maskRootName) || layer.mask.empty())
+    {
+        layer.maskRootName = maskRootName;
+        m_model->skeleton->buildMask(m_model->skeleton->jointIndex(maskRootName), layer.mask);
+    }
+
+    layer.clip.time = time;
+    layer.weight = weight;
+    layer.isAdditive = isAdditive;
+    m_isDirty = true;
+}
+
+void AnimationGraph::removeLayer(uint32_t index)
+{
+    if (m_layers.erase(index))
+        m_isDirty = true;
+}
+
+void AnimationGraph::evaluate(std::vector<glm::vec4>& palette)
+{
+    auto& skeleton = *m_model->skeleton;
+
+    if (m_currentClip.animation)
+        skeleton.sample(*m_currentClip.animation, m_currentClip.channels, m_currentClip.time, m_pose);
+    else
+        m_pose = skeleton.bindPose();
+
+    if (m_previousClip.animation)
+    {
+        const float elapsedTime = m_currentClip.time - m_crossFadeStartTime;
+        // the cross-fade time may be set to zero during a fade, it finishes at once then
+        m_crossFadeFactor = (m_crossFadeTime > 0.0f) ? glm::clamp(elapsedTime / m_crossFadeTime, 0.0f, 1.0f) : 1.0f;
+        if (m_crossFadeFactor < 1.0f)
+        {
+            skeleton.sample(*m_previousClip.animation, m_previousClip.channels, m_previousClip.time + elapsedTime, m_tmpPose);
+            m_weights.assign(m_pose.size(), 1.0f - m_crossFadeFactor);
+            blendPoses(m_pose, m_tmpPose, m_weights.data(), m_pose);
+        }
+        else
+            m_previousClip.animation = nullptr;
+    }
+
+    for (auto& layerIt : m_layers)
+    {
+        auto& layer = layerIt.second;
+        if (!layer.clip.animation || (layer.weight <= 0.0f))
+            continue;
+
+        skeleton.sample(*layer.clip.animation, layer.clip.channels, layer.clip.time, m_tmpPose);
+
+        m_weights.resize(m_pose.size());
+        for (size_t i = 0; i < m_weights.size(); ++i)
+            m_weights[i] = layer.weight * layer.mask[i];
+
+        if (layer.isAdditive)
+        {
+            makeAdditivePose(m_tmpPose, skeleton.bindPose(), m_tmpPose);
+            addPose(m_pose, m_tmpPose, m_weights.data(), m_pose);
+        }
+        else
+            blendPoses(m_pose, m_tmpPose, m_weights.data(), m_pose);
+    }
+
+    skeleton.calcSkinningMatrices(m_pose, m_skinningMatrices, m_modelMatrices);
+    buildPalette(palette);
+    m_boundingBox = skeleton.calcBoundingBox(m_modelMatrices);
+    m_isDirty = false;
+}
+
+utils::BoundingBox AnimationGraph::clipsBoundingBox() const
+{
+    auto& skeleton = *m_model->skeleton;
+
+    utils::BoundingBox result;
+    if (m_currentClip.animation)
+        result = skeleton.clipBoundingBox(*m_currentClip.animation);
+    else
+    {
+        std::vector<glm::mat3x4> transforms, modelMatrices;
+        skeleton.calcSkinningMatrices(skeleton.bindPose(), transforms, modelMatrices);
+        result = skeleton.calcBoundingBox(modelMatrices);
+    }
+
+    if (m_previousClip.animation)
+        result += skeleton.clipBoundingBox(*m_previousClip.animation);
+
+    for (auto& layer : m_layers)
+        if (layer.second.clip.animation && (layer.second.weight > 0.0f))
+            result += skeleton.clipBoundingBox(*layer.second.clip.animation);
+
+    return result;
+}
+
+bool AnimationGraph::sharedPoseKey(float step, SharedPoseKey& key) const
+{
+    if (!m_currentClip.animation || (step <= 0.0f))
+        return false;
+
+    if (m_previousClip.animation && (m_currentClip.time - m_crossFadeStartTime < m_crossFadeTime))
+        return false;
+
+    for (auto& layer : m_layers)
+        if (layer.second.clip.animation && (layer.second.weight > 0.0f))
+            return false;
+
+    const auto& animation = *m_currentClip.animation;
+    const float ticksPerSecond = animation.framesPerSecond > 0.0f ? animation.framesPerSecond : 25.0f;
+    const float duration = animation.duration / ticksPerSecond;
+
+    int64_t frame = 0;
+    if (duration > 0.0f)
+    {
+        frame = static_cast<int64_t>(std::fmod(m_currentClip.time, duration) / step + 0.5f);
+        if (static_cast<float>(frame) * step >= duration)
+            frame = 0;
+    }
+
+    key.model = m_model.get();
+    key.animation = m_currentClip.animation.get();
+    key.frame = frame;
+    key.skinningType = m_skinningType;
+    return true;
+}
+
+void AnimationGraph::evaluateShared(const SharedPoseKey& key, float step, std::vector<glm::vec4>& palette)
+{
+    auto& skeleton = *m_model->skeleton;
+
+    skeleton.sample(*key.animation, m_currentClip.channels, static_cast<float>(key.frame) * step, m_pose);
+    skeleton.calcSkinningMatrices(m_pose, m_skinningMatrices, m_modelMatrices);
+    buildPalette(palette);
+    m_boundingBox = skeleton.calcBoundingBox(m_modelMatrices);
+
+    m_previousClip.animation = nullptr;
+    m_isDirty = false;
+}
+
+void AnimationGraph::setClip(Clip& clip, const std::string& name, std::shared_ptr<Model::Animation> animation) const
+{
+    clip.name = name;
+    clip.animation = animation;
+    clip.time = 0.0f;
+    if (animation)
+        m_model->skeleton->resolveChannels(*animation, clip.channels);
+    else
+        clip.channels.clear();
+}
+
+void AnimationGraph::buildPalette(std::vector<glm::vec4>& palette)
+{
+    // the fallback is kept for the rest of the life of the graph to not switch shaders back and forth
+    if ((m_skinningType == SkinningType::DualQuaternion) && !buildDualQuaternionPalette(m_skinningMatrices, palette))
+        m_skinningType = SkinningType::LinearBlend;
+
+    if (m_skinningType == SkinningType::LinearBlend)
+        buildLinearBlendPalette(m_skinningMatrices, palette);
+}
+
+} // namespace
+} // namespace
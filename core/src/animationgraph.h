@@ -0,0 +1,160 @@
+#ifndef ANIMATIONGRAPH_H
+#define ANIMATIONGRAPH_H
+
+#include <map>
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <glm/vec4.hpp>
+#include <glm/mat3x4.hpp>
+
+#include <core/types.h>
+#include <utils/boundingbox.h>
+
+#include "renderer.h"
+
+namespace trash
+{
+namespace core
+{
+
+// Local joint transforms stored as structure of arrays. The size is padded to a multiple of 4 to process joints by four.
+struct Pose
+{
+    std::vector<float> rx, ry, rz, rw;
+    std::vector<float> sx, sy, sz;
+    std::vector<float> tx, ty, tz;
+
+    void resize(size_t);
+    size_t size() const { return rx.size(); }
+};
+
+// Flattened Model::Node tree. Joints are sorted so that parent index is always less than child index.
+class Skeleton
+{
+public:
+    Skeleton(const Model&);
+
+    size_t numJoints() const { return m_parents.size(); }
+    size_t numBones() const { return m_offsets.size(); }
+    int32_t jointIndex(const std::string&) const;
+
+    const Pose& bindPose() const { return m_bindPose; }
+
+    void resolveChannels(const Model::Animation&, std::vector<const Model::Animation::Channels*>&) const;
+    void sample(const Model::Animation&, const std::vector<const Model::Animation::Channels*>&, float, Pose&) const;
+    void buildMask(int32_t, std::vector<float>&) const;
+    void calcSkinningMatrices(const Pose&, std::vector<glm::mat3x4>&, std::vector<glm::mat3x4>&) const;
+
+    // Bounds of skinned vertices built from per bone boxes moved by the model matrices of the joints, so vertex data is read only once when the model is loaded.
+    // Clip bounds are baked on the first request and cover all poses of the clip. They are cached without locking, so request them from the main thread.
+    utils::BoundingBox calcBoundingBox(const std::vector<glm::mat3x4>&) const;
+    const utils::BoundingBox& clipBoundingBox(const Model::Animation&) const;
+
+private:
+    std::vector<int32_t> m_parents;
+    std::vector<int32_t> m_boneIndices;
+    std::vector<std::string> m_names;
+    std::vector<glm::mat3x4> m_offsets; // rows of inverse bind matrices
+    std::vector<utils::BoundingBox> m_boneBoundingBoxes; // vertices influenced by bones in their bind spaces
+    mutable std::unordered_map<const Model::Animation*, utils::BoundingBox> m_clipBoundingBoxes;
+    Pose m_bindPose;
+};
+
+// Identifies a pose that depends only on the model, the clip and the quantized clip time
+struct SharedPoseKey
+{
+    const Model *model = nullptr;
+    const Model::Animation *animation = nullptr;
+    int64_t frame = 0;
+    SkinningType skinningType = SkinningType::LinearBlend;
+
+    bool operator ==(const SharedPoseKey& other) const {
+        return (model == other.model) && (animation == other.animation) && (frame == other.frame) && (skinningType == other.skinningType);
+    }
+};
+
+struct SharedPoseKeyHash
+{
+    size_t operator ()(const SharedPoseKey& key) const;
+};
+
+void blendPoses(const Pose&, const Pose&, const float*, Pose&);
+void makeAdditivePose(const Pose&, const Pose&, Pose&);
+void addPose(const Pose&, const Pose&, const float*, Pose&);
+
+// Bones palettes uploaded to the GPU: 3 texels (matrix rows) or 2 texels (real and dual parts) per bone.
+// Scaled bones can't be represented by unit dual quaternions, false is returned for them.
+void buildLinearBlendPalette(const std::vector<glm::mat3x4>&, std::vector<glm::vec4>&);
+bool buildDualQuaternionPalette(const std::vector<glm::mat3x4>&, std::vector<glm::vec4>&);
+
+// Per model node animation state: the base clip with crossfading and a set of blended or additive layers.
+class AnimationGraph
+{
+public:
+    AnimationGraph(std::shared_ptr<Model>);
+
+    void setCrossFadeTime(float);
+    float crossFadeTime() const { return m_crossFadeTime; }
+
+    void setSkinningType(SkinningType);
+    SkinningType skinningType() const { return m_skinningType; } // linear blend after falling back from dual quaternions
+
+    void play(const std::string&, std::shared_ptr<Model::Animation>, float);
+    void setLayer(uint32_t, const std::string&, std::shared_ptr<Model::Animation>, float, float, bool, const std::string&);
+    void removeLayer(uint32_t);
+
+    bool isDirty() const { return m_isDirty; }
+    void resetDirty() { m_isDirty = false; }
+    void evaluate(std::vector<glm::vec4>&);
+
+    const utils::BoundingBox& boundingBox() const { return m_boundingBox; } // bounds of the last evaluated pose
+    utils::BoundingBox clipsBoundingBox() const; // bounds of all poses of the playing clips, additive layers are treated as blended ones
+
+    bool sharedPoseKey(float, SharedPoseKey&) const;
+    void evaluateShared(const SharedPoseKey&, float, std::vector<glm::vec4>&);
+
+private:
+    struct Clip
+    {
+        std::string name;
+        std::shared_ptr<Model::Animation> animation;
+        std::vector<const Model::Animation::Channels*> channels;
+        float time = 0.0f;
+    };
+
+    struct Layer
+    {
+        Clip clip;
+        float weight = 1.0f;
+        bool isAdditive = false;
+        std::string maskRootName;
+        std::vector<float> mask;
+    };
+
+    void setClip(Clip&, const std::string&, std::shared_ptr<Model::Animation>) const;
+    void buildPalette(std::vector<glm::vec4>&);
+
+    std::shared_ptr<Model> m_model;
+    Clip m_currentClip;
+    Clip m_previousClip;
+    std::map<uint32_t, Layer> m_layers;
+    float m_crossFadeTime;
+    float m_crossFadeStartTime;
+    float m_crossFadeFactor;
+    SkinningType m_skinningType;
+    bool m_isDirty;
+
+    Pose m_pose, m_tmpPose;
+    std::vector<float> m_weights;
+    std::vector<glm::mat3x4> m_modelMatrices;
+    std::vector<glm::mat3x4> m_skinningMatrices;
+    utils::BoundingBox m_boundingBox;
+};
+
+} // namespace
+} // namespace
+
+#endif // ANIMATIONGRAPH_H
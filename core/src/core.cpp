@@ -8,6 +8,7 @@
 #include "coreprivate.h"
 #include "renderwidget.h"
 #include "importexport.h"
+#include "messagepool.h"
 
 namespace trash
 {
@@ -34,7 +35,7 @@ void Core::setGame(std::shared_ptr<AbstractGame> game)
     m().game = game;
 }
 
-void Core::doWork(std::shared_ptr<AbstractController::Message> msg)
+void Core::doWork(const std::shared_ptr<AbstractController::Message>& msg)
 {
     auto& corePrivate = m();
 
@@ -56,7 +57,7 @@ void Core::doWork(std::shared_ptr<AbstractController::Message> msg)
     case ControllerMessageType::RenderWidgetWasUpdated:
     {
         auto message = msg_cast<RenderWidgetWasUpdatedMessage>(msg);
-        auto updateMessage = std::make_shared<UpdateMessage>(message->time, message->dt);
+        auto updateMessage = makeMessage<UpdateMessage>(message->time, message->dt);
         for (auto controller : corePrivate.controllers)
         {
             controller->sendMessage(updateMessage);
@@ -111,6 +112,7 @@ Core::Core()
     : AbstractController(new CorePrivate())
 {
     std::setlocale(LC_NUMERIC, "C"); // to guarantee that std::to_string separates floating numbers by point (not comma)
+    MessagePool::instance(); // to be destroyed after the core and the messages in its queues
     m().renderWidget = new RenderWidget(*this);
 }
 
@@ -6,6 +6,7 @@
 
 #include "drawablenodeprivate.h"
 #include "sceneprivate.h"
+#include "nodeupdatevisitor.h"
 #include "lightprivate.h"
 #include "renderer.h"
 #include "drawables.h"
@@ -148,7 +149,7 @@ void DrawableNodePrivate::doDirtyShadowMaps()
 
     for (auto light : *lightsList)
     {
-        if (!light)
+        if (!light || !light->isShadowMapEnabled())
             continue;
 
         const utils::OpenFrustum lightOpenFrustum(ScenePrivate::calcLightProjMatrix(light, {0.0f, 1.0f}) * ScenePrivate::calcLightViewTransform(light));
@@ -179,7 +180,11 @@ void DrawableNodePrivate::doRender(uint32_t id)
 void DrawableNodePrivate::doUpdate(uint64_t time, uint64_t dt)
 {
     NodePrivate::doUpdate(time, dt);
-    doUpdateLightIndices();
+
+    // light indices are selected for all dirty nodes at once by the worker threads after the nodes are updated
+    if (isLightIndicesDirty && lightIndices.isEnabled)
+        if (auto* scene = getScene())
+            NodeUpdateCommands::run([this, scene]() { scene->m().dirtyLightIndicesNodes.push_back(this); });
 }
 
 void DrawableNodePrivate::doBeforeChangingTransformation()
@@ -23,7 +23,10 @@ ParticleSystemDrawable::ParticleSystemDrawable(std::shared_ptr<Mesh> m,
                                                std::reference_wrapper<const BlendingType> blendingType,
                                                std::reference_wrapper<const bool> distanceAttenuationState,
                                                std::reference_wrapper<const float> distanceAttenuationValue,
-                                               std::shared_ptr<Texture> opacityTexture)
+                                               std::shared_ptr<Texture> opacityTexture,
+                                               std::shared_ptr<Texture> particlesDataTexture,
+                                               std::shared_ptr<Uniform<glm::vec4>> particleCurvesUniform,
+                                               std::shared_ptr<Uniform<std::reference_wrapper<const float>>> particleStepUniform)
     : Drawable()
     , m_mesh(m)
     , m_particleType(particleType)
@@ -31,6 +34,9 @@ ParticleSystemDrawable::ParticleSystemDrawable(std::shared_ptr<Mesh> m,
     , m_distanceAttenuationState(distanceAttenuationState)
     , m_distanceAttenuationValueUniform(std::make_shared<Uniform<std::reference_wrapper<const float>>>(distanceAttenuationValue))
     , m_opacityTextureUniform(opacityTexture ? std::make_shared<Uniform<std::shared_ptr<Texture>>>(opacityTexture) : nullptr)
+    , m_particlesDataUniform(std::make_shared<Uniform<std::shared_ptr<Texture>>>(particlesDataTexture))
+    , m_particleCurvesUniform(particleCurvesUniform)
+    , m_particleStepUniform(particleStepUniform)
 {
 }
 
@@ -76,6 +82,21 @@ std::shared_ptr<AbstractUniform> ParticleSystemDrawable::uniform(UniformId id) c
         result = m_opacityTextureUniform;
         break;
     }
+    case UniformId::ParticlesData:
+    {
+        result = m_particlesDataUniform;
+        break;
+    }
+    case UniformId::ParticleCurves:
+    {
+        result = m_particleCurvesUniform;
+        break;
+    }
+    case UniformId::ParticleStep:
+    {
+        result = m_particleStepUniform;
+        break;
+    }
     }
 
     return result;
@@ -110,11 +131,14 @@ std::map<std::string, std::string> ParticleSystemDrawable::renderProgramDefines(
     if (m_opacityTextureUniform)
         result.insert({"HAS_OPACITYMAPPING", ""});
 
+    if (m_particleCurvesUniform)
+        result.insert({"GPU_PARTICLES", ""});
+
     return result;
 }
 
 StandardDrawable::StandardDrawable(std::shared_ptr<Mesh> mesh,
-                                           std::shared_ptr<Buffer> bonesBuffer,
+                                           std::shared_ptr<Uniform<std::shared_ptr<BonesPaletteRange>>> bonesBufferUniform,
                                            const glm::vec4& color,
                                            const glm::vec2& metallicRoughness,
                                            std::shared_ptr<Texture> baseColorTexture,
@@ -124,7 +148,12 @@ StandardDrawable::StandardDrawable(std::shared_ptr<Mesh> mesh,
                                            std::shared_ptr<Texture> roughnessTexture,
                                            std::reference_wrapper<const LightIndicesList> lightIndicesList)
     : m_mesh(mesh)
-    , m_bonesBufferUniform(bonesBuffer ? std::make_shared<Uniform<std::shared_ptr<Buffer>>>(bonesBuffer) : nullptr)
+    , m_bonesBufferUniform(bonesBufferUniform)
+    , m_isPreSkinned(bonesBufferUniform &&
+                     mesh->vertexBuffer(VertexAttribute::BonesIDs) &&
+                     mesh->vertexBuffer(VertexAttribute::BonesWeights) &&
+                     Renderer::instance().isPreSkinningEnabled())
+    , m_skinningType(bonesBufferUniform ? bonesBufferUniform->get()->skinningType : SkinningType::LinearBlend)
     , m_baseColorUniform(std::make_shared<Uniform<glm::vec4>>(color))
     , m_metallicRoughnessUniform(std::make_shared<Uniform<glm::vec2>>(metallicRoughness))
     , m_baseColorTextureUniform(baseColorTexture ? std::make_shared<Uniform<std::shared_ptr<Texture>>>(baseColorTexture) : nullptr)
@@ -159,6 +188,13 @@ std::shared_ptr<RenderProgram> StandardDrawable::renderProgram(DrawableRenderPro
 {
     auto& renderer = Renderer::instance();
 
+    // the bones range is replaced when the model node changes its skinning type
+    if (m_bonesBufferUniform && (m_bonesBufferUniform->get()->skinningType != m_skinningType))
+    {
+        m_skinningType = m_bonesBufferUniform->get()->skinningType;
+        resetRenderPrograms();
+    }
+
     std::shared_ptr<RenderProgram> result;
     switch (id)
     {
@@ -178,6 +214,18 @@ std::shared_ptr<RenderProgram> StandardDrawable::renderProgram(DrawableRenderPro
         result = m_deferredRenderProgram;
         break;
     }
+    case DrawableRenderProgramId::DeferredGeometryPassInstanced:
+    {
+        if (!m_deferredInstancedRenderProgram)
+        {
+            auto defines = renderProgramDefines();
+            defines.insert({"HAS_INSTANCING", ""});
+            m_deferredInstancedRenderProgram = renderer.loadRenderProgram(deferredGeometryPassRenderProgramName.first, deferredGeometryPassRenderProgramName.second, defines);
+        }
+
+        result = m_deferredInstancedRenderProgram;
+        break;
+    }
     case DrawableRenderProgramId::Shadow:
     {
         if (!m_shadowProgram)
@@ -186,6 +234,18 @@ std::shared_ptr<RenderProgram> StandardDrawable::renderProgram(DrawableRenderPro
         result = m_shadowProgram;
         break;
     }
+    case DrawableRenderProgramId::ShadowInstanced:
+    {
+        if (!m_shadowInstancedProgram)
+        {
+            auto defines = renderProgramDefines();
+            defines.insert({"HAS_INSTANCING", ""});
+            m_shadowInstancedProgram = renderer.loadRenderProgram(shadowRenderProgramName.first, shadowRenderProgramName.second, defines);
+        }
+
+        result = m_shadowInstancedProgram;
+        break;
+    }
     case DrawableRenderProgramId::Selection:
     {
         if (!m_selectionProgram)
@@ -201,7 +261,8 @@ std::shared_ptr<RenderProgram> StandardDrawable::renderProgram(DrawableRenderPro
 
 std::shared_ptr<Mesh> StandardDrawable::mesh() const
 {
-    return m_mesh;
+    // the skinned copy has the same bounding box and it's picked by the current pose
+    return m_isPreSkinned ? Renderer::instance().skinnedMesh(m_mesh, m_bonesBufferUniform->get()) : m_mesh;
 }
 
 std::shared_ptr<AbstractUniform> StandardDrawable::uniform(UniformId id) const
@@ -210,7 +271,7 @@ std::shared_ptr<AbstractUniform> StandardDrawable::uniform(UniformId id) const
 
     switch (id)
     {
-    case UniformId::BonesBuffer:
+    case UniformId::BonesOffset:
     {
         result = m_bonesBufferUniform;
         break;
@@ -260,11 +321,43 @@ std::shared_ptr<AbstractUniform> StandardDrawable::uniform(UniformId id) const
     return result;
 }
 
+bool StandardDrawable::isInstancingCompatible(const Drawable& other) const
+{
+    auto otherStandard = dynamic_cast<const StandardDrawable*>(&other);
+    if (!otherStandard || (m_mesh != otherStandard->m_mesh))
+        return false;
+
+    static const auto textureOf = [](const std::shared_ptr<AbstractUniform>& uniform) {
+        return uniform ? std::static_pointer_cast<Uniform<std::shared_ptr<Texture>>>(uniform)->get() : nullptr;
+    };
+
+    const auto skinningTypeOf = [](const StandardDrawable& drawable) {
+        return drawable.m_bonesBufferUniform ? castFromSkinningType(drawable.m_bonesBufferUniform->get()->skinningType) : numElementsSkinningType();
+    };
+
+    return (skinningTypeOf(*this) == skinningTypeOf(*otherStandard)) &&
+            (m_lightIndicesListUniform->get().get().isEnabled == otherStandard->m_lightIndicesListUniform->get().get().isEnabled) &&
+            (m_baseColorUniform->get() == otherStandard->m_baseColorUniform->get()) &&
+            (std::static_pointer_cast<Uniform<glm::vec2>>(m_metallicRoughnessUniform)->get() == std::static_pointer_cast<Uniform<glm::vec2>>(otherStandard->m_metallicRoughnessUniform)->get()) &&
+            (textureOf(m_baseColorTextureUniform) == textureOf(otherStandard->m_baseColorTextureUniform)) &&
+            (textureOf(m_opacityTextureUniform) == textureOf(otherStandard->m_opacityTextureUniform)) &&
+            (textureOf(m_normalTextureUniform) == textureOf(otherStandard->m_normalTextureUniform)) &&
+            (textureOf(m_metallicTextureUniform) == textureOf(otherStandard->m_metallicTextureUniform)) &&
+            (textureOf(m_roughnessTextureUniform) == textureOf(otherStandard->m_roughnessTextureUniform));
+}
+
 void StandardDrawable::dirtyCache()
+{
+    resetRenderPrograms();
+}
+
+void StandardDrawable::resetRenderPrograms() const
 {
     m_forwardRenderProgram = nullptr;
     m_deferredRenderProgram = nullptr;
+    m_deferredInstancedRenderProgram = nullptr;
     m_shadowProgram = nullptr;
+    m_shadowInstancedProgram = nullptr;
     m_selectionProgram = nullptr;
 }
 
@@ -285,8 +378,12 @@ std::map<std::string, std::string> StandardDrawable::renderProgramDefines() cons
     if (m_mesh->vertexBuffer(VertexAttribute::TexCoord))
         defines.insert({"HAS_TEXCOORDS", ""});
 
-    if (m_bonesBufferUniform && m_mesh->vertexBuffer(VertexAttribute::BonesIDs) && m_mesh->vertexBuffer(VertexAttribute::BonesWeights))
+    if (!m_isPreSkinned && m_bonesBufferUniform && m_mesh->vertexBuffer(VertexAttribute::BonesIDs) && m_mesh->vertexBuffer(VertexAttribute::BonesWeights))
+    {
         defines.insert({"HAS_BONES", ""});
+        if (m_skinningType == SkinningType::DualQuaternion)
+            defines.insert({"HAS_DUAL_QUATERNION_SKINNING", ""});
+    }
 
     if (m_mesh->vertexBuffer(VertexAttribute::Tangent))
         defines.insert({"HAS_TANGENTS", ""});
@@ -10,6 +10,7 @@
 #include <utils/forwarddecl.h>
 #include <utils/enumclass.h>
 #include <core/forwarddecl.h>
+#include <core/types.h>
 
 #include "typesprivate.h"
 
@@ -23,6 +24,7 @@ template<typename T> class Uniform;
 struct RenderProgram;
 struct Mesh;
 struct Buffer;
+struct BonesPaletteRange;
 struct Font;
 
 class Drawable
@@ -36,6 +38,9 @@ public:
     virtual std::shared_ptr<Mesh> mesh() const = 0;
     virtual std::shared_ptr<AbstractUniform> uniform(UniformId) const { return nullptr; }
 
+    // drawables which can be rendered by one instanced draw call differing only in model matrices and bones offsets
+    virtual bool isInstancingCompatible(const Drawable&) const { return false; }
+
     virtual void dirtyCache() {}
 };
 
@@ -47,7 +52,10 @@ public:
                            std::reference_wrapper<const BlendingType>,
                            std::reference_wrapper<const bool>,
                            std::reference_wrapper<const float>,
-                           std::shared_ptr<Texture>);
+                           std::shared_ptr<Texture>,
+                           std::shared_ptr<Texture>,
+                           std::shared_ptr<Uniform<glm::vec4>> = nullptr,
+                           std::shared_ptr<Uniform<std::reference_wrapper<const float>>> = nullptr);
 
     LayerId layerId() const override;
     BlendingType blendingType() const override;
@@ -68,13 +76,16 @@ protected:
     std::reference_wrapper<const bool> m_distanceAttenuationState;
     std::shared_ptr<AbstractUniform> m_distanceAttenuationValueUniform;
     std::shared_ptr<AbstractUniform> m_opacityTextureUniform;
+    std::shared_ptr<AbstractUniform> m_particlesDataUniform;
+    std::shared_ptr<AbstractUniform> m_particleCurvesUniform; // set for particles simulated on the GPU
+    std::shared_ptr<AbstractUniform> m_particleStepUniform; // set for particles simulated on the GPU
 };
 
 class StandardDrawable : public Drawable
 {
 public:
     StandardDrawable(std::shared_ptr<Mesh>,
-                         std::shared_ptr<Buffer>,
+                         std::shared_ptr<Uniform<std::shared_ptr<BonesPaletteRange>>>,
                          const glm::vec4&,
                          const glm::vec2&,
                          std::shared_ptr<Texture>,
@@ -89,15 +100,20 @@ public:
     std::shared_ptr<RenderProgram> renderProgram(DrawableRenderProgramId) const override;
     std::shared_ptr<Mesh> mesh() const override;
     std::shared_ptr<AbstractUniform> uniform(UniformId) const override;
+    bool isInstancingCompatible(const Drawable&) const override;
     void dirtyCache() override;
 
 protected:
     std::map<std::string, std::string> renderProgramDefines() const;
+    void resetRenderPrograms() const;
 
     std::shared_ptr<Mesh> m_mesh;
-    std::shared_ptr<AbstractUniform> m_bonesBufferUniform;
+    std::shared_ptr<Uniform<std::shared_ptr<BonesPaletteRange>>> m_bonesBufferUniform;
+    bool m_isPreSkinned;
 
     mutable std::shared_ptr<RenderProgram> m_forwardRenderProgram, m_deferredRenderProgram, m_shadowProgram, m_selectionProgram;
+    mutable std::shared_ptr<RenderProgram> m_deferredInstancedRenderProgram, m_shadowInstancedProgram;
+    mutable SkinningType m_skinningType;
     mutable bool hasLighting;
     std::shared_ptr<Uniform<glm::vec4>> m_baseColorUniform;
     std::shared_ptr<AbstractUniform> m_metallicRoughnessUniform;
@@ -27,7 +27,7 @@ std::shared_ptr<const Scene> GraphicsController::mainScene() const
     return m().scene;
 }
 
-void GraphicsController::doWork(std::shared_ptr<AbstractController::Message> msg)
+void GraphicsController::doWork(const std::shared_ptr<AbstractController::Message>& msg)
 {
     auto& gcPrivate = m();
 
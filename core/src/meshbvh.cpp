@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <numeric>
+#include <limits>
+
+#include <glm/common.hpp>
+
+#include <utils/boundingbox.h>
+#include <utils/ray.h>
+
+#include "meshbvh.h"
+#include "simd.h"
+
+namespace trash
+{
+namespace core
+{
+
+namespace
+{
+
+using namespace simd;
+
+const uint32_t numBins = 16u;
+const uint32_t maxLeafSize = 8u;
+const float traversalCost = 1.f; // relatively to the test of one packet of triangles
+
+float halfArea(const utils::BoundingBox& box)
+{
+    const glm::vec3 size = box.maxPoint - box.minPoint;
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+uint32_t numPackets(uint32_t numTriangles)
+{
+    return (numTriangles + 3u) / 4u;
+}
+
+}
+
+struct MeshBvh::BuildData
+{
+    const glm::vec3 *vertices;
+    const uint32_t *indices;
+    std::vector<utils::BoundingBox> boxes;
+    std::vector<glm::vec3> centroids;
+    std::vector<uint32_t> triangles;
+};
+
+MeshBvh::MeshBvh(const glm::vec3 *vertices, const uint32_t *indices, uint32_t numIndices)
+    : m_numTriangles(numIndices / 3u)
+{
+    if (!m_numTriangles)
+        return;
+
+    BuildData data;
+    data.vertices = vertices;
+    data.indices = indices;
+    data.boxes.resize(m_numTriangles);
+    data.centroids.resize(m_numTriangles);
+    data.triangles.resize(m_numTriangles);
+    std::iota(data.triangles.begin(), data.triangles.end(), 0u);
+
+    for (size_t i = 0; i < m_numTriangles; ++i)
+    {
+        const glm::vec3& v0 = vertices[indices[3 * i + 0]];
+        const glm::vec3& v1 = vertices[indices[3 * i + 1]];
+        const glm::vec3& v2 = vertices[indices[3 * i + 2]];
+        data.boxes[i] = utils::BoundingBox(glm::min(v0, glm::min(v1, v2)), glm::max(v0, glm::max(v1, v2)));
+        data.centroids[i] = data.boxes[i].center();
+    }
+
+    m_nodes.reserve(2u * m_numTriangles);
+    m_packets.reserve(numPackets(static_cast<uint32_t>(m_numTriangles)) * 2u);
+    build(data, 0u, static_cast<uint32_t>(m_numTriangles));
+
+    m_nodes.shrink_to_fit();
+    m_packets.shrink_to_fit();
+}
+
+bool MeshBvh::intersect(const utils::Ray& ray, float maxDistance, float& t) const
+{
+    t = maxDistance;
+    return traverse<false>(ray, t);
+}
+
+bool MeshBvh::occluded(const utils::Ray& ray, float maxDistance) const
+{
+    return traverse<true>(ray, maxDistance);
+}
+
+template <bool anyHit>
+bool MeshBvh::traverse(const utils::Ray& ray, float& tMax) const
+{
+    static const F4 zero = splat(0.f), one = splat(1.f), inf = splat(std::numeric_limits<float>::max());
+    static const F4 eps = splat(1e-8f);
+
+    const glm::vec3 invDir = 1.f / ray.dir;
+    const F4 ox = splat(ray.pos.x), oy = splat(ray.pos.y), oz = splat(ray.pos.z);
+    const F4 dx = splat(ray.dir.x), dy = splat(ray.dir.y), dz = splat(ray.dir.z);
+
+    bool result = false;
+    const auto numNodes = static_cast<uint32_t>(m_nodes.size());
+
+    for (uint32_t i = 0; i < numNodes; )
+    {
+        const Node& node = m_nodes[i];
+
+        const glm::vec3 t0 = (node.minPoint - ray.pos) * invDir;
+        const glm::vec3 t1 = (node.maxPoint - ray.pos) * invDir;
+        const glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+        const float tEnter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.f));
+        const float tExit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax));
+
+        if (!(tEnter <= tExit))
+        {
+            i = node.next;
+            continue;
+        }
+
+        if (!node.numPackets)
+        {
+            ++i;
+            continue;
+        }
+
+        for (uint32_t p = node.firstPacket; p < node.firstPacket + node.numPackets; ++p)
+        {
+            const TrianglePacket& packet = m_packets[p];
+            const F4 e1x = load(packet.e1[0]), e1y = load(packet.e1[1]), e1z = load(packet.e1[2]);
+            const F4 e2x = load(packet.e2[0]), e2y = load(packet.e2[1]), e2z = load(packet.e2[2]);
+
+            const F4 px = dy * e2z - dz * e2y, py = dz * e2x - dx * e2z, pz = dx * e2y - dy * e2x;
+            const F4 det = e1x * px + e1y * py + e1z * pz;
+            const F4 invDet = one / det;
+
+            const F4 sx = ox - load(packet.v0[0]), sy = oy - load(packet.v0[1]), sz = oz - load(packet.v0[2]);
+            const F4 u = (sx * px + sy * py + sz * pz) * invDet;
+
+            const F4 qx = sy * e1z - sz * e1y, qy = sz * e1x - sx * e1z, qz = sx * e1y - sy * e1x;
+            const F4 v = (dx * qx + dy * qy + dz * qz) * invDet;
+            const F4 t = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+
+            // NaNs of degenerate and padding triangles fail all the comparisons
+            const F4 mask = greater(max(det, zero - det), eps) &
+                    greaterEqual(u, zero) & greaterEqual(v, zero) & greaterEqual(one, u + v) &
+                    greaterEqual(t, zero) & greater(splat(tMax), t);
+
+            if (!moveMask(mask))
+                continue;
+
+            result = true;
+            if (anyHit)
+                return true;
+
+            float ts[4];
+            store(ts, select(mask, t, inf));
+            tMax = glm::min(glm::min(ts[0], ts[1]), glm::min(ts[2], ts[3]));
+        }
+
+        i = node.next;
+    }
+
+    return result;
+}
+
+void MeshBvh::build(BuildData& data, uint32_t begin, uint32_t end)
+{
+    const auto nodeIndex = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.push_back(Node());
+
+    utils::BoundingBox box, centroidsBox;
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        box += data.boxes[data.triangles[i]];
+        centroidsBox += utils::BoundingBox(data.centroids[data.triangles[i]], data.centroids[data.triangles[i]]);
+    }
+    m_nodes[nodeIndex].minPoint = box.minPoint;
+    m_nodes[nodeIndex].maxPoint = box.maxPoint;
+
+    const uint32_t numTriangles = end - begin;
+    const float leafCost = static_cast<float>(numPackets(numTriangles));
+
+    // find the cheapest split among the bins borders of all axes
+    float bestCost = std::numeric_limits<float>::max();
+    int32_t bestAxis = -1;
+    uint32_t bestBin = 0u;
+
+    if (numTriangles > 4u)
+    {
+        for (int32_t axis = 0; axis < 3; ++axis)
+        {
+            const float extent = centroidsBox.maxPoint[axis] - centroidsBox.minPoint[axis];
+            if (extent <= 0.f)
+                continue;
+
+            const float scale = numBins / extent;
+            utils::BoundingBox binBoxes[numBins];
+            uint32_t binCounts[numBins] = {};
+
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                const uint32_t triangle = data.triangles[i];
+                const auto bin = glm::min(static_cast<uint32_t>((data.centroids[triangle][axis] - centroidsBox.minPoint[axis]) * scale), numBins - 1u);
+                binBoxes[bin] += data.boxes[triangle];
+                ++binCounts[bin];
+            }
+
+            float rightAreas[numBins];
+            uint32_t rightCounts[numBins];
+            utils::BoundingBox rightBox;
+            uint32_t rightCount = 0u;
+            for (uint32_t b = numBins - 1u; b > 0u; --b)
+            {
+                rightBox += binBoxes[b];
+                rightCount += binCounts[b];
+                rightAreas[b] = rightBox.empty() ? 0.f : halfArea(rightBox);
+                rightCounts[b] = rightCount;
+            }
+
+            utils::BoundingBox leftBox;
+            uint32_t leftCount = 0u;
+            for (uint32_t b = 1u; b < numBins; ++b)
+            {
+                leftBox += binBoxes[b - 1u];
+                leftCount += binCounts[b - 1u];
+                if (!leftCount || !rightCounts[b])
+                    continue;
+
+                const float cost = halfArea(leftBox) * numPackets(leftCount) + rightAreas[b] * numPackets(rightCounts[b]);
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+
+        const float area = halfArea(box);
+        bestCost = traversalCost + ((area > 0.f) ? bestCost / area : 0.f);
+    }
+
+    uint32_t middle = begin;
+    if ((bestAxis >= 0) && ((bestCost < leafCost) || (numTriangles > maxLeafSize)))
+    {
+        const float minPoint = centroidsBox.minPoint[bestAxis];
+        const float scale = numBins / (centroidsBox.maxPoint[bestAxis] - minPoint);
+        middle = static_cast<uint32_t>(std::partition(data.triangles.begin() + begin, data.triangles.begin() + end, [&](uint32_t triangle) {
+            return glm::min(static_cast<uint32_t>((data.centroids[triangle][bestAxis] - minPoint) * scale), numBins - 1u) < bestBin;
+        }) - data.triangles.begin());
+    }
+    else if (numTriangles > maxLeafSize)
+    {
+        // all centroids coincide, so the triangles are split in halves
+        middle = begin + numTriangles / 2u;
+    }
+
+    if (middle > begin)
+    {
+        build(data, begin, middle);
+        build(data, middle, end);
+        m_nodes[nodeIndex].next = static_cast<uint32_t>(m_nodes.size());
+        return;
+    }
+
+    m_nodes[nodeIndex].next = nodeIndex + 1u;
+    m_nodes[nodeIndex].firstPacket = static_cast<uint32_t>(m_packets.size());
+    m_nodes[nodeIndex].numPackets = numPackets(numTriangles);
+
+    for (uint32_t i = begin; i < end; i += 4u)
+    {
+        TrianglePacket packet = {}; // zero edges of the padding triangles make their determinants zero
+        for (uint32_t lane = 0; (lane < 4u) && (i + lane < end); ++lane)
+        {
+            const uint32_t *triangleIndices = data.indices + 3u * data.triangles[i + lane];
+            const glm::vec3& v0 = data.vertices[triangleIndices[0]];
+            const glm::vec3 e1 = data.vertices[triangleIndices[1]] - v0;
+            const glm::vec3 e2 = data.vertices[triangleIndices[2]] - v0;
+            for (int32_t k = 0; k < 3; ++k)
+            {
+                packet.v0[k][lane] = v0[k];
+                packet.e1[k][lane] = e1[k];
+                packet.e2[k][lane] = e2[k];
+            }
+        }
+        m_packets.push_back(packet);
+    }
+}
+
+} // namespace
+} // namespace
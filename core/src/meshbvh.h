@@ -0,0 +1,62 @@
+#ifndef MESHBVH_H
+#define MESHBVH_H
+
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include <utils/forwarddecl.h>
+
+namespace trash
+{
+namespace core
+{
+
+// Bounding volume hierarchy over triangles of a mesh built by the binned surface area heuristic.
+// Nodes are stored in depth first order together with the index of the node following their subtree, so traversal needs no stack.
+// Triangles of a leaf are packed by four and tested by one SIMD Moller-Trumbore test.
+class MeshBvh
+{
+public:
+    MeshBvh(const glm::vec3*, const uint32_t*, uint32_t); // vertices, indices and number of indices of a triangle list
+
+    size_t numTriangles() const { return m_numTriangles; }
+    size_t numNodes() const { return m_nodes.size(); }
+
+    // Rays are given in the space of the mesh. Distances are measured along the ray direction, hits farther than the max distance are ignored.
+    bool intersect(const utils::Ray&, float, float&) const; // closest hit
+    bool occluded(const utils::Ray&, float) const; // any hit
+
+private:
+    struct Node
+    {
+        glm::vec3 minPoint;
+        uint32_t next;
+        glm::vec3 maxPoint;
+        uint32_t firstPacket;
+        uint32_t numPackets; // 0 for inner nodes, their children follow them
+    };
+
+    struct TrianglePacket
+    {
+        float v0[3][4];
+        float e1[3][4];
+        float e2[3][4];
+    };
+
+    struct BuildData;
+
+    template <bool anyHit>
+    bool traverse(const utils::Ray&, float&) const;
+
+    void build(BuildData&, uint32_t, uint32_t);
+
+    std::vector<Node> m_nodes;
+    std::vector<TrianglePacket> m_packets;
+    size_t m_numTriangles;
+};
+
+} // namespace
+} // namespace
+
+#endif // MESHBVH_H
@@ -0,0 +1,76 @@
+#include <new>
+
+#include "messagepool.h"
+
+namespace trash
+{
+namespace core
+{
+
+namespace
+{
+
+const uint64_t indexMask = 0xFFFFFFFFu;
+
+}
+
+MessagePool::MessagePool()
+{
+    for (size_t c = 0; c < s_numSizeClasses; ++c)
+    {
+        auto& sizeClass = m_sizeClasses[c];
+        sizeClass.blockSize = s_maxBlockSize >> (s_numSizeClasses - 1 - c);
+        for (uint32_t i = 0; i < s_numBlocks; ++i)
+            sizeClass.next[i].store(i + 1, std::memory_order_relaxed);
+        sizeClass.head.store(0u, std::memory_order_relaxed);
+    }
+}
+
+void *MessagePool::allocate(size_t size)
+{
+    if (auto sizeClass = this->sizeClass(size))
+    {
+        uint64_t head = sizeClass->head.load(std::memory_order_acquire);
+        while ((head & indexMask) != s_numBlocks)
+        {
+            const uint32_t index = static_cast<uint32_t>(head & indexMask);
+            const uint64_t newHead = (((head >> 32) + 1) << 32) | sizeClass->next[index].load(std::memory_order_relaxed);
+            if (sizeClass->head.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire))
+                return sizeClass->storage + index * sizeClass->blockSize;
+        }
+    }
+
+    return ::operator new(size);
+}
+
+void MessagePool::deallocate(void *p, size_t size)
+{
+    auto sizeClass = this->sizeClass(size);
+    auto block = static_cast<uint8_t*>(p);
+
+    if (sizeClass && (block >= sizeClass->storage) && (block < sizeClass->storage + sizeClass->blockSize * s_numBlocks))
+    {
+        const uint32_t index = static_cast<uint32_t>((block - sizeClass->storage) / sizeClass->blockSize);
+        uint64_t head = sizeClass->head.load(std::memory_order_relaxed);
+        uint64_t newHead;
+        do
+        {
+            sizeClass->next[index].store(static_cast<uint32_t>(head & indexMask), std::memory_order_relaxed);
+            newHead = (((head >> 32) + 1) << 32) | index;
+        } while (!sizeClass->head.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+        return;
+    }
+
+    ::operator delete(p);
+}
+
+MessagePool::SizeClass *MessagePool::sizeClass(size_t size)
+{
+    for (auto& sizeClass : m_sizeClasses)
+        if (size <= sizeClass.blockSize)
+            return &sizeClass;
+    return nullptr;
+}
+
+} // namespace
+} // namespace
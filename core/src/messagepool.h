@@ -0,0 +1,72 @@
+#ifndef MESSAGEPOOL_H
+#define MESSAGEPOOL_H
+
+#include <atomic>
+#include <memory>
+
+#include <utils/noncopyble.h>
+#include <utils/singletoon.h>
+
+namespace trash
+{
+namespace core
+{
+
+// Fixed blocks for messages of a few size classes with lock-free free lists. Larger messages and the ones which
+// don't fit into the exhausted pool are allocated on the heap. The storage is static, so messages may outlive the pool.
+class MessagePool
+{
+    NONCOPYBLE(MessagePool)
+    SINGLETON(MessagePool)
+
+public:
+    void *allocate(size_t);
+    void deallocate(void*, size_t);
+
+private:
+    MessagePool();
+
+    static const size_t s_numSizeClasses = 3;
+    static const size_t s_maxBlockSize = 256;
+    static const uint32_t s_numBlocks = 256; // per size class
+
+    struct SizeClass
+    {
+        alignas(16) uint8_t storage[s_maxBlockSize * s_numBlocks];
+        std::atomic<uint32_t> next[s_numBlocks];
+        std::atomic<uint64_t> head; // tag in high bits against ABA and index of the first free block
+        size_t blockSize;
+    };
+
+    SizeClass *sizeClass(size_t);
+
+    SizeClass m_sizeClasses[s_numSizeClasses];
+};
+
+template <typename T>
+class MessageAllocator
+{
+public:
+    using value_type = T;
+
+    MessageAllocator() = default;
+    template <typename U> MessageAllocator(const MessageAllocator<U>&) {}
+
+    T *allocate(size_t n) { return static_cast<T*>(MessagePool::instance().allocate(n * sizeof(T))); }
+    void deallocate(T *p, size_t n) { MessagePool::instance().deallocate(p, n * sizeof(T)); }
+
+    template <typename U> bool operator ==(const MessageAllocator<U>&) const { return true; }
+    template <typename U> bool operator !=(const MessageAllocator<U>&) const { return false; }
+};
+
+// the message and its reference counters are allocated together in a block of the pool
+template <typename T, typename... Args>
+inline std::shared_ptr<T> makeMessage(Args&&... args)
+{
+    return std::allocate_shared<T>(MessageAllocator<T>(), std::forward<Args>(args)...);
+}
+
+} // namespace
+} // namespace
+
+#endif // MESSAGEPOOL_H
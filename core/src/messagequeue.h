@@ -0,0 +1,119 @@
+#ifndef MESSAGEQUEUE_H
+#define MESSAGEQUEUE_H
+
+#include <atomic>
+#include <array>
+#include <deque>
+#include <mutex>
+
+#include <utils/noncopyble.h>
+
+namespace trash
+{
+namespace core
+{
+
+// Bounded lock-free queue of many producers and a single consumer (the ring of sequenced cells by D. Vyukov).
+// When the ring is full, messages go to a locked overflow queue until the consumer drains it, so the order of messages
+// of every producer is kept and sending never blocks on the consumer.
+template <typename T, size_t Capacity>
+class MessageQueue
+{
+    NONCOPYBLE(MessageQueue)
+
+    static_assert((Capacity >= 2) && ((Capacity & (Capacity - 1)) == 0), "Capacity must be a power of two");
+
+public:
+    MessageQueue()
+        : m_enqueuePosition(0)
+        , m_dequeuePosition(0)
+        , m_isOverflowed(false)
+    {
+        for (size_t i = 0; i < Capacity; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    void push(T&& value)
+    {
+        if (!m_isOverflowed.load(std::memory_order_acquire) && tryPush(value))
+            return;
+
+        std::lock_guard<std::mutex> lock(m_overflowMutex);
+        m_overflow.push_back(std::move(value));
+        m_isOverflowed.store(true, std::memory_order_release);
+    }
+
+    bool pop(T& value) // must be called only by the consumer thread
+    {
+        auto& cell = m_cells[m_dequeuePosition & (Capacity - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) == m_dequeuePosition + 1)
+        {
+            value = std::move(cell.value);
+            cell.sequence.store(m_dequeuePosition + Capacity, std::memory_order_release);
+            ++m_dequeuePosition;
+            return true;
+        }
+
+        if (!m_isOverflowed.load(std::memory_order_acquire))
+            return false;
+
+        std::lock_guard<std::mutex> lock(m_overflowMutex);
+        if (m_overflow.empty())
+            return false;
+
+        value = std::move(m_overflow.front());
+        m_overflow.pop_front();
+        if (m_overflow.empty())
+            m_isOverflowed.store(false, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    bool tryPush(T& value)
+    {
+        size_t position = m_enqueuePosition.load(std::memory_order_relaxed);
+        while (true)
+        {
+            auto& cell = m_cells[position & (Capacity - 1)];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+            if (difference == 0)
+            {
+                if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = m_enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::array<Cell, Capacity> m_cells;
+    std::atomic<size_t> m_enqueuePosition;
+    size_t m_dequeuePosition;
+
+    std::atomic<bool> m_isOverflowed;
+    std::mutex m_overflowMutex;
+    std::deque<T> m_overflow;
+};
+
+} // namespace
+} // namespace
+
+#endif // MESSAGEQUEUE_H
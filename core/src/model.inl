@@ -11,6 +11,7 @@
 
 #include "renderer.h"
 #include "importexport.h"
+#include "animationgraph.h"
 
 namespace trash
 {
@@ -30,6 +31,7 @@ std::shared_ptr<Model> Renderer::loadModel(const std::string& filename)
                 return nullptr;
             pull(file, mdl);
             file.close();
+            mdl->skeleton = std::make_shared<Skeleton>(*mdl);
             m_resourceStorage->store(filename, mdl);
             return mdl;
         }
@@ -195,6 +197,9 @@ std::shared_ptr<Model> Renderer::loadModel(const std::string& filename)
             }
             meshTo->attachIndexBuffer(std::make_shared<IndexBuffer>(GL_TRIANGLES, indices.size(), indices.data(), GL_STATIC_DRAW));
 
+            if (meshFrom->HasPositions())
+                meshTo->bvh = std::make_shared<MeshBvh>(reinterpret_cast<const glm::vec3*>(meshFrom->mVertices), indices.data(), static_cast<uint32_t>(indices.size()));
+
             meshes[m] = std::shared_ptr<Model::Mesh>(new Model::Mesh(meshTo, materials[meshFrom->mMaterialIndex]));
         }
 
@@ -281,6 +286,7 @@ std::shared_ptr<Model> Renderer::loadModel(const std::string& filename)
         }
 
         importer.FreeScene();
+        object->skeleton = std::make_shared<Skeleton>(*object);
         m_resourceStorage->store(filename, object);
     }
 
@@ -297,86 +303,16 @@ bool Model::calcBoneTransforms(const std::string &animName, float timeInSecs, st
     transforms.resize(numBones(), glm::mat3x4(1.0f));
 
     auto iter = animations.find(animName);
-    if (iter == animations.end())
+    if ((iter == animations.end()) || !skeleton)
         return false;
 
-    auto animation = iter->second;
-
-    float ticksPerSecond = animation->framesPerSecond > 0.0f ? animation->framesPerSecond : 25.0f;
-    float timeInTicks = timeInSecs * ticksPerSecond;
-    float animTime = std::fmod(timeInTicks, animation->duration);
-
-    std::queue<std::pair<std::shared_ptr<Node>, utils::Transform>> nodes;
-    if (rootNode)
-        nodes.push(std::make_pair(rootNode, utils::Transform()));
-    while (!nodes.empty())
-    {
-        auto node = nodes.front().first;
-        auto parentTransform = nodes.front().second;
-        nodes.pop();
-
-        utils::Transform globalTransform = parentTransform;
-        if (node->boneIndex >= 0)
-        {
-            utils::Transform boneTransform = node->transform;
-            auto& transformTuple = animation->transforms[boneNames[static_cast<size_t>(node->boneIndex)]];
-
-            auto& scales = std::get<0>(transformTuple);
-            if (scales.size() == 1)
-                boneTransform.scale = scales.front().second;
-            else if (scales.size() > 1)
-            {
-                for (unsigned int i = 0; i < scales.size() - 1; ++i)
-                    if (animTime < scales[i+1].first)
-                    {
-                        float factor = (animTime - scales[i].first) / (scales[i+1].first - scales[i].first);
-                        boneTransform.scale = glm::mix(scales[i].second, scales[i+1].second, factor);
-                        break;
-                    }
-            }
+    std::vector<const Animation::Channels*> channels;
+    skeleton->resolveChannels(*iter->second, channels);
 
-            auto& rotations = std::get<1>(transformTuple);
-            if (rotations.size() == 1)
-                boneTransform.rotation = rotations.front().second;
-            else if (rotations.size() > 1)
-            {
-                for (unsigned int i = 0; i < rotations.size() - 1; ++i)
-                    if (animTime < rotations[i+1].first)
-                    {
-                        float factor = (animTime - rotations[i].first) / (rotations[i+1].first - rotations[i].first);
-                        boneTransform.rotation = glm::slerp(rotations[i].second, rotations[i+1].second, factor);
-                        break;
-                    }
-            }
-
-            auto& translations = std::get<2>(transformTuple);
-            if (translations.size() == 1)
-                boneTransform.translation = translations.front().second;
-            else if (translations.size() > 1)
-            {
-                for (unsigned int i = 0; i < translations.size() - 1; ++i)
-                    if (animTime < translations[i+1].first)
-                    {
-                        float factor = (animTime - translations[i].first) / (translations[i+1].first - translations[i].first);
-                        boneTransform.translation = glm::mix(translations[i].second, translations[i+1].second, factor);
-                        break;
-                    }
-            }
-
-            globalTransform *= boneTransform;
-            //transforms[static_cast<size_t>(node->boneIndex)] = globalTransform * boneTransforms[static_cast<size_t>(node->boneIndex)];
-            transforms[static_cast<size_t>(node->boneIndex)] = glm::transpose(
-                        (globalTransform * boneTransforms[static_cast<size_t>(node->boneIndex)]).operator glm::mat4x4()
-                    );
-
-        }
-        else {
-            globalTransform *= node->transform;
-        }
-
-        for (auto child: node->children())
-            nodes.push(std::make_pair(child, globalTransform));
-    }
+    Pose pose;
+    std::vector<glm::mat3x4> modelMatrices;
+    skeleton->sample(*iter->second, channels, timeInSecs, pose);
+    skeleton->calcSkinningMatrices(pose, transforms, modelMatrices);
 
     return true;
 }
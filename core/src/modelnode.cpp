@@ -2,12 +2,14 @@
 
 #include <core/modelnode.h>
 #include <core/drawablenode.h>
+#include <core/settings.h>
 
 #include "modelnodeprivate.h"
 #include "drawablenodeprivate.h"
 #include "sceneprivate.h"
 #include "renderer.h"
 #include "drawables.h"
+#include "animationgraph.h"
 
 namespace trash
 {
@@ -21,9 +23,15 @@ ModelNode::ModelNode(const std::string &filename)
     auto& renderer = Renderer::instance();
 
     mPrivate.model = renderer.loadModel(filename);
+    mPrivate.animationGraph = std::make_shared<AnimationGraph>(mPrivate.model);
+    if (Settings::instance().readBool("Renderer.Animation.DualQuaternionSkinning", false))
+        mPrivate.animationGraph->setSkinningType(SkinningType::DualQuaternion);
 
     if (mPrivate.model->numBones())
-        mPrivate.bonesBuffer = std::make_shared<Buffer>(mPrivate.model->numBones()*sizeof(glm::mat3x4), nullptr, GL_DYNAMIC_DRAW);
+    {
+        mPrivate.bonesBuffer = std::make_shared<BonesPaletteRange>(mPrivate.model->numBones(), mPrivate.animationGraph->skinningType());
+        mPrivate.bonesBufferUniform = std::make_shared<Uniform<std::shared_ptr<BonesPaletteRange>>>(mPrivate.bonesBuffer);
+    }
 
     utils::BoundingBox minimalBoundingBox;
     std::queue<std::pair<std::shared_ptr<Model::Node>, utils::Transform>> nodes;
@@ -53,7 +61,7 @@ ModelNode::ModelNode(const std::string &filename)
             auto& meshNodePrivate = meshNode->m();
             meshNode->setTransform(transform);
             meshNodePrivate.addDrawable(std::make_shared<StandardDrawable>(mesh->mesh,
-                                                                         mPrivate.bonesBuffer,
+                                                                         mPrivate.bonesBufferUniform,
                                                                          glm::vec4(1.f, 1.f, 1.f, 1.f),
                                                                          glm::vec2(1.f, 1.f),
                                                                          diffuseTexture,
@@ -63,6 +71,11 @@ ModelNode::ModelNode(const std::string &filename)
                                                                          roughTexture,
                                                                          meshNodePrivate.getLightIndices()));
             attach(meshNode);
+            mPrivate.meshNodes.push_back(meshNode);
+
+            if (mPrivate.bonesBufferUniform && renderer.isPreSkinningEnabled() &&
+                    mesh->mesh->vertexBuffer(VertexAttribute::BonesIDs) && mesh->mesh->vertexBuffer(VertexAttribute::BonesWeights))
+                mPrivate.skinnedMeshes.push_back(mesh->mesh);
 
             minimalBoundingBox += transform * mesh->mesh->boundingBox;
         }
@@ -100,42 +113,51 @@ void ModelNode::showBones(bool state)
 void ModelNode::setAnimationFrame(const std::string& animationName, uint64_t animationTime)
 {
     auto& privateData = m();
+    privateData.animationGraph->play(animationName, privateData.animation(animationName), animationTime * 0.001f);
+}
 
-    if (!privateData.model->animations.count(animationName))
-    {
-        auto anim = Renderer::instance().loadAnimation(animationName + ".anim");
-        assert(anim != nullptr);
-        privateData.model->animations.insert({animationName, anim});
-    }
-
-    if (privateData.animationName == animationName && privateData.animationTime == animationTime)
-        return;
+uint64_t ModelNode::animationTime(const std::string& animationName) const
+{
+    auto anim = m().animation(animationName);
+    if (!anim)
+        return 0;
+    return static_cast<uint64_t>(anim->duration / anim->framesPerSecond * 1000.0f + .5f);
+}
 
-    privateData.animationName = animationName;
-    privateData.animationTime = animationTime;
+void ModelNode::setAnimationCrossFadeTime(uint64_t value)
+{
+    m().animationGraph->setCrossFadeTime(value * 0.001f);
+}
 
-    ScenePrivate::dirtyNodeShadowMaps(*this);
+void ModelNode::setAnimationLayer(uint32_t layer, const std::string& animationName, uint64_t animationTime, float weight, bool additive, const std::string& maskRootBone)
+{
+    auto& privateData = m();
+    privateData.animationGraph->setLayer(layer, animationName, privateData.animation(animationName), animationTime * 0.001f, weight, additive, maskRootBone);
+}
 
-    std::vector<glm::mat3x4> bones;
-    privateData.model->calcBoneTransforms(animationName, animationTime * 0.001f, bones);
-    privateData.bonesBuffer->setSubData(0, static_cast<GLsizeiptr>(bones.size()*sizeof(glm::mat3x4)), bones.data());
+void ModelNode::removeAnimationLayer(uint32_t layer)
+{
+    m().animationGraph->removeLayer(layer);
 }
 
-uint64_t ModelNode::animationTime(const std::string& animationName) const
+void ModelNode::setSkinningType(SkinningType value)
 {
-    auto& privateData = m();
+    auto& mPrivate = m();
+    mPrivate.animationGraph->setSkinningType(value);
 
-    if (!privateData.model->animations.count(animationName))
+    if (mPrivate.bonesBuffer && (mPrivate.bonesBuffer->skinningType != value))
     {
-        auto anim = Renderer::instance().loadAnimation(animationName + ".anim");
-        assert(anim != nullptr);
-        privateData.model->animations.insert({animationName, anim});
+        mPrivate.resetBonesBuffer();
+
+        // the palette has to be evaluated in the new format before the model is drawn again
+        mPrivate.bones.clear();
+        mPrivate.previousBones.clear();
     }
+}
 
-    auto anim = privateData.model->animations[animationName];
-    if (!anim)
-        return 0;
-    return static_cast<uint64_t>(anim->duration / anim->framesPerSecond * 1000.0f + .5f);
+SkinningType ModelNode::skinningType() const
+{
+    return m().animationGraph->skinningType();
 }
 
 } // namespace
@@ -1,4 +1,11 @@
+#include <chrono>
+
+#include <core/scene.h>
+#include <core/node.h>
+
 #include "modelnodeprivate.h"
+#include "sceneprivate.h"
+#include "nodeupdatevisitor.h"
 
 namespace trash
 {
@@ -7,10 +14,130 @@ namespace core
 
 ModelNodePrivate::ModelNodePrivate(Node& node)
     : NodePrivate(node)
-    , animationName("")
-    , animationTime(0)
+    , animationLodPeriod(1)
+    , numFramesSinceEvaluation(0)
+    , hasSharedPose(false)
+    , evaluationTime(0.0)
     , showBones(false)
 {
+    // spreads reduced-rate animation updates of different models across frames
+    static uint32_t lodPhaseCounter = 0;
+    animationLodPhase = lodPhaseCounter++;
+}
+
+std::shared_ptr<Model::Animation> ModelNodePrivate::animation(const std::string& animationName) const
+{
+    auto iter = model->animations.find(animationName);
+    if (iter != model->animations.end())
+        return iter->second;
+
+    auto anim = Renderer::instance().loadAnimation(animationName + ".anim");
+    assert(anim != nullptr);
+    model->animations.insert({animationName, anim});
+    model->skeleton->clipBoundingBox(*anim); // bake the bounds while loading rather than on the first culling
+    return anim;
+}
+
+void ModelNodePrivate::doUpdate(uint64_t time, uint64_t dt)
+{
+    NodePrivate::doUpdate(time, dt);
+
+    if (!bonesBuffer || !animationGraph->isDirty())
+        return;
+
+    // poses are evaluated in parallel by the scene after all nodes are updated
+    if (auto scene = getScene())
+        NodeUpdateCommands::run([this, scene]() { scene->m().dirtyAnimatedNodes.push_back(this); });
+}
+
+void ModelNodePrivate::evaluateAnimation(float sharedPoseStep)
+{
+    const auto startTime = std::chrono::steady_clock::now();
+
+    previousBones.swap(bones);
+    if (hasSharedPose)
+        animationGraph->evaluateShared(sharedPoseKey, sharedPoseStep, bones);
+    else
+        animationGraph->evaluate(bones);
+    numFramesSinceEvaluation = 0;
+
+    previousPoseBoundingBox = poseBoundingBox;
+    poseBoundingBox = animationGraph->boundingBox();
+
+    evaluationTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void ModelNodePrivate::uploadAnimation(bool interpolate)
+{
+    // the graph falls back to linear blend skinning if the model has scaled bones. The pose is already evaluated in the new
+    // format, only the range (own or shared one of the old format) has to be replaced and the previous pose can't be blended.
+    if (bonesBufferUniform->get()->skinningType != animationGraph->skinningType())
+    {
+        if (bonesBuffer->skinningType != animationGraph->skinningType())
+            resetBonesBuffer();
+        bonesBufferUniform->set(bonesBuffer);
+        previousBones.clear();
+    }
+
+    const std::vector<glm::vec4> *data = &bones;
+    utils::BoundingBox boundingBox = poseBoundingBox;
+
+    // reduced-rate models are drawn one update period behind to blend between the last two evaluated poses
+    if (interpolate && (animationLodPeriod > 1) && (previousBones.size() == bones.size()))
+    {
+        const float factor = glm::min(static_cast<float>(numFramesSinceEvaluation) / static_cast<float>(animationLodPeriod), 1.0f);
+        interpolatedBones.resize(bones.size());
+        if (animationGraph->skinningType() == SkinningType::DualQuaternion)
+        {
+            for (size_t i = 0; i < bones.size(); i += 2)
+            {
+                // both dual quaternions have to be in the same hemisphere
+                const float sign = (glm::dot(previousBones[i], bones[i]) < 0.0f) ? -1.0f : 1.0f;
+                interpolatedBones[i] = previousBones[i] + (bones[i] * sign - previousBones[i]) * factor;
+                interpolatedBones[i+1] = previousBones[i+1] + (bones[i+1] * sign - previousBones[i+1]) * factor;
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < bones.size(); ++i)
+                interpolatedBones[i] = previousBones[i] + (bones[i] - previousBones[i]) * factor;
+        }
+        data = &interpolatedBones;
+        boundingBox += previousPoseBoundingBox;
+    }
+    ++numFramesSinceEvaluation;
+
+    ScenePrivate::dirtyNodeShadowMaps(thisNode);
+    bonesBufferUniform->get()->setData(data->data(), static_cast<uint32_t>(data->size()));
+
+    for (auto& mesh : skinnedMeshes)
+        Renderer::instance().queueSkinning(mesh, bonesBufferUniform->get());
+
+    setPoseBoundingBox(boundingBox);
+}
+
+void ModelNodePrivate::resetBonesBuffer()
+{
+    bonesBuffer = std::make_shared<BonesPaletteRange>(model->numBones(), animationGraph->skinningType());
+    bonesBufferUniform->set(bonesBuffer);
+}
+
+void ModelNodePrivate::setPoseBoundingBox(const utils::BoundingBox& boundingBox)
+{
+    if (boundingBox.empty())
+        return;
+
+    // mesh nodes cover the whole posed model as they do for the bind pose
+    for (auto& meshNode : meshNodes)
+    {
+        auto& meshNodePrivate = meshNode->m();
+        const auto meshNodeBoundingBox = meshNode->transform().inverted() * boundingBox;
+        if ((meshNodeBoundingBox.minPoint != meshNodePrivate.minimalBoundingBox.minPoint) || (meshNodeBoundingBox.maxPoint != meshNodePrivate.minimalBoundingBox.maxPoint))
+        {
+            meshNodePrivate.minimalBoundingBox = meshNodeBoundingBox;
+            meshNodePrivate.dirtyBoundingBox();
+        }
+    }
 }
 
 } // namespace
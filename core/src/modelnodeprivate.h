@@ -2,26 +2,48 @@
 #define MODELNODEPRIVATE_H
 
 #include <string>
+#include <vector>
+
+#include <glm/vec4.hpp>
 
 #include "nodeprivate.h"
+#include "renderer.h"
+#include "animationgraph.h"
 
 namespace trash
 {
 namespace core
 {
 
-struct Model;
-struct Buffer;
 
 class ModelNodePrivate : public NodePrivate
 {
 public:
     ModelNodePrivate(Node&);
 
+    std::shared_ptr<Model::Animation> animation(const std::string&) const;
+
+    void doUpdate(uint64_t, uint64_t) override;
+
+    void evaluateAnimation(float);
+    void uploadAnimation(bool);
+    void resetBonesBuffer();
+    void setPoseBoundingBox(const utils::BoundingBox&);
+
     std::shared_ptr<Model> model;
-    std::shared_ptr<Buffer> bonesBuffer;
-    std::string animationName;
-    uint64_t animationTime;
+    std::shared_ptr<BonesPaletteRange> bonesBuffer;
+    std::shared_ptr<Uniform<std::shared_ptr<BonesPaletteRange>>> bonesBufferUniform;
+    std::shared_ptr<AnimationGraph> animationGraph;
+    std::vector<std::shared_ptr<Mesh>> skinnedMeshes; // meshes which are skinned by the renderer after every bones upload
+    std::vector<std::shared_ptr<Node>> meshNodes;
+    utils::BoundingBox poseBoundingBox, previousPoseBoundingBox;
+    std::vector<glm::vec4> bones, previousBones, interpolatedBones; // bones palette texels
+    uint32_t animationLodPhase;
+    uint32_t animationLodPeriod;
+    uint32_t numFramesSinceEvaluation;
+    SharedPoseKey sharedPoseKey;
+    bool hasSharedPose;
+    double evaluationTime;
     bool showBones;
 };
 
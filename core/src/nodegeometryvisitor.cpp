@@ -0,0 +1,65 @@
+#include <utils/transform.h>
+
+#include <core/nodegeometryvisitor.h>
+#include <core/node.h>
+#include <core/drawablenode.h>
+
+#include "drawablenodeprivate.h"
+#include "drawables.h"
+#include "renderer.h"
+
+namespace trash
+{
+namespace core
+{
+
+class NodeGeometryVisitorPrivate
+{
+public:
+    GeometryData data;
+    std::vector<glm::vec3> meshVertices;
+    std::vector<uint32_t> meshIndices;
+};
+
+NodeGeometryVisitor::NodeGeometryVisitor()
+    : m_(std::make_unique<NodeGeometryVisitorPrivate>())
+{
+}
+
+NodeGeometryVisitor::~NodeGeometryVisitor()
+{
+}
+
+bool NodeGeometryVisitor::visit(std::shared_ptr<Node> node)
+{
+    auto drawableNode = std::dynamic_pointer_cast<DrawableNode>(node);
+    if (!drawableNode || (drawableNode->intersectionMode() != IntersectionMode::UseGeometry))
+        return true;
+
+    const utils::Transform& transform = node->globalTransform();
+
+    for (auto drawable : drawableNode->m().drawables)
+    {
+        auto mesh = drawable->mesh();
+        if (!mesh)
+            continue;
+
+        mesh->triangles(m_->meshVertices, m_->meshIndices);
+
+        const auto firstVertex = static_cast<uint32_t>(m_->data.vertices.size());
+        for (const auto& vertex : m_->meshVertices)
+            m_->data.vertices.push_back(transform * vertex);
+        for (auto index : m_->meshIndices)
+            m_->data.indices.push_back(firstVertex + index);
+    }
+
+    return true;
+}
+
+const GeometryData &NodeGeometryVisitor::geometryData() const
+{
+    return m_->data;
+}
+
+} // namespace
+} // namespace
@@ -1,3 +1,5 @@
+#include <limits>
+
 #include <utils/ray.h>
 #include <utils/frustum.h>
 
@@ -9,6 +11,7 @@
 #include "drawablenodeprivate.h"
 #include "drawables.h"
 #include "renderer.h"
+#include "meshbvh.h"
 
 namespace trash
 {
@@ -18,10 +21,12 @@ namespace core
 class NodeRayIntersectionVisitorPrivate
 {
 public:
-    NodeRayIntersectionVisitorPrivate(const utils::Ray& r) : ray(r) {}
+    NodeRayIntersectionVisitorPrivate(const utils::Ray& r, float d, bool a) : ray(r), maxDistance(d), anyHit(a) {}
     ~NodeRayIntersectionVisitorPrivate();
 
     utils::Ray ray;
+    float maxDistance;
+    bool anyHit;
     IntersectionData data;
 };
 
@@ -44,8 +49,8 @@ NodeFrustumIntersectionVisitorPrivate::~NodeFrustumIntersectionVisitorPrivate()
 {
 }
 
-NodeRayIntersectionVisitor::NodeRayIntersectionVisitor(const utils::Ray& ray)
-    : m_(std::make_unique<NodeRayIntersectionVisitorPrivate>(ray))
+NodeRayIntersectionVisitor::NodeRayIntersectionVisitor(const utils::Ray& ray, float maxDistance, bool anyHit)
+    : m_(std::make_unique<NodeRayIntersectionVisitorPrivate>(ray, maxDistance, anyHit))
 {
 }
 
@@ -55,14 +60,16 @@ NodeRayIntersectionVisitor::~NodeRayIntersectionVisitor()
 
 bool NodeRayIntersectionVisitor::visit(std::shared_ptr<Node> node)
 {
-    if (!m_->ray.intersect(node->globalTransform() * node->boundingBox()))
+    if (m_->anyHit && !m_->data.nodes.empty())
+        return false;
+
+    float boundBoxT0, boundBoxT1;
+    if (!m_->ray.intersect(node->globalTransform() * node->boundingBox(), &boundBoxT0) || (boundBoxT0 > m_->maxDistance))
         return false;
 
     if (auto drawableNode = std::dynamic_pointer_cast<DrawableNode>(node))
     {
-        float boundBoxT0, boundBoxT1;
-
-        if (m_->ray.intersect(node->globalTransform() * node->m().getLocalBoundingBox(), &boundBoxT0, &boundBoxT1))
+        if (m_->ray.intersect(node->globalTransform() * node->m().getLocalBoundingBox(), &boundBoxT0, &boundBoxT1) && (boundBoxT0 <= m_->maxDistance))
         {
             auto drawableIntersectionMode = drawableNode->intersectionMode();
             if (drawableIntersectionMode == IntersectionMode::None)
@@ -72,45 +79,39 @@ bool NodeRayIntersectionVisitor::visit(std::shared_ptr<Node> node)
             if (drawableIntersectionMode == IntersectionMode::UseBoundingBox)
             {
                 m_->data.nodes.insert({glm::max(.0f, boundBoxT0), drawableNode});
-                m_->data.nodes.insert({boundBoxT1, drawableNode});
+                if (boundBoxT1 <= m_->maxDistance)
+                    m_->data.nodes.insert({boundBoxT1, drawableNode});
             }
             else if (drawableIntersectionMode == IntersectionMode::UseGeometry)
             {
                 auto nodeGLobalTransformInv = node->globalTransform().inverted();
                 auto invertedRay = nodeGLobalTransformInv * m_->ray;
                 auto dirRayScale = glm::length(m_->ray.dir * nodeGLobalTransformInv.scale);
+                const float maxDistance = (m_->maxDistance < std::numeric_limits<float>::max()) ?
+                            m_->maxDistance * dirRayScale :
+                            std::numeric_limits<float>::max();
 
                 for (auto drawable : drawableNode->m().drawables)
                 {
                     auto mesh = drawable->mesh();
-                    float t0, t1;
-
-                    if (!invertedRay.intersect(mesh->boundingBox, &t0, &t1))
-                        continue;
-
-                    auto verteBuffer = mesh->vertexBuffer(VertexAttribute::Position);
-                    if (!verteBuffer)
+                    if (!invertedRay.intersect(mesh->boundingBox))
                         continue;
 
-                    assert(verteBuffer->numComponents == 2 || verteBuffer->numComponents == 3);
+                    if (!mesh->bvh)
+                        mesh->recalcBvh();
 
-                    const void *vertexData = verteBuffer->cpuData();
-
-                    for (auto indexBuffer : mesh->indexBuffers)
+                    float t;
+                    if (m_->anyHit)
                     {
-                        if (indexBuffer->primitiveType != GL_TRIANGLES)
-                            continue;
-
-                        const uint32_t *indexData = static_cast<const uint32_t*>(indexBuffer->cpuData());
-
-                        std::set<float> rayCoords;
-                        if (verteBuffer->numComponents == 3)
-                            invertedRay.intersect(static_cast<const glm::vec3*>(vertexData), indexData, indexBuffer->numIndices, &rayCoords);
-                        else if (verteBuffer->numComponents == 2)
-                            invertedRay.intersect(static_cast<const glm::vec2*>(vertexData), indexData, indexBuffer->numIndices, &rayCoords);
-
-                        for (auto t : rayCoords)
-                            m_->data.nodes.insert({t / dirRayScale, drawableNode});
+                        if (mesh->bvh->occluded(invertedRay, maxDistance))
+                        {
+                            m_->data.nodes.insert({0.f, drawableNode});
+                            break;
+                        }
+                    }
+                    else if (mesh->bvh->intersect(invertedRay, maxDistance, t))
+                    {
+                        m_->data.nodes.insert({t / dirRayScale, drawableNode});
                     }
                 }
             }
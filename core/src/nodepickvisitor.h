@@ -1,9 +1,9 @@
-#ifndef NODEINTERSECTIONVISITOR_H
-#define NODEINTERSECTIONVISITOR_H
+#ifndef NODEPICKVISITOR_H
+#define NODEPICKVISITOR_H
 
 #include <vector>
 
-#include <utils/ray.h>
+#include <utils/frustum.h>
 
 #include <core/nodevisitor.h>
 #include <core/node.h>
@@ -16,20 +16,21 @@ namespace trash
 namespace core
 {
 
+// Queues the drawables inside the pick frustum for rendering of their ids. Ids are indices in nodeIds() plus one.
 class NodePickVisitor : public NodeVisitor
 {
 public:
-    NodePickVisitor(const utils::Ray& ray) : m_ray(ray), m_nodeIds() {}
+    NodePickVisitor(const utils::Frustum& frustum) : m_frustum(frustum), m_nodeIds() {}
 
     bool visit(std::shared_ptr<Node> node) override
     {
-        if (!m_ray.intersect(node->globalTransform() * node->boundingBox()))
+        if (!m_frustum.contain(node->globalTransform() * node->boundingBox()))
             return false;
 
         if (auto drawableNode = std::dynamic_pointer_cast<DrawableNode>(node))
         {
             auto& drawableNodePrivate = drawableNode->m();
-            if (m_ray.intersect(drawableNode->globalTransform() * drawableNodePrivate.getLocalBoundingBox()))
+            if (m_frustum.contain(drawableNode->globalTransform() * drawableNodePrivate.getLocalBoundingBox()))
             {
                 m_nodeIds.push_back(drawableNode);
                 drawableNode->m().doRender(static_cast<uint32_t>(m_nodeIds.size()));
@@ -42,7 +43,7 @@ public:
     const std::vector<std::shared_ptr<DrawableNode>>& nodeIds() const { return m_nodeIds; }
 
 private:
-    utils::Ray m_ray;
+    utils::Frustum m_frustum;
     std::vector<std::shared_ptr<DrawableNode>> m_nodeIds;
 
 };
@@ -50,4 +51,4 @@ private:
 } // namespace
 } // namespace
 
-#endif // NODEINTERSECTIONVISITOR_H
+#endif // NODEPICKVISITOR_H
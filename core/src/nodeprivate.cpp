@@ -2,6 +2,7 @@
 #include <core/scenerootnode.h>
 
 #include "nodeprivate.h"
+#include "nodeupdatevisitor.h"
 
 #include "renderer.h"
 
@@ -34,8 +35,16 @@ void NodePrivate::dirtyGlobalTransform()
 void NodePrivate::dirtyBoundingBox()
 {
     isBoundingBoxDirty = true;
-    if (thisNode.parent())
-        thisNode.parent()->m().dirtyBoundingBox();
+
+    auto parent = thisNode.parent();
+    if (!parent)
+        return;
+
+    // the parent of a concurrently updated subtree is shared with the other subtrees
+    if (NodeUpdateCommands::isSubtreeRoot(thisNode))
+        NodeUpdateCommands::run([parentPrivate = &parent->m()]() { parentPrivate->dirtyBoundingBox(); });
+    else
+        parent->m().dirtyBoundingBox();
 }
 
 void NodePrivate::doUpdate(uint64_t, uint64_t)
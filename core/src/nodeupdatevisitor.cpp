@@ -0,0 +1,57 @@
+#include "nodeupdatevisitor.h"
+
+namespace trash
+{
+namespace core
+{
+
+namespace
+{
+
+thread_local NodeUpdateCommands *currentCommands = nullptr;
+thread_local const Node *currentSubtreeRoot = nullptr;
+
+}
+
+NodeUpdateCommands::NodeUpdateCommands()
+    : m_commands()
+{
+}
+
+void NodeUpdateCommands::run(Command command)
+{
+    if (currentCommands)
+        currentCommands->m_commands.push_back(std::move(command));
+    else
+        command();
+}
+
+bool NodeUpdateCommands::isSubtreeRoot(const Node& node)
+{
+    return &node == currentSubtreeRoot;
+}
+
+void NodeUpdateCommands::update(Node& subtreeRoot, uint64_t time, uint64_t dt)
+{
+    // a waiting thread may take the update of another subtree, so the previous one is restored
+    auto *previousCommands = currentCommands;
+    auto *previousSubtreeRoot = currentSubtreeRoot;
+    currentCommands = this;
+    currentSubtreeRoot = &subtreeRoot;
+
+    NodeUpdateVisitor nodeUpdateVisitor(time, dt);
+    subtreeRoot.accept(nodeUpdateVisitor);
+
+    currentCommands = previousCommands;
+    currentSubtreeRoot = previousSubtreeRoot;
+}
+
+void NodeUpdateCommands::execute()
+{
+    for (auto& command : m_commands)
+        command();
+    m_commands.clear();
+}
+
+} // namespace
+} // namespace
@@ -1,6 +1,10 @@
 #ifndef NODEUPDATEVISITOR_H
 #define NODEUPDATEVISITOR_H
 
+#include <vector>
+#include <functional>
+
+#include <utils/noncopyble.h>
 #include <core/nodevisitor.h>
 #include <core/node.h>
 
@@ -22,6 +26,28 @@ private:
     uint64_t m_time, m_dt;
 };
 
+// Subtrees of the scene root are updated concurrently. Nodes don't write to the state shared between the subtrees
+// (the scene, the root and the renderer) directly, the writes are recorded to the command list of the subtree and executed
+// after the update on the calling thread in the order of the subtrees, so the result is the same as of the serial update.
+class NodeUpdateCommands
+{
+    NONCOPYBLE(NodeUpdateCommands)
+
+public:
+    using Command = std::function<void()>;
+
+    NodeUpdateCommands();
+
+    static void run(Command); // is executed at once outside of the concurrent update
+    static bool isSubtreeRoot(const Node&); // of the subtree which is being updated by the calling thread
+
+    void update(Node&, uint64_t, uint64_t);
+    void execute();
+
+private:
+    std::vector<Command> m_commands;
+};
+
 } // namespace
 } // namespace
 
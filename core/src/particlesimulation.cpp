@@ -0,0 +1,227 @@
+#include <glm/common.hpp>
+
+#include "particlesimulation.h"
+#include "simd.h"
+
+namespace trash
+{
+namespace core
+{
+
+namespace
+{
+
+using namespace simd;
+
+const uint32_t numCurveSamples = 256u;
+
+}
+
+void Particles::resize(uint32_t value)
+{
+    capacity = value;
+    rangeEnd = 0u;
+    freeIndices.clear();
+    for (auto *v : {&px, &py, &pz, &vx, &vy, &vz, &lifetime})
+        v->assign((value + 3u) & ~3u, 0.f);
+}
+
+uint32_t Particles::allocate(uint32_t count, std::vector<uint32_t>& indices)
+{
+    indices.clear();
+    for (; (indices.size() < count) && !freeIndices.empty(); freeIndices.pop_back())
+        indices.push_back(freeIndices.back());
+    while ((indices.size() < count) && (rangeEnd < capacity))
+        indices.push_back(rangeEnd++);
+
+    return static_cast<uint32_t>(indices.size());
+}
+
+void Particles::collect(std::vector<uint32_t>& aliveIndices)
+{
+    aliveIndices.clear();
+    freeIndices.clear();
+
+    uint32_t newRangeEnd = 0u;
+    for (uint32_t i = 0; i < rangeEnd; ++i)
+    {
+        if (lifetime[i] > 0.f)
+        {
+            aliveIndices.push_back(i);
+            newRangeEnd = i + 1u;
+        }
+    }
+
+    for (uint32_t i = newRangeEnd; i-- > 0u; )
+        if (lifetime[i] <= 0.f)
+            freeIndices.push_back(i);
+
+    rangeEnd = newRangeEnd;
+}
+
+ParticleCurves::ParticleCurves(const ParticleSystemDescription& description)
+    : colorOpacity(numCurveSamples)
+    , size(numCurveSamples)
+    , scale((numCurveSamples - 1u) / glm::max(description.lifetime.y, 1e-3f))
+{
+    for (uint32_t i = 0; i < numCurveSamples; ++i)
+    {
+        const float t = i / scale;
+        colorOpacity[i] = glm::vec4(description.color.interpolate(t), description.opacity.interpolate(t));
+        size[i] = description.size.interpolate(t);
+    }
+}
+
+void spawnParticles(const ParticleSystemDescription& description,
+                    const std::vector<uint32_t>& indices,
+                    const glm::vec3 *positions,
+                    float dt,
+                    utils::Random& random,
+                    Particles& particles)
+{
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        // particles are spread over the last frame to avoid visible bursts
+        const float age = random(0.f, dt);
+        const size_t j = indices[i];
+        particles.px[j] = positions[i].x + description.velocity.x * age;
+        particles.py[j] = positions[i].y + description.velocity.y * age;
+        particles.pz[j] = positions[i].z + description.velocity.z * age;
+        particles.vx[j] = description.velocity.x;
+        particles.vy[j] = description.velocity.y;
+        particles.vz[j] = description.velocity.z;
+        particles.lifetime[j] = glm::max(random(description.lifetime.x, description.lifetime.y) - age, 1e-3f);
+    }
+}
+
+void integrateParticles(const ParticleSystemDescription& description, float dt, Particles& particles, size_t begin, size_t end)
+{
+    const F4 zero = splat(0.f), dt4 = splat(dt), eps = splat(1e-12f), strength = splat(description.attractorStrength);
+    const F4 sx = splat(description.attractorScale.x), sy = splat(description.attractorScale.y), sz = splat(description.attractorScale.z);
+    const F4 ox = splat(description.attractorOffset.x), oy = splat(description.attractorOffset.y), oz = splat(description.attractorOffset.z);
+    const F4 accx = splat(description.acceleration.x), accy = splat(description.acceleration.y), accz = splat(description.acceleration.z);
+
+    for (size_t i = begin; i < end; i += 4)
+    {
+        const F4 lifetime = load(particles.lifetime.data() + i);
+        const F4 step = select(greater(lifetime, zero), dt4, zero);
+
+        F4 px = load(particles.px.data() + i), py = load(particles.py.data() + i), pz = load(particles.pz.data() + i);
+        F4 vx = load(particles.vx.data() + i), vy = load(particles.vy.data() + i), vz = load(particles.vz.data() + i);
+
+        const F4 ax = px * sx + ox, ay = py * sy + oy, az = pz * sz + oz;
+        const F4 k = strength * invSqrt(max(ax * ax + ay * ay + az * az, eps));
+
+        vx = vx + step * (ax * k + accx);
+        vy = vy + step * (ay * k + accy);
+        vz = vz + step * (az * k + accz);
+        px = px + step * vx;
+        py = py + step * vy;
+        pz = pz + step * vz;
+
+        store(particles.px.data() + i, px);
+        store(particles.py.data() + i, py);
+        store(particles.pz.data() + i, pz);
+        store(particles.vx.data() + i, vx);
+        store(particles.vy.data() + i, vy);
+        store(particles.vz.data() + i, vz);
+        store(particles.lifetime.data() + i, max(lifetime - dt4, zero));
+    }
+}
+
+void sortParticles(const Particles& particles, const glm::vec3& viewPosition, std::vector<uint32_t>& indices, ParticleSortBuffers& buffers)
+{
+    const size_t numIndices = indices.size();
+    if (numIndices < 2u)
+        return;
+
+    buffers.distances.resize(numIndices);
+    buffers.keys.resize(numIndices);
+    buffers.tmpKeys.resize(numIndices);
+    buffers.tmpIndices.resize(numIndices);
+
+    float minDistance = std::numeric_limits<float>::max(), maxDistance = 0.f;
+    for (size_t i = 0; i < numIndices; ++i)
+    {
+        const uint32_t j = indices[i];
+        const glm::vec3 d = glm::vec3(particles.px[j], particles.py[j], particles.pz[j]) - viewPosition;
+        const float distance = glm::sqrt(d.x * d.x + d.y * d.y + d.z * d.z);
+        buffers.distances[i] = distance;
+        minDistance = glm::min(minDistance, distance);
+        maxDistance = glm::max(maxDistance, distance);
+    }
+
+    // far particles get small keys to be drawn first
+    const float scale = 65535.f / glm::max(maxDistance - minDistance, 1e-6f);
+    for (size_t i = 0; i < numIndices; ++i)
+        buffers.keys[i] = static_cast<uint16_t>((maxDistance - buffers.distances[i]) * scale + .5f);
+
+    // two stable counting passes by 8 bits
+    uint16_t *srcKeys = buffers.keys.data(), *dstKeys = buffers.tmpKeys.data();
+    uint32_t *srcIndices = indices.data(), *dstIndices = buffers.tmpIndices.data();
+    for (uint32_t shift = 0u; shift < 16u; shift += 8u)
+    {
+        uint32_t offsets[256] = {};
+        for (size_t i = 0; i < numIndices; ++i)
+            ++offsets[(srcKeys[i] >> shift) & 0xFFu];
+
+        for (uint32_t k = 0, sum = 0; k < 256u; ++k)
+        {
+            const uint32_t count = offsets[k];
+            offsets[k] = sum;
+            sum += count;
+        }
+
+        for (size_t i = 0; i < numIndices; ++i)
+        {
+            const uint32_t k = offsets[(srcKeys[i] >> shift) & 0xFFu]++;
+            dstKeys[k] = srcKeys[i];
+            dstIndices[k] = srcIndices[i];
+        }
+
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcIndices, dstIndices);
+    }
+    // after an even number of passes the result is back in indices
+}
+
+utils::BoundingBox packParticles(const ParticleCurves& curves,
+                                 const Particles& particles,
+                                 uint32_t numFrames,
+                                 float fps,
+                                 glm::vec4 *texels,
+                                 size_t begin,
+                                 size_t end)
+{
+    static const float inf = std::numeric_limits<float>::max();
+    const float lastSample = static_cast<float>(numCurveSamples - 1u);
+    glm::vec3 minPoint(inf), maxPoint(-inf);
+
+    texels += 3u * begin;
+    for (size_t i = begin; i < end; ++i, texels += 3)
+    {
+        const float lifetime = particles.lifetime[i];
+        const bool isAlive = lifetime > 0.f;
+
+        const float t = glm::min(lifetime * curves.scale, lastSample);
+        const uint32_t k = glm::min(static_cast<uint32_t>(t), numCurveSamples - 2u);
+        const float f = t - k;
+        const float size = glm::mix(curves.size[k], curves.size[k + 1], f);
+        const glm::vec3 position(particles.px[i], particles.py[i], particles.pz[i]);
+
+        const float frame = lifetime * fps;
+        const uint32_t frameIndex = static_cast<uint32_t>(frame);
+
+        texels[0] = glm::vec4(position, isAlive ? size : -1.f);
+        texels[1] = glm::mix(curves.colorOpacity[k], curves.colorOpacity[k + 1], f);
+        texels[2] = glm::vec4(numFrames - (frameIndex % numFrames) - 1u, 1.f - (frame - frameIndex), 0.f, 0.f);
+
+        minPoint = glm::min(minPoint, isAlive ? position - glm::vec3(size) : glm::vec3(inf));
+        maxPoint = glm::max(maxPoint, isAlive ? position + glm::vec3(size) : glm::vec3(-inf));
+    }
+
+    return utils::BoundingBox(minPoint, maxPoint);
+}
+
+} // namespace
+} // namespace
@@ -0,0 +1,82 @@
+#ifndef PARTICLESIMULATION_H
+#define PARTICLESIMULATION_H
+
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <utils/interpolator.h>
+#include <utils/boundingbox.h>
+#include <utils/random.h>
+
+namespace trash
+{
+namespace core
+{
+
+// Declarative description of a particle system. Curves are keyed by the remaining lifetime in seconds.
+// A particle is accelerated by attractorStrength * normalize(position * attractorScale + attractorOffset) + acceleration.
+struct ParticleSystemDescription
+{
+    uint32_t maxNumParticles = 0u;
+    float numParticlesPerSecond = 0.f;
+    glm::vec2 lifetime = glm::vec2(1.f); // range in seconds
+    glm::vec3 velocity = glm::vec3(0.f);
+    glm::vec3 attractorScale = glm::vec3(0.f);
+    glm::vec3 attractorOffset = glm::vec3(0.f, 1.f, 0.f);
+    float attractorStrength = 0.f;
+    glm::vec3 acceleration = glm::vec3(0.f);
+    utils::LinearInterpolator<glm::vec3> color;
+    utils::LinearInterpolator<float> opacity;
+    utils::LinearInterpolator<float> size;
+};
+
+// Pool of particles stored as structure of arrays. The size is padded to a multiple of 4 to process particles by four.
+// Dead particles have zero lifetime. All particles at and after rangeEnd are dead, dead ones before it are kept in the free list.
+struct Particles
+{
+    std::vector<float> px, py, pz;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> lifetime;
+    std::vector<uint32_t> freeIndices; // sorted in descending order, so the lowest slot is reused first
+    uint32_t capacity = 0u;
+    uint32_t rangeEnd = 0u;
+
+    void resize(uint32_t);
+    uint32_t allocate(uint32_t, std::vector<uint32_t>&);
+    void collect(std::vector<uint32_t>&);
+};
+
+// Curves of a description baked with a uniform step, so they are sampled without searching keys
+struct ParticleCurves
+{
+    ParticleCurves(const ParticleSystemDescription&);
+
+    std::vector<glm::vec4> colorOpacity;
+    std::vector<float> size;
+    float scale; // samples per second
+};
+
+// Scratch arrays of the particles radix sort
+struct ParticleSortBuffers
+{
+    std::vector<float> distances;
+    std::vector<uint16_t> keys, tmpKeys;
+    std::vector<uint32_t> tmpIndices;
+};
+
+void spawnParticles(const ParticleSystemDescription&, const std::vector<uint32_t>&, const glm::vec3*, float, utils::Random&, Particles&);
+void integrateParticles(const ParticleSystemDescription&, float, Particles&, size_t, size_t); // range of particles aligned by 4
+
+// Orders alive particles from back to front by 16 bit quantized distances to the view position
+void sortParticles(const Particles&, const glm::vec3&, std::vector<uint32_t>&, ParticleSortBuffers&);
+
+// Fills 3 texels (position and size, color, frame number) per particle of a range. Returns bounds of alive particles of the range.
+utils::BoundingBox packParticles(const ParticleCurves&, const Particles&, uint32_t, float, glm::vec4*, size_t, size_t);
+
+} // namespace
+} // namespace
+
+#endif // PARTICLESIMULATION_H
@@ -3,7 +3,6 @@
 #include <glm/gtc/color_space.hpp>
 
 #include <utils/random.h>
-#include <utils/interpolator.h>
 
 #include <core/particlesystemnode.h>
 
@@ -17,41 +16,58 @@ namespace trash
 namespace core
 {
 
-class PointEmitter : public ParticleSystemNode::AbstractEmitter
+// Built-in emitters generate positions without a virtual call per particle and use their own random generators
+template <typename Derived, ParticleEmitterType type>
+class BatchEmitter : public ParticleSystemNode::AbstractEmitter, public BuiltInEmitter
 {
 public:
-    glm::vec3 operator()() override { return glm::vec3(0.f); }
+    ParticleEmitterType emitterType() const override { return type; }
+    glm::vec3 operator()() override { return static_cast<Derived&>(*this).generate(); }
+    void emit(uint32_t count, glm::vec3 *positions) override {
+        for (uint32_t i = 0; i < count; ++i)
+            positions[i] = static_cast<Derived&>(*this).generate();
+    }
+
+protected:
+    BatchEmitter() : m_random(utils::nextRandomSeed()) {}
+    utils::Random m_random;
+};
+
+class PointEmitter : public BatchEmitter<PointEmitter, ParticleEmitterType::Point>
+{
+public:
+    glm::vec3 generate() { return glm::vec3(0.f); }
 };
 
-class QuadEmitter : public ParticleSystemNode::AbstractEmitter
+class QuadEmitter : public BatchEmitter<QuadEmitter, ParticleEmitterType::Quad>
 {
 public:
-    glm::vec3 operator()() override { return glm::vec3(utils::random(-.5f, .5f), 0.f, utils::random(-.5f, .5f)); }
+    glm::vec3 generate() { return glm::vec3(m_random(-.5f, .5f), 0.f, m_random(-.5f, .5f)); }
 };
 
-class CircleEmitter : public ParticleSystemNode::AbstractEmitter
+class CircleEmitter : public BatchEmitter<CircleEmitter, ParticleEmitterType::Circle>
 {
 public:
-    glm::vec3 operator()() override {
-        const float a = utils::random(0.0f, glm::two_pi<float>());
-        const float r = .5f * glm::sqrt(utils::random());
+    glm::vec3 generate() {
+        const float a = m_random(0.0f, glm::two_pi<float>());
+        const float r = .5f * glm::sqrt(m_random());
         return glm::vec3(r * glm::cos(a), 0.0f, r * glm::sin(a));
     }
 };
 
-class BoxEmitter : public ParticleSystemNode::AbstractEmitter
+class BoxEmitter : public BatchEmitter<BoxEmitter, ParticleEmitterType::Box>
 {
 public:
-    glm::vec3 operator()() override { return glm::vec3(utils::random(-.5f, .5f), utils::random(-.5f, .5f), utils::random(-.5f, .5f)); }
+    glm::vec3 generate() { return glm::vec3(m_random(-.5f, .5f), m_random(-.5f, .5f), m_random(-.5f, .5f)); }
 };
 
-class SphereEmitter : public ParticleSystemNode::AbstractEmitter
+class SphereEmitter : public BatchEmitter<SphereEmitter, ParticleEmitterType::Sphere>
 {
 public:
-    glm::vec3 operator()() override {
-        const float a = utils::random(0.0f, glm::two_pi<float>());
-        const float b = utils::random(-glm::half_pi<float>(), glm::half_pi<float>());
-        const float r = .5f * glm::sqrt(utils::random());
+    glm::vec3 generate() {
+        const float a = m_random(0.0f, glm::two_pi<float>());
+        const float b = m_random(-glm::half_pi<float>(), glm::half_pi<float>());
+        const float r = .5f * glm::sqrt(m_random());
         return glm::vec3(r * glm::cos(a) * glm::cos(b), r * glm::sin(b), r * glm::sin(a) * glm::cos(b));
     }
 };
@@ -61,41 +77,26 @@ class FireParticleSystemNodePrivate : public ParticleSystemNodePrivate
 public:
     FireParticleSystemNodePrivate(Node& n, std::shared_ptr<ParticleSystemNode::AbstractEmitter> e)
         : ParticleSystemNodePrivate(n, e)
-        , m_opacityInterpolator()
-        , m_color(glm::convertSRGBToLinear(glm::vec3(1.0f, 0.2f, 0.05f)))
     {
         m_particleType = ParticleType::SoftCircle;
         m_blendingType = BlendingType::Additive;
 
-        m_opacityInterpolator.addValue(0.f, 0.f);
-        m_opacityInterpolator.addValue(1.2f, .8f);
-    }
-
-    uint32_t maxNumParticles() const override { return 1700u; }
-    uint32_t numParticlesPerSecond() const override { return 800u; }
+        m_description.maxNumParticles = 1700u;
+        m_description.numParticlesPerSecond = 800.f;
+        m_description.lifetime = glm::vec2(1.25f, 2.5f);
+        m_description.velocity = glm::vec3(0.0f, 1.0f, 0.0f);
+        m_description.attractorScale = glm::vec3(-1.0f, 0.0f, -1.0f);
+        m_description.attractorOffset = glm::vec3(0.0f, 1.0f, 0.0f);
+        m_description.attractorStrength = 0.1f;
 
-    void createParticle(const glm::vec3& /*position*/, glm::vec3& velocity, uint32_t& lifetime) const override {
-        velocity = glm::vec3(0.0f, 1.0f, 0.0f);
-        lifetime = utils::random(0.5f, 1.0f) * 2500u; // [1250..2500]
-    }
+        m_description.color.addValue(0.f, glm::convertSRGBToLinear(glm::vec3(1.0f, 0.2f, 0.05f)));
 
-    void moveParticle(float dtSec, glm::vec3& velocity, glm::vec3& position) const override {
-        const glm::vec3 gravity = glm::normalize(-glm::vec3(position.x, -1.f, position.z)) * 0.1f;
+        m_description.opacity.addValue(0.f, 0.f);
+        m_description.opacity.addValue(1.2f, .8f);
 
-        velocity += dtSec * gravity;
-        position += dtSec * velocity;
+        m_description.size.addValue(0.f, 0.2f);
     }
-
-    void updateParticle(uint32_t lifeTime, glm::vec4& color, float& halfSize) const override {
-        color = glm::vec4(m_color, m_opacityInterpolator.interpolate(lifeTime * .001f));
-        halfSize = 0.2f;
-    }
-
-protected:
-    utils::LinearInterpolator<float> m_opacityInterpolator;
-    const glm::vec3 m_color;
 };
-
 class FireParticleSystemNode : public ParticleSystemNode
 {
 public:
@@ -109,52 +110,31 @@ class SmokeParticleSystemNodePrivate : public ParticleSystemNodePrivate
 public:
     SmokeParticleSystemNodePrivate(Node& n, std::shared_ptr<ParticleSystemNode::AbstractEmitter> e)
         : ParticleSystemNodePrivate(n, e)
-        , m_sizeInterpolator()
-        , m_opacityInterpolator()
-        , m_colorInterpolator()
     {
         m_particleType = ParticleType::Quad;
         m_blendingType = BlendingType::Alpha;
         m_opacityMap = Renderer::instance().loadTexture(smokeOpacityMapName);
         m_opacityMapFps = 6.0f;
 
-        m_sizeInterpolator.addValue(0.0f, 0.65f);
-        m_sizeInterpolator.addValue(3.0f, 0.5f);
-
-        m_opacityInterpolator.addValue(0.0f, 0.0f);
-        m_opacityInterpolator.addValue(2.5f, 0.3f);
-        m_opacityInterpolator.addValue(3.5f, 1.0f);
+        m_description.maxNumParticles = 100u;
+        m_description.numParticlesPerSecond = 20.f;
+        m_description.lifetime = glm::vec2(3.5f, 5.0f);
+        m_description.velocity = glm::vec3(0.0f, 0.7f, 0.0f);
+        m_description.attractorScale = glm::vec3(1.0f, 0.0f, 1.0f);
+        m_description.attractorOffset = glm::vec3(0.0f, 0.8f, 0.0f);
+        m_description.attractorStrength = 0.1f;
 
-        m_colorInterpolator.addValue(0.0f, glm::convertSRGBToLinear(glm::vec3(0.7f)));
-        m_colorInterpolator.addValue(1.5f, glm::convertSRGBToLinear(glm::vec3(0.35f)));
-        m_colorInterpolator.addValue(3.5f, glm::convertSRGBToLinear(glm::vec3(0.15f)));
-    }
+        m_description.size.addValue(0.0f, 0.65f);
+        m_description.size.addValue(3.0f, 0.5f);
 
-    uint32_t maxNumParticles() const override { return 100u; }
-    uint32_t numParticlesPerSecond() const override { return 20u; }
+        m_description.opacity.addValue(0.0f, 0.0f);
+        m_description.opacity.addValue(2.5f, 0.3f);
+        m_description.opacity.addValue(3.5f, 1.0f);
 
-    void createParticle(const glm::vec3& /*position*/, glm::vec3& velocity, uint32_t& lifetime) const override {
-        velocity = glm::vec3(0.0f, 0.7f, 0.0f);
-        lifetime = utils::random(0.7f, 1.0f) * 5000u; //[3500..5000]
+        m_description.color.addValue(0.0f, glm::convertSRGBToLinear(glm::vec3(0.7f)));
+        m_description.color.addValue(1.5f, glm::convertSRGBToLinear(glm::vec3(0.35f)));
+        m_description.color.addValue(3.5f, glm::convertSRGBToLinear(glm::vec3(0.15f)));
     }
-
-    void moveParticle(float dtSec, glm::vec3& velocity, glm::vec3& position) const override {
-        const glm::vec3 gravity = glm::normalize(glm::vec3(position.x, .8f, position.z)) * 0.1f;
-
-        velocity += dtSec * gravity;
-        position += dtSec * velocity;
-    }
-
-    void updateParticle(uint32_t lifeTime, glm::vec4& color, float& halfSize) const override {
-        const float lifeTimeSec = lifeTime * .001f;
-        color = glm::vec4(m_colorInterpolator.interpolate(lifeTimeSec), m_opacityInterpolator.interpolate(lifeTimeSec));
-        halfSize = m_sizeInterpolator.interpolate(lifeTimeSec);
-    }
-
-protected:
-    utils::LinearInterpolator<float> m_sizeInterpolator;
-    utils::LinearInterpolator<float> m_opacityInterpolator;
-    utils::LinearInterpolator<glm::vec3> m_colorInterpolator;
 };
 
 class SmokeParticleSystemNode : public ParticleSystemNode
@@ -194,6 +174,12 @@ ParticleSystemNode::AbstractEmitter::AbstractEmitter()
 {
 }
 
+void ParticleSystemNode::AbstractEmitter::emit(uint32_t count, glm::vec3 *positions)
+{
+    for (uint32_t i = 0; i < count; ++i)
+        positions[i] = (*this)();
+}
+
 ParticleSystemNode::ParticleSystemNode(ParticleSystemNodePrivate *nodePrivate)
     : DrawableNode(nodePrivate)
 {
@@ -1,32 +1,73 @@
 #include <vector>
+#include <algorithm>
+#include <mutex>
 
 #include <glm/vec2.hpp>
 #include <glm/vec4.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/norm.hpp>
 
-#include <utils/random.h>
-
 #include <core/scene.h>
+#include <core/settings.h>
 
 #include "particlesystemnodeprivate.h"
+#include "sceneprivate.h"
 #include "renderer.h"
 #include "drawables.h"
+#include "threadpool.h"
+#include "nodeupdatevisitor.h"
 
 namespace trash
 {
 namespace core
 {
 
+namespace
+{
+
+const size_t numParticlesPerJob = 1024u; // multiple of 4, so ranges are aligned for SIMD
+
+std::shared_ptr<Mesh> createParticleMesh(std::shared_ptr<Mesh> mesh)
+{
+    static std::vector<glm::vec2> texCoords {
+        glm::vec2(0.f, 0.f), glm::vec2(1.f, 0.f), glm::vec2(0.f, 1.f), glm::vec2(1.f, 1.f)
+    };
+
+    static std::vector<uint32_t> indices {0u, 1u, 2u, 3u};
+
+    mesh->declareVertexAttribute(VertexAttribute::TexCoord,
+                                 std::make_shared<VertexBuffer>(texCoords.size(), 2u, glm::value_ptr(*texCoords.data()), GL_STATIC_DRAW));
+    mesh->attachIndexBuffer(std::make_shared<IndexBuffer>(GL_TRIANGLE_STRIP, indices.size(), indices.data(), GL_STATIC_DRAW));
+    mesh->numInstances = 0u;
+
+    return mesh;
+}
+
+} // namespace
+
 ParticleSystemNodePrivate::ParticleSystemNodePrivate(Node& thisNode, std::shared_ptr<ParticleSystemNode::AbstractEmitter> e)
     : DrawableNodePrivate(thisNode)
+    , m_description()
     , m_particleType(ParticleType::SoftCircle)
     , m_blendingType(BlendingType::Additive)
     , m_opacityMap()
     , m_opacityMapFps(16.f)
     , emitter(e)
-    , particlesDataArray()
-    , currentParticlesData(0)
+    , curves()
+    , particles()
+    , newParticlesIndices()
+    , newParticlesPositions()
+    , drawIndices()
+    , drawIndicesData()
+    , particlesTexels()
+    , sortBuffers()
+    , particlesBuffer()
+    , particlesTexture()
+    , gpuParticles()
+    , curvesUniform()
+    , random(utils::nextRandomSeed())
+    , offscreenUpdatePeriod(Settings::instance().readFloat("Renderer.Particles.OffscreenUpdatePeriod", 0.25f))
+    , offscreenTime(0.f)
     , distanceAttenuationState(false)
     , distanceAttenuationValue(1.0f)
     , timeNumberCounter(0.f)
@@ -37,158 +78,194 @@ void ParticleSystemNodePrivate::doUpdate(uint64_t time, uint64_t dt)
 {
     DrawableNodePrivate::doUpdate(time, dt);
 
-    const uint32_t numParticles = maxNumParticles();
-
-    auto& particlesData = particlesDataArray[currentParticlesData];
-
+    // buffers are created on the thread of the renderer, so the first step is made after the update of the scene
     if (!drawable)
     {
-        particlesData.positionSize.resize(numParticles);
-        particlesData.color.resize(numParticles);
-        particlesData.velocity.resize(numParticles);
-        particlesData.lifetime.resize(numParticles);
-        particlesData.frameNumber.resize(numParticles);
-
-        for (size_t i = 0; i < numParticles; ++i)
-            particlesData.lifetime[i] = 0u;
-
-        static std::vector<glm::vec2> texCoords {
-            glm::vec2(0.f, 0.f), glm::vec2(1.f, 0.f), glm::vec2(0.f, 1.f), glm::vec2(1.f, 1.f)
-        };
-
-        static std::vector<uint32_t> indices {0u, 1u, 2u, 3u};
-
-        auto mesh = std::make_shared<Mesh>();
-        mesh->declareVertexAttribute(VertexAttribute::Position,
-                                     std::make_shared<VertexBuffer>(numParticles, decltype(particlesData.positionSize)::value_type::length(), nullptr, GL_DYNAMIC_DRAW),
-                                     1u);
-        mesh->declareVertexAttribute(VertexAttribute::Color,
-                                     std::make_shared<VertexBuffer>(numParticles, decltype(particlesData.color)::value_type::length(), nullptr, GL_DYNAMIC_DRAW),
-                                     1u);
-        mesh->declareVertexAttribute(VertexAttribute::BonesIDs, // frameNumber
-                                     std::make_shared<VertexBuffer>(numParticles, decltype(particlesData.frameNumber)::value_type::length(), nullptr, GL_DYNAMIC_DRAW),
-                                     1u);
-        mesh->declareVertexAttribute(VertexAttribute::TexCoord,
-                                     std::make_shared<VertexBuffer>(texCoords.size(), 2u, glm::value_ptr(*texCoords.data()), GL_STATIC_DRAW));
-        mesh->attachIndexBuffer(std::make_shared<IndexBuffer>(GL_TRIANGLE_STRIP, indices.size(), indices.data(), GL_STATIC_DRAW));
-        mesh->numInstances = numParticles;
-
-        drawable = std::make_shared<ParticleSystemDrawable>(mesh,
-                                                            std::cref(m_particleType),
-                                                            std::cref(m_blendingType),
-                                                            std::cref(distanceAttenuationState),
-                                                            std::cref(distanceAttenuationValue),
-                                                            m_opacityMap);
-        addDrawable(drawable);
+        NodeUpdateCommands::run([this, dt]() {
+            initialize();
+            simulate(dt);
+        });
+        return;
     }
 
-    const float dtSec = dt * 0.001f;
-    const float frameSec = 1.0f / m_opacityMapFps;
+    simulate(dt);
+}
 
-    uint32_t numFrames = 1;
-    if (m_opacityMap)
-        numFrames = m_opacityMap->size[2];
+void ParticleSystemNodePrivate::initialize()
+{
+    curves = std::make_unique<ParticleCurves>(m_description);
 
-    for (size_t i = 0; i < numParticles; ++i)
-    {
-        if (particlesData.lifetime[i] <= dt)
-        {
-            particlesData.lifetime[i] = 0u;
-            particlesData.positionSize[i].w = -1.f;
-        }
-        else
-        {
-            particlesData.lifetime[i] -= dt;
-            particlesData.frameNumber[i] = calcFrameNumber(particlesData.lifetime[i], numFrames, m_opacityMapFps);
+    // there is no sorting on the GPU, so only additive systems can be simulated there
+    auto builtInEmitter = std::dynamic_pointer_cast<BuiltInEmitter>(emitter);
+    if (builtInEmitter && (m_blendingType == BlendingType::Additive) && Settings::instance().readBool("Renderer.Particles.GpuSimulation", false))
+        initializeGpuSimulation(builtInEmitter->emitterType());
+    else
+        initializeCpuSimulation();
 
-            moveParticle(dtSec, particlesData.velocity[i], reinterpret_cast<glm::vec3&>(particlesData.positionSize[i]));
-            updateParticle(particlesData.lifetime[i], particlesData.color[i], particlesData.positionSize[i].w);
+    addDrawable(drawable);
+}
 
+void ParticleSystemNodePrivate::simulate(uint64_t dt)
+{
+    auto* scene = getScene();
+
+    // off-screen systems are simulated rarely with a larger time step and aren't uploaded in between.
+    // A system without particles has an empty box, so it isn't throttled until it has something to be seen.
+    offscreenTime += dt * 0.001f;
+    const auto box = thisNode.globalTransform() * thisNode.boundingBox();
+    if (scene && !box.empty() && !scene->m().cameraFrustum.contain(box) && (offscreenTime < offscreenUpdatePeriod))
+        return;
+
+    const float dtSec = offscreenTime;
+    offscreenTime = 0.f;
+
+    // the GPU simulation reads back queries and queues the step to the renderer
+    if (gpuParticles)
+        NodeUpdateCommands::run([this, dtSec]() { updateGpuSimulation(dtSec); });
+    else
+        updateCpuSimulation(dtSec);
+}
 
-        }
-    }
+void ParticleSystemNodePrivate::initializeCpuSimulation()
+{
+    const uint32_t numParticles = m_description.maxNumParticles;
+
+    particles.resize(numParticles);
+    particlesTexels.resize(3u * numParticles);
+
+    particlesBuffer = std::make_shared<Buffer>(static_cast<GLsizeiptr>(particlesTexels.size() * sizeof(glm::vec4)), nullptr, GL_DYNAMIC_DRAW);
+    particlesTexture = Renderer::instance().createTextureBuffer(GL_RGBA32F, particlesBuffer);
+    particlesTexture->size.x = static_cast<uint32_t>(particlesTexels.size());
+
+    auto mesh = createParticleMesh(std::make_shared<Mesh>());
+    mesh->declareVertexAttribute(VertexAttribute::ParticleIndex,
+                                 std::make_shared<VertexBuffer>(numParticles, 1u, nullptr, GL_DYNAMIC_DRAW),
+                                 1u);
+
+    drawable = std::make_shared<ParticleSystemDrawable>(mesh,
+                                                        std::cref(m_particleType),
+                                                        std::cref(m_blendingType),
+                                                        std::cref(distanceAttenuationState),
+                                                        std::cref(distanceAttenuationValue),
+                                                        m_opacityMap,
+                                                        particlesTexture);
+}
 
-    timeNumberCounter += dtSec;
-    const float newParticleTime = 1.f / numParticlesPerSecond();
-    for (size_t i = 0; (i < numParticles) && (timeNumberCounter >= newParticleTime); ++i)
-        if (particlesData.lifetime[i] == 0u)
-        {
-            particlesData.positionSize[i] = glm::vec4((*emitter)(), 1.0f);
-            createParticle(particlesData.positionSize[i], particlesData.velocity[i], particlesData.lifetime[i]);
+void ParticleSystemNodePrivate::initializeGpuSimulation(ParticleEmitterType emitterType)
+{
+    gpuParticles = std::make_shared<GpuParticles>(m_description.maxNumParticles, emitterType);
 
-            const uint32_t ddt = static_cast<uint32_t>(utils::random() * (dt % particlesData.lifetime[i]) + .5f);
-            particlesData.lifetime[i] -= ddt;
-            particlesData.frameNumber[i] = calcFrameNumber(particlesData.lifetime[i], numFrames, m_opacityMapFps);
+    // particles are drawn by the shader from their lifetimes, so only curves are uploaded
+    const size_t numSamples = curves->size.size();
+    particlesTexels.resize(2u * numSamples);
+    for (size_t i = 0; i < numSamples; ++i)
+    {
+        particlesTexels[2u * i] = curves->colorOpacity[i];
+        particlesTexels[2u * i + 1u] = glm::vec4(curves->size[i], 0.f, 0.f, 0.f);
+    }
 
-            moveParticle(ddt * .001f, particlesData.velocity[i], reinterpret_cast<glm::vec3&>(particlesData.positionSize[i]));
-            updateParticle(particlesData.lifetime[i], particlesData.color[i], particlesData.positionSize[i].w);
+    particlesBuffer = std::make_shared<Buffer>(static_cast<GLsizeiptr>(particlesTexels.size() * sizeof(glm::vec4)), particlesTexels.data(), GL_STATIC_DRAW);
+    particlesTexture = Renderer::instance().createTextureBuffer(GL_RGBA32F, particlesBuffer);
+    particlesTexture->size.x = static_cast<uint32_t>(particlesTexels.size());
+
+    curvesUniform = std::make_shared<Uniform<glm::vec4>>(glm::vec4(curves->scale,
+                                                                   static_cast<float>(numSamples - 1u),
+                                                                   m_opacityMapFps,
+                                                                   static_cast<float>(m_opacityMap ? m_opacityMap->size[2] : 1u)));
+
+    gpuParticles->parameters[1] = glm::vec4(m_description.lifetime, m_description.attractorStrength, 0.f);
+    gpuParticles->parameters[2] = glm::vec4(m_description.velocity, 0.f);
+    gpuParticles->parameters[3] = glm::vec4(m_description.attractorScale, 0.f);
+    gpuParticles->parameters[4] = glm::vec4(m_description.attractorOffset, 0.f);
+    gpuParticles->parameters[5] = glm::vec4(m_description.acceleration, 0.f);
+
+    // positions aren't read back, so the bounds cover the whole way a particle can pass
+    const float maxLifetime = m_description.lifetime.y;
+    const float maxAcceleration = m_description.attractorStrength + glm::length(m_description.acceleration);
+    const float maxSize = *std::max_element(curves->size.begin(), curves->size.end());
+    const float reach = maxLifetime * (glm::length(m_description.velocity) + .5f * maxAcceleration * maxLifetime) + maxSize;
+
+    auto mesh = createParticleMesh(gpuParticles->mesh);
+    mesh->boundingBox = utils::BoundingBox(glm::vec3(-.5f - reach), glm::vec3(.5f + reach));
+    dirtyLocalBoundingBox();
 
-            timeNumberCounter -= newParticleTime;
-        }
+    drawable = std::make_shared<ParticleSystemDrawable>(mesh,
+                                                        std::cref(m_particleType),
+                                                        std::cref(m_blendingType),
+                                                        std::cref(distanceAttenuationState),
+                                                        std::cref(distanceAttenuationValue),
+                                                        m_opacityMap,
+                                                        particlesTexture,
+                                                        curvesUniform,
+                                                        std::make_shared<Uniform<std::reference_wrapper<const float>>>(std::cref(gpuParticles->drawnStep)));
+}
+
+void ParticleSystemNodePrivate::updateCpuSimulation(float dt)
+{
+    auto& threadPool = ThreadPool::instance();
 
+    // slots are disjoint, so ranges of them are processed by the worker threads
+    threadPool.parallelFor(particles.rangeEnd, numParticlesPerJob, [this, dt](size_t begin, size_t end) {
+        integrateParticles(m_description, dt, particles, begin, (end + 3u) & ~size_t(3u));
+    });
+    particles.collect(drawIndices);
 
-    auto& bb = drawable->mesh()->boundingBox;
-    bb = utils::BoundingBox();
+    timeNumberCounter += dt;
+    const uint32_t numNewParticles = static_cast<uint32_t>(timeNumberCounter * m_description.numParticlesPerSecond);
+    if (numNewParticles)
+    {
+        particles.allocate(numNewParticles, newParticlesIndices);
+        newParticlesPositions.resize(newParticlesIndices.size());
+        emitter->emit(static_cast<uint32_t>(newParticlesPositions.size()), newParticlesPositions.data());
+        spawnParticles(m_description, newParticlesIndices, newParticlesPositions.data(), dt, random, particles);
+        drawIndices.insert(drawIndices.end(), newParticlesIndices.begin(), newParticlesIndices.end());
 
-    for (size_t i = 0; i < numParticles; ++i)
-        if (particlesData.lifetime[i] > 0u)
-            bb += utils::BoundingBox::fromCenterHalfSize(reinterpret_cast<glm::vec3&>(particlesData.positionSize[i]), glm::vec3(particlesData.positionSize[i].w));
+        timeNumberCounter -= numNewParticles / m_description.numParticlesPerSecond;
+    }
 
+    const uint32_t numFrames = m_opacityMap ? m_opacityMap->size[2] : 1u;
+    utils::BoundingBox boundingBox;
+    std::mutex boundingBoxMutex;
+    threadPool.parallelFor(particles.rangeEnd, numParticlesPerJob, [&](size_t begin, size_t end) {
+        const auto rangeBoundingBox = packParticles(*curves, particles, numFrames, m_opacityMapFps, particlesTexels.data(), begin, end);
+        std::lock_guard<std::mutex> lock(boundingBoxMutex);
+        boundingBox += rangeBoundingBox;
+    });
+    drawable->mesh()->boundingBox = boundingBox;
     dirtyLocalBoundingBox();
 
-    if (m_blendingType == BlendingType::Alpha)
+    auto* scene = getScene();
+    if ((m_blendingType == BlendingType::Alpha) && scene)
     {
-        auto* scene = getScene();
-        if (scene)
-        {
-            const glm::vec3 viewPosition =
-                    getGlobalTransform().inverted() *
-                    glm::vec3(glm::inverse(scene->viewMatrix()) * glm::vec4(0.f, 0.f, 0.f, 1.f));
-
-            std::vector<std::pair<float, size_t>> dists;
-            dists.reserve(numParticles);
-            for (size_t i = 0; i < numParticles; ++i)
-                dists.push_back(std::make_pair(glm::length2(reinterpret_cast<const glm::vec3&>(particlesData.positionSize[i]) - viewPosition), i));
-
-            static const auto comparator = [](const std::pair<float, size_t>& v1, const std::pair<float, size_t>& v2) {
-                return v1.first > v2.first;
-            };
-            std::sort(dists.begin(), dists.end(), comparator);
-
-            currentParticlesData = 1u - currentParticlesData;
-            auto& copyData = particlesDataArray[currentParticlesData];
-
-            copyData.positionSize.resize(numParticles);
-            copyData.color.resize(numParticles);
-            copyData.velocity.resize(numParticles);
-            copyData.lifetime.resize(numParticles);
-            copyData.frameNumber.resize(numParticles);
-
-            for (size_t i = 0; i < numParticles; ++i)
-            {
-                copyData.positionSize[i] = particlesData.positionSize[dists[i].second];
-                copyData.color[i] = particlesData.color[dists[i].second];
-                copyData.velocity[i] = particlesData.velocity[dists[i].second];
-                copyData.lifetime[i] = particlesData.lifetime[dists[i].second];
-                copyData.frameNumber[i] = particlesData.frameNumber[dists[i].second];
-            }
-        }
+        const glm::vec3 viewPosition =
+                getGlobalTransform().inverted() *
+                glm::vec3(glm::inverse(scene->viewMatrix()) * glm::vec4(0.f, 0.f, 0.f, 1.f));
+        sortParticles(particles, viewPosition, drawIndices, sortBuffers);
     }
 
-    drawable->mesh()->vertexBuffer(VertexAttribute::Position)->setSubData(0u, numParticles * sizeof(decltype(particlesData.positionSize)::value_type), glm::value_ptr(particlesDataArray[currentParticlesData].positionSize[0]));
-    drawable->mesh()->vertexBuffer(VertexAttribute::Color)->setSubData(0u, numParticles * sizeof(decltype(particlesData.color)::value_type), glm::value_ptr(particlesDataArray[currentParticlesData].color[0]));
+    drawIndicesData.assign(drawIndices.begin(), drawIndices.end());
 
-    if (m_opacityMap)
-        drawable->mesh()->vertexBuffer(VertexAttribute::BonesIDs)->setSubData(0u, numParticles * sizeof(decltype(particlesData.frameNumber)::value_type), particlesDataArray[currentParticlesData].frameNumber.data());
+    auto mesh = drawable->mesh();
+    mesh->numInstances = static_cast<uint32_t>(drawIndices.size());
+    if (!drawIndices.empty())
+    {
+        NodeUpdateCommands::run([this, mesh]() {
+            particlesBuffer->streamSubData(0, static_cast<GLsizeiptr>(3u * particles.rangeEnd * sizeof(glm::vec4)), particlesTexels.data());
+            mesh->vertexBuffer(VertexAttribute::ParticleIndex)->streamSubData(0, static_cast<GLsizeiptr>(drawIndicesData.size() * sizeof(float)), drawIndicesData.data());
+        });
+    }
 }
 
-glm::vec2 ParticleSystemNodePrivate::calcFrameNumber(uint32_t lifetime, uint32_t numFrames, float fps)
+void ParticleSystemNodePrivate::updateGpuSimulation(float dt)
 {
-    const float frameNumberFloat = lifetime * .001f * fps;
-    const uint32_t frameNumber = static_cast<uint32_t>(frameNumberFloat);
-    const float coef = frameNumberFloat - frameNumber;
-    return glm::vec2(numFrames - (frameNumber % numFrames) - 1u, 1.f - coef);
+    timeNumberCounter += dt;
+    const uint32_t numRequestedParticles = static_cast<uint32_t>(timeNumberCounter * m_description.numParticlesPerSecond);
+
+    // particles which don't fit the buffer are dropped like on the CPU
+    gpuParticles->prepareStep(dt, numRequestedParticles, random.next());
+    timeNumberCounter -= numRequestedParticles / m_description.numParticlesPerSecond;
 
+    Renderer::instance().queueParticlesSimulation(gpuParticles);
 }
 
 } // namespace
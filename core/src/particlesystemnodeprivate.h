@@ -4,6 +4,8 @@
 #include <core/particlesystemnode.h>
 
 #include "drawablenodeprivate.h"
+#include "particlesimulation.h"
+#include "typesprivate.h"
 
 namespace trash
 {
@@ -11,18 +13,23 @@ namespace core
 {
 
 class ParticleSystemDrawable;
-class Texture;
+struct Buffer;
+struct Texture;
+struct GpuParticles;
+template<typename T> class Uniform;
+
+// Emitters which can be reproduced by the particles simulation shader
+class BuiltInEmitter
+{
+public:
+    virtual ~BuiltInEmitter() = default;
+    virtual ParticleEmitterType emitterType() const = 0;
+};
 
 class ParticleSystemNodePrivate : public DrawableNodePrivate
 {
 protected:
-    virtual uint32_t maxNumParticles() const = 0;
-    virtual uint32_t numParticlesPerSecond() const = 0;
-
-    virtual void createParticle(const glm::vec3& position, glm::vec3& velocity, uint32_t& lifetime) const = 0;
-    virtual void moveParticle(float dtSec, glm::vec3& velocity, glm::vec3& position) const = 0;
-    virtual void updateParticle(uint32_t lifeTime, glm::vec4& color, float& halfSize) const = 0;
-
+    ParticleSystemDescription m_description;
     ParticleType m_particleType;
     BlendingType m_blendingType;
     std::shared_ptr<Texture> m_opacityMap;
@@ -32,28 +39,35 @@ protected:
     ParticleSystemNodePrivate(Node&, std::shared_ptr<ParticleSystemNode::AbstractEmitter>);
 
 public:
-    struct ParticlesData
-    {
-        std::vector<glm::vec4> positionSize;
-        std::vector<glm::vec4> color;
-        std::vector<glm::vec3> velocity;
-        std::vector<uint32_t> lifetime;
-        std::vector<glm::vec2> frameNumber;
-    };
-
     void doUpdate(uint64_t, uint64_t) override;
 
+    void initialize();
+    void simulate(uint64_t);
+    void initializeCpuSimulation();
+    void initializeGpuSimulation(ParticleEmitterType);
+    void updateCpuSimulation(float);
+    void updateGpuSimulation(float);
+
     std::shared_ptr<ParticleSystemNode::AbstractEmitter> emitter;
     std::shared_ptr<ParticleSystemDrawable> drawable;
-    std::array<ParticlesData, 2u> particlesDataArray;
-    uint8_t currentParticlesData;
+    std::unique_ptr<ParticleCurves> curves;
+    Particles particles;
+    std::vector<uint32_t> newParticlesIndices;
+    std::vector<glm::vec3> newParticlesPositions;
+    std::vector<uint32_t> drawIndices;
+    std::vector<float> drawIndicesData;
+    std::vector<glm::vec4> particlesTexels;
+    ParticleSortBuffers sortBuffers;
+    std::shared_ptr<Buffer> particlesBuffer;
+    std::shared_ptr<Texture> particlesTexture;
+    std::shared_ptr<GpuParticles> gpuParticles; // set if additive particles of a built-in emitter are simulated on the GPU
+    std::shared_ptr<Uniform<glm::vec4>> curvesUniform;
+    utils::Random random;
+    float offscreenUpdatePeriod;
+    float offscreenTime; // time elapsed since the last update while the system is off-screen
     bool distanceAttenuationState;
     float distanceAttenuationValue;
     float timeNumberCounter;
-
-private:
-    static glm::vec2 calcFrameNumber(uint32_t, uint32_t, float);
-
 };
 
 } // namespace
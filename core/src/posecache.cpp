@@ -0,0 +1,93 @@
+#include "posecache.h"
+#include "renderer.h"
+
+namespace trash
+{
+namespace core
+{
+
+PoseCache::PoseCache(float step, uint32_t maxUnusedFrames)
+    : m_step(step)
+    , m_maxUnusedFrames(maxUnusedFrames)
+    , m_frameNumber(0)
+    , m_numHits(0)
+    , m_numMisses(0)
+    , m_numEvaluations(0)
+    , m_evaluationTime(0.0)
+{
+}
+
+void PoseCache::beginFrame()
+{
+    ++m_frameNumber;
+
+    for (auto it = m_entries.begin(); it != m_entries.end(); )
+    {
+        if (it->second.lastUsedFrame + m_maxUnusedFrames >= m_frameNumber)
+        {
+            ++it;
+            continue;
+        }
+
+        // a range can still be bound to a model which is not animated anymore, so it is recycled only if nobody uses it
+        if (it->second.bonesBuffer.use_count() == 1)
+            m_freeBuffers[it->first.model].push_back(it->second.bonesBuffer);
+
+        it = m_entries.erase(it);
+    }
+}
+
+std::shared_ptr<BonesPaletteRange> PoseCache::find(const SharedPoseKey& key)
+{
+    auto it = m_entries.find(key);
+    if (it == m_entries.end())
+        return nullptr;
+
+    ++m_numHits;
+    it->second.lastUsedFrame = m_frameNumber;
+    return it->second.bonesBuffer;
+}
+
+std::shared_ptr<BonesPaletteRange> PoseCache::insert(const SharedPoseKey& key, uint32_t numBones)
+{
+    ++m_numMisses;
+
+    std::shared_ptr<BonesPaletteRange> bonesBuffer;
+
+    auto& freeBuffers = m_freeBuffers[key.model];
+    if (!freeBuffers.empty() && (freeBuffers.back()->skinningType == key.skinningType))
+    {
+        bonesBuffer = freeBuffers.back();
+        freeBuffers.pop_back();
+    }
+    else
+        bonesBuffer = std::make_shared<BonesPaletteRange>(numBones, key.skinningType);
+
+    m_entries[key] = { bonesBuffer, m_frameNumber };
+    return bonesBuffer;
+}
+
+void PoseCache::erase(const SharedPoseKey& key)
+{
+    m_entries.erase(key);
+}
+
+void PoseCache::addEvaluationTime(uint32_t numEvaluations, double time)
+{
+    m_numEvaluations += numEvaluations;
+    m_evaluationTime += time;
+}
+
+float PoseCache::hitRate() const
+{
+    const uint64_t numRequests = m_numHits + m_numMisses;
+    return numRequests ? static_cast<float>(m_numHits) / static_cast<float>(numRequests) : 0.0f;
+}
+
+double PoseCache::savedEvaluationTime() const
+{
+    return m_numEvaluations ? m_evaluationTime / static_cast<double>(m_numEvaluations) * static_cast<double>(m_numHits) : 0.0;
+}
+
+} // namespace
+} // namespace
@@ -0,0 +1,61 @@
+#ifndef POSECACHE_H
+#define POSECACHE_H
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+#include <utils/noncopyble.h>
+
+#include "animationgraph.h"
+
+namespace trash
+{
+namespace core
+{
+
+struct BonesPaletteRange;
+
+// Bones palette ranges of poses shared by instances of the same model playing the same clip at the same quantized time
+class PoseCache
+{
+    NONCOPYBLE(PoseCache)
+
+public:
+    PoseCache(float, uint32_t);
+
+    bool isEnabled() const { return m_step > 0.0f; }
+    float step() const { return m_step; }
+
+    void beginFrame();
+    std::shared_ptr<BonesPaletteRange> find(const SharedPoseKey&);
+    std::shared_ptr<BonesPaletteRange> insert(const SharedPoseKey&, uint32_t);
+    void erase(const SharedPoseKey&);
+
+    void addEvaluationTime(uint32_t, double);
+
+    // shown by the statistics overlay
+    float hitRate() const;
+    double savedEvaluationTime() const; // ms estimated to be saved by the cache hits
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<BonesPaletteRange> bonesBuffer;
+        uint64_t lastUsedFrame;
+    };
+
+    std::unordered_map<SharedPoseKey, Entry, SharedPoseKeyHash> m_entries;
+    std::unordered_map<const Model*, std::vector<std::shared_ptr<BonesPaletteRange>>> m_freeBuffers;
+    float m_step;
+    uint32_t m_maxUnusedFrames;
+    uint64_t m_frameNumber;
+
+    uint64_t m_numHits, m_numMisses, m_numEvaluations;
+    double m_evaluationTime;
+};
+
+} // namespace
+} // namespace
+
+#endif // POSECACHE_H
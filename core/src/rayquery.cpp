@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <numeric>
+#include <limits>
+
+#include <glm/common.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/matrix.hpp>
+
+#include <utils/boundingbox.h>
+#include <utils/transform.h>
+#include <utils/ray.h>
+
+#include <core/rayquery.h>
+#include <core/node.h>
+#include <core/drawablenode.h>
+#include <core/nodevisitor.h>
+
+#include "drawablenodeprivate.h"
+#include "drawables.h"
+#include "renderer.h"
+#include "meshbvh.h"
+#include "threadpool.h"
+
+namespace trash
+{
+namespace core
+{
+
+namespace
+{
+
+const uint32_t maxLeafSize = 2u;
+const uint32_t packetSize = 16u;
+const size_t minNumRaysForWorkers = 1024u; // smaller batches are traced by the calling thread only
+
+uint32_t expandBits(uint32_t v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+}
+
+class RayQueryPrivate
+{
+public:
+    struct Instance
+    {
+        glm::mat4x4 worldToLocal;
+        std::shared_ptr<MeshBvh> bvh; // nullptr if the node is intersected by its bounding box
+        utils::BoundingBox localBox;
+    };
+
+    struct TreeNode
+    {
+        glm::vec3 minPoint;
+        uint32_t next;
+        glm::vec3 maxPoint;
+        uint32_t firstInstance;
+        uint32_t numInstances; // 0 for inner nodes, their children follow them
+    };
+
+    RayQueryPrivate(std::shared_ptr<Node> n) : rootNode(n) {}
+
+    void build(std::vector<Instance>&, std::vector<utils::BoundingBox>&, uint32_t, uint32_t);
+    void sortRays(size_t, const utils::Ray*, std::vector<uint32_t>&) const;
+
+    template <bool anyHit>
+    void trace(size_t, const utils::Ray*, const float*, float*, bool*) const;
+
+    template <bool anyHit>
+    void tracePacket(const utils::Ray*, const uint32_t*, uint32_t, float*, bool*) const;
+
+    template <bool anyHit>
+    bool intersectInstance(const Instance&, const utils::Ray&, float&) const;
+
+    std::shared_ptr<Node> rootNode;
+    std::vector<Instance> instances;
+    std::vector<TreeNode> nodes;
+};
+
+void RayQueryPrivate::build(std::vector<Instance>& sourceInstances, std::vector<utils::BoundingBox>& boxes, uint32_t begin, uint32_t end)
+{
+    const auto nodeIndex = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(TreeNode());
+
+    utils::BoundingBox box, centersBox;
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        box += boxes[i];
+        centersBox += utils::BoundingBox(boxes[i].center(), boxes[i].center());
+    }
+    nodes[nodeIndex].minPoint = box.minPoint;
+    nodes[nodeIndex].maxPoint = box.maxPoint;
+
+    if (end - begin > maxLeafSize)
+    {
+        // the scene has few instances, so the median split along the longest axis is good enough
+        const glm::vec3 extent = centersBox.maxPoint - centersBox.minPoint;
+        const int32_t axis = (extent.x > extent.y) ? ((extent.x > extent.z) ? 0 : 2) : ((extent.y > extent.z) ? 1 : 2);
+
+        std::vector<uint32_t> order(end - begin);
+        std::iota(order.begin(), order.end(), begin);
+        const auto middle = order.begin() + static_cast<std::ptrdiff_t>(order.size() / 2u);
+        std::nth_element(order.begin(), middle, order.end(), [&boxes, axis](uint32_t a, uint32_t b) {
+            return boxes[a].center()[axis] < boxes[b].center()[axis];
+        });
+
+        std::vector<Instance> orderedInstances;
+        std::vector<utils::BoundingBox> orderedBoxes;
+        orderedInstances.reserve(order.size());
+        orderedBoxes.reserve(order.size());
+        for (auto i : order)
+        {
+            orderedInstances.push_back(sourceInstances[i]);
+            orderedBoxes.push_back(boxes[i]);
+        }
+        std::copy(orderedInstances.begin(), orderedInstances.end(), sourceInstances.begin() + begin);
+        std::copy(orderedBoxes.begin(), orderedBoxes.end(), boxes.begin() + begin);
+
+        const uint32_t middleIndex = begin + (end - begin) / 2u;
+        build(sourceInstances, boxes, begin, middleIndex);
+        build(sourceInstances, boxes, middleIndex, end);
+        nodes[nodeIndex].next = static_cast<uint32_t>(nodes.size());
+        return;
+    }
+
+    nodes[nodeIndex].next = nodeIndex + 1u;
+    nodes[nodeIndex].firstInstance = static_cast<uint32_t>(instances.size());
+    nodes[nodeIndex].numInstances = end - begin;
+    instances.insert(instances.end(), sourceInstances.begin() + begin, sourceInstances.begin() + end);
+}
+
+void RayQueryPrivate::sortRays(size_t numRays, const utils::Ray *rays, std::vector<uint32_t>& order) const
+{
+    order.resize(numRays);
+    std::iota(order.begin(), order.end(), 0u);
+
+    if (numRays <= packetSize)
+        return;
+
+    utils::BoundingBox originsBox;
+    for (size_t i = 0; i < numRays; ++i)
+        originsBox += utils::BoundingBox(rays[i].pos, rays[i].pos);
+    const glm::vec3 scale = 1023.f / glm::max(originsBox.maxPoint - originsBox.minPoint, glm::vec3(1e-6f));
+
+    // rays are grouped by the octant of direction first and by the Morton code of origin then
+    std::vector<uint64_t> keys(numRays);
+    for (size_t i = 0; i < numRays; ++i)
+    {
+        const glm::uvec3 cell = glm::uvec3((rays[i].pos - originsBox.minPoint) * scale);
+        const uint64_t octant = (rays[i].dir.x < 0.f ? 1u : 0u) | (rays[i].dir.y < 0.f ? 2u : 0u) | (rays[i].dir.z < 0.f ? 4u : 0u);
+        keys[i] = (octant << 30u) | (expandBits(cell.x) << 2u) | (expandBits(cell.y) << 1u) | expandBits(cell.z);
+    }
+
+    std::sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+}
+
+template <bool anyHit>
+void RayQueryPrivate::trace(size_t numRays, const utils::Ray *rays, const float *maxDistances, float *distances, bool *hits) const
+{
+    for (size_t i = 0; i < numRays; ++i)
+    {
+        distances[i] = maxDistances[i];
+        if (anyHit)
+            hits[i] = false;
+    }
+
+    if (nodes.empty() || !numRays)
+        return;
+
+    std::vector<uint32_t> order;
+    sortRays(numRays, rays, order);
+
+    const size_t numPackets = (numRays + packetSize - 1u) / packetSize;
+    auto tracePacketFunc = [this, numRays, rays, &order, distances, hits](size_t packet) {
+        const size_t begin = packet * packetSize;
+        tracePacket<anyHit>(rays, order.data() + begin, static_cast<uint32_t>(glm::min(numRays - begin, size_t(packetSize))), distances, hits);
+    };
+
+    if (numRays < minNumRaysForWorkers)
+    {
+        for (size_t packet = 0; packet < numPackets; ++packet)
+            tracePacketFunc(packet);
+    }
+    else
+    {
+        ThreadPool::instance().parallelFor(numPackets, tracePacketFunc);
+    }
+}
+
+template <bool anyHit>
+void RayQueryPrivate::tracePacket(const utils::Ray *rays, const uint32_t *indices, uint32_t count, float *distances, bool *hits) const
+{
+    glm::vec3 invDirs[packetSize];
+    for (uint32_t lane = 0; lane < count; ++lane)
+        invDirs[lane] = 1.f / rays[indices[lane]].dir;
+
+    uint32_t activeMask = (1u << count) - 1u;
+    const auto numNodes = static_cast<uint32_t>(nodes.size());
+
+    for (uint32_t i = 0; (i < numNodes) && activeMask; )
+    {
+        const TreeNode& node = nodes[i];
+
+        uint32_t nodeMask = 0u;
+        for (uint32_t lane = 0; lane < count; ++lane)
+        {
+            if (!(activeMask & (1u << lane)))
+                continue;
+
+            const utils::Ray& ray = rays[indices[lane]];
+            const glm::vec3 t0 = (node.minPoint - ray.pos) * invDirs[lane];
+            const glm::vec3 t1 = (node.maxPoint - ray.pos) * invDirs[lane];
+            const glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+            const float tEnter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.f));
+            const float tExit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, distances[indices[lane]]));
+            if (tEnter <= tExit)
+                nodeMask |= 1u << lane;
+        }
+
+        if (!nodeMask)
+        {
+            i = node.next;
+            continue;
+        }
+
+        if (!node.numInstances)
+        {
+            ++i;
+            continue;
+        }
+
+        for (uint32_t k = node.firstInstance; k < node.firstInstance + node.numInstances; ++k)
+        {
+            for (uint32_t lane = 0; lane < count; ++lane)
+            {
+                if (!(nodeMask & activeMask & (1u << lane)))
+                    continue;
+
+                const uint32_t rayIndex = indices[lane];
+                if (intersectInstance<anyHit>(instances[k], rays[rayIndex], distances[rayIndex]) && anyHit)
+                {
+                    hits[rayIndex] = true;
+                    activeMask &= ~(1u << lane);
+                }
+            }
+        }
+
+        i = node.next;
+    }
+}
+
+template <bool anyHit>
+bool RayQueryPrivate::intersectInstance(const Instance& instance, const utils::Ray& ray, float& t) const
+{
+    utils::Ray localRay(glm::vec3(instance.worldToLocal * glm::vec4(ray.pos, 1.f)), ray.dir);
+    localRay.dir = glm::mat3x3(instance.worldToLocal) * ray.dir; // not normalized, so distances along the ray stay in world units
+
+    if (!instance.bvh)
+    {
+        float t0;
+        if (!localRay.intersect(instance.localBox, &t0) || (glm::max(t0, 0.f) >= t))
+            return false;
+
+        t = glm::max(t0, 0.f);
+        return true;
+    }
+
+    if (anyHit)
+        return instance.bvh->occluded(localRay, t);
+
+    return instance.bvh->intersect(localRay, t, t);
+}
+
+RayQuery::RayQuery(std::shared_ptr<Node> node)
+    : m_(std::make_unique<RayQueryPrivate>(node))
+{
+    rebuild();
+}
+
+RayQuery::~RayQuery()
+{
+}
+
+void RayQuery::rebuild()
+{
+    m_->instances.clear();
+    m_->nodes.clear();
+
+    std::vector<RayQueryPrivate::Instance> instances;
+    std::vector<utils::BoundingBox> boxes;
+
+    NodeSimpleVisitor nv([&instances, &boxes](std::shared_ptr<Node> node) {
+        auto drawableNode = std::dynamic_pointer_cast<DrawableNode>(node);
+        if (!drawableNode)
+            return;
+
+        const auto intersectionMode = drawableNode->intersectionMode();
+        if (intersectionMode == IntersectionMode::None)
+            return;
+
+        const utils::Transform& transform = node->globalTransform();
+        const glm::mat4x4 worldToLocal = glm::inverse(glm::mat4x4(transform));
+
+        if (intersectionMode == IntersectionMode::UseBoundingBox)
+        {
+            const auto& box = drawableNode->m().getLocalBoundingBox();
+            if (!box.empty())
+            {
+                instances.push_back({worldToLocal, nullptr, box});
+                boxes.push_back(transform * box);
+            }
+            return;
+        }
+
+        for (auto drawable : drawableNode->m().drawables)
+        {
+            auto mesh = drawable->mesh();
+            if (!mesh || mesh->boundingBox.empty())
+                continue;
+
+            // build here once, so the queries do not race for it
+            if (!mesh->bvh)
+                mesh->recalcBvh();
+
+            instances.push_back({worldToLocal, mesh->bvh, mesh->boundingBox});
+            boxes.push_back(transform * mesh->boundingBox);
+        }
+    });
+    m_->rootNode->accept(nv);
+
+    if (instances.empty())
+        return;
+
+    m_->instances.reserve(instances.size());
+    m_->nodes.reserve(2u * instances.size());
+    m_->build(instances, boxes, 0u, static_cast<uint32_t>(instances.size()));
+}
+
+size_t RayQuery::numInstances() const
+{
+    return m_->instances.size();
+}
+
+void RayQuery::intersect(size_t numRays, const utils::Ray *rays, const float *maxDistances, float *distances) const
+{
+    m_->trace<false>(numRays, rays, maxDistances, distances, nullptr);
+}
+
+void RayQuery::occluded(size_t numRays, const utils::Ray *rays, const float *maxDistances, bool *hits) const
+{
+    std::vector<float> distances(numRays);
+    m_->trace<true>(numRays, rays, maxDistances, distances.data(), hits);
+}
+
+} // namespace
+} // namespace
@@ -1,8 +1,12 @@
 #include <array>
+#include <algorithm>
 #include <functional>
+#include <chrono>
+#include <cstring>
 
 #include <QtGui/QOpenGLExtraFunctions>
 #include <QtGui/QOpenGLFramebufferObject>
+#include <QtGui/QOpenGLTimerQuery>
 #include <QtCore/QFile>
 
 #include <glm/gtc/type_ptr.hpp>
@@ -20,8 +24,10 @@
 #include "renderer.h"
 #include "resourcestorage.h"
 #include "drawables.h"
+#include "meshbvh.h"
 #include "resources.h"
 #include "importexport.h"
+#include "threadpool.h"
 #include "utils.h"
 #include "model.inl"
 #include "texture.inl"
@@ -40,6 +46,57 @@ AbstractUniform::~AbstractUniform()
 RenderProgram::RenderProgram(GLuint id_)
     : id(id_)
 {
+    collectUniforms();
+}
+
+RenderProgram::~RenderProgram()
+{
+    auto& functions = Renderer::instance().functions();
+
+    GLuint shaders[3];
+    GLsizei count = 0;
+    functions.glGetAttachedShaders(id, 3, &count, shaders);
+    for (GLsizei i = 0; i < count; ++i)
+    {
+        functions.glDetachShader(id, shaders[i]);
+        functions.glDeleteShader(shaders[i]);
+    }
+    functions.glDeleteProgram(id);
+}
+
+void RenderProgram::setupTransformFeedback(const std::vector<std::string>& varyings, GLenum mode)
+{
+    std::vector<const char*> names;
+    names.reserve(varyings.size());
+    for (const auto& varying : varyings)
+        names.push_back(varying.c_str());
+
+    auto& functions = Renderer::instance().functions();
+
+    functions.glTransformFeedbackVaryings(id, static_cast<GLsizei>(names.size()), names.data(), mode);
+    functions.glLinkProgram(id);
+
+    GLint linked;
+    functions.glGetProgramiv(id, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        GLint infoLen = 0;
+        functions.glGetProgramiv(id, GL_INFO_LOG_LENGTH, &infoLen);
+        if(infoLen > 1) {
+            char *infoLog = static_cast<char*>(malloc(sizeof(char) * static_cast<unsigned int>(infoLen)));
+            functions.glGetProgramInfoLog(id, infoLen, nullptr, infoLog);
+            std::cout << "Transform feedback link: " << infoLog << std::endl;
+            free(infoLog);
+        }
+    }
+
+    // relinking may change the locations of uniforms
+    collectUniforms();
+}
+
+void RenderProgram::collectUniforms()
+{
+    uniforms.clear();
+
     auto& functions = Renderer::instance().functions();
 
     GLint numActiveUniforms, uniformMaxLength;
@@ -78,46 +135,6 @@ RenderProgram::RenderProgram(GLuint id_)
     free(name);
 }
 
-RenderProgram::~RenderProgram()
-{
-    auto& functions = Renderer::instance().functions();
-
-    GLuint shaders[2];
-    GLsizei count = 0;
-    functions.glGetAttachedShaders(id, 2, &count, shaders);
-    functions.glDetachShader(id, shaders[0]);
-    functions.glDeleteShader(shaders[0]);
-    functions.glDetachShader(id, shaders[1]);
-    functions.glDeleteShader(shaders[1]);
-    functions.glDeleteProgram(id);
-}
-
-void RenderProgram::setupTransformFeedback(const std::vector<std::string>& varyings, GLenum mode)
-{
-    std::vector<const char*> names;
-    names.reserve(varyings.size());
-    for (const auto& varying : varyings)
-        names.push_back(varying.c_str());
-
-    auto& functions = Renderer::instance().functions();
-
-    functions.glTransformFeedbackVaryings(id, static_cast<GLsizei>(names.size()), names.data(), mode);
-    functions.glLinkProgram(id);
-
-    GLint linked;
-    functions.glGetProgramiv(id, GL_LINK_STATUS, &linked);
-    if (!linked) {
-        GLint infoLen = 0;
-        functions.glGetProgramiv(id, GL_INFO_LOG_LENGTH, &infoLen);
-        if(infoLen > 1) {
-            char *infoLog = static_cast<char*>(malloc(sizeof(char) * static_cast<unsigned int>(infoLen)));
-            functions.glGetProgramInfoLog(id, infoLen, nullptr, infoLog);
-            std::cout << "Transform feedback link: " << infoLog << std::endl;
-            free(infoLog);
-        }
-    }
-}
-
 UniformId RenderProgram::uniformIdByName(const std::string& name)
 {
     static const std::map<std::string, UniformId> s_names {
@@ -144,7 +161,8 @@ UniformId RenderProgram::uniformIdByName(const std::string& name)
         { "u_brdfLUT", UniformId::BrdfLutMap },
         { "u_IBLContribution", UniformId::IBLContribution },
         { "u_shadowMaps", UniformId::ShadowMaps },
-        { "u_bonesBuffer", UniformId::BonesBuffer },
+        { "u_bonesPalette", UniformId::BonesPalette },
+        { "u_bonesOffset", UniformId::BonesOffset },
         { "u_lightsBuffer", UniformId::LightsBuffer },
         { "u_ssaoSamplesBuffer", UniformId::SSAOSamplesBuffer },
         { "u_blurKernelBuffer", UniformId::BlurKernelBuffer },
@@ -170,7 +188,11 @@ UniformId RenderProgram::uniformIdByName(const std::string& name)
         { "u_combineSourceMap1", UniformId::CombineSourceMap1 },
         { "u_combineLevel0", UniformId::CombineLevel0 },
         { "u_combineLevel1", UniformId::CombineLevel1 },
-        { "u_particleDistanceAttenuation", UniformId::ParticleDistanceAttenuation }
+        { "u_particleDistanceAttenuation", UniformId::ParticleDistanceAttenuation },
+        { "u_particlesData", UniformId::ParticlesData },
+        { "u_particleCurves", UniformId::ParticleCurves },
+        { "u_particleStep", UniformId::ParticleStep },
+        { "u_particleSimulation[0]", UniformId::ParticleSimulation }
     };
 
     auto it = s_names.find(name);
@@ -341,6 +363,17 @@ void Buffer::setSubData(GLintptr offset, GLsizeiptr size, const void* data)
     m_cpuDataIsDirty = true;
 }
 
+void Buffer::streamSubData(GLintptr offset, GLsizeiptr size, const void* data)
+{
+    const auto range = Renderer::instance().streamBuffer().write(data, size);
+
+    auto& functions = Renderer::instance().functions();
+    functions.glBindBuffer(GL_COPY_READ_BUFFER, range.buffer->id);
+    functions.glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+    functions.glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, range.offset, offset, size);
+    m_cpuDataIsDirty = true;
+}
+
 void *Buffer::map(GLintptr offset, GLsizeiptr size, GLbitfield access)
 {
     auto& functions = Renderer::instance().functions();
@@ -379,6 +412,189 @@ void Buffer::clearCpuData()
     m_cpuDataIsDirty = true;
 }
 
+StreamBuffer::StreamBuffer(GLsizeiptr initialRegionSize)
+    : m_regionIndex(0u)
+    , m_regionSize(0)
+    , m_head(0)
+    , m_alignment(16)
+    , m_numWrittenBytes(0u)
+    , m_numStalls(0u)
+    , m_stallTime(0.0)
+{
+    m_fences.fill(nullptr);
+
+    GLint uniformBufferOffsetAlignment = 0;
+    Renderer::instance().functions().glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformBufferOffsetAlignment);
+    m_alignment = glm::max(m_alignment, static_cast<GLintptr>(uniformBufferOffsetAlignment));
+
+    reserve(glm::max(initialRegionSize, static_cast<GLsizeiptr>(m_alignment)));
+}
+
+StreamBuffer::~StreamBuffer()
+{
+    auto& functions = Renderer::instance().functions();
+    for (auto fence : m_fences)
+        if (fence)
+            functions.glDeleteSync(fence);
+}
+
+void StreamBuffer::nextFrame()
+{
+    auto& functions = Renderer::instance().functions();
+
+    if (m_fences[m_regionIndex])
+        functions.glDeleteSync(m_fences[m_regionIndex]);
+    m_fences[m_regionIndex] = functions.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    m_regionIndex = (m_regionIndex + 1u) % s_numRegions;
+    m_head = 0;
+    m_numWrittenBytes = 0u;
+    m_numStalls = 0u;
+    m_stallTime = 0.0;
+
+    // the region was written 3 frames ago, so the GPU is expected to be done with it
+    auto& fence = m_fences[m_regionIndex];
+    if (fence)
+    {
+        if (functions.glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            const auto startTime = std::chrono::steady_clock::now();
+
+            GLenum status;
+            do
+                status = functions.glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000u);
+            while (status == GL_TIMEOUT_EXPIRED);
+
+            m_stallTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+            ++m_numStalls;
+        }
+
+        functions.glDeleteSync(fence);
+        fence = nullptr;
+    }
+}
+
+void *StreamBuffer::map(GLsizeiptr size, StreamRange& range)
+{
+    GLsizeiptr offset = (m_head + m_alignment - 1) / m_alignment * m_alignment;
+    if (offset + size > m_regionSize)
+    {
+        GLsizeiptr newRegionSize = m_regionSize;
+        while (newRegionSize < size)
+            newRegionSize *= 2;
+        reserve(2 * newRegionSize);
+        offset = 0;
+    }
+
+    m_head = offset + size;
+    m_numWrittenBytes += static_cast<uint64_t>(size);
+
+    range.buffer = m_buffer;
+    range.offset = static_cast<GLintptr>(m_regionIndex) * m_regionSize + offset;
+    range.size = size;
+
+    return m_buffer->map(range.offset, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+StreamRange StreamBuffer::write(const void *data, GLsizeiptr size)
+{
+    // an empty range has no buffer, so it's bound as no buffer at all
+    StreamRange range;
+    if (size <= 0)
+        return range;
+
+    std::memcpy(map(size, range), data, static_cast<size_t>(size));
+    Buffer::unmap();
+    return range;
+}
+
+void StreamBuffer::reserve(GLsizeiptr newRegionSize)
+{
+    // ranges of the previous buffer keep it alive until they are drawn, the new one isn't used by the GPU yet
+    auto& functions = Renderer::instance().functions();
+    for (auto& fence : m_fences)
+        if (fence)
+        {
+            functions.glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+    m_regionSize = (newRegionSize + m_alignment - 1) / m_alignment * m_alignment;
+    m_buffer = std::make_shared<Buffer>(static_cast<GLsizeiptr>(s_numRegions) * m_regionSize, nullptr, GL_STREAM_DRAW);
+    m_head = 0;
+}
+
+PickBuffer::PickBuffer(GLsizei maxRegionSize)
+    : m_framebuffer(std::make_shared<Framebuffer>())
+    , m_fence(nullptr)
+    , m_maxRegionSize(maxRegionSize)
+    , m_regionSize(0)
+{
+    m_framebuffer->attachColor(0, std::make_shared<Renderbuffer>(GL_R32UI, maxRegionSize, maxRegionSize));
+    m_framebuffer->attachDepth(std::make_shared<Renderbuffer>(GL_DEPTH_COMPONENT32, maxRegionSize, maxRegionSize));
+
+    // ids of the region are followed by its depths
+    const auto numPixels = static_cast<GLsizeiptr>(maxRegionSize * maxRegionSize);
+    m_pixelBuffer = std::make_shared<Buffer>(numPixels * static_cast<GLsizeiptr>(sizeof(GLuint) + sizeof(GLfloat)), nullptr, GL_STREAM_READ);
+}
+
+PickBuffer::~PickBuffer()
+{
+    if (m_fence)
+        Renderer::instance().functions().glDeleteSync(m_fence);
+}
+
+void PickBuffer::readback(GLsizei regionSize)
+{
+    auto& functions = Renderer::instance().functions();
+
+    m_regionSize = glm::min(regionSize, m_maxRegionSize);
+    const auto idsSize = static_cast<size_t>(m_regionSize * m_regionSize) * sizeof(GLuint);
+
+    functions.glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer->id);
+    functions.glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pixelBuffer->id);
+    functions.glReadBuffer(GL_COLOR_ATTACHMENT0);
+    functions.glReadPixels(0, 0, m_regionSize, m_regionSize, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    functions.glReadPixels(0, 0, m_regionSize, m_regionSize, GL_DEPTH_COMPONENT, GL_FLOAT, reinterpret_cast<GLvoid*>(idsSize));
+    functions.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // a newer pick replaces the one still in flight
+    if (m_fence)
+        functions.glDeleteSync(m_fence);
+    m_fence = functions.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool PickBuffer::fetch(std::vector<uint32_t>& ids, std::vector<float>& depths, bool wait)
+{
+    if (!m_fence)
+        return false;
+
+    auto& functions = Renderer::instance().functions();
+    if (wait)
+    {
+        GLenum status;
+        do
+            status = functions.glClientWaitSync(m_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000u);
+        while (status == GL_TIMEOUT_EXPIRED);
+    }
+    else if (functions.glClientWaitSync(m_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+        return false;
+
+    functions.glDeleteSync(m_fence);
+    m_fence = nullptr;
+
+    const auto numPixels = static_cast<size_t>(m_regionSize * m_regionSize);
+    ids.resize(numPixels);
+    depths.resize(numPixels);
+
+    const auto data = static_cast<const uint8_t*>(m_pixelBuffer->map(0, static_cast<GLsizeiptr>(numPixels * (sizeof(GLuint) + sizeof(GLfloat))), GL_MAP_READ_BIT));
+    std::memcpy(ids.data(), data, numPixels * sizeof(GLuint));
+    std::memcpy(depths.data(), data + numPixels * sizeof(GLuint), numPixels * sizeof(GLfloat));
+    Buffer::unmap();
+
+    return true;
+}
+
 VertexBuffer::VertexBuffer(uint32_t nv, uint32_t nc, const float *data, GLenum usage)
     : Buffer(static_cast<GLsizeiptr>(nv*nc*sizeof(float)), data, usage)
     , numVertices(nv)
@@ -393,6 +609,123 @@ IndexBuffer::IndexBuffer(GLenum primitiveType_, uint32_t numIndices_, const uint
 {
 }
 
+BonesPalette::BonesPalette(uint32_t initialCapacity)
+    : m_capacity(0)
+    , m_numAllocatedTexels(0)
+    , m_numUploadedBytes(0)
+{
+    GLuint textureId;
+    Renderer::instance().functions().glGenTextures(1, &textureId);
+    texture = std::make_shared<Texture>(textureId, GL_TEXTURE_BUFFER, glm::uvec3(0u, 1u, 1u));
+
+    reserve(glm::max(initialCapacity, 1u));
+}
+
+uint32_t BonesPalette::allocate(uint32_t numTexels)
+{
+    auto it = std::find_if(m_freeRanges.begin(), m_freeRanges.end(), [numTexels](const std::pair<const uint32_t, uint32_t>& range) {
+        return range.second >= numTexels;
+    });
+
+    if (it == m_freeRanges.end())
+    {
+        uint32_t newCapacity = m_capacity;
+        while (newCapacity - m_capacity < numTexels)
+            newCapacity *= 2u;
+        reserve(newCapacity);
+
+        // the new space is merged with the last free range if it ends at the old capacity
+        it = std::prev(m_freeRanges.end());
+    }
+
+    const uint32_t offset = it->first;
+    const uint32_t numFreeTexels = it->second;
+    m_freeRanges.erase(it);
+    if (numFreeTexels > numTexels)
+        m_freeRanges.insert({offset + numTexels, numFreeTexels - numTexels});
+
+    m_numAllocatedTexels += numTexels;
+    return offset;
+}
+
+void BonesPalette::free(uint32_t offset, uint32_t numTexels)
+{
+    m_numAllocatedTexels -= numTexels;
+
+    auto next = m_freeRanges.lower_bound(offset);
+    if ((next != m_freeRanges.end()) && (offset + numTexels == next->first))
+    {
+        numTexels += next->second;
+        next = m_freeRanges.erase(next);
+    }
+
+    if (next != m_freeRanges.begin())
+    {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset)
+        {
+            prev->second += numTexels;
+            return;
+        }
+    }
+
+    m_freeRanges.insert(next, {offset, numTexels});
+}
+
+void BonesPalette::setData(uint32_t offset, uint32_t numTexels, const glm::vec4 *data)
+{
+    const auto dataSize = static_cast<GLsizeiptr>(numTexels * sizeof(glm::vec4));
+    buffer->streamSubData(static_cast<GLintptr>(offset * sizeof(glm::vec4)), dataSize, data);
+    m_numUploadedBytes += static_cast<uint64_t>(dataSize);
+}
+
+void BonesPalette::reserve(uint32_t newCapacity)
+{
+    auto& functions = Renderer::instance().functions();
+
+    auto newBuffer = std::make_shared<Buffer>(static_cast<GLsizeiptr>(newCapacity * sizeof(glm::vec4)), nullptr, GL_DYNAMIC_DRAW);
+    if (buffer)
+    {
+        functions.glBindBuffer(GL_COPY_READ_BUFFER, buffer->id);
+        functions.glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer->id);
+        functions.glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(m_capacity * sizeof(glm::vec4)));
+    }
+    buffer = newBuffer;
+
+    functions.glBindTexture(GL_TEXTURE_BUFFER, texture->id);
+    functions.glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer->id);
+    texture->size.x = newCapacity;
+
+    // the new space is released as a free range
+    m_numAllocatedTexels += newCapacity - m_capacity;
+    free(m_capacity, newCapacity - m_capacity);
+    m_capacity = newCapacity;
+}
+
+BonesPaletteRange::BonesPaletteRange(uint32_t numBones, SkinningType skinningType_)
+    : offset(Renderer::instance().bonesPalette().allocate(numBones * numTexelsPerBone(skinningType_)))
+    , size(numBones * numTexelsPerBone(skinningType_))
+    , skinningType(skinningType_)
+    , hasData(false)
+{
+}
+
+BonesPaletteRange::~BonesPaletteRange()
+{
+    Renderer::instance().bonesPalette().free(offset, size);
+}
+
+void BonesPaletteRange::setData(const glm::vec4 *data, uint32_t numTexels)
+{
+    Renderer::instance().bonesPalette().setData(offset, glm::min(numTexels, size), data);
+    hasData = true;
+}
+
+uint32_t BonesPaletteRange::numTexelsPerBone(SkinningType skinningType)
+{
+    return (skinningType == SkinningType::DualQuaternion) ? 2u : 3u;
+}
+
 Mesh::Mesh()
     : numInstances(1u)
 {
@@ -419,7 +752,10 @@ void Mesh::declareVertexAttribute(VertexAttribute attrib, std::shared_ptr<Vertex
     attributesDeclaration[attrib] = vb;
 
     if (attrib == VertexAttribute::Position)
+    {
         recalcBoundingBox();
+        bvh = nullptr;
+    }
 }
 
 void Mesh::undeclareVertexAttribute(VertexAttribute attrib)
@@ -451,6 +787,7 @@ void Mesh::attachIndexBuffer(std::shared_ptr<IndexBuffer> b)
     functions.glBindVertexArray(0);
 
     indexBuffers.insert(b);
+    bvh = nullptr;
 }
 
 void Mesh::recalcBoundingBox()
@@ -463,6 +800,42 @@ void Mesh::recalcBoundingBox()
     }
 }
 
+void Mesh::triangles(std::vector<glm::vec3>& vertices, std::vector<uint32_t>& indices) const
+{
+    vertices.clear();
+    indices.clear();
+
+    auto vb = vertexBuffer(VertexAttribute::Position);
+    if (!vb || (vb->numComponents < 2u))
+        return;
+
+    const float *vertexData = static_cast<const float*>(vb->cpuData());
+    vertices.resize(vb->numVertices, glm::vec3(0.f));
+    for (uint32_t v = 0; v < vb->numVertices; ++v)
+        for (uint32_t k = 0; k < glm::min(vb->numComponents, 3u); ++k)
+            vertices[v][static_cast<glm::length_t>(k)] = vertexData[v * vb->numComponents + k];
+    vb->clearCpuData();
+
+    for (auto ib : indexBuffers)
+    {
+        if (ib->primitiveType != GL_TRIANGLES)
+            continue;
+
+        const uint32_t *indexData = static_cast<const uint32_t*>(ib->cpuData());
+        indices.insert(indices.end(), indexData, indexData + ib->numIndices);
+        ib->clearCpuData();
+    }
+}
+
+void Mesh::recalcBvh()
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<uint32_t> indices;
+    triangles(vertices, indices);
+
+    bvh = std::make_shared<MeshBvh>(vertices.data(), indices.data(), static_cast<uint32_t>(indices.size()));
+}
+
 Renderbuffer::Renderbuffer(GLenum internalFormat, GLsizei width, GLsizei height)
 {
     auto& functions = Renderer::instance().functions();
@@ -694,15 +1067,169 @@ bool Framebuffer::isComplete() const
     return res == GL_FRAMEBUFFER_COMPLETE;
 }
 
+const uint32_t GpuParticles::numSteps = 8388608u;
+
+GpuParticles::GpuParticles(uint32_t capacity_, ParticleEmitterType emitterType_)
+    : mesh(std::make_shared<Mesh>())
+    , isQueryPending({false, false})
+    , numParticles({0u, 0u})
+    , numSpawnedParticles({0u, 0u})
+    , steps({0u, 0u})
+    , parameters()
+    , drawnStep(0.f)
+    , capacity(capacity_)
+    , current(0u)
+    , numNewParticles(0u)
+    , emitterType(emitterType_)
+    , isQueued(false)
+{
+    auto& functions = Renderer::instance().functions();
+    functions.glGenQueries(2, queries.data());
+
+    // slots which were never written have a step which is never reached
+    const std::vector<glm::vec4> initialVelocities(capacity, glm::vec4(0.f, 0.f, 0.f, -1.f));
+
+    for (size_t i = 0; i < 2; ++i)
+    {
+        positionLifetimeBuffers[i] = std::make_shared<VertexBuffer>(capacity, 4u, nullptr, GL_DYNAMIC_COPY);
+        velocityBuffers[i] = std::make_shared<VertexBuffer>(capacity, 4u, glm::value_ptr(*initialVelocities.data()), GL_DYNAMIC_COPY);
+
+        simulationMeshes[i] = std::make_shared<Mesh>();
+        simulationMeshes[i]->declareVertexAttribute(VertexAttribute::ParticlePositionLifetime, positionLifetimeBuffers[i]);
+        simulationMeshes[i]->declareVertexAttribute(VertexAttribute::ParticleVelocity, velocityBuffers[i]);
+    }
+}
+
+GpuParticles::~GpuParticles()
+{
+    Renderer::instance().functions().glDeleteQueries(2, queries.data());
+}
+
+uint32_t GpuParticles::prepareStep(float dt, uint32_t numRequestedParticles, uint32_t seed)
+{
+    // the step which hasn't been simulated yet is extended instead of being overwritten
+    if (isQueued)
+    {
+        const uint32_t numAddedParticles = glm::min(numRequestedParticles, capacity - numParticles[current] - numNewParticles);
+        numNewParticles += numAddedParticles;
+        parameters[0].x += dt;
+        return numAddedParticles;
+    }
+
+    // counts are read only when they are available, so the pipeline isn't stalled
+    auto readCount = [this](uint32_t buffer) {
+        if (!isQueryPending[buffer])
+            return false;
+
+        auto& functions = Renderer::instance().functions();
+
+        GLuint isAvailable = GL_FALSE;
+        functions.glGetQueryObjectuiv(queries[buffer], GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+        if (isAvailable != GL_TRUE)
+            return false;
+
+        GLuint result = 0;
+        functions.glGetQueryObjectuiv(queries[buffer], GL_QUERY_RESULT, &result);
+        numParticles[buffer] = result;
+        isQueryPending[buffer] = false;
+        return true;
+    };
+
+    // the previous buffer is the source of the current one, so its count bounds the current one by the spawned particles
+    const uint32_t previous = 1u - current;
+    if (readCount(previous))
+        numParticles[current] = glm::min(numParticles[current], numParticles[previous] + numSpawnedParticles[current]);
+    readCount(current);
+
+    numNewParticles = glm::min(numRequestedParticles, capacity - numParticles[current]);
+    parameters[0] = glm::vec4(dt,
+                              static_cast<float>(numParticles[current]),
+                              static_cast<float>(seed & 0xFFFFFFu),
+                              static_cast<float>((steps[current] + 1u) % numSteps));
+
+    // the current buffer is drawn while the next step is simulated
+    mesh->declareVertexAttribute(VertexAttribute::ParticlePositionLifetime, positionLifetimeBuffers[current], 1u);
+    mesh->declareVertexAttribute(VertexAttribute::ParticleVelocity, velocityBuffers[current], 1u);
+    mesh->numInstances = numParticles[current];
+    drawnStep = static_cast<float>(steps[current]);
+
+    return numNewParticles;
+}
+
+GpuTimer::GpuTimer()
+    : m_frameQueries(1u)
+    , m_time(0.0)
+    , m_isStarted(false)
+{
+}
+
+void GpuTimer::begin()
+{
+    std::shared_ptr<QOpenGLTimerQuery> query;
+    if (m_freeQueries.empty())
+    {
+        query = std::make_shared<QOpenGLTimerQuery>();
+        if (!query->create()) // timer queries are not supported by OpenGL ES
+            return;
+    }
+    else
+    {
+        query = m_freeQueries.back();
+        m_freeQueries.pop_back();
+    }
+
+    query->begin();
+    m_frameQueries.back().push_back(query);
+    m_isStarted = true;
+}
+
+void GpuTimer::end()
+{
+    if (m_isStarted)
+    {
+        m_frameQueries.back().back()->end();
+        m_isStarted = false;
+    }
+}
+
+void GpuTimer::nextFrame()
+{
+    while (m_frameQueries.size() > 1u)
+    {
+        auto& queries = m_frameQueries.front();
+        if (!std::all_of(queries.begin(), queries.end(), [](const std::shared_ptr<QOpenGLTimerQuery>& query) { return query->isResultAvailable(); }))
+            break;
+
+        // the results are available, so reading them doesn't wait
+        GLuint64 time = 0u;
+        for (auto& query : queries)
+        {
+            time += query->waitForResult();
+            m_freeQueries.push_back(query);
+        }
+
+        m_time = static_cast<double>(time) * 1e-6;
+        m_frameQueries.pop_front();
+    }
+
+    m_frameQueries.emplace_back();
+}
+
 Renderer::Renderer(QOpenGLExtraFunctions& functions, GLuint defaultFbo)
     : m_functions(functions)
     , m_defaultFbo(defaultFbo)
     , m_resourceStorage(std::make_unique<ResourceStorage>())
     , m_drawData()
+    , m_numDrawCalls(0)
+    , m_numInstancedDrawCalls(0)
+    , m_numInstancedDrawables(0)
+    , m_numSkinnedMeshes(0)
+    , m_numSimulatedParticleSystems(0)
     , m_ssaoBlurNumPasses(Settings::instance().readUint32("Renderer.SSAO.Blur.NumPasses", 1u))
     , m_ssaoContribution(Settings::instance().readFloat("Renderer.SSAO.Contribution", 1.f))
     , m_bloomBlurNumPasses(Settings::instance().readUint32("Renderer.Bloom.Blur.NumPasses", 1u))
     , m_isBloomEnabled(Settings::instance().readBool("Renderer.Bloom.Enabled", true))
+    , m_isPreSkinningEnabled(Settings::instance().readBool("Renderer.Animation.PreSkinning", false))
 {
 }
 
@@ -710,6 +1237,13 @@ void Renderer::initialize()
 {
     m_functions.glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
+    m_bonesPalette = std::make_unique<BonesPalette>(Settings::instance().readUint32("Renderer.Animation.BonesPaletteSize", 16384u));
+    m_streamBuffer = std::make_unique<StreamBuffer>(static_cast<GLsizeiptr>(Settings::instance().readUint32("Renderer.StreamBufferSize", 1048576u)));
+    m_pickBuffer = std::make_unique<PickBuffer>(static_cast<GLsizei>(Settings::instance().readUint32("Renderer.Picking.BufferSize", 16u)));
+    m_skinningTimer = std::make_unique<GpuTimer>();
+    m_shadowsTimer = std::make_unique<GpuTimer>();
+    m_geometryTimer = std::make_unique<GpuTimer>();
+
     m_fullscreenQuad = buildPlaneMesh();
     m_backgroundDrawable = std::make_shared<BackgroundDrawable>(Settings::instance().readFloat("Renderer.Background.Roughness", 0.05f));
     m_ssaoDrawable = std::make_shared<SSAODrawable>(Settings::instance().readFloat("Renderer.SSAO.Radius", 1.f), Settings::instance().readUint32("Renderer.SSAO.NumSamples", 8u));
@@ -790,21 +1324,28 @@ GLuint Renderer::defaultFbo() const
 
 std::shared_ptr<RenderProgram> Renderer::loadRenderProgram(const std::string &vertexFile, const std::string &fragmentFile, const std::map<std::string, std::string> &defines)
 {
-    std::string key = vertexFile+fragmentFile;
+    return loadRenderProgram(vertexFile, "", fragmentFile, defines);
+}
+
+std::shared_ptr<RenderProgram> Renderer::loadRenderProgram(const std::string &vertexFile, const std::string &geometryFile, const std::string &fragmentFile, const std::map<std::string, std::string> &defines)
+{
+    std::string key = vertexFile+geometryFile+fragmentFile;
     for (const auto& define : defines)
         key += define.first + define.second;
 
     auto object = std::dynamic_pointer_cast<RenderProgram>(m_resourceStorage->get(key));
     if (!object)
     {
-        std::array<std::pair<GLenum, std::string>, 2> shaderFilenames {
+        std::vector<std::pair<GLenum, std::string>> shaderFilenames {
             std::make_pair(GL_VERTEX_SHADER, vertexFile),
             std::make_pair(GL_FRAGMENT_SHADER, fragmentFile)
         };
+        if (!geometryFile.empty())
+            shaderFilenames.insert(shaderFilenames.begin() + 1, std::make_pair(GL_GEOMETRY_SHADER, geometryFile));
 
-        GLuint shaderIds[2];
+        GLuint shaderIds[3];
         bool isOk = true;
-        for (size_t i = 0; i < 2; ++i)
+        for (size_t i = 0; i < shaderFilenames.size(); ++i)
         {
             auto& shader = shaderFilenames[i];
             auto dir = utils::fileDir(shader.second);
@@ -853,8 +1394,8 @@ std::shared_ptr<RenderProgram> Renderer::loadRenderProgram(const std::string &ve
         if (isOk)
         {
             programId = m_functions.glCreateProgram();
-            m_functions.glAttachShader(programId, shaderIds[0]);
-            m_functions.glAttachShader(programId, shaderIds[1]);
+            for (size_t i = 0; i < shaderFilenames.size(); ++i)
+                m_functions.glAttachShader(programId, shaderIds[i]);
             m_functions.glLinkProgram(programId);
             GLint linked;
             m_functions.glGetProgramiv(programId, GL_LINK_STATUS, &linked);
@@ -864,7 +1405,7 @@ std::shared_ptr<RenderProgram> Renderer::loadRenderProgram(const std::string &ve
                 if(infoLen > 1) {
                     char *infoLog = static_cast<char*>(malloc(sizeof(char) * static_cast<unsigned int>(infoLen)));
                     m_functions.glGetProgramInfoLog(programId, infoLen, nullptr, infoLog);
-                    std::cout << vertexFile << " " << fragmentFile << " link: " << infoLog << std::endl;
+                    std::cout << vertexFile << " " << geometryFile << " " << fragmentFile << " link: " << infoLog << std::endl;
                     free(infoLog);
                 }
                 m_functions.glDeleteProgram(programId);
@@ -989,6 +1530,77 @@ void Renderer::bindUniformBuffer(std::shared_ptr<Buffer> buffer, GLuint unit)
     m_functions.glBindBufferBase(GL_UNIFORM_BUFFER, unit, id);
 }
 
+void Renderer::bindUniformBuffer(const StreamRange& range, GLuint unit)
+{
+    if (range.buffer)
+        m_functions.glBindBufferRange(GL_UNIFORM_BUFFER, unit, range.buffer->id, range.offset, range.size);
+    else
+        m_functions.glBindBufferBase(GL_UNIFORM_BUFFER, unit, 0);
+}
+
+BonesPalette &Renderer::bonesPalette()
+{
+    return *m_bonesPalette;
+}
+
+StreamBuffer &Renderer::streamBuffer()
+{
+    return *m_streamBuffer;
+}
+
+PickBuffer &Renderer::pickBuffer()
+{
+    return *m_pickBuffer;
+}
+
+std::shared_ptr<Mesh> Renderer::skinnedMesh(std::shared_ptr<Mesh> sourceMesh, std::shared_ptr<BonesPaletteRange> bonesRange)
+{
+    return skinnedMeshEntry(sourceMesh, bonesRange).mesh;
+}
+
+void Renderer::queueSkinning(std::shared_ptr<Mesh> sourceMesh, std::shared_ptr<BonesPaletteRange> bonesRange)
+{
+    auto& skinnedMesh = skinnedMeshEntry(sourceMesh, bonesRange);
+    if (!skinnedMesh.isQueued)
+    {
+        skinnedMesh.isQueued = true;
+        m_skinningQueue.push_back(&skinnedMesh);
+    }
+}
+
+void Renderer::queueParticlesSimulation(std::shared_ptr<GpuParticles> particles)
+{
+    if (!particles->isQueued)
+    {
+        particles->isQueued = true;
+        m_particlesSimulationQueue.push_back(particles);
+    }
+}
+
+void Renderer::beginFrame()
+{
+    m_numDrawCalls = 0;
+    m_numInstancedDrawCalls = 0;
+    m_numInstancedDrawables = 0;
+    m_numSkinnedMeshes = 0;
+    m_numSimulatedParticleSystems = 0;
+
+    m_streamBuffer->nextFrame();
+    m_bonesPalette->nextFrame();
+    m_skinningTimer->nextFrame();
+    m_shadowsTimer->nextFrame();
+    m_geometryTimer->nextFrame();
+
+    // skinned meshes live as long as their source meshes and bones ranges
+    for (auto it = m_skinnedMeshes.begin(); it != m_skinnedMeshes.end();)
+    {
+        if (!it->second.isQueued && (it->second.sourceMesh.expired() || it->second.bonesRange.expired()))
+            it = m_skinnedMeshes.erase(it);
+        else
+            ++it;
+    }
+}
+
 void Renderer::draw(std::shared_ptr<Drawable> drawable, const utils::Transform& transform, uint32_t id)
 {
     m_drawData[castFromLayerId(drawable->layerId())].push_back(std::tuple<std::shared_ptr<Drawable>, utils::Transform, uint32_t>(drawable, transform, id));
@@ -1002,6 +1614,9 @@ void Renderer::clear()
 
 void Renderer::renderDeffered(const RenderInfo& renderInfo)
 {
+    skinMeshes();
+    simulateParticles();
+
     m_functions.glBindFramebuffer(GL_FRAMEBUFFER, m_gRenderSurface.first->id);
     setupViewportSize(m_gRenderSurface.second);
 
@@ -1020,11 +1635,9 @@ void Renderer::renderDeffered(const RenderInfo& renderInfo)
     m_functions.glEnable(GL_CULL_FACE);
     m_functions.glCullFace(GL_BACK);
 
-    for (const auto& drawData : m_drawData[castFromLayerId(LayerId::OpaqueGeometry)])
-    {
-        setupUniforms(drawData, DrawableRenderProgramId::DeferredGeometryPass, renderInfo);
-        renderMesh(std::get<0>(drawData)->mesh());
-    }
+    m_geometryTimer->begin();
+    renderLayer(m_drawData[castFromLayerId(LayerId::OpaqueGeometry)], DrawableRenderProgramId::DeferredGeometryPass, DrawableRenderProgramId::DeferredGeometryPassInstanced, renderInfo);
+    m_geometryTimer->end();
 
     if (m_ssaoContribution > utils::epsilon)
     {
@@ -1221,6 +1834,9 @@ void Renderer::renderDeffered(const RenderInfo& renderInfo)
 
 void Renderer::renderForward(const RenderInfo& renderInfo)
 {
+    skinMeshes();
+    simulateParticles();
+
     m_functions.glBindFramebuffer(GL_FRAMEBUFFER, m_hdrRenderSurface.first->id);
     setupViewportSize(m_hdrRenderSurface.second);
 
@@ -1241,11 +1857,13 @@ void Renderer::renderForward(const RenderInfo& renderInfo)
     renderMesh(m_fullscreenQuad);
 
     m_functions.glEnable(GL_DEPTH_TEST);
+    m_geometryTimer->begin();
     for (const auto& drawData : m_drawData[castFromLayerId(LayerId::OpaqueGeometry)])
     {
         setupUniforms(drawData, DrawableRenderProgramId::ForwardRender, renderInfo);
         renderMesh(std::get<0>(drawData)->mesh());
     }
+    m_geometryTimer->end();
     for (const auto& drawData : m_drawData[castFromLayerId(LayerId::NotLightedGeometry)])
     {
         setupUniforms(drawData, DrawableRenderProgramId::ForwardRender, renderInfo);
@@ -1344,6 +1962,9 @@ void Renderer::renderForward(const RenderInfo& renderInfo)
 
 void Renderer::renderShadows(const RenderInfo& renderInfo, std::shared_ptr<Framebuffer> framebuffer, const glm::uvec2& shadowMapSize)
 {
+    skinMeshes();
+    simulateParticles();
+
     GLuint framebufferId = framebuffer ? framebuffer->id : m_defaultFbo;
     m_functions.glBindFramebuffer(GL_FRAMEBUFFER, framebufferId);
 
@@ -1359,22 +1980,27 @@ void Renderer::renderShadows(const RenderInfo& renderInfo, std::shared_ptr<Frame
     m_functions.glEnable(GL_CULL_FACE);
     m_functions.glCullFace(GL_FRONT);
 
+    m_shadowsTimer->begin();
     for (auto layer : {LayerId::OpaqueGeometry, LayerId::NotLightedGeometry, LayerId::TransparentGeometry})
-        for (const auto& drawData : m_drawData.at(castFromLayerId(layer)))
-        {
-            setupUniforms(drawData, DrawableRenderProgramId::Shadow, renderInfo);
-            renderMesh(std::get<0>(drawData)->mesh());
-        }
+        renderLayer(m_drawData.at(castFromLayerId(layer)), DrawableRenderProgramId::Shadow, DrawableRenderProgramId::ShadowInstanced, renderInfo);
+    m_shadowsTimer->end();
 
     m_functions.glBindVertexArray(0);
 }
 
-void Renderer::renderIds(const RenderInfo& renderInfo, std::shared_ptr<Framebuffer> framebuffer, const glm::uvec2& framebufferSize)
+void Renderer::renderIds(const RenderInfo& renderInfo, GLsizei regionSize)
 {
-    GLuint framebufferId = framebuffer ? framebuffer->id : m_defaultFbo;
-    m_functions.glBindFramebuffer(GL_FRAMEBUFFER, framebufferId);
+    skinMeshes();
+    simulateParticles();
+
+    regionSize = glm::min(regionSize, m_pickBuffer->maxRegionSize());
+    m_functions.glBindFramebuffer(GL_FRAMEBUFFER, m_pickBuffer->framebuffer()->id);
 
-    setupViewportSize(framebufferSize);
+    setupViewportSize(glm::uvec2(static_cast<glm::uint>(regionSize)));
+
+    // the target is shared by regions of all sizes, so pixels outside the current one are not touched even by the clear
+    m_functions.glEnable(GL_SCISSOR_TEST);
+    m_functions.glScissor(0, 0, regionSize, regionSize);
 
     static const GLuint color[4] = {0u, 0u, 0u, 0u};
     static const GLfloat depth[1] = {1.0f};
@@ -1398,16 +2024,10 @@ void Renderer::renderIds(const RenderInfo& renderInfo, std::shared_ptr<Framebuff
         }
     }
 
+    m_functions.glDisable(GL_SCISSOR_TEST);
     m_functions.glBindVertexArray(0);
-}
-
-void Renderer::readPixel(std::shared_ptr<Framebuffer> framebuffer, GLenum attachment, int xi, int yi, GLenum format, GLenum type, GLvoid *data) const
-{
-    GLuint framebufferId = framebuffer ? framebuffer->id : m_defaultFbo;
-    m_functions.glBindFramebuffer(GL_FRAMEBUFFER, framebufferId);
 
-    m_functions.glReadBuffer(attachment);
-    m_functions.glReadPixels(xi, yi, 1, 1, format, type, data);
+    m_pickBuffer->readback(regionSize);
 }
 
 void Renderer::setupViewportSize(const glm::uvec2& viewportSize)
@@ -1555,14 +2175,17 @@ void Renderer::setupUniforms(const DrawDataType& data, DrawableRenderProgramId p
             bindTexture(renderInfo.shadowMaps(), textureUnit++);
             break;
         }
-        case UniformId::BonesBuffer:
+        case UniformId::BonesPalette:
         {
-            auto uniformValue = std::dynamic_pointer_cast<Uniform<std::shared_ptr<Buffer>>>(drawable->uniform(uniform.first));
+            m_functions.glUniform1i(uniform.second, textureUnit);
+            bindTexture(m_bonesPalette->texture, textureUnit++);
+            break;
+        }
+        case UniformId::BonesOffset:
+        {
+            auto uniformValue = std::dynamic_pointer_cast<Uniform<std::shared_ptr<BonesPaletteRange>>>(drawable->uniform(uniform.first));
             if (uniformValue)
-            {
-                m_functions.glUniformBlockBinding(renderProgram->id, uniform.second, uniformBufferIndex);
-                bindUniformBuffer(uniformValue->get(), uniformBufferIndex++);
-            }
+                m_functions.glUniform1i(uniform.second, static_cast<GLint>(uniformValue->get()->offset));
             break;
         }
         case UniformId::LightsBuffer:
@@ -1751,12 +2374,30 @@ void Renderer::setupUniforms(const DrawDataType& data, DrawableRenderProgramId p
             break;
         }
         case UniformId::ParticleDistanceAttenuation:
+        case UniformId::ParticleStep:
         {
             auto uniformValue = std::dynamic_pointer_cast<Uniform<std::reference_wrapper<const float>>>(drawable->uniform(uniform.first));
             if (uniformValue)
                 m_functions.glUniform1f(uniform.second, uniformValue->get().get());
             break;
         }
+        case UniformId::ParticleCurves:
+        {
+            auto uniformValue = std::dynamic_pointer_cast<Uniform<glm::vec4>>(drawable->uniform(uniform.first));
+            if (uniformValue)
+                m_functions.glUniform4fv(uniform.second, 1, glm::value_ptr(uniformValue->get()));
+            break;
+        }
+        case UniformId::ParticlesData:
+        {
+            auto uniformValue = std::dynamic_pointer_cast<Uniform<std::shared_ptr<Texture>>>(drawable->uniform(uniform.first));
+            if (uniformValue)
+            {
+                m_functions.glUniform1i(uniform.second, textureUnit);
+                bindTexture(uniformValue->get(), textureUnit++);
+            }
+            break;
+        }
         }
     }
 }
@@ -1766,6 +2407,299 @@ void Renderer::renderMesh(std::shared_ptr<Mesh> mesh)
     m_functions.glBindVertexArray(mesh->id);
     for (auto ibo : mesh->indexBuffers)
         m_functions.glDrawElementsInstanced(ibo->primitiveType, ibo->numIndices, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(mesh->numInstances));
+
+    m_numDrawCalls += static_cast<uint32_t>(mesh->indexBuffers.size());
+}
+
+void Renderer::renderMeshInstanced(std::shared_ptr<Mesh> mesh, const glm::vec4 *instancesData, GLsizei numInstances)
+{
+    // per instance attributes (3 rows of the model matrix and the bones offset) follow the vertex attributes
+    static const GLuint firstInstanceAttribute = static_cast<GLuint>(numElementsVertexAttribute());
+    static const GLuint numInstanceAttributes = 4u;
+    static const GLsizei instanceDataStride = static_cast<GLsizei>(numInstanceAttributes * sizeof(glm::vec4));
+
+    const auto range = m_streamBuffer->write(instancesData, static_cast<GLsizeiptr>(numInstances * instanceDataStride));
+
+    m_functions.glBindVertexArray(mesh->id);
+    m_functions.glBindBuffer(GL_ARRAY_BUFFER, range.buffer->id);
+    for (GLuint i = 0; i < numInstanceAttributes; ++i)
+    {
+        m_functions.glEnableVertexAttribArray(firstInstanceAttribute + i);
+        m_functions.glVertexAttribPointer(firstInstanceAttribute + i, 4, GL_FLOAT, GL_FALSE, instanceDataStride, reinterpret_cast<const GLvoid*>(range.offset + static_cast<GLintptr>(i * sizeof(glm::vec4))));
+        m_functions.glVertexAttribDivisor(firstInstanceAttribute + i, 1);
+    }
+
+    for (auto ibo : mesh->indexBuffers)
+        m_functions.glDrawElementsInstanced(ibo->primitiveType, ibo->numIndices, GL_UNSIGNED_INT, nullptr, numInstances);
+
+    for (GLuint i = 0; i < numInstanceAttributes; ++i)
+        m_functions.glDisableVertexAttribArray(firstInstanceAttribute + i);
+
+    m_numDrawCalls += static_cast<uint32_t>(mesh->indexBuffers.size());
+    m_numInstancedDrawCalls += static_cast<uint32_t>(mesh->indexBuffers.size());
+    m_numInstancedDrawables += static_cast<uint32_t>(numInstances);
+}
+
+void Renderer::renderLayer(const DrawDataLayerContainer& layer, DrawableRenderProgramId programId, DrawableRenderProgramId instancedProgramId, const RenderInfo& renderInfo)
+{
+    // drawables are grouped by mesh so that compatible neighbours are drawn by one instanced call
+    m_sortedDrawData.clear();
+    for (const auto& drawData : layer)
+        m_sortedDrawData.push_back({std::get<0>(drawData)->mesh().get(), &drawData});
+    std::stable_sort(m_sortedDrawData.begin(), m_sortedDrawData.end(), [](const std::pair<const Mesh*, const DrawDataType*>& d1, const std::pair<const Mesh*, const DrawDataType*>& d2) {
+        return d1.first < d2.first;
+    });
+
+    // instance data of all drawables of the layer is prepared by the worker threads, single ones just don't use it
+    m_instancesData.resize(4u * m_sortedDrawData.size());
+    ThreadPool::instance().parallelFor(m_sortedDrawData.size(), 64u, [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const auto& instanceDrawData = *m_sortedDrawData[i].second;
+            const glm::mat4x4 modelMatrixTransposed = glm::transpose(std::get<1>(instanceDrawData).operator glm::mat4x4());
+
+            uint32_t bonesOffset = 0;
+            if (auto bonesOffsetUniform = std::dynamic_pointer_cast<Uniform<std::shared_ptr<BonesPaletteRange>>>(std::get<0>(instanceDrawData)->uniform(UniformId::BonesOffset)))
+                bonesOffset = bonesOffsetUniform->get()->offset;
+
+            glm::vec4 *instanceData = m_instancesData.data() + 4u * i;
+            instanceData[0] = modelMatrixTransposed[0];
+            instanceData[1] = modelMatrixTransposed[1];
+            instanceData[2] = modelMatrixTransposed[2];
+            instanceData[3] = glm::vec4(static_cast<float>(bonesOffset), 0.f, 0.f, 0.f);
+        }
+    });
+
+    for (size_t first = 0, last = 1; first < m_sortedDrawData.size(); first = last++)
+    {
+        const auto& drawData = *m_sortedDrawData[first].second;
+        const auto& drawable = std::get<0>(drawData);
+
+        while ((last < m_sortedDrawData.size()) &&
+               (m_sortedDrawData[last].first == m_sortedDrawData[first].first) &&
+               drawable->isInstancingCompatible(*std::get<0>(*m_sortedDrawData[last].second)))
+            ++last;
+
+        if (last - first == 1)
+        {
+            setupUniforms(drawData, programId, renderInfo);
+            renderMesh(drawable->mesh());
+            continue;
+        }
+
+        setupUniforms(drawData, instancedProgramId, renderInfo);
+        renderMeshInstanced(drawable->mesh(), m_instancesData.data() + 4u * first, static_cast<GLsizei>(last - first));
+    }
+}
+
+Renderer::SkinnedMesh& Renderer::skinnedMeshEntry(std::shared_ptr<Mesh> sourceMesh, std::shared_ptr<BonesPaletteRange> bonesRange)
+{
+    auto& skinnedMesh = m_skinnedMeshes[SkinnedMeshKey(sourceMesh.get(), bonesRange.get())];
+
+    // the key may be left by a released mesh or range with the same address
+    if (skinnedMesh.mesh && (skinnedMesh.sourceMesh.lock() == sourceMesh) && (skinnedMesh.bonesRange.lock() == bonesRange))
+        return skinnedMesh;
+
+    skinnedMesh.sourceMesh = sourceMesh;
+    skinnedMesh.bonesRange = bonesRange;
+    skinnedMesh.mesh = std::make_shared<Mesh>();
+
+    // skinned attributes are written by transform feedback, the others are shared with the source mesh
+    auto positions = sourceMesh->vertexBuffer(VertexAttribute::Position);
+    auto normals = sourceMesh->vertexBuffer(VertexAttribute::Normal);
+    auto tangents = sourceMesh->vertexBuffer(VertexAttribute::Tangent);
+
+    skinnedMesh.mesh->declareVertexAttribute(VertexAttribute::Position, std::make_shared<VertexBuffer>(positions->numVertices, 3u, nullptr, GL_DYNAMIC_COPY));
+    if (normals)
+        skinnedMesh.mesh->declareVertexAttribute(VertexAttribute::Normal, std::make_shared<VertexBuffer>(normals->numVertices, 3u, nullptr, GL_DYNAMIC_COPY));
+    if (tangents)
+        skinnedMesh.mesh->declareVertexAttribute(VertexAttribute::Tangent, normals ? std::make_shared<VertexBuffer>(tangents->numVertices, 3u, nullptr, GL_DYNAMIC_COPY) : tangents);
+    for (auto attrib : {VertexAttribute::TexCoord, VertexAttribute::Color})
+        if (auto vertexBuffer = sourceMesh->vertexBuffer(attrib))
+            skinnedMesh.mesh->declareVertexAttribute(attrib, vertexBuffer);
+    for (auto indexBuffer : sourceMesh->indexBuffers)
+        skinnedMesh.mesh->attachIndexBuffer(indexBuffer);
+    skinnedMesh.mesh->boundingBox = sourceMesh->boundingBox;
+
+    // the mesh is drawn in the bind pose until the range receives a pose and the mesh is skinned by it
+    for (auto attrib : {VertexAttribute::Position, VertexAttribute::Normal, VertexAttribute::Tangent})
+    {
+        auto sourceBuffer = sourceMesh->vertexBuffer(attrib);
+        auto skinnedBuffer = skinnedMesh.mesh->vertexBuffer(attrib);
+        if (!sourceBuffer || (skinnedBuffer == sourceBuffer) || (skinnedBuffer->numComponents != sourceBuffer->numComponents))
+            continue;
+
+        m_functions.glBindBuffer(GL_COPY_READ_BUFFER, sourceBuffer->id);
+        m_functions.glBindBuffer(GL_COPY_WRITE_BUFFER, skinnedBuffer->id);
+        m_functions.glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(skinnedBuffer->size()));
+    }
+
+    if (bonesRange->hasData && !skinnedMesh.isQueued)
+    {
+        skinnedMesh.isQueued = true;
+        m_skinningQueue.push_back(&skinnedMesh);
+    }
+
+    return skinnedMesh;
+}
+
+std::shared_ptr<RenderProgram> Renderer::skinningRenderProgram(const Mesh& sourceMesh, SkinningType skinningType)
+{
+    const bool hasNormals = sourceMesh.vertexBuffer(VertexAttribute::Normal) != nullptr;
+    const bool hasTangents = hasNormals && (sourceMesh.vertexBuffer(VertexAttribute::Tangent) != nullptr);
+    const bool hasDualQuaternions = skinningType == SkinningType::DualQuaternion;
+
+    auto& renderProgram = m_skinningRenderPrograms[(hasNormals ? 1u : 0u) | (hasTangents ? 2u : 0u) | (hasDualQuaternions ? 4u : 0u)];
+    if (!renderProgram)
+    {
+        std::map<std::string, std::string> defines;
+        std::vector<std::string> varyings {"v_position"};
+
+        if (hasNormals)
+        {
+            defines.insert({"HAS_NORMALS", ""});
+            varyings.push_back("v_normal");
+        }
+
+        if (hasTangents)
+        {
+            defines.insert({"HAS_TANGENTS", ""});
+            varyings.push_back("v_tangent");
+        }
+
+        if (hasDualQuaternions)
+            defines.insert({"HAS_DUAL_QUATERNION_SKINNING", ""});
+
+        renderProgram = loadRenderProgram(skinningRenderProgramName.first, skinningRenderProgramName.second, defines);
+        renderProgram->setupTransformFeedback(varyings, GL_SEPARATE_ATTRIBS);
+    }
+
+    return renderProgram;
+}
+
+void Renderer::skinMeshes()
+{
+    if (m_skinningQueue.empty())
+        return;
+
+    m_skinningTimer->begin();
+    m_functions.glEnable(GL_RASTERIZER_DISCARD);
+
+    for (auto skinnedMesh : m_skinningQueue)
+    {
+        skinnedMesh->isQueued = false;
+
+        auto sourceMesh = skinnedMesh->sourceMesh.lock();
+        auto bonesRange = skinnedMesh->bonesRange.lock();
+        if (!sourceMesh || !bonesRange)
+            continue;
+
+        auto renderProgram = skinningRenderProgram(*sourceMesh, bonesRange->skinningType);
+        m_functions.glUseProgram(renderProgram->id);
+        for (const auto& uniform : renderProgram->uniforms)
+        {
+            if (uniform.first == UniformId::BonesPalette)
+            {
+                m_functions.glUniform1i(uniform.second, 0);
+                bindTexture(m_bonesPalette->texture, 0);
+            }
+            else if (uniform.first == UniformId::BonesOffset)
+                m_functions.glUniform1i(uniform.second, static_cast<GLint>(bonesRange->offset));
+        }
+
+        GLuint bindingIndex = 0;
+        const bool hasNormals = sourceMesh->vertexBuffer(VertexAttribute::Normal) != nullptr;
+        for (auto attrib : {VertexAttribute::Position, VertexAttribute::Normal, VertexAttribute::Tangent})
+        {
+            auto vertexBuffer = skinnedMesh->mesh->vertexBuffer(attrib);
+            if (!vertexBuffer || ((attrib == VertexAttribute::Tangent) && !hasNormals))
+                continue;
+
+            m_functions.glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, bindingIndex++, vertexBuffer->id);
+            vertexBuffer->clearCpuData();
+        }
+
+        m_functions.glBindVertexArray(sourceMesh->id);
+        m_functions.glBeginTransformFeedback(GL_POINTS);
+        m_functions.glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(sourceMesh->vertexBuffer(VertexAttribute::Position)->numVertices));
+        m_functions.glEndTransformFeedback();
+
+        ++m_numSkinnedMeshes;
+    }
+    m_skinningQueue.clear();
+
+    for (GLuint i = 0; i < 3u; ++i)
+        m_functions.glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, i, 0);
+
+    m_functions.glDisable(GL_RASTERIZER_DISCARD);
+    m_skinningTimer->end();
+}
+
+void Renderer::simulateParticles()
+{
+    if (m_particlesSimulationQueue.empty())
+        return;
+
+    m_functions.glEnable(GL_RASTERIZER_DISCARD);
+
+    for (auto weakParticles : m_particlesSimulationQueue)
+    {
+        auto particles = weakParticles.lock();
+        if (!particles)
+            continue;
+
+        particles->isQueued = false;
+
+        auto& renderProgram = m_particlesSimulationRenderPrograms[castFromParticleEmitterType(particles->emitterType)];
+        if (!renderProgram)
+        {
+            static const std::array<std::string, numElementsParticleEmitterType()> s_emitterDefines {
+                "", "EMITTER_TYPE_POINT", "EMITTER_TYPE_QUAD", "EMITTER_TYPE_CIRCLE", "EMITTER_TYPE_BOX", "EMITTER_TYPE_SPHERE"
+            };
+
+            std::map<std::string, std::string> defines;
+            defines.insert({s_emitterDefines[castFromParticleEmitterType(particles->emitterType)], ""});
+
+            renderProgram = loadRenderProgram(particlesSimulationRenderProgramName.first,
+                                              particlesSimulationGeometryShaderName,
+                                              particlesSimulationRenderProgramName.second,
+                                              defines);
+            renderProgram->setupTransformFeedback({"v_positionLifetime", "v_velocity"}, GL_SEPARATE_ATTRIBS);
+        }
+
+        m_functions.glUseProgram(renderProgram->id);
+        auto uniformIt = renderProgram->uniforms.find(UniformId::ParticleSimulation);
+        if (uniformIt != renderProgram->uniforms.end())
+            m_functions.glUniform4fv(uniformIt->second, static_cast<GLsizei>(particles->parameters.size()), glm::value_ptr(particles->parameters[0]));
+
+        const uint32_t source = particles->current;
+        const uint32_t destination = 1u - source;
+
+        m_functions.glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, particles->positionLifetimeBuffers[destination]->id);
+        m_functions.glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, particles->velocityBuffers[destination]->id);
+
+        m_functions.glBindVertexArray(particles->simulationMeshes[source]->id);
+        m_functions.glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, particles->queries[destination]);
+        m_functions.glBeginTransformFeedback(GL_POINTS);
+        m_functions.glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(particles->numParticles[source] + particles->numNewParticles));
+        m_functions.glEndTransformFeedback();
+        m_functions.glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+
+        // the count of the written particles isn't known until the query is read, so all the processed ones are counted
+        particles->numParticles[destination] = particles->numParticles[source] + particles->numNewParticles;
+        particles->numSpawnedParticles[destination] = particles->numNewParticles;
+        particles->steps[destination] = (particles->steps[source] + 1u) % GpuParticles::numSteps;
+        particles->isQueryPending[destination] = true;
+        particles->current = destination;
+
+        ++m_numSimulatedParticleSystems;
+    }
+    m_particlesSimulationQueue.clear();
+
+    for (GLuint i = 0; i < 2u; ++i)
+        m_functions.glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, i, 0);
+
+    m_functions.glDisable(GL_RASTERIZER_DISCARD);
 }
 
 void Renderer::resizeRenderSurfaces(const glm::uvec2& size)
@@ -1903,7 +2837,7 @@ std::string Renderer::precompileShader(const QString &dir, QByteArray &text, con
 RenderInfo::RenderInfo(const glm::mat4x4& vm, const glm::mat4x4& pm)
     : m_viewMatrix(vm)
     , m_projMatrix(pm)
-    , m_lightsBuffer(nullptr)
+    , m_lightsBuffer()
     , m_shadowMaps(nullptr)
     , m_IBLDiffuseMap(nullptr)
     , m_IBLSpecularMap(nullptr)
@@ -2,6 +2,7 @@
 #define RENDERER_H
 
 #include <string>
+#include <map>
 #include <unordered_map>
 #include <unordered_set>
 #include <set>
@@ -11,6 +12,7 @@
 #include <QtOpenGL/QGL>
 
 #include <glm/vec3.hpp>
+#include <glm/mat3x4.hpp>
 #include <glm/gtc/quaternion.hpp>
 
 #include <core/types.h>
@@ -26,6 +28,7 @@
 
 
 class QOpenGLExtraFunctions;
+class QOpenGLTimerQuery;
 
 namespace trash
 {
@@ -35,6 +38,8 @@ namespace core
 class Drawable;
 class BlurDrawable;
 class CombineDrawable;
+class Skeleton;
+class MeshBvh;
 
 class AbstractUniform
 {
@@ -70,6 +75,9 @@ struct RenderProgram : public ResourceStorage::Object
     std::unordered_map<std::string, GLint> uniformBufferOffsets(GLuint); // it works but don't use it better
 
     static UniformId uniformIdByName(const std::string&);
+
+private:
+    void collectUniforms();
 };
 
 struct Texture : public ResourceStorage::Object
@@ -108,6 +116,7 @@ struct Buffer
     int64_t size() const;
 
     void setSubData(GLintptr, GLsizeiptr, const void*);
+    void streamSubData(GLintptr, GLsizeiptr, const void*); // copied on the GPU from the streaming buffer, so pending draws aren't waited for
 
     void *map(GLintptr, GLsizeiptr, GLbitfield);
     static void unmap();
@@ -121,6 +130,97 @@ protected:
 
 };
 
+// All bones transforms are stored in one RGBA32F texture buffer so that skinned meshes of different nodes can be drawn instanced.
+// Offsets and sizes are measured in texels.
+struct BonesPalette
+{
+    NONCOPYBLE(BonesPalette)
+
+    std::shared_ptr<Buffer> buffer;
+    std::shared_ptr<Texture> texture;
+
+    BonesPalette(uint32_t);
+
+    uint32_t capacity() const { return m_capacity; }
+    uint32_t numAllocatedTexels() const { return m_numAllocatedTexels; }
+    uint64_t numUploadedBytes() const { return m_numUploadedBytes; } // in the current frame
+    void nextFrame() { m_numUploadedBytes = 0u; }
+
+    uint32_t allocate(uint32_t);
+    void free(uint32_t, uint32_t);
+    void setData(uint32_t, uint32_t, const glm::vec4*);
+
+private:
+    void reserve(uint32_t);
+
+    std::map<uint32_t, uint32_t> m_freeRanges; // offset -> number of texels
+    uint32_t m_capacity;
+    uint32_t m_numAllocatedTexels;
+    uint64_t m_numUploadedBytes;
+};
+
+// Range of the bones palette owned by a skinned model or by a shared pose
+struct BonesPaletteRange
+{
+    NONCOPYBLE(BonesPaletteRange)
+
+    uint32_t offset;
+    uint32_t size;
+    SkinningType skinningType;
+    bool hasData; // a pose has been uploaded
+
+    BonesPaletteRange(uint32_t, SkinningType);
+    ~BonesPaletteRange();
+
+    void setData(const glm::vec4*, uint32_t);
+
+    static uint32_t numTexelsPerBone(SkinningType);
+};
+
+// Range of the streaming buffer written in the current frame. The buffer is kept, so the range stays valid if the streaming buffer grows.
+struct StreamRange
+{
+    std::shared_ptr<Buffer> buffer;
+    GLintptr offset = 0;
+    GLsizeiptr size = 0;
+};
+
+// Ring of per frame regions of one buffer. Ranges are written through unsynchronized maps and a region is reused only after
+// the fence placed at the end of its frame is signalled, so the driver never synchronizes the buffer implicitly.
+// All ranges are aligned to be bound as uniform buffers.
+struct StreamBuffer
+{
+    NONCOPYBLE(StreamBuffer)
+
+    StreamBuffer(GLsizeiptr);
+    ~StreamBuffer();
+
+    void nextFrame();
+
+    void *map(GLsizeiptr, StreamRange&); // unmap by Buffer::unmap()
+    StreamRange write(const void*, GLsizeiptr);
+
+    GLsizeiptr regionSize() const { return m_regionSize; }
+    uint64_t numWrittenBytes() const { return m_numWrittenBytes; }
+    uint32_t numStalls() const { return m_numStalls; }
+    double stallTime() const { return m_stallTime; } // milliseconds
+
+private:
+    static const size_t s_numRegions = 3u;
+
+    void reserve(GLsizeiptr);
+
+    std::shared_ptr<Buffer> m_buffer;
+    std::array<GLsync, s_numRegions> m_fences;
+    size_t m_regionIndex;
+    GLsizeiptr m_regionSize;
+    GLsizeiptr m_head;
+    GLintptr m_alignment;
+    uint64_t m_numWrittenBytes;
+    uint32_t m_numStalls;
+    double m_stallTime;
+};
+
 struct VertexBuffer : public Buffer
 {
     uint32_t numVertices;
@@ -145,6 +245,7 @@ struct Mesh
     std::unordered_map<VertexAttribute, std::shared_ptr<VertexBuffer>> attributesDeclaration;
     std::unordered_set<std::shared_ptr<IndexBuffer>> indexBuffers;
     utils::BoundingBox boundingBox;
+    std::shared_ptr<MeshBvh> bvh; // CPU copy of triangles for ray queries, built at load or on the first query
     uint32_t numInstances;
 
     Mesh();
@@ -157,6 +258,9 @@ struct Mesh
     void attachIndexBuffer(std::shared_ptr<IndexBuffer>);
 
     void recalcBoundingBox();
+    void recalcBvh();
+
+    void triangles(std::vector<glm::vec3>&, std::vector<uint32_t>&) const; // read back from the GPU
 };
 
 struct Renderbuffer
@@ -210,6 +314,85 @@ struct Framebuffer
     bool isComplete() const;
 };
 
+// Persistent small target the ids of drawables around the cursor are rendered to. Ids and depths of the rendered region are copied
+// to a pixel pack buffer and fetched after the fence placed behind the copy is signalled, so picking never waits for the GPU.
+struct PickBuffer
+{
+    NONCOPYBLE(PickBuffer)
+
+    PickBuffer(GLsizei); // max size of the picked region
+    ~PickBuffer();
+
+    GLsizei maxRegionSize() const { return m_maxRegionSize; }
+    std::shared_ptr<Framebuffer> framebuffer() const { return m_framebuffer; }
+
+    void readback(GLsizei); // queues the copy of the region of the given size
+    bool isPending() const { return m_fence != nullptr; }
+    bool fetch(std::vector<uint32_t>&, std::vector<float>&, bool = false); // false while the copy is in flight, unless it's waited for
+
+private:
+    std::shared_ptr<Framebuffer> m_framebuffer;
+    std::shared_ptr<Buffer> m_pixelBuffer;
+    GLsync m_fence;
+    GLsizei m_maxRegionSize;
+    GLsizei m_regionSize;
+};
+
+// GPU time of the commands between begin() and end() summed over a frame. Queries are read back only when their results are available,
+// so the time lags a few frames behind and the pipeline is never stalled.
+struct GpuTimer
+{
+    NONCOPYBLE(GpuTimer)
+
+    GpuTimer();
+
+    void begin();
+    void end();
+    void nextFrame();
+
+    double time() const { return m_time; } // milliseconds
+
+private:
+    std::deque<std::vector<std::shared_ptr<QOpenGLTimerQuery>>> m_frameQueries; // from the oldest pending frame to the current one
+    std::vector<std::shared_ptr<QOpenGLTimerQuery>> m_freeQueries;
+    double m_time;
+    bool m_isStarted;
+};
+
+// Particles simulated on the GPU. Two pairs of buffers are swapped every step: the current one is drawn and read by the simulation,
+// the other one receives alive and new particles by transform feedback. The number of particles written is read back only when it's available,
+// so reading the query doesn't stall the pipeline. Until then the buffer is processed up to the upper bound of the count, and the slots
+// behind the alive particles are told apart by the step which wrote them.
+struct GpuParticles
+{
+    NONCOPYBLE(GpuParticles)
+
+    GpuParticles(uint32_t, ParticleEmitterType);
+    ~GpuParticles();
+
+    // prepares the step which is simulated by the renderer before drawing, returns the number of particles which are going to be spawned.
+    // Steps prepared before the simulation runs are accumulated.
+    uint32_t prepareStep(float, uint32_t, uint32_t);
+
+    static const uint32_t numSteps; // steps are counted modulo it to be exact in floats
+
+    std::array<std::shared_ptr<VertexBuffer>, 2> positionLifetimeBuffers, velocityBuffers;
+    std::array<std::shared_ptr<Mesh>, 2> simulationMeshes;
+    std::shared_ptr<Mesh> mesh; // drawn mesh, instance attributes are taken from the current buffers
+    std::array<GLuint, 2> queries;
+    std::array<bool, 2> isQueryPending;
+    std::array<uint32_t, 2> numParticles; // exact if the query isn't pending, otherwise the upper bound
+    std::array<uint32_t, 2> numSpawnedParticles; // by the step which wrote the buffer
+    std::array<uint32_t, 2> steps; // which wrote the buffers
+    std::array<glm::vec4, 6> parameters; // time step, upper bound of the number of alive particles, seed and step followed by the description
+    float drawnStep;
+    uint32_t capacity;
+    uint32_t current;
+    uint32_t numNewParticles;
+    ParticleEmitterType emitterType;
+    bool isQueued;
+};
+
 struct Model : public ResourceStorage::Object
 {
     struct Material;
@@ -221,6 +404,7 @@ struct Model : public ResourceStorage::Object
     std::unordered_map<std::string, std::shared_ptr<Animation>> animations;
     std::vector<utils::Transform> boneTransforms;
     std::vector<std::string> boneNames;
+    std::shared_ptr<Skeleton> skeleton;
 
     uint32_t numBones() const;
     bool calcBoneTransforms(const std::string&, float, std::vector<glm::mat3x4>&) const;
@@ -251,11 +435,13 @@ struct Model::Animation : public ResourceStorage::Object
     float framesPerSecond;
     float duration;
 
-    std::unordered_map<std::string, std::tuple<
+    using Channels = std::tuple<
         std::vector<std::pair<float, glm::vec3>>,
         std::vector<std::pair<float, glm::quat>>,
         std::vector<std::pair<float, glm::vec3>>
-    >> transforms;
+    >;
+
+    std::unordered_map<std::string, Channels> transforms;
 
     Animation(float fps, float d)
         : framesPerSecond(fps)
@@ -308,8 +494,8 @@ public:
     const glm::vec3& viewYDirection() const { return m_viewYDirection; }
     const glm::vec3& viewZDirection() const { return m_viewZDirection; }
 
-    void setLightsBuffer(std::shared_ptr<Buffer> buffer) { m_lightsBuffer = buffer; }
-    std::shared_ptr<Buffer> lightsBuffer() const { return m_lightsBuffer; }
+    void setLightsBuffer(const StreamRange& range) { m_lightsBuffer = range; }
+    const StreamRange& lightsBuffer() const { return m_lightsBuffer; }
 
     void setShadowMaps(std::shared_ptr<Texture> maps) { m_shadowMaps = maps; }
     std::shared_ptr<Texture> shadowMaps() const { return m_shadowMaps; }
@@ -337,7 +523,7 @@ private:
     glm::vec3 m_viewPosition;
     glm::vec3 m_viewXDirection, m_viewYDirection, m_viewZDirection;
 
-    std::shared_ptr<Buffer> m_lightsBuffer;
+    StreamRange m_lightsBuffer;
     std::shared_ptr<Texture> m_shadowMaps;
     std::shared_ptr<Texture> m_IBLDiffuseMap, m_IBLSpecularMap, m_brdfLutMap;
     int32_t m_maxIBLSpecularMapMipmapLevel;
@@ -362,9 +548,11 @@ public:
     GLuint defaultFbo() const;
 
     std::shared_ptr<RenderProgram> loadRenderProgram(const std::string&, const std::string&, const std::map<std::string, std::string>& = std::map<std::string, std::string>());
+    std::shared_ptr<RenderProgram> loadRenderProgram(const std::string&, const std::string&, const std::string&, const std::map<std::string, std::string>&); // with a geometry shader
     std::shared_ptr<Texture> loadTexture(const std::string&);
     std::shared_ptr<Texture> createTexture2D(GLenum, GLint, GLint, GLenum, GLenum, const void*, uint32_t, const std::string& = "");
     std::shared_ptr<Texture> createTexture2DArray(GLenum, GLint, GLint, GLint, GLenum, GLenum, const void*, const std::string& = "");
+    std::shared_ptr<Texture> createTextureBuffer(GLenum, std::shared_ptr<Buffer>); // the buffer must outlive the texture
     std::shared_ptr<Model> loadModel(const std::string&);
     std::shared_ptr<Model::Animation> loadAnimation(const std::string&);
     std::shared_ptr<Font> loadFont(const std::string&);
@@ -372,6 +560,34 @@ public:
     // binding
     void bindTexture(std::shared_ptr<Texture>, GLint);
     void bindUniformBuffer(std::shared_ptr<Buffer>, GLuint);
+    void bindUniformBuffer(const StreamRange&, GLuint);
+
+    BonesPalette& bonesPalette();
+    StreamBuffer& streamBuffer();
+    PickBuffer& pickBuffer();
+
+    // animated meshes are skinned by transform feedback once per bones upload and drawn as static ones in all passes
+    bool isPreSkinningEnabled() const { return m_isPreSkinningEnabled; }
+    std::shared_ptr<Mesh> skinnedMesh(std::shared_ptr<Mesh>, std::shared_ptr<BonesPaletteRange>);
+    void queueSkinning(std::shared_ptr<Mesh>, std::shared_ptr<BonesPaletteRange>);
+
+    // prepared particles steps are simulated by transform feedback before the first pass of the frame
+    void queueParticlesSimulation(std::shared_ptr<GpuParticles>);
+
+    // statistics of the current frame. GPU times are in milliseconds and lag a few frames behind.
+    void beginFrame();
+    uint32_t numDrawCalls() const { return m_numDrawCalls; }
+    uint32_t numInstancedDrawCalls() const { return m_numInstancedDrawCalls; }
+    uint32_t numInstancedDrawables() const { return m_numInstancedDrawables; }
+    uint32_t numSkinnedMeshes() const { return m_numSkinnedMeshes; }
+    uint32_t numSimulatedParticleSystems() const { return m_numSimulatedParticleSystems; }
+    uint64_t numUploadedBonesBytes() const { return m_bonesPalette->numUploadedBytes(); }
+    uint64_t numStreamedBytes() const { return m_streamBuffer->numWrittenBytes(); }
+    uint32_t numStreamStalls() const { return m_streamBuffer->numStalls(); }
+    double streamStallTime() const { return m_streamBuffer->stallTime(); } // milliseconds of waiting for the GPU to release a region
+    double skinningGpuTime() const { return m_skinningTimer->time(); }
+    double shadowsGpuTime() const { return m_shadowsTimer->time(); }
+    double geometryGpuTime() const { return m_geometryTimer->time(); }
 
     void draw(std::shared_ptr<Drawable>, const utils::Transform&, uint32_t);
     void clear();
@@ -380,26 +596,51 @@ public:
     void renderDeffered(const RenderInfo&);
 
     void renderShadows(const RenderInfo&, std::shared_ptr<Framebuffer>, const glm::uvec2&);
-    void renderIds(const RenderInfo&, std::shared_ptr<Framebuffer>, const glm::uvec2&);
-
-    void readPixel(std::shared_ptr<Framebuffer>, GLenum, int, int, GLenum, GLenum, GLvoid*) const;
+    void renderIds(const RenderInfo&, GLsizei); // into the square region of the pick buffer of the given size, read back asynchronously
 
 private:
     using DrawDataType = std::tuple<std::shared_ptr<Drawable>, utils::Transform, uint32_t>;
     using DrawDataLayerContainer = std::deque<DrawDataType>;
     using DrawDataContainer = std::array<DrawDataLayerContainer, numElementsLayerId()>;
 
+    struct SkinnedMesh
+    {
+        std::weak_ptr<Mesh> sourceMesh;
+        std::weak_ptr<BonesPaletteRange> bonesRange;
+        std::shared_ptr<Mesh> mesh;
+        bool isQueued = false;
+    };
+    using SkinnedMeshKey = std::pair<const Mesh*, const BonesPaletteRange*>;
+
     void setupViewportSize(const glm::uvec2&);
     void setupUniforms(const DrawDataType&, DrawableRenderProgramId, const RenderInfo&);
     void renderMesh(std::shared_ptr<Mesh>);
+    void renderMeshInstanced(std::shared_ptr<Mesh>, const glm::vec4*, GLsizei); // 4 vectors per instance
+    void renderLayer(const DrawDataLayerContainer&, DrawableRenderProgramId, DrawableRenderProgramId, const RenderInfo&);
+    SkinnedMesh& skinnedMeshEntry(std::shared_ptr<Mesh>, std::shared_ptr<BonesPaletteRange>);
+    std::shared_ptr<RenderProgram> skinningRenderProgram(const Mesh&, SkinningType);
+    void skinMeshes();
+    void simulateParticles();
     void resizeRenderSurfaces(const glm::uvec2&);
 
     static std::string precompileShader(const QString& dir, QByteArray&, const std::map<std::string, std::string>&);
 
     QOpenGLExtraFunctions& m_functions;
     GLuint m_defaultFbo;
+    std::unique_ptr<BonesPalette> m_bonesPalette; // is destroyed after all members which may own its ranges
     std::unique_ptr<ResourceStorage> m_resourceStorage;
     DrawDataContainer m_drawData;
+    std::vector<std::pair<const Mesh*, const DrawDataType*>> m_sortedDrawData;
+    std::vector<glm::vec4> m_instancesData;
+    std::unique_ptr<StreamBuffer> m_streamBuffer;
+    std::unique_ptr<PickBuffer> m_pickBuffer;
+    std::map<SkinnedMeshKey, SkinnedMesh> m_skinnedMeshes;
+    std::vector<SkinnedMesh*> m_skinningQueue;
+    std::array<std::shared_ptr<RenderProgram>, 8> m_skinningRenderPrograms;
+    std::vector<std::weak_ptr<GpuParticles>> m_particlesSimulationQueue;
+    std::array<std::shared_ptr<RenderProgram>, numElementsParticleEmitterType()> m_particlesSimulationRenderPrograms;
+    std::unique_ptr<GpuTimer> m_skinningTimer, m_shadowsTimer, m_geometryTimer;
+    uint32_t m_numDrawCalls, m_numInstancedDrawCalls, m_numInstancedDrawables, m_numSkinnedMeshes, m_numSimulatedParticleSystems;
     glm::uvec2 m_cachedViewportSize, m_currentViewportSize;
 
     RenderSurface m_hdrRenderSurface;
@@ -415,6 +656,7 @@ private:
     const uint32_t m_ssaoBlurNumPasses, m_bloomBlurNumPasses;
     const float m_ssaoContribution;
     const bool m_isBloomEnabled;
+    const bool m_isPreSkinningEnabled;
 
     friend class RenderWidget;
 };
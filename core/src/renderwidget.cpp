@@ -4,12 +4,19 @@
 #include <QtGui/QStaticText>
 #include <QtCore/QTimer>
 #include <QtCore/QDateTime>
+#include <QtCore/QStringList>
 
 #include <core/core.h>
+#include <core/settings.h>
+#include <core/graphicscontroller.h>
+#include <core/scene.h>
 
 #include "renderwidget.h"
 #include "renderer.h"
 #include "importexport.h"
+#include "messagepool.h"
+#include "sceneprivate.h"
+#include "posecache.h"
 
 namespace trash
 {
@@ -49,8 +56,11 @@ void RenderWidget::initializeGL()
 
     m_startTime = m_lastFpsTime = static_cast<uint64_t>(QDateTime::currentMSecsSinceEpoch());
     m_lastUpdateTime = 0;
+    m_lastNumProcessedMessages = AbstractController::numProcessedMessages();
+    m_lastMessagesPerSecond = 0.f;
+    m_isStatisticsShown = Settings::instance().readBool("Renderer.Debug.Statistics", false);
 
-    m_core.sendMessage(std::make_shared<RenderWidgetWasInitializedMessage>());
+    m_core.sendMessage(makeMessage<RenderWidgetWasInitializedMessage>());
 }
 
 void RenderWidget::resizeGL(int w, int h)
@@ -68,42 +78,71 @@ void RenderWidget::paintGL()
     ++m_fpsCounter;
     if (time - m_lastFpsTime >= deltaFps)
     {
+        const uint64_t numProcessedMessages = AbstractController::numProcessedMessages();
         m_lastFps = m_fpsCounter / (0.001f * deltaFps);
+        m_lastMessagesPerSecond = (numProcessedMessages - m_lastNumProcessedMessages) / (0.001f * deltaFps);
         m_fpsCounter = 0;
         m_lastFpsTime = time;
+        m_lastNumProcessedMessages = numProcessedMessages;
     }
 
-    m_core.sendMessage(std::make_shared<RenderWidgetWasUpdatedMessage>(time, dt));
+    m_core.sendMessage(makeMessage<RenderWidgetWasUpdatedMessage>(time, dt));
     m_core.process();
 
-    int textSize = static_cast<int>(static_cast<float>(height()) / 720 * 28);
-    int textXY = static_cast<int>(static_cast<float>(height()) / 720 * 10);
-
-    QPainter painter(this);
-    painter.setPen(Qt::red);
-    painter.setFont(QFont("Arial", textSize));
-    //painter.drawStaticText(QPoint(textXY, textXY), QStaticText("FPS: " + QString::number(static_cast<double>(m_lastFps), 'f', 1)));
+    if (m_isStatisticsShown)
+        drawStatistics();
 }
 
 void RenderWidget::mousePressEvent(QMouseEvent *event)
 {
-    m_core.sendMessage(std::make_shared<RenderWidgetMouseClickMessage>(mouseButtonMask(event->buttons()), event->x(), event->y()));
+    m_core.sendMessage(makeMessage<RenderWidgetMouseClickMessage>(mouseButtonMask(event->buttons()), event->x(), event->y()));
     event->accept();
 }
 
 void RenderWidget::mouseMoveEvent(QMouseEvent *event)
 {
-    m_core.sendMessage(std::make_shared<RenderWidgetMouseMoveMessage>(event->buttons(), event->x(), event->y()));
+    m_core.sendMessage(makeMessage<RenderWidgetMouseMoveMessage>(event->buttons(), event->x(), event->y()));
     event->accept();
 }
 
 void RenderWidget::closeEvent(QCloseEvent *event)
 {
-    m_core.sendMessage(std::make_shared<RenderWidgetWasClosedMessage>());
+    m_core.sendMessage(makeMessage<RenderWidgetWasClosedMessage>());
     m_core.process();
     event->accept();
 }
 
+void RenderWidget::drawStatistics()
+{
+    QStringList lines;
+    lines << "FPS: " + QString::number(static_cast<double>(m_lastFps), 'f', 1);
+    lines << "Messages/s: " + QString::number(static_cast<double>(m_lastMessagesPerSecond), 'f', 0);
+    lines << "Draw calls: " + QString::number(m_renderer->numDrawCalls()) + " (instanced: " + QString::number(m_renderer->numInstancedDrawCalls()) +
+             " of " + QString::number(m_renderer->numInstancedDrawables()) + " drawables)";
+    lines << "GPU particle systems: " + QString::number(m_renderer->numSimulatedParticleSystems());
+    lines << "Bones uploaded: " + QString::number(m_renderer->numUploadedBonesBytes() / 1024u) + " KB";
+    lines << "Streamed: " + QString::number(m_renderer->numStreamedBytes() / 1024u) + " KB, stalls " +
+             QString::number(m_renderer->numStreamStalls()) + " (" + QString::number(m_renderer->streamStallTime(), 'f', 2) + " ms)";
+    lines << "GPU ms: skinning " + QString::number(m_renderer->skinningGpuTime(), 'f', 2) + ", shadows " +
+             QString::number(m_renderer->shadowsGpuTime(), 'f', 2) + ", geometry " + QString::number(m_renderer->geometryGpuTime(), 'f', 2);
+
+    if (auto scene = m_core.graphicsController().mainScene())
+    {
+        const auto& poseCache = *scene->m().poseCache;
+        lines << "Pose cache hits: " + QString::number(static_cast<double>(100.f * poseCache.hitRate()), 'f', 1) + "%, saved " +
+                 QString::number(poseCache.savedEvaluationTime(), 'f', 0) + " ms";
+    }
+
+    int textSize = static_cast<int>(static_cast<float>(height()) / 720 * 14);
+    int textXY = static_cast<int>(static_cast<float>(height()) / 720 * 10);
+
+    QPainter painter(this);
+    painter.setPen(Qt::red);
+    painter.setFont(QFont("Arial", textSize));
+    for (int i = 0; i < lines.size(); ++i)
+        painter.drawStaticText(QPoint(textXY, textXY + i * 2 * textSize), QStaticText(lines[i]));
+}
+
 uint32_t RenderWidget::mouseButtonMask(const Qt::MouseButtons& qtMask)
 {
     uint32_t result =
@@ -46,6 +46,11 @@ private:
     uint64_t m_startTime, m_lastUpdateTime, m_lastFpsTime;
     uint32_t m_fpsCounter;
     float m_lastFps;
+    uint64_t m_lastNumProcessedMessages;
+    float m_lastMessagesPerSecond; // processed by all controllers
+    bool m_isStatisticsShown;
+
+    void drawStatistics();
 
     static uint32_t mouseButtonMask(const Qt::MouseButtons&);
 };
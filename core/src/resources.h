@@ -23,6 +23,9 @@ const std::pair<std::string, std::string> bloomRenderProgramName { ":/res/bloom.
 const std::pair<std::string, std::string> blurRenderProgramName { ":/res/blur.vert", ":/res/blur.frag" };
 const std::pair<std::string, std::string> combineRenderProgramName { ":/res/combine.vert", ":/res/combine.frag" };
 const std::pair<std::string, std::string> postEffectRenderProgramName { ":/res/posteffect.vert", ":/res/posteffect_final.frag" };
+const std::pair<std::string, std::string> skinningRenderProgramName { ":/res/skinning.vert", ":/res/skinning.frag" };
+const std::pair<std::string, std::string> particlesSimulationRenderProgramName { ":/res/particlessimulation.vert", ":/res/particlessimulation.frag" };
+const std::string particlesSimulationGeometryShaderName(":/res/particlessimulation.geom");
 
 const std::string teapotModelName(":/res/teapot.fbx");
 const std::string standardDiffuseTextureName(":/res/chess.png");
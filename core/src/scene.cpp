@@ -23,6 +23,21 @@ PickData Scene::pickScene(int32_t x, int32_t y) const
     return m_->pickScene(x, y);
 }
 
+void Scene::requestPickScene(int32_t x, int32_t y) const
+{
+    m_->requestPickScene(x, y);
+}
+
+bool Scene::pickSceneResult(PickData& result) const
+{
+    return m_->pickSceneResult(result);
+}
+
+PickData Scene::intersectScene(int32_t x, int32_t y) const
+{
+    return m_->intersectScene(x, y);
+}
+
 utils::Ray Scene::throwRay(int32_t x, int32_t y) const
 {
     return m_->throwRay(x, y);
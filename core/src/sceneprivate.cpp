@@ -10,6 +10,7 @@
 #include <core/scenerootnode.h>
 #include <core/settings.h>
 #include <core/nodevisitor.h>
+#include <core/nodeintersectionvisitor.h>
 
 #include "renderer.h"
 #include "drawables.h"
@@ -17,6 +18,9 @@
 #include "sceneprivate.h"
 #include "scenerootnodeprivate.h"
 #include "lightprivate.h"
+#include "modelnodeprivate.h"
+#include "threadpool.h"
+#include "posecache.h"
 #include "nodeupdatevisitor.h"
 #include "noderendershadowmapvisitor.h"
 #include "noderendervisitor.h"
@@ -33,8 +37,10 @@ ScenePrivate::ScenePrivate(Scene *scene)
     , lights(std::make_shared<LightsList>())
     , lightsFramebuffer(std::make_shared<Framebuffer>())
     , viewMatrix(1.0f)
+    , cameraFrustum(glm::mat4x4(1.0f))
     , fov(glm::half_pi<float>())
     , isPerspectiveProjection(true)
+    , animationFrameNumber(0)
 {
     auto& settings = Settings::instance();
     auto& renderer = Renderer::instance();
@@ -45,6 +51,13 @@ ScenePrivate::ScenePrivate(Scene *scene)
     shadowMapMaxZFar = settings.readFloat("Renderer.Shadow.MaxZFar", std::numeric_limits<float>::max());
     shadowMapSize = settings.readInt32("Renderer.Shadow.ShadowMapSize", 512);
     useDeferredTechnique = settings.readBool("Renderer.DeferredTechnique", false);
+    pickRegionSize = settings.readInt32("Renderer.Picking.RegionSize", 5);
+
+    animationLod1Distance = settings.readFloat("Renderer.Animation.Lod1Distance", 30.0f);
+    animationLod2Distance = settings.readFloat("Renderer.Animation.Lod2Distance", 60.0f);
+    interpolateAnimationLods = settings.readBool("Renderer.Animation.InterpolateLods", false);
+    poseCache = std::make_shared<PoseCache>(settings.readFloat("Renderer.Animation.PoseCache.Step", 1.0f / 30.0f),
+                                            settings.readUint32("Renderer.Animation.PoseCache.MaxUnusedFrames", 60u));
 
     renderNodesAABBs = settings.readBool("Renderer.Debug.NodesAABBs.State", false);
     nodesAABBsColor = glm::vec4(settings.readVec3("Renderer.Debug.NodesAABBs.Color"), 1.f);
@@ -83,8 +96,7 @@ void ScenePrivate::attachLight(std::shared_ptr<Light> light)
             dirtyShadowMaps.insert(i);
         }
 
-        size_t bufferSize = 2 * sizeof(glm::mat4x4) * lights->size();
-        lightsUbo = std::make_shared<Buffer>(bufferSize, nullptr, GL_STATIC_DRAW);
+        lightsData.resize(2 * lights->size());
 
         auto& renderer = Renderer::instance();
         lightsShadowMaps = renderer.createTexture2DArray(GL_DEPTH_COMPONENT16, shadowMapSize, shadowMapSize, static_cast<GLint>(lights->size()), GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
@@ -128,7 +140,8 @@ void ScenePrivate::dirtyLightParams(Light *light)
 
 void ScenePrivate::dirtyShadowMap(Light *light)
 {
-    dirtyShadowMaps.insert(light->m().indexInScene);
+    const uint32_t lightIndex = light->m().indexInScene;
+    NodeUpdateCommands::run([this, lightIndex]() { dirtyShadowMaps.insert(lightIndex); });
 }
 
 glm::mat4x4 ScenePrivate::calcProjectionMatrix(float aspect, float zNear, float zFar)
@@ -192,6 +205,132 @@ glm::mat4x4 ScenePrivate::calcLightProjMatrix(std::shared_ptr<Light> light, cons
     return result;
 }
 
+void ScenePrivate::updateAnimations(const utils::Frustum& cameraFrustum)
+{
+    ++animationFrameNumber;
+    poseCache->beginFrame();
+
+    const glm::vec3 cameraPosition(glm::inverse(viewMatrix)[3]);
+
+    std::vector<utils::OpenFrustum> shadowFrustums;
+    for (auto light : *lights)
+        if (light && light->isShadowMapEnabled())
+            shadowFrustums.push_back(utils::OpenFrustum(calcLightProjMatrix(light, {0.0f, 1.0f}) * calcLightViewTransform(light)));
+
+    animatedNodesToEvaluate.clear();
+    animatedNodesToUpload.clear();
+
+    for (auto modelNodePrivate : dirtyAnimatedNodes)
+    {
+        // the node's box follows the last uploaded pose while the clips box also covers the pose which is going to be evaluated
+        const auto& node = modelNodePrivate->thisNode;
+        const auto boundingBox = node.globalTransform() * (node.boundingBox() + modelNodePrivate->animationGraph->clipsBoundingBox());
+
+        bool isVisible = cameraFrustum.contain(boundingBox);
+        for (size_t i = 0; !isVisible && (i < shadowFrustums.size()); ++i)
+            isVisible = shadowFrustums[i].contain(boundingBox);
+
+        // invisible models only advance their animation time. They stay dirty and are evaluated once they become visible.
+        if (!isVisible)
+            continue;
+
+        const float distance = glm::distance(cameraPosition, boundingBox.center());
+        modelNodePrivate->animationLodPeriod = (distance >= animationLod2Distance) ? 4u : (distance >= animationLod1Distance) ? 2u : 1u;
+
+        if (!modelNodePrivate->bones.empty() &&
+            ((animationFrameNumber + modelNodePrivate->animationLodPhase) % modelNodePrivate->animationLodPeriod != 0))
+        {
+            if (interpolateAnimationLods)
+            {
+                modelNodePrivate->bonesBufferUniform->set(modelNodePrivate->bonesBuffer);
+                animatedNodesToUpload.push_back(modelNodePrivate);
+            }
+            continue;
+        }
+
+        modelNodePrivate->hasSharedPose = poseCache->isEnabled() &&
+                ((modelNodePrivate->animationLodPeriod == 1) || !interpolateAnimationLods) &&
+                modelNodePrivate->animationGraph->sharedPoseKey(poseCache->step(), modelNodePrivate->sharedPoseKey);
+
+        if (modelNodePrivate->hasSharedPose)
+        {
+            if (auto sharedBonesBuffer = poseCache->find(modelNodePrivate->sharedPoseKey))
+            {
+                // the pose has already been evaluated and uploaded for another instance
+                modelNodePrivate->animationGraph->resetDirty();
+                modelNodePrivate->setPoseBoundingBox(modelNodePrivate->animationGraph->clipsBoundingBox());
+                if (modelNodePrivate->bonesBufferUniform->get() != sharedBonesBuffer)
+                {
+                    modelNodePrivate->bonesBufferUniform->set(sharedBonesBuffer);
+                    dirtyNodeShadowMaps(modelNodePrivate->thisNode);
+                }
+                continue;
+            }
+
+            modelNodePrivate->bonesBufferUniform->set(poseCache->insert(modelNodePrivate->sharedPoseKey, modelNodePrivate->model->numBones()));
+        }
+        else
+            modelNodePrivate->bonesBufferUniform->set(modelNodePrivate->bonesBuffer);
+
+        animatedNodesToEvaluate.push_back(modelNodePrivate);
+        animatedNodesToUpload.push_back(modelNodePrivate);
+    }
+
+    const float sharedPoseStep = poseCache->step();
+    ThreadPool::instance().parallelFor(animatedNodesToEvaluate.size(), [this, sharedPoseStep](size_t i) {
+        animatedNodesToEvaluate[i]->evaluateAnimation(sharedPoseStep);
+    });
+
+    double evaluationTime = 0.0;
+    for (auto modelNodePrivate : animatedNodesToEvaluate)
+    {
+        evaluationTime += modelNodePrivate->evaluationTime;
+
+        // a pose with scaled bones has been evaluated with linear blend skinning and can't be shared as a dual quaternion one
+        if (modelNodePrivate->hasSharedPose && (modelNodePrivate->sharedPoseKey.skinningType != modelNodePrivate->animationGraph->skinningType()))
+            poseCache->erase(modelNodePrivate->sharedPoseKey);
+    }
+    poseCache->addEvaluationTime(static_cast<uint32_t>(animatedNodesToEvaluate.size()), evaluationTime);
+
+    for (auto modelNodePrivate : animatedNodesToUpload)
+        modelNodePrivate->uploadAnimation(interpolateAnimationLods);
+
+    dirtyAnimatedNodes.clear();
+}
+
+void ScenePrivate::updateNodes(uint64_t time, uint64_t dt)
+{
+    rootNode->m().doUpdate(time, dt);
+    rootNode->globalTransform(); // is read by the subtrees concurrently
+
+    const auto& subtrees = rootNode->children();
+    while (nodeUpdateCommands.size() < subtrees.size())
+        nodeUpdateCommands.push_back(std::make_unique<NodeUpdateCommands>());
+
+    ThreadPool::instance().parallelFor(subtrees.size(), [this, &subtrees, time, dt](size_t i) {
+        nodeUpdateCommands[i]->update(*subtrees[i], time, dt);
+    });
+
+    for (size_t i = 0; i < subtrees.size(); ++i)
+        nodeUpdateCommands[i]->execute();
+}
+
+void ScenePrivate::updateLightIndices()
+{
+    // transforms and boxes are cached lazily up the hierarchy, so they are computed here before the nodes are processed concurrently
+    for (auto drawableNodePrivate : dirtyLightIndicesNodes)
+    {
+        drawableNodePrivate->getGlobalTransform();
+        drawableNodePrivate->getLocalBoundingBox();
+    }
+
+    ThreadPool::instance().parallelFor(dirtyLightIndicesNodes.size(), [this](size_t i) {
+        dirtyLightIndicesNodes[i]->doUpdateLightIndices();
+    });
+
+    dirtyLightIndicesNodes.clear();
+}
+
 void ScenePrivate::renderScene(uint64_t time, uint64_t dt)
 {
     static const glm::mat4x4 shadowMapBiasMatrix = glm::translate(glm::mat4x4(1.f), glm::vec3(.5f)) * glm::scale(glm::mat4x4(1.f), glm::vec3(.5f));
@@ -202,6 +341,7 @@ void ScenePrivate::renderScene(uint64_t time, uint64_t dt)
     sceneBoundingBox = utils::BoundingBox(sceneBoundingBoxCenter - sceneBoundingBoxScaledHalfSize, sceneBoundingBoxCenter + sceneBoundingBoxScaledHalfSize);
 
     auto& renderer = Renderer::instance();
+    renderer.beginFrame();
     float aspectRatio = static_cast<float>(renderer.viewportSize().x) / static_cast<float>(renderer.viewportSize().y);
 
     //updating camera
@@ -217,11 +357,12 @@ void ScenePrivate::renderScene(uint64_t time, uint64_t dt)
     }
 
     const glm::mat4x4 projectionMatrix = calcProjectionMatrix(aspectRatio, distsToSceneBox.first, distsToSceneBox.second);
-    const utils::Frustum cameraFrustum(projectionMatrix * viewMatrix);
+    cameraFrustum = utils::Frustum(projectionMatrix * viewMatrix);
 
     // updating nodes
-    NodeUpdateVisitor nodeUpdateVisitor(time, dt);
-    rootNode->accept(nodeUpdateVisitor);
+    updateNodes(time, dt);
+    updateLightIndices();
+    updateAnimations(cameraFrustum);
 
     // updating lights and shadows
     for (auto lightIdx : dirtyLights)
@@ -229,9 +370,7 @@ void ScenePrivate::renderScene(uint64_t time, uint64_t dt)
         auto light = lights->at(lightIdx);
         if (light)
         {
-            auto *p = reinterpret_cast<glm::mat4x4*>(lightsUbo->map(sizeof(glm::mat4x4) * (2 * lightIdx + 0), sizeof(glm::mat4x4), GL_MAP_WRITE_BIT));
-            *p = light->m().packParams();
-            lightsUbo->unmap();
+            lightsData[2 * lightIdx + 0] = light->m().packParams();
         }
     }
     dirtyLights.clear();
@@ -284,9 +423,7 @@ void ScenePrivate::renderScene(uint64_t time, uint64_t dt)
         renderer.renderShadows(RenderInfo(glm::mat4x4(1.0f), lightMatrix), lightsFramebuffer, glm::uvec2(shadowMapSize, shadowMapSize));
         renderer.clear();
 
-        auto *p = reinterpret_cast<glm::mat4x4*>(lightsUbo->map(sizeof(glm::mat4x4) * (2 * lightIdx + 1), sizeof(glm::mat4x4), GL_MAP_WRITE_BIT));
-        *p = shadowMapBiasMatrix * lightMatrix;
-        lightsUbo->unmap();
+        lightsData[2 * lightIdx + 1] = shadowMapBiasMatrix * lightMatrix;
 
         it = dirtyShadowMaps.erase(it);
     }
@@ -356,7 +493,7 @@ void ScenePrivate::renderScene(uint64_t time, uint64_t dt)
 
     RenderInfo renderInfo(viewMatrix, projectionMatrix);
     renderInfo.setIBLData(iblDiffuseMap, iblSpecularMap, iblBrdfLutMap, iblContribution);
-    renderInfo.setLightsBuffer(lightsUbo);
+    renderInfo.setLightsBuffer(renderer.streamBuffer().write(lightsData.data(), static_cast<GLsizeiptr>(lightsData.size() * sizeof(glm::mat4x4))));
     renderInfo.setShadowMaps(lightsShadowMaps);
 
     useDeferredTechnique ?
@@ -366,6 +503,29 @@ void ScenePrivate::renderScene(uint64_t time, uint64_t dt)
 }
 
 PickData ScenePrivate::pickScene(int32_t xi, int32_t yi)
+{
+    PickData result{nullptr, glm::vec3(0.0f, 0.0f, 0.0f)};
+    requestPickScene(xi, yi);
+    pickSceneResult(result, true);
+    return result;
+}
+
+PickData ScenePrivate::intersectScene(int32_t xi, int32_t yi)
+{
+    const auto ray = throwRay(xi, yi);
+
+    NodeRayIntersectionVisitor nodeRayIntersectionVisitor(ray);
+    rootNode->accept(nodeRayIntersectionVisitor);
+    const auto& nodes = nodeRayIntersectionVisitor.intersectionData().nodes;
+
+    if (nodes.empty())
+        return PickData{nullptr, glm::vec3(0.0f, 0.0f, 0.0f)};
+
+    const auto& closest = *nodes.begin();
+    return PickData{closest.second, closest.second->globalTransform().inverted() * ray.calculatePoint(closest.first)};
+}
+
+void ScenePrivate::requestPickScene(int32_t xi, int32_t yi)
 {
     auto& renderer = Renderer::instance();
     const auto& viewportSize = renderer.viewportSize();
@@ -388,44 +548,80 @@ PickData ScenePrivate::pickScene(int32_t xi, int32_t yi)
     }
 
     const glm::mat4x4 projectionMatrix = calcProjectionMatrix(aspectRatio, distsToSceneBox.first, distsToSceneBox.second);
-    RenderInfo renderInfo(viewMatrix, projectionMatrix);
 
-    const float x = static_cast<float>(xi) / static_cast<float>(viewportSize.x) * 2.0f - 1.0f;
-    const float y = (1.0f - static_cast<float>(yi) / static_cast<float>(viewportSize.y)) * 2.0f - 1.0f;
+    // odd, so the cursor pixel is the central one
+    const int32_t regionSize = (glm::clamp(pickRegionSize, 1, static_cast<int32_t>(renderer.pickBuffer().maxRegionSize())) - 1) | 1;
 
-    glm::vec4 p0 = renderInfo.viewProjMatrixInverse() * glm::vec4(x, y, -1.0f, 1.0f);
-    glm::vec4 p1 = renderInfo.viewProjMatrixInverse() * glm::vec4(x, y, 1.0f, 1.0f);
+    pickRequest.viewProjMatrixInverse = glm::inverse(projectionMatrix * viewMatrix);
+    pickRequest.pixelSize = glm::vec2(2.0f) / glm::vec2(viewportSize);
+    pickRequest.cursorCoord = glm::vec2(static_cast<float>(xi) + .5f, static_cast<float>(viewportSize.y) - static_cast<float>(yi) - .5f) * pickRequest.pixelSize - glm::vec2(1.0f);
+    pickRequest.regionSize = regionSize;
 
-    p0 /= p0.w;
-    p1 /= p1.w;
+    // the projection is narrowed to the pixels around the cursor, which fill the whole region
+    const glm::mat4x4 regionMatrix =
+            glm::scale(glm::mat4x4(1.f), glm::vec3(glm::vec2(viewportSize) / static_cast<float>(regionSize), 1.f)) *
+            glm::translate(glm::mat4x4(1.f), glm::vec3(-pickRequest.cursorCoord, 0.f));
+    RenderInfo renderInfo(viewMatrix, regionMatrix * projectionMatrix);
 
-    NodePickVisitor nodePickVisitor(utils::Ray(p0, p1-p0));
+    NodePickVisitor nodePickVisitor(utils::Frustum(renderInfo.viewProjMatrix()));
     rootNode->accept(nodePickVisitor);
 
-    auto pickBuffer = std::make_shared<Framebuffer>();
-    pickBuffer->attachColor(0, std::make_shared<Renderbuffer>(GL_R32UI, viewportSize.x, viewportSize.y));
-    pickBuffer->attachDepth(std::make_shared<Renderbuffer>(GL_DEPTH_COMPONENT32, viewportSize.x, viewportSize.y));
-
-    renderer.renderIds(renderInfo, pickBuffer, viewportSize);
+    renderer.renderIds(renderInfo, regionSize);
     renderer.clear();
 
-    GLuint id[1] = {0u};
-    GLfloat depth[1] = {1.0f};
+    pickRequest.nodeIds = nodePickVisitor.nodeIds();
+    pickRequest.isPending = true;
+}
 
-    renderer.readPixel(pickBuffer, GL_COLOR_ATTACHMENT0, xi, viewportSize.y - yi - 1, GL_RED_INTEGER, GL_UNSIGNED_INT, static_cast<GLvoid*>(id));
-    renderer.readPixel(pickBuffer, GL_DEPTH_ATTACHMENT, xi, viewportSize.y - yi - 1, GL_DEPTH_COMPONENT, GL_FLOAT, static_cast<GLvoid*>(depth));
+bool ScenePrivate::pickSceneResult(PickData& result, bool wait)
+{
+    if (!pickRequest.isPending)
+        return false;
 
-    std::shared_ptr<DrawableNode> node = (id[0] > 0 && id[0] <= nodePickVisitor.nodeIds().size()) ? nodePickVisitor.nodeIds()[id[0] - 1] : nullptr;
+    std::vector<uint32_t> ids;
+    std::vector<float> depths;
+    if (!Renderer::instance().pickBuffer().fetch(ids, depths, wait))
+        return false;
 
-    depth[0] = depth[0] * 2.0f - 1.0f;
-    p0 = renderInfo.viewProjMatrixInverse() * glm::vec4(x, y, depth[0], 1.0f);
-    p0 /= p0.w;
+    pickRequest.isPending = false;
 
-    glm::vec3 localCoord(0.0f, 0.0f, 0.0f);
-    if (node)
-        localCoord = node->globalTransform().inverted() * glm::vec3(p0.x, p0.y, p0.z);
+    // the picked pixel closest to the cursor wins, so thin objects are picked without precise aiming
+    const int32_t regionSize = pickRequest.regionSize;
+    const int32_t center = regionSize / 2;
+    int32_t bestPixel = -1, bestDistance = std::numeric_limits<int32_t>::max();
 
-    return PickData{node, localCoord};
+    for (int32_t y = 0; y < regionSize; ++y)
+        for (int32_t x = 0; x < regionSize; ++x)
+        {
+            const int32_t pixel = y * regionSize + x;
+            const uint32_t id = ids[static_cast<size_t>(pixel)];
+            if ((id == 0u) || (id > pickRequest.nodeIds.size()))
+                continue;
+
+            const int32_t distance = (x - center) * (x - center) + (y - center) * (y - center);
+            if (distance < bestDistance)
+            {
+                bestDistance = distance;
+                bestPixel = pixel;
+            }
+        }
+
+    result = PickData{nullptr, glm::vec3(0.0f, 0.0f, 0.0f)};
+
+    if (bestPixel >= 0)
+    {
+        result.node = pickRequest.nodeIds[ids[static_cast<size_t>(bestPixel)] - 1u];
+
+        const glm::vec2 pixelCoord = pickRequest.cursorCoord +
+                glm::vec2(bestPixel % regionSize - center, bestPixel / regionSize - center) * pickRequest.pixelSize;
+        glm::vec4 p = pickRequest.viewProjMatrixInverse * glm::vec4(pixelCoord, depths[static_cast<size_t>(bestPixel)] * 2.0f - 1.0f, 1.0f);
+        p /= p.w;
+
+        result.localCoord = result.node->globalTransform().inverted() * glm::vec3(p);
+    }
+
+    pickRequest.nodeIds.clear();
+    return true;
 }
 
 utils::Ray ScenePrivate::throwRay(int32_t xi, int32_t yi)
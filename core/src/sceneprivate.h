@@ -8,12 +8,14 @@
 #include <glm/mat4x4.hpp>
 
 #include <utils/forwarddecl.h>
+#include <utils/frustum.h>
 
 #include <core/forwarddecl.h>
 #include <core/light.h>
 #include <core/types.h>
 
 #include "typesprivate.h"
+#include "nodeupdatevisitor.h"
 
 namespace trash
 {
@@ -25,6 +27,9 @@ struct Texture;
 struct Framebuffer;
 
 class Drawable;
+class ModelNodePrivate;
+class DrawableNodePrivate;
+class PoseCache;
 
 class ScenePrivate
 {
@@ -45,14 +50,20 @@ public:
     static glm::mat4x4 calcLightProjMatrix(std::shared_ptr<Light>, const std::pair<float, float>&);
 
 
+    void updateNodes(uint64_t, uint64_t);
+    void updateLightIndices();
+    void updateAnimations(const utils::Frustum&);
     void renderScene(uint64_t, uint64_t);
     PickData pickScene(int32_t, int32_t);
+    void requestPickScene(int32_t, int32_t);
+    bool pickSceneResult(PickData&, bool = false);
+    PickData intersectScene(int32_t, int32_t);
     utils::Ray throwRay(int32_t, int32_t);
 
     Scene& thisScene;
     std::shared_ptr<SceneRootNode> rootNode;
     std::shared_ptr<LightsList> lights;
-    std::shared_ptr<Buffer> lightsUbo;
+    std::vector<glm::mat4x4> lightsData; // parameters and shadow matrix of each light, streamed to the GPU every frame
     std::shared_ptr<Framebuffer> lightsFramebuffer;
     std::shared_ptr<Texture> lightsShadowMaps;
     std::shared_ptr<Texture> iblDiffuseMap, iblSpecularMap, iblBrdfLutMap;
@@ -61,6 +72,7 @@ public:
     std::shared_ptr<Drawable> iblDrawable;
 
     glm::mat4x4 viewMatrix;
+    utils::Frustum cameraFrustum; // frustum of the frame being updated
     float fov;
     bool isPerspectiveProjection;
 
@@ -72,8 +84,27 @@ public:
 
     std::set<uint32_t> freeLightIndices;
     std::set<uint32_t> dirtyLights, dirtyShadowMaps;
+    std::vector<DrawableNodePrivate*> dirtyLightIndicesNodes;
+    std::vector<std::unique_ptr<NodeUpdateCommands>> nodeUpdateCommands; // by subtrees of the root
+    std::vector<ModelNodePrivate*> dirtyAnimatedNodes, animatedNodesToEvaluate, animatedNodesToUpload;
+    uint64_t animationFrameNumber;
+    std::shared_ptr<PoseCache> poseCache;
+    float animationLod1Distance, animationLod2Distance;
+    bool interpolateAnimationLods;
 
     bool useDeferredTechnique;
+
+    struct PickRequest
+    {
+        std::vector<std::shared_ptr<DrawableNode>> nodeIds;
+        glm::mat4x4 viewProjMatrixInverse;
+        glm::vec2 cursorCoord; // NDC of the center of the cursor pixel
+        glm::vec2 pixelSize; // in NDC
+        int32_t regionSize;
+        bool isPending = false;
+    };
+    PickRequest pickRequest;
+    int32_t pickRegionSize;
 };
 
 } // namespace
@@ -0,0 +1,74 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define CORE_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace trash
+{
+namespace core
+{
+namespace simd
+{
+
+// Four lanes of floats. Batched math is written once in terms of F4 and maps either to SSE or to a plain loop.
+// Masks returned by comparisons are only meant to be combined by &, passed to select() or tested by moveMask().
+#ifdef CORE_USE_SSE
+struct F4 { __m128 v; };
+inline F4 load(const float *p) { return {_mm_loadu_ps(p)}; }
+inline void store(float *p, F4 a) { _mm_storeu_ps(p, a.v); }
+inline F4 splat(float a) { return {_mm_set1_ps(a)}; }
+inline F4 operator +(F4 a, F4 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline F4 operator -(F4 a, F4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline F4 operator *(F4 a, F4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline F4 operator /(F4 a, F4 b) { return {_mm_div_ps(a.v, b.v)}; }
+inline F4 min(F4 a, F4 b) { return {_mm_min_ps(a.v, b.v)}; }
+inline F4 max(F4 a, F4 b) { return {_mm_max_ps(a.v, b.v)}; }
+inline F4 greater(F4 a, F4 b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+inline F4 greaterEqual(F4 a, F4 b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+inline F4 operator &(F4 mask1, F4 mask2) { return {_mm_and_ps(mask1.v, mask2.v)}; }
+inline int moveMask(F4 mask) { return _mm_movemask_ps(mask.v); }
+inline F4 select(F4 mask, F4 a, F4 b) { return {_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))}; }
+inline F4 invSqrt(F4 a) { return {_mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(a.v))}; }
+inline F4 signOf(F4 a) { return {_mm_and_ps(a.v, _mm_set1_ps(-0.0f))}; }
+inline F4 xorSign(F4 a, F4 sign) { return {_mm_xor_ps(a.v, sign.v)}; }
+inline void transpose(F4& a, F4& b, F4& c, F4& d) { _MM_TRANSPOSE4_PS(a.v, b.v, c.v, d.v); }
+#else
+struct F4 { float v[4]; };
+template <typename Func> inline F4 apply(F4 a, F4 b, Func f) { F4 r; for (int i = 0; i < 4; ++i) r.v[i] = f(a.v[i], b.v[i]); return r; }
+inline F4 load(const float *p) { F4 r; std::copy(p, p + 4, r.v); return r; }
+inline void store(float *p, F4 a) { std::copy(a.v, a.v + 4, p); }
+inline F4 splat(float a) { return {{a, a, a, a}}; }
+inline F4 operator +(F4 a, F4 b) { return apply(a, b, [](float x, float y) { return x + y; }); }
+inline F4 operator -(F4 a, F4 b) { return apply(a, b, [](float x, float y) { return x - y; }); }
+inline F4 operator *(F4 a, F4 b) { return apply(a, b, [](float x, float y) { return x * y; }); }
+inline F4 operator /(F4 a, F4 b) { return apply(a, b, [](float x, float y) { return x / y; }); }
+inline F4 min(F4 a, F4 b) { return apply(a, b, [](float x, float y) { return std::min(x, y); }); }
+inline F4 max(F4 a, F4 b) { return apply(a, b, [](float x, float y) { return std::max(x, y); }); }
+inline F4 greater(F4 a, F4 b) { return apply(a, b, [](float x, float y) { return x > y ? 1.0f : 0.0f; }); }
+inline F4 greaterEqual(F4 a, F4 b) { return apply(a, b, [](float x, float y) { return x >= y ? 1.0f : 0.0f; }); }
+inline F4 operator &(F4 mask1, F4 mask2) { return apply(mask1, mask2, [](float x, float y) { return ((x != 0.0f) && (y != 0.0f)) ? 1.0f : 0.0f; }); }
+inline int moveMask(F4 mask) { int r = 0; for (int i = 0; i < 4; ++i) r |= (mask.v[i] != 0.0f) ? (1 << i) : 0; return r; }
+inline F4 select(F4 mask, F4 a, F4 b) { F4 r; for (int i = 0; i < 4; ++i) r.v[i] = (mask.v[i] != 0.0f) ? a.v[i] : b.v[i]; return r; }
+inline F4 invSqrt(F4 a) { return apply(a, a, [](float x, float) { return 1.0f / std::sqrt(x); }); }
+inline F4 signOf(F4 a) { return apply(a, a, [](float x, float) { return x < 0.0f ? -1.0f : 1.0f; }); }
+inline F4 xorSign(F4 a, F4 sign) { return a * sign; }
+inline void transpose(F4& a, F4& b, F4& c, F4& d)
+{
+    F4 *m[4] = {&a, &b, &c, &d};
+    for (int i = 0; i < 4; ++i)
+        for (int j = i + 1; j < 4; ++j)
+            std::swap(m[i]->v[j], m[j]->v[i]);
+}
+#endif
+
+} // namespace
+} // namespace
+} // namespace
+
+#endif // SIMD_H
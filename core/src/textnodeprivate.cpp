@@ -2,6 +2,7 @@
 #include "drawables.h"
 #include "renderer.h"
 #include "utils.h"
+#include "nodeupdatevisitor.h"
 
 namespace trash
 {
@@ -36,7 +37,10 @@ void TextNodePrivate::updateDrawable()
 
 void TextNodePrivate::doUpdate(uint64_t time, uint64_t dt)
 {
-    updateDrawable();
+    // meshes are created on the thread of the renderer
+    if (drawableIsDyrty)
+        NodeUpdateCommands::run([this]() { updateDrawable(); });
+
     DrawableNodePrivate::doUpdate(time, dt);
 }
 
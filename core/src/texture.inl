@@ -399,5 +399,15 @@ std::shared_ptr<Texture> Renderer::createTexture2DArray(GLenum internalFormat,
     return object;
 }
 
+std::shared_ptr<Texture> Renderer::createTextureBuffer(GLenum internalFormat, std::shared_ptr<Buffer> buffer)
+{
+    GLuint id;
+    m_functions.glGenTextures(1, &id);
+    m_functions.glBindTexture(GL_TEXTURE_BUFFER, id);
+    m_functions.glTexBuffer(GL_TEXTURE_BUFFER, internalFormat, buffer->id);
+
+    return std::make_shared<Texture>(id, GL_TEXTURE_BUFFER, glm::uvec3(0u, 1u, 1u));
+}
+
 } // namespace
 } // namespace
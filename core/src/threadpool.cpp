@@ -0,0 +1,254 @@
+#include <algorithm>
+
+#include <core/settings.h>
+
+#include "threadpool.h"
+
+namespace trash
+{
+namespace core
+{
+
+namespace
+{
+
+thread_local size_t currentQueueIndex = 0; // workers have their own queues, the other threads share the first one
+
+class SpinLockGuard
+{
+public:
+    SpinLockGuard(std::atomic_flag& lock) : m_lock(lock) { while (m_lock.test_and_set(std::memory_order_acquire)) std::this_thread::yield(); }
+    ~SpinLockGuard() { m_lock.clear(std::memory_order_release); }
+
+private:
+    std::atomic_flag& m_lock;
+};
+
+}
+
+const uint32_t ThreadPool::s_numSpinsBeforeSleep = 1024u;
+const size_t ThreadPool::s_numChunksPerThread = 4u;
+
+JobCounter::JobCounter()
+    : m_value(0u)
+{
+    m_lock.clear();
+}
+
+bool JobCounter::isDone() const
+{
+    return m_value.load(std::memory_order_acquire) == 0u;
+}
+
+ThreadPool::ThreadPool()
+    : m_numQueuedTasks(0u)
+    , m_numSleepingWorkers(0u)
+    , m_isStopping(false)
+{
+    const int32_t hardwareThreads = static_cast<int32_t>(std::thread::hardware_concurrency());
+    // hardware_concurrency() is 0 if it's unknown, the queue of the calling thread exists anyway
+    const int32_t numWorkers = std::max(Settings::instance().readInt32("Core.NumWorkerThreads", hardwareThreads - 1), 0);
+
+    for (int32_t i = 0; i <= numWorkers; ++i)
+        m_queues.push_back(std::make_unique<WorkQueue>());
+
+    for (int32_t i = 0; i < numWorkers; ++i)
+        m_workers.emplace_back(&ThreadPool::workerLoop, this, static_cast<size_t>(i + 1));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_isStopping = true;
+    }
+    m_sleepCondition.notify_all();
+
+    for (auto& worker : m_workers)
+        worker.join();
+}
+
+size_t ThreadPool::numThreads() const
+{
+    return m_workers.size() + 1;
+}
+
+void ThreadPool::run(Job job, JobCounter *counter)
+{
+    if (counter)
+        counter->m_value.fetch_add(1u, std::memory_order_relaxed);
+
+    push({std::move(job), counter});
+}
+
+void ThreadPool::runAfter(JobCounter& dependency, Job job, JobCounter *counter)
+{
+    if (counter)
+        counter->m_value.fetch_add(1u, std::memory_order_relaxed);
+
+    {
+        SpinLockGuard lock(dependency.m_lock);
+        if (!dependency.isDone())
+        {
+            dependency.m_continuations.push_back({std::move(job), counter});
+            return;
+        }
+    }
+
+    push({std::move(job), counter});
+}
+
+void ThreadPool::wait(JobCounter& counter)
+{
+    Task task;
+    while (!counter.isDone())
+    {
+        if (pop(task))
+            execute(task);
+        else
+            std::this_thread::yield();
+    }
+
+    // the thread which has finished the last job may still hold the lock
+    SpinLockGuard lock(counter.m_lock);
+}
+
+void ThreadPool::parallelFor(size_t size, const std::function<void(size_t)>& func)
+{
+    parallelFor(size, 1u, [&func](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            func(i);
+    });
+}
+
+void ThreadPool::parallelFor(size_t size, size_t grainSize, const std::function<void(size_t, size_t)>& func)
+{
+    if (m_workers.empty() || (size <= grainSize))
+    {
+        if (size)
+            func(0u, size);
+        return;
+    }
+
+    // chunks are multiples of the grain size, so they may be aligned by it
+    const size_t numChunks = numThreads() * s_numChunksPerThread;
+    const size_t numGrains = (size + grainSize - 1) / grainSize;
+    const size_t chunkSize = ((numGrains + numChunks - 1) / numChunks) * grainSize;
+
+    JobCounter counter;
+    for (size_t begin = chunkSize; begin < size; begin += chunkSize)
+    {
+        const size_t end = std::min(begin + chunkSize, size);
+        run([&func, begin, end]() { func(begin, end); }, &counter);
+    }
+
+    func(0u, std::min(chunkSize, size));
+    wait(counter);
+}
+
+void ThreadPool::push(Task&& task)
+{
+    auto& queue = *m_queues[currentQueueIndex];
+    {
+        SpinLockGuard lock(queue.lock);
+        queue.tasks.push_back(std::move(task));
+    }
+    m_numQueuedTasks.fetch_add(1u, std::memory_order_seq_cst);
+
+    if (m_numSleepingWorkers.load(std::memory_order_seq_cst))
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_sleepCondition.notify_one();
+    }
+}
+
+bool ThreadPool::pop(Task& task)
+{
+    if (!m_numQueuedTasks.load(std::memory_order_acquire))
+        return false;
+
+    // the own queue is used as a stack for locality, the others are robbed from the oldest jobs
+    const size_t numQueues = m_queues.size();
+    for (size_t i = 0; i < numQueues; ++i)
+    {
+        const bool isOwn = (i == 0);
+        auto& queue = *m_queues[(currentQueueIndex + i) % numQueues];
+
+        SpinLockGuard lock(queue.lock);
+        if (queue.tasks.empty())
+            continue;
+
+        if (isOwn)
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+
+        m_numQueuedTasks.fetch_sub(1u, std::memory_order_relaxed);
+        return true;
+    }
+
+    return false;
+}
+
+void ThreadPool::execute(Task& task)
+{
+    task.job();
+    task.job = nullptr;
+    finish(task.counter);
+}
+
+void ThreadPool::finish(JobCounter *counter)
+{
+    if (!counter)
+        return;
+
+    std::vector<std::pair<Job, JobCounter*>> continuations;
+    {
+        SpinLockGuard lock(counter->m_lock);
+        if (counter->m_value.fetch_sub(1u, std::memory_order_acq_rel) != 1u)
+            return;
+        continuations.swap(counter->m_continuations);
+    }
+
+    for (auto& continuation : continuations)
+        push({std::move(continuation.first), continuation.second});
+}
+
+void ThreadPool::workerLoop(size_t queueIndex)
+{
+    currentQueueIndex = queueIndex;
+
+    Task task;
+    uint32_t numSpins = 0;
+
+    while (!m_isStopping.load(std::memory_order_relaxed))
+    {
+        if (pop(task))
+        {
+            execute(task);
+            numSpins = 0;
+            continue;
+        }
+
+        if (++numSpins < s_numSpinsBeforeSleep)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_numSleepingWorkers.fetch_add(1u, std::memory_order_seq_cst);
+        m_sleepCondition.wait(lock, [this]() { return m_isStopping.load() || m_numQueuedTasks.load(std::memory_order_seq_cst); });
+        m_numSleepingWorkers.fetch_sub(1u, std::memory_order_seq_cst);
+        numSpins = 0;
+    }
+}
+
+} // namespace
+} // namespace
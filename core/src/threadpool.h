@@ -0,0 +1,104 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include <utils/noncopyble.h>
+#include <utils/singletoon.h>
+
+namespace trash
+{
+namespace core
+{
+
+class ThreadPool;
+
+// Number of unfinished jobs. Waiting on it and jobs started after it are the dependencies between jobs.
+// The counter must be waited for before it is destroyed.
+class JobCounter
+{
+    NONCOPYBLE(JobCounter)
+
+public:
+    JobCounter();
+
+    bool isDone() const;
+
+private:
+    std::atomic<uint32_t> m_value;
+    std::atomic_flag m_lock;
+    std::vector<std::pair<std::function<void()>, JobCounter*>> m_continuations; // started when the value gets zero
+
+    friend class ThreadPool;
+};
+
+// Work stealing job system. Every thread has its own deque of jobs, it takes the newest ones from the back
+// and idle threads steal the oldest ones from the front. The deques are guarded by spin locks, waiting threads execute
+// other jobs, workers go to sleep only after spinning without work for a while.
+class ThreadPool
+{
+    NONCOPYBLE(ThreadPool)
+    SINGLETON(ThreadPool)
+
+public:
+    using Job = std::function<void()>;
+
+    ~ThreadPool();
+
+    size_t numThreads() const; // workers and the calling thread
+
+    void run(Job, JobCounter* = nullptr);
+    void runAfter(JobCounter&, Job, JobCounter* = nullptr); // the job is started after the jobs of the first counter are finished
+    void wait(JobCounter&);
+
+    void parallelFor(size_t, const std::function<void(size_t)>&);
+    void parallelFor(size_t, size_t, const std::function<void(size_t, size_t)>&); // size, grain size and function of ranges
+
+private:
+    ThreadPool();
+
+    struct Task
+    {
+        Job job;
+        JobCounter *counter;
+    };
+
+    struct WorkQueue
+    {
+        WorkQueue() { lock.clear(); }
+
+        std::atomic_flag lock;
+        std::deque<Task> tasks;
+    };
+
+    void push(Task&&);
+    bool pop(Task&);
+    void execute(Task&);
+    void finish(JobCounter*);
+
+    void workerLoop(size_t);
+
+    std::vector<std::thread> m_workers;
+    std::vector<std::unique_ptr<WorkQueue>> m_queues; // the first one is shared by the threads which aren't workers
+    std::atomic<size_t> m_numQueuedTasks;
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_sleepCondition;
+    std::atomic<size_t> m_numSleepingWorkers;
+    std::atomic<bool> m_isStopping;
+
+    static const uint32_t s_numSpinsBeforeSleep;
+    static const size_t s_numChunksPerThread;
+};
+
+} // namespace
+} // namespace
+
+#endif // THREADPOOL_H
@@ -40,7 +40,10 @@ ENUMCLASS(VertexAttribute, uint32_t,
           BonesIDs,
           BonesWeights,
           Tangent,
-          Color)
+          Color,
+          ParticleIndex,
+          ParticlePositionLifetime,
+          ParticleVelocity)
 
 ENUMCLASS(LayerId, uint32_t,
           Undefined,
@@ -59,12 +62,22 @@ ENUMCLASS(BlendingType, uint32_t,
           Additive,
           Alpha)
 
+ENUMCLASS(ParticleEmitterType, uint32_t,
+          Custom,
+          Point,
+          Quad,
+          Circle,
+          Box,
+          Sphere)
+
 ENUMCLASS(DrawableRenderProgramId, uint32_t,
           ForwardRender,
           DeferredGeometryPass,
+          DeferredGeometryPassInstanced,
           DeferredStencilPass,
           DeferredLightPass,
           Shadow,
+          ShadowInstanced,
           Selection,
           PostEffect)
 
@@ -93,7 +106,8 @@ ENUMCLASS(UniformId, uint32_t,
           BrdfLutMap,
           IBLContribution,
           ShadowMaps,
-          BonesBuffer,
+          BonesPalette,
+          BonesOffset,
           LightsBuffer,
           SSAOSamplesBuffer,
           BlurKernelBuffer,
@@ -119,7 +133,11 @@ ENUMCLASS(UniformId, uint32_t,
           CombineSourceMap1,
           CombineLevel0,
           CombineLevel1,
-          ParticleDistanceAttenuation)
+          ParticleDistanceAttenuation,
+          ParticlesData,
+          ParticleCurves,
+          ParticleStep,
+          ParticleSimulation)
 
 ENUMCLASS(BlurType, uint32_t, Horizontal, Vertical)
 
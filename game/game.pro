@@ -17,6 +17,13 @@ HEADERS += \
     src/teapot.h \
     src/level.h \
     src/waypointsystem.h \
+    src/waypointgraph.h \
+    src/navmesh.h \
+    src/navmeshbuilder.h \
+    src/pathfinder.h \
+    src/crowd.h \
+    src/spatialindex.h \
+    src/entitystore.h \
     src/typesprivate.h
 
 SOURCES += \
@@ -27,7 +34,15 @@ SOURCES += \
     src/person.cpp \
     src/teapot.cpp \
     src/level.cpp \
-    src/waypointsystem.cpp
+    src/waypointsystem.cpp \
+    src/waypointgraph.cpp \
+    src/navmesh.cpp \
+    src/navmeshbuilder.cpp \
+    src/pathfinder.cpp \
+    src/crowd.cpp \
+    src/spatialindex.cpp \
+    src/entitystore.cpp \
+    src/object.cpp
 
 LIBS += \
     -lcore
@@ -0,0 +1,422 @@
+#include <algorithm>
+#include <limits>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include "crowd.h"
+
+namespace trash
+{
+namespace game
+{
+
+namespace
+{
+
+const float epsilon = 1e-5f;
+
+float det(const glm::vec2& a, const glm::vec2& b)
+{
+    return a.x * b.y - a.y * b.x;
+}
+
+}
+
+const uint32_t Crowd::invalidId = std::numeric_limits<uint32_t>::max();
+
+const float Crowd::s_neighborDistance = 3.f;
+const uint32_t Crowd::s_maxNeighbors = 10u;
+const float Crowd::s_timeHorizon = 2.f;
+
+Crowd::Crowd()
+    : m_numAgents(0u)
+    , m_cellSize(s_neighborDistance)
+    , m_bucketsMask(0u)
+{
+}
+
+Crowd::~Crowd()
+{
+}
+
+uint32_t Crowd::addAgent(const glm::vec2& position, float radius, float maxSpeed)
+{
+    uint32_t id;
+    if (m_freeIds.empty())
+    {
+        id = static_cast<uint32_t>(m_positions.size());
+        m_positions.emplace_back();
+        m_velocities.emplace_back();
+        m_preferredVelocities.emplace_back();
+        m_newVelocities.emplace_back();
+        m_radiuses.emplace_back();
+        m_maxSpeeds.emplace_back();
+        m_isActive.emplace_back();
+    }
+    else
+    {
+        id = m_freeIds.back();
+        m_freeIds.pop_back();
+    }
+
+    m_positions[id] = position;
+    m_velocities[id] = m_preferredVelocities[id] = m_newVelocities[id] = glm::vec2(0.f);
+    m_radiuses[id] = radius;
+    m_maxSpeeds[id] = maxSpeed;
+    m_isActive[id] = true;
+    ++m_numAgents;
+
+    return id;
+}
+
+void Crowd::removeAgent(uint32_t id)
+{
+    if ((id >= m_isActive.size()) || !m_isActive[id])
+        return;
+
+    m_isActive[id] = false;
+    m_freeIds.push_back(id);
+    --m_numAgents;
+}
+
+void Crowd::setAgentPosition(uint32_t id, const glm::vec2& position)
+{
+    m_positions[id] = position;
+}
+
+const glm::vec2& Crowd::agentPosition(uint32_t id) const
+{
+    return m_positions[id];
+}
+
+const glm::vec2& Crowd::agentVelocity(uint32_t id) const
+{
+    return m_velocities[id];
+}
+
+void Crowd::setAgentPreferredVelocity(uint32_t id, const glm::vec2& velocity)
+{
+    m_preferredVelocities[id] = velocity;
+}
+
+void Crowd::update(float dt)
+{
+    if ((m_numAgents == 0u) || (dt <= 0.f))
+        return;
+
+    buildSpatialHash();
+
+    // agents are processed in the order of the buckets, so consecutive agents mostly read the same cells
+    for (auto id : m_sortedIds)
+        computeVelocity(id, dt, m_scratch);
+
+    for (auto id : m_sortedIds)
+    {
+        m_velocities[id] = m_newVelocities[id];
+        m_positions[id] += m_velocities[id] * dt;
+    }
+}
+
+void Crowd::buildSpatialHash()
+{
+    uint32_t numBuckets = 16u;
+    while (numBuckets < 2u * m_numAgents)
+        numBuckets <<= 1u;
+    m_bucketsMask = numBuckets - 1u;
+
+    m_bucketsFirstAgent.assign(numBuckets + 1u, 0u);
+    m_agentsBuckets.resize(m_positions.size());
+
+    // counting sort of the agents by buckets
+    for (uint32_t id = 0; id < m_positions.size(); ++id)
+    {
+        if (!m_isActive[id])
+            continue;
+
+        const glm::vec2 cell = glm::floor(m_positions[id] / m_cellSize);
+        const uint32_t b = bucket(static_cast<int32_t>(cell.x), static_cast<int32_t>(cell.y));
+        m_agentsBuckets[id] = b;
+        ++m_bucketsFirstAgent[b + 1u];
+    }
+
+    for (uint32_t b = 0; b < numBuckets; ++b)
+        m_bucketsFirstAgent[b + 1u] += m_bucketsFirstAgent[b];
+
+    m_sortedIds.resize(m_numAgents);
+    m_sortedX.resize(m_numAgents);
+    m_sortedZ.resize(m_numAgents);
+
+    std::vector<uint32_t> heads(m_bucketsFirstAgent.begin(), m_bucketsFirstAgent.end() - 1);
+    for (uint32_t id = 0; id < m_positions.size(); ++id)
+    {
+        if (!m_isActive[id])
+            continue;
+
+        const uint32_t index = heads[m_agentsBuckets[id]]++;
+        m_sortedIds[index] = id;
+        m_sortedX[index] = m_positions[id].x;
+        m_sortedZ[index] = m_positions[id].y;
+    }
+}
+
+void Crowd::findNeighbors(uint32_t id, Scratch& scratch) const
+{
+    auto& neighbors = scratch.neighbors;
+    neighbors.clear();
+
+    const glm::vec2& position = m_positions[id];
+    const glm::vec2 cell = glm::floor(position / m_cellSize);
+    float rangeSq = s_neighborDistance * s_neighborDistance;
+
+    uint32_t visitedBuckets[9];
+    uint32_t numVisitedBuckets = 0u;
+
+    for (int32_t dz = -1; dz <= 1; ++dz)
+        for (int32_t dx = -1; dx <= 1; ++dx)
+        {
+            // different cells may share a bucket
+            const uint32_t b = bucket(static_cast<int32_t>(cell.x) + dx, static_cast<int32_t>(cell.y) + dz);
+            if (std::find(visitedBuckets, visitedBuckets + numVisitedBuckets, b) != visitedBuckets + numVisitedBuckets)
+                continue;
+            visitedBuckets[numVisitedBuckets++] = b;
+
+            const uint32_t first = m_bucketsFirstAgent[b];
+            const uint32_t count = m_bucketsFirstAgent[b + 1u] - first;
+
+            // the distances are computed over the contiguous coordinates first, so the loop is vectorized
+            scratch.distances.resize(count);
+            const float *x = m_sortedX.data() + first;
+            const float *z = m_sortedZ.data() + first;
+            float *distances = scratch.distances.data();
+            for (uint32_t k = 0; k < count; ++k)
+            {
+                const float ax = x[k] - position.x;
+                const float az = z[k] - position.y;
+                distances[k] = ax * ax + az * az;
+            }
+
+            for (uint32_t k = 0; k < count; ++k)
+            {
+                const float distSq = distances[k];
+                if ((distSq >= rangeSq) || (m_sortedIds[first + k] == id))
+                    continue;
+
+                // the nearest neighbors are kept sorted, the range shrinks to the farthest of them when there are enough ones
+                if (neighbors.size() < s_maxNeighbors)
+                    neighbors.emplace_back();
+
+                size_t i = neighbors.size() - 1u;
+                while ((i != 0u) && (distSq < neighbors[i - 1u].first))
+                {
+                    neighbors[i] = neighbors[i - 1u];
+                    --i;
+                }
+                neighbors[i] = {distSq, first + k};
+
+                if (neighbors.size() == s_maxNeighbors)
+                    rangeSq = neighbors.back().first;
+            }
+        }
+}
+
+void Crowd::computeVelocity(uint32_t id, float dt, Scratch& scratch)
+{
+    findNeighbors(id, scratch);
+
+    const glm::vec2& position = m_positions[id];
+    const glm::vec2& velocity = m_velocities[id];
+    const float radius = m_radiuses[id];
+    const float invTimeHorizon = 1.f / s_timeHorizon;
+
+    auto& lines = scratch.lines;
+    lines.clear();
+
+    for (const auto& neighbor : scratch.neighbors)
+    {
+        const uint32_t other = m_sortedIds[neighbor.second];
+
+        const glm::vec2 relativePosition = m_positions[other] - position;
+        const glm::vec2 relativeVelocity = velocity - m_velocities[other];
+        const float distSq = neighbor.first;
+        const float combinedRadius = radius + m_radiuses[other];
+        const float combinedRadiusSq = combinedRadius * combinedRadius;
+
+        Line line;
+        glm::vec2 u;
+
+        if (distSq > combinedRadiusSq)
+        {
+            // vector from the cutoff center to the relative velocity
+            const glm::vec2 w = relativeVelocity - invTimeHorizon * relativePosition;
+            const float wLengthSq = glm::dot(w, w);
+            const float dotProduct = glm::dot(w, relativePosition);
+
+            if ((dotProduct < 0.f) && (dotProduct * dotProduct > combinedRadiusSq * wLengthSq))
+            {
+                // projection on the cutoff circle
+                const float wLength = glm::sqrt(wLengthSq);
+                const glm::vec2 unitW = w / wLength;
+                line.direction = glm::vec2(unitW.y, -unitW.x);
+                u = (combinedRadius * invTimeHorizon - wLength) * unitW;
+            }
+            else
+            {
+                // projection on the legs
+                const float leg = glm::sqrt(distSq - combinedRadiusSq);
+                if (det(relativePosition, w) > 0.f)
+                    line.direction = glm::vec2(relativePosition.x * leg - relativePosition.y * combinedRadius,
+                                               relativePosition.x * combinedRadius + relativePosition.y * leg) / distSq;
+                else
+                    line.direction = -glm::vec2(relativePosition.x * leg + relativePosition.y * combinedRadius,
+                                                -relativePosition.x * combinedRadius + relativePosition.y * leg) / distSq;
+
+                u = glm::dot(relativeVelocity, line.direction) * line.direction - relativeVelocity;
+            }
+        }
+        else
+        {
+            // the agents collide, they are pushed apart during the time step
+            const float invTimeStep = 1.f / dt;
+            const glm::vec2 w = relativeVelocity - invTimeStep * relativePosition;
+            const float wLength = glm::length(w);
+            const glm::vec2 unitW = (wLength > epsilon) ? w / wLength : glm::vec2(1.f, 0.f);
+            line.direction = glm::vec2(unitW.y, -unitW.x);
+            u = (combinedRadius * invTimeStep - wLength) * unitW;
+        }
+
+        // each agent takes a half of the responsibility
+        line.point = velocity + .5f * u;
+        lines.push_back(line);
+    }
+
+    glm::vec2 newVelocity;
+    const float maxSpeed = m_maxSpeeds[id];
+    const size_t lineFail = linearProgram2(lines, maxSpeed, m_preferredVelocities[id], false, newVelocity);
+    if (lineFail < lines.size())
+        linearProgram3(lines, lineFail, maxSpeed, scratch.projectedLines, newVelocity);
+
+    m_newVelocities[id] = newVelocity;
+}
+
+uint32_t Crowd::bucket(int32_t x, int32_t z) const
+{
+    return ((static_cast<uint32_t>(x) * 73856093u) ^ (static_cast<uint32_t>(z) * 19349663u)) & m_bucketsMask;
+}
+
+bool Crowd::linearProgram1(const std::vector<Line>& lines, size_t lineNo, float radius, const glm::vec2& optVelocity, bool directionOpt, glm::vec2& result)
+{
+    const Line& line = lines[lineNo];
+    const float dotProduct = glm::dot(line.point, line.direction);
+    const float discriminant = dotProduct * dotProduct + radius * radius - glm::dot(line.point, line.point);
+    if (discriminant < 0.f)
+        return false; // the max speed circle fully invalidates the line
+
+    const float sqrtDiscriminant = glm::sqrt(discriminant);
+    float tLeft = -dotProduct - sqrtDiscriminant;
+    float tRight = -dotProduct + sqrtDiscriminant;
+
+    for (size_t i = 0; i < lineNo; ++i)
+    {
+        const float denominator = det(line.direction, lines[i].direction);
+        const float numerator = det(lines[i].direction, line.point - lines[i].point);
+
+        if (glm::abs(denominator) <= epsilon)
+        {
+            // the lines are almost parallel
+            if (numerator < 0.f)
+                return false;
+            continue;
+        }
+
+        const float t = numerator / denominator;
+        if (denominator >= 0.f)
+            tRight = glm::min(tRight, t);
+        else
+            tLeft = glm::max(tLeft, t);
+
+        if (tLeft > tRight)
+            return false;
+    }
+
+    if (directionOpt)
+    {
+        result = line.point + ((glm::dot(optVelocity, line.direction) > 0.f) ? tRight : tLeft) * line.direction;
+    }
+    else
+    {
+        const float t = glm::dot(line.direction, optVelocity - line.point);
+        result = line.point + glm::clamp(t, tLeft, tRight) * line.direction;
+    }
+
+    return true;
+}
+
+size_t Crowd::linearProgram2(const std::vector<Line>& lines, float radius, const glm::vec2& optVelocity, bool directionOpt, glm::vec2& result)
+{
+    if (directionOpt)
+        result = optVelocity * radius; // the optimization direction is a unit vector
+    else if (glm::dot(optVelocity, optVelocity) > radius * radius)
+        result = glm::normalize(optVelocity) * radius;
+    else
+        result = optVelocity;
+
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        if (det(lines[i].direction, lines[i].point - result) > 0.f)
+        {
+            // the result doesn't satisfy the constraint
+            const glm::vec2 tempResult = result;
+            if (!linearProgram1(lines, i, radius, optVelocity, directionOpt, result))
+            {
+                result = tempResult;
+                return i;
+            }
+        }
+    }
+
+    return lines.size();
+}
+
+void Crowd::linearProgram3(const std::vector<Line>& lines, size_t beginLine, float radius, std::vector<Line>& projectedLines, glm::vec2& result)
+{
+    // the constraints are infeasible, the velocity minimizing the max penetration is taken
+    float distance = 0.f;
+
+    for (size_t i = beginLine; i < lines.size(); ++i)
+    {
+        if (det(lines[i].direction, lines[i].point - result) <= distance)
+            continue;
+
+        projectedLines.clear();
+        for (size_t j = 0; j < i; ++j)
+        {
+            Line line;
+            const float determinant = det(lines[i].direction, lines[j].direction);
+
+            if (glm::abs(determinant) <= epsilon)
+            {
+                if (glm::dot(lines[i].direction, lines[j].direction) > 0.f)
+                    continue; // the lines point in the same direction
+
+                line.point = .5f * (lines[i].point + lines[j].point);
+            }
+            else
+            {
+                line.point = lines[i].point + (det(lines[j].direction, lines[i].point - lines[j].point) / determinant) * lines[i].direction;
+            }
+
+            line.direction = glm::normalize(lines[j].direction - lines[i].direction);
+            projectedLines.push_back(line);
+        }
+
+        const glm::vec2 tempResult = result;
+        if (linearProgram2(projectedLines, radius, glm::vec2(-lines[i].direction.y, lines[i].direction.x), true, result) < projectedLines.size())
+            result = tempResult; // can only happen by rounding errors, the result is kept
+
+        distance = det(lines[i].direction, lines[i].point - result);
+    }
+}
+
+} // namespace
+} // namespace
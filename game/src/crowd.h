@@ -0,0 +1,88 @@
+#ifndef CROWD_H
+#define CROWD_H
+
+#include <vector>
+
+#include <glm/vec2.hpp>
+
+#include <utils/noncopyble.h>
+
+namespace trash
+{
+namespace game
+{
+
+// Local collision avoidance of agents moving in the (x, z) plane by optimal reciprocal collision avoidance (ORCA).
+// Every update the agents are counting sorted into a spatial hash of uniform cells, whose positions are stored contiguously,
+// so neighbor queries touch only the nearby cells and read memory linearly. New velocities are solved by the 2D and 3D linear programs
+// of ORCA for each agent from the velocities of the previous update, so the result doesn't depend on the order of the agents.
+class Crowd
+{
+    NONCOPYBLE(Crowd)
+
+public:
+    static const uint32_t invalidId;
+
+    Crowd();
+    ~Crowd();
+
+    uint32_t addAgent(const glm::vec2&, float, float); // position, radius and max speed
+    void removeAgent(uint32_t);
+    uint32_t numAgents() const { return m_numAgents; }
+
+    void setAgentPosition(uint32_t, const glm::vec2&);
+    const glm::vec2& agentPosition(uint32_t) const;
+    const glm::vec2& agentVelocity(uint32_t) const;
+    void setAgentPreferredVelocity(uint32_t, const glm::vec2&);
+
+    void update(float); // seconds
+
+private:
+    struct Line
+    {
+        glm::vec2 point;
+        glm::vec2 direction;
+    };
+
+    struct Scratch
+    {
+        std::vector<std::pair<float, uint32_t>> neighbors; // squared distances and sorted indices
+        std::vector<float> distances; // squared distances to the agents of a bucket
+        std::vector<Line> lines, projectedLines;
+    };
+
+    void buildSpatialHash();
+    void findNeighbors(uint32_t, Scratch&) const;
+    void computeVelocity(uint32_t, float, Scratch&);
+    uint32_t bucket(int32_t, int32_t) const;
+
+    static bool linearProgram1(const std::vector<Line>&, size_t, float, const glm::vec2&, bool, glm::vec2&);
+    static size_t linearProgram2(const std::vector<Line>&, float, const glm::vec2&, bool, glm::vec2&);
+    static void linearProgram3(const std::vector<Line>&, size_t, float, std::vector<Line>&, glm::vec2&);
+
+    // agents by ids, removed ones are inactive until their ids are reused
+    std::vector<glm::vec2> m_positions, m_velocities, m_preferredVelocities, m_newVelocities;
+    std::vector<float> m_radiuses, m_maxSpeeds;
+    std::vector<bool> m_isActive;
+    std::vector<uint32_t> m_freeIds;
+    uint32_t m_numAgents;
+
+    // spatial hash, the agents are sorted by buckets
+    float m_cellSize;
+    uint32_t m_bucketsMask;
+    std::vector<uint32_t> m_bucketsFirstAgent; // number of buckets + 1
+    std::vector<uint32_t> m_agentsBuckets; // by ids
+    std::vector<uint32_t> m_sortedIds;
+    std::vector<float> m_sortedX, m_sortedZ;
+
+    Scratch m_scratch;
+
+    static const float s_neighborDistance;
+    static const uint32_t s_maxNeighbors;
+    static const float s_timeHorizon;
+};
+
+} // namespace
+} // namespace
+
+#endif // CROWD_H
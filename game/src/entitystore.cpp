@@ -0,0 +1,198 @@
+#include <algorithm>
+
+#include <glm/geometric.hpp>
+#include <glm/common.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <core/node.h>
+#include <core/modelnode.h>
+
+#include "entitystore.h"
+
+namespace trash
+{
+namespace game
+{
+
+namespace
+{
+
+utils::Transform interpolate(const utils::Transform& t1, const utils::Transform& t2, float alpha)
+{
+    return utils::Transform(glm::mix(t1.scale, t2.scale, alpha),
+                            glm::slerp(t1.rotation, t2.rotation, alpha),
+                            glm::mix(t1.translation, t2.translation, alpha));
+}
+
+}
+
+const Entity EntityStore::invalidEntity = std::numeric_limits<Entity>::max();
+
+EntityStore::EntityStore()
+{
+}
+
+Entity EntityStore::createEntity(std::shared_ptr<core::Node> node)
+{
+    Entity entity;
+    if (!m_freeEntities.empty())
+    {
+        entity = m_freeEntities.back();
+        m_freeEntities.pop_back();
+    }
+    else
+    {
+        entity = static_cast<Entity>(m_nodes.size());
+        m_nodes.push_back(nullptr);
+        m_isChanged.push_back(false);
+    }
+
+    m_nodes[entity] = node;
+    m_transforms.insert(entity, TransformComponent{node->transform(), node->transform()});
+    return entity;
+}
+
+void EntityStore::destroyEntity(Entity entity)
+{
+    // the node keeps the last transform of the entity
+    m_nodes[entity]->setTransform(m_transforms.get(entity).transform);
+    for (auto entities : {&m_changedEntities, &m_movingEntities, &m_settledEntities})
+        entities->erase(std::remove(entities->begin(), entities->end(), entity), entities->end());
+    m_isChanged[entity] = false;
+
+    m_transforms.erase(entity);
+    m_velocities.erase(entity);
+    m_ais.erase(entity);
+    m_animations.erase(entity);
+
+    m_nodes[entity] = nullptr;
+    m_freeEntities.push_back(entity);
+}
+
+const utils::Transform& EntityStore::transform(Entity entity) const
+{
+    return m_transforms.get(entity).transform;
+}
+
+void EntityStore::setTransform(Entity entity, const utils::Transform& value)
+{
+    markChanged(entity);
+    m_transforms.get(entity).transform = value;
+}
+
+void EntityStore::update(uint64_t, uint64_t dt)
+{
+    const float seconds = dt * .001f;
+
+    updateAIs(seconds);
+    updateVelocities(seconds);
+
+    // the entities which haven't been changed by this step stop being interpolated after the next presentation
+    for (auto entity : m_movingEntities)
+    {
+        if (!m_isChanged[entity])
+        {
+            auto& component = m_transforms.get(entity);
+            component.previousTransform = component.transform;
+            m_settledEntities.push_back(entity);
+        }
+    }
+
+    m_movingEntities.swap(m_changedEntities);
+    m_changedEntities.clear();
+    for (auto entity : m_movingEntities)
+        m_isChanged[entity] = false;
+}
+
+void EntityStore::present(uint64_t time, float alpha)
+{
+    updateAnimations(time);
+
+    for (auto entity : m_settledEntities)
+        m_nodes[entity]->setTransform(m_transforms.get(entity).transform);
+    m_settledEntities.clear();
+
+    for (auto entity : m_movingEntities)
+    {
+        const auto& component = m_transforms.get(entity);
+        m_nodes[entity]->setTransform(interpolate(component.previousTransform, component.transform, alpha));
+    }
+}
+
+void EntityStore::markChanged(Entity entity)
+{
+    // the transform at the beginning of the step is kept for the interpolation, so the entity must be marked before changing it
+    if (!m_isChanged[entity])
+    {
+        auto& component = m_transforms.get(entity);
+        component.previousTransform = component.transform;
+
+        m_isChanged[entity] = true;
+        m_changedEntities.push_back(entity);
+    }
+}
+
+void EntityStore::updateAIs(float seconds)
+{
+    for (size_t i = 0; i < m_ais.size(); ++i)
+    {
+        auto& ai = m_ais.component(i);
+        if (ai.state != AIState::Moving)
+            continue;
+
+        const Entity entity = m_ais.entity(i);
+        markChanged(entity);
+
+        auto& transform = m_transforms.get(entity).transform;
+        auto& velocity = m_velocities.has(entity) ? m_velocities.get(entity).velocity : m_velocities.insert(entity).velocity;
+
+        const glm::vec3 direction = ai.target - transform.translation;
+        const float distance = glm::length(direction);
+
+        if (distance > 0.f)
+        {
+            const glm::vec3 z(direction / distance);
+            const glm::vec3 y(0.0f, 1.0f, 0.0f);
+            const glm::vec3 x(glm::cross(y, z));
+            transform.rotation = glm::quat_cast(glm::mat3x3(x, y, z));
+        }
+
+        if (distance <= ai.speed * seconds)
+        {
+            transform.translation = ai.target;
+            velocity = glm::vec3(0.f);
+            ai.state = AIState::Arrived;
+        }
+        else
+        {
+            velocity = direction * (ai.speed / distance);
+        }
+    }
+}
+
+void EntityStore::updateVelocities(float seconds)
+{
+    for (size_t i = 0; i < m_velocities.size(); ++i)
+    {
+        const auto& velocity = m_velocities.component(i).velocity;
+        if (velocity == glm::vec3(0.f))
+            continue;
+
+        const Entity entity = m_velocities.entity(i);
+        markChanged(entity);
+        m_transforms.get(entity).transform.translation += velocity * seconds;
+    }
+}
+
+void EntityStore::updateAnimations(uint64_t time)
+{
+    for (size_t i = 0; i < m_animations.size(); ++i)
+    {
+        const auto& animation = m_animations.component(i);
+        if (animation.modelNode && !animation.name.empty())
+            animation.modelNode->setAnimationFrame(animation.name, (time > animation.startTime) ? time - animation.startTime : 0u);
+    }
+}
+
+} // namespace
+} // namespace
@@ -0,0 +1,157 @@
+#ifndef ENTITYSTORE_H
+#define ENTITYSTORE_H
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <limits>
+
+#include <glm/vec3.hpp>
+
+#include <utils/enumclass.h>
+#include <utils/noncopyble.h>
+#include <utils/transform.h>
+
+#include <core/forwarddecl.h>
+
+namespace trash
+{
+namespace game
+{
+
+using Entity = uint32_t;
+
+// Sparse set of components. The components are stored densely in the order of insertion (with swap removal),
+// so systems iterate contiguous arrays, and the sparse array maps entities to dense indices.
+// Insertion may reallocate the arrays, so references to the components are valid only until the next insertion.
+template <typename T>
+class ComponentArray
+{
+public:
+    static const uint32_t invalidIndex = std::numeric_limits<uint32_t>::max();
+
+    bool has(Entity entity) const { return (entity < m_sparse.size()) && (m_sparse[entity] != invalidIndex); }
+    T& get(Entity entity) { return m_components[m_sparse[entity]]; }
+    const T& get(Entity entity) const { return m_components[m_sparse[entity]]; }
+
+    T& insert(Entity entity, const T& component = T())
+    {
+        if (has(entity))
+            return get(entity) = component;
+
+        if (entity >= m_sparse.size())
+            m_sparse.resize(entity + 1, invalidIndex);
+
+        m_sparse[entity] = static_cast<uint32_t>(m_components.size());
+        m_entities.push_back(entity);
+        m_components.push_back(component);
+        return m_components.back();
+    }
+
+    void erase(Entity entity)
+    {
+        if (!has(entity))
+            return;
+
+        const uint32_t index = m_sparse[entity];
+        const Entity lastEntity = m_entities.back();
+
+        m_entities[index] = lastEntity;
+        m_components[index] = std::move(m_components.back());
+        m_sparse[lastEntity] = index;
+
+        m_entities.pop_back();
+        m_components.pop_back();
+        m_sparse[entity] = invalidIndex;
+    }
+
+    size_t size() const { return m_components.size(); }
+    Entity entity(size_t index) const { return m_entities[index]; }
+    T& component(size_t index) { return m_components[index]; }
+    const T& component(size_t index) const { return m_components[index]; }
+
+private:
+    std::vector<uint32_t> m_sparse; // by entities
+    std::vector<Entity> m_entities;
+    std::vector<T> m_components;
+};
+
+template <typename T>
+const uint32_t ComponentArray<T>::invalidIndex;
+
+struct TransformComponent
+{
+    utils::Transform transform;
+    utils::Transform previousTransform; // at the beginning of the last simulation step
+};
+
+struct VelocityComponent
+{
+    glm::vec3 velocity = glm::vec3(0.f); // units per second
+};
+
+ENUMCLASS(AIState, uint32_t, Idle, Moving, Arrived)
+
+struct AIComponent
+{
+    AIState state = AIState::Idle;
+    glm::vec3 target = glm::vec3(0.f);
+    float speed = 0.f; // units per second
+};
+
+struct AnimationComponent
+{
+    std::shared_ptr<core::ModelNode> modelNode;
+    std::string name;
+    uint64_t startTime = 0u;
+};
+
+// Component storage of the objects of a scene and the systems updating them. Updates are fixed simulation steps, presentation writes
+// the transforms interpolated between the two latest steps to the graphics nodes, only for the entities changed by the latest step.
+class EntityStore
+{
+    NONCOPYBLE(EntityStore)
+
+public:
+    static const Entity invalidEntity;
+
+    EntityStore();
+
+    Entity createEntity(std::shared_ptr<core::Node>); // the node receiving the transform of the entity
+    void destroyEntity(Entity);
+
+    const utils::Transform& transform(Entity) const;
+    void setTransform(Entity, const utils::Transform&);
+
+    ComponentArray<VelocityComponent>& velocities() { return m_velocities; }
+    ComponentArray<AIComponent>& ais() { return m_ais; }
+    ComponentArray<AnimationComponent>& animations() { return m_animations; }
+
+    void update(uint64_t, uint64_t); // time and dt of the step in milliseconds
+    void present(uint64_t, float); // time of animations and the interpolation factor between the two latest steps
+
+private:
+    void markChanged(Entity);
+
+    void updateAIs(float);
+    void updateVelocities(float);
+    void updateAnimations(uint64_t);
+
+    std::vector<std::shared_ptr<core::Node>> m_nodes; // by entities
+    std::vector<Entity> m_freeEntities;
+
+    ComponentArray<TransformComponent> m_transforms;
+    ComponentArray<VelocityComponent> m_velocities;
+    ComponentArray<AIComponent> m_ais;
+    ComponentArray<AnimationComponent> m_animations;
+
+    std::vector<Entity> m_changedEntities; // by the current step
+    std::vector<bool> m_isChanged; // by entities
+    std::vector<Entity> m_movingEntities; // changed by the latest step
+    std::vector<Entity> m_settledEntities; // changed by the previous step but not by the latest one
+};
+
+} // namespace
+} // namespace
+
+#endif // ENTITYSTORE_H
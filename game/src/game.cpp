@@ -1,3 +1,5 @@
+#include <limits>
+
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <core/core.h>
@@ -23,6 +25,8 @@
 #include "floor.h"
 #include "teapot.h"
 #include "waypointsystem.h"
+#include "pathfinder.h"
+#include "crowd.h"
 
 auto rnd = [](float from = 0.0f, float to = 1.0f)
 {
@@ -217,13 +221,15 @@ void Game::doInitialize()
     for (size_t i = 0; i < GamePrivate::numPersons; ++i)
     {
         m_->persons[i] = std::make_shared<Person>(GamePrivate::personsNames[i]);
-        m_->scene->attachObject(m_->persons[i]);
 
         float angle = 2.0f * glm::pi<float>() * i / GamePrivate::numPersons;
-        m_->persons[i]->graphicsNode()->setTransform(utils::Transform(
-                                                         glm::vec3(1.f,1.f,1.f),
-                                                         glm::quat_cast(glm::mat3x3(glm::vec3(-.7f,0.f,-.7f), glm::vec3(0.f,1.f,0.f), glm::vec3(.7f,0.f,-.7f))),
-                                                         20.0f * glm::vec3(glm::cos(angle), 0.0f,glm::sin(angle))));
+        m_->persons[i]->setTransform(utils::Transform(
+                                         glm::vec3(1.f,1.f,1.f),
+                                         glm::quat_cast(glm::mat3x3(glm::vec3(-.7f,0.f,-.7f), glm::vec3(0.f,1.f,0.f), glm::vec3(.7f,0.f,-.7f))),
+                                         20.0f * glm::vec3(glm::cos(angle), 0.0f,glm::sin(angle))));
+
+        m_->scene->attachObject(m_->persons[i]);
+        m_->persons[i]->setCrowd(m_->scene->crowd());
 
         m_->acivePerson = m_->persons[i];
     }
@@ -268,9 +274,9 @@ void Game::doInitialize()
 
     const size_t wpFrom = 2;
     auto person = m_->persons[0];
-    auto transform = person->graphicsNode()->transform();
+    auto transform = person->transform();
     transform.translation = waypoints[wpFrom]->position;
-    person->graphicsNode()->setTransform(transform);
+    person->setTransform(transform);
 }
 
 void Game::doUnitialize()
@@ -283,7 +289,22 @@ void Game::doUnitialize()
 
 void Game::doUpdate(uint64_t time, uint64_t dt)
 {   
-    m_->scene->update(time, dt);
+    // the simulation runs by fixed steps, the time exceeding the max number of steps per frame is dropped to not fall behind forever
+    static const uint64_t step = GamePrivate::simulationStep;
+    m_->simulationAccumulator += glm::min(dt, GamePrivate::maxSimulationStepsPerFrame * step);
+    while (m_->simulationAccumulator >= step)
+    {
+        m_->simulationTime += step;
+        m_->scene->update(m_->simulationTime, step);
+        m_->scene->crowd()->update(step * .001f);
+        m_->simulationAccumulator -= step;
+    }
+
+    // the frame shows the state between the two latest steps
+    const float alpha = static_cast<float>(m_->simulationAccumulator) / step;
+    m_->scene->present(glm::max(m_->simulationTime + m_->simulationAccumulator, step) - step, alpha);
+
+    m_->scene->pathFinder().update(GamePrivate::pathFindingTimeBudget);
 
     const float r = 2.2f;
     const float t = /*3.14f / 4;*/time * 0.00001f;
@@ -306,35 +327,34 @@ void Game::doUpdate(uint64_t time, uint64_t dt)
 
         utils::Frustum frustum(glm::perspective(glm::pi<float>()*0.25f, 1.0f, .5f, 3000.0f) * glm::inverse(transform));
 
-        core::NodeFrustumIntersectionVisitor nv(frustum);
-        m_->scene->graphicsScene()->rootNode()->accept(nv);
-        const auto& intersectionData = nv.intersectionData();
+        m_->scene->findObjects(frustum, m_->foundObjects);
 
         person->setText(person->name());
 
-        bool isFound = false;
-        for (const auto& intersection: intersectionData.nodes)
+        std::shared_ptr<Person> closestPerson;
+        float closestDistance = std::numeric_limits<float>::max();
+        for (const auto& intersectedObject : m_->foundObjects)
         {
-            if (intersection.first < 0.f)
-                continue;
-
-            auto intersectedObject = m_->scene->findObject(intersection.second);
             if (intersectedObject == person)
                 continue;
 
             for (auto intersectedPerson : m_->persons)
             {
-                if (intersectedPerson == intersectedObject)
+                if (intersectedPerson != intersectedObject)
+                    continue;
+
+                const float distance = glm::distance(ray.pos, intersectedPerson->graphicsNode()->globalTransform().translation);
+                if (distance < closestDistance)
                 {
-                    person->setText(person->name() + " is looking at " + intersectedPerson->name());
-                    isFound = true;
-                    break;
+                    closestDistance = distance;
+                    closestPerson = intersectedPerson;
                 }
-            }
-
-            if (isFound)
                 break;
+            }
         }
+
+        if (closestPerson)
+            person->setText(person->name() + " is looking at " + closestPerson->name());
     }
 }
 
@@ -357,16 +377,36 @@ void Game::doMouseClick(uint32_t, int x, int y)
             const glm::vec3 clickCoord = ray.calculatePoint(firstDist);
             const glm::vec3 personPos = m_->acivePerson.lock()->graphicsNode()->globalTransform().translation;
 
-            static const float shift = 0.25f;
-            auto path = m_->scene->buildRoute(personPos, clickCoord, {glm::vec2(0.f, 0.75f - shift),
-                                                                      glm::vec2(0.f - shift, 0.75f + shift),
-                                                                      glm::vec2(0.f + shift, 0.75f + shift)});
+            std::weak_ptr<Person> weakPerson = m_->acivePerson;
+            std::weak_ptr<Level> weakLevel = m_->scene;
+
+            // the route is searched on the path finder threads, the way points are the fallback if the navigation mesh has no path
+            m_->scene->pathFinder().findPath(personPos, clickCoord, [weakPerson, weakLevel, personPos, clickCoord](PathFinder::PathPtr path) {
+                auto person = weakPerson.lock();
+                auto level = weakLevel.lock();
+                if (!person || !level)
+                    return;
+
+                std::vector<glm::vec3> targets;
+                if (path)
+                {
+                    for (size_t i = 1; i + 1u < path->size(); ++i)
+                        targets.push_back((*path)[i]);
+                }
+                else
+                {
+                    static const float shift = 0.25f;
+                    for (auto wp : level->buildRoute(personPos, clickCoord, {glm::vec2(0.f, 0.75f - shift),
+                                                                             glm::vec2(0.f - shift, 0.75f + shift),
+                                                                             glm::vec2(0.f + shift, 0.75f + shift)}))
+                        targets.push_back(wp->position);
+                }
 
-            auto person = m_->acivePerson.lock();
-            person->clearTasks();
-            for (auto wp : path)
-                person->addTask(std::make_shared<PersonTaskRun>(wp->position));
-            person->addTask(std::make_shared<PersonTaskRun>(clickCoord));
+                person->clearTasks();
+                for (const auto& target : targets)
+                    person->addTask(std::make_shared<PersonTaskRun>(target));
+                person->addTask(std::make_shared<PersonTaskRun>(clickCoord));
+            });
         }
         else
         {
@@ -5,6 +5,10 @@ namespace trash
 namespace game
 {
 
+const uint64_t GamePrivate::pathFindingTimeBudget = 2000u;
+const uint64_t GamePrivate::simulationStep = 16u;
+const uint64_t GamePrivate::maxSimulationStepsPerFrame = 5u;
+
 const int GamePrivate::numPersons;
 const std::array<std::string, GamePrivate::numPersons> GamePrivate::personsNames {
     "malcolm.mdl",
@@ -15,6 +19,8 @@ const std::array<std::string, GamePrivate::numPersons> GamePrivate::personsNames
 };
 
 GamePrivate::GamePrivate()
+    : simulationTime(0u)
+    , simulationAccumulator(0u)
 {
 }
 
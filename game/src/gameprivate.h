@@ -11,6 +11,7 @@ namespace trash
 namespace game
 {
 
+class Object;
 class Person;
 class Level;
 class Floor;
@@ -22,10 +23,18 @@ public:
 
     std::shared_ptr<Level> scene;
 
+    static const uint64_t pathFindingTimeBudget; // microseconds per frame
+    static const uint64_t simulationStep; // milliseconds
+    static const uint64_t maxSimulationStepsPerFrame;
+
+    uint64_t simulationTime;
+    uint64_t simulationAccumulator;
+
     static const int numPersons = 1;
     static const std::array<std::string, numPersons> personsNames;
     std::array<std::shared_ptr<Person>, numPersons> persons;
     std::weak_ptr<Person> acivePerson;
+    std::vector<std::shared_ptr<Object>> foundObjects;
 
     std::shared_ptr<Floor> floor;
 };
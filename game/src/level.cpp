@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <limits>
 #include <queue>
 #include <set>
 
@@ -15,10 +17,16 @@
 #include <core/particlesystemnode.h>
 #include <core/nodevisitor.h>
 #include <core/nodeintersectionvisitor.h>
+#include <core/rayquery.h>
+#include <core/nodegeometryvisitor.h>
 #include <core/light.h>
 
 #include "level.h"
 #include "waypointsystem.h"
+#include "navmesh.h"
+#include "navmeshbuilder.h"
+#include "pathfinder.h"
+#include "crowd.h"
 
 namespace trash
 {
@@ -80,6 +88,16 @@ Level::Level()
     });
     m_wallsNode->accept(nv);
     m_floorNode->accept(nv);
+
+    m_wallsRayQuery = std::make_unique<core::RayQuery>(m_wallsNode);
+
+    core::NodeGeometryVisitor geometryVisitor;
+    m_wallsNode->accept(geometryVisitor);
+    m_floorNode->accept(geometryVisitor);
+    const auto& geometry = geometryVisitor.geometryData();
+    m_navMesh = NavMeshBuilder::build(geometry.vertices, geometry.indices);
+    m_pathFinder = std::make_unique<PathFinder>(m_navMesh);
+    m_crowd = std::make_shared<Crowd>();
 }
 
 Level::~Level()
@@ -96,11 +114,32 @@ const WayPointSystem &Level::wayPointSystem() const
     return *m_wayPointSystem;
 }
 
+PathFinder &Level::pathFinder()
+{
+    return *m_pathFinder;
+}
+
+std::shared_ptr<Crowd> Level::crowd()
+{
+    return m_crowd;
+}
+
 ClosestWayPoints Level::findClosestWayPoints(const glm::vec3& pos, const std::vector<glm::vec2>& rayShifts) const
+{
+    const auto wayPoints = m_wayPointSystem->wayPoints();
+    return findVisibleWayPoints(pos, std::vector<std::shared_ptr<WayPoint>>(wayPoints.begin(), wayPoints.end()), rayShifts);
+}
+
+ClosestWayPoints Level::findVisibleWayPoints(const glm::vec3& pos, const std::vector<std::shared_ptr<WayPoint>>& t, const std::vector<glm::vec2>& rayShifts) const
 {
     std::multimap<float, std::shared_ptr<WayPoint>> result;
 
-    auto t = m_wayPointSystem->wayPoints();
+    std::vector<std::pair<std::shared_ptr<WayPoint>, float>> candidates;
+    std::vector<utils::Ray> rays;
+    std::vector<float> distances;
+    candidates.reserve(t.size());
+    rays.reserve(t.size() * rayShifts.size());
+    distances.reserve(t.size() * rayShifts.size());
 
     for (auto wayPoint : t)
     {
@@ -113,32 +152,12 @@ ClosestWayPoints Level::findClosestWayPoints(const glm::vec3& pos, const std::ve
             static const glm::vec3 rayUp = glm::vec3(0.f, 1.f, 0.f);
             const glm::vec3 rayRight = glm::cross(rayUp, -rayDir);
 
-            bool isOk = true;
+            candidates.push_back({wayPoint, distance});
 
             for (const auto& shift : rayShifts)
             {
-                const glm::vec3 rayPos = pos + shift.x * rayRight + shift.y * rayUp;
-
-                core::NodeRayIntersectionVisitor visitor(utils::Ray(rayPos, rayDir));
-                m_wallsNode->accept(visitor);
-                const auto& intersections = visitor.intersectionData();
-
-                if (!intersections.nodes.empty() && intersections.nodes.begin()->first < distance)
-                {
-                    isOk = false;
-                    break;
-                }
-            }
-
-            if (isOk)
-            {
-                result.insert({distance, wayPoint});
-
-                for (const auto& shift : rayShifts)
-                {
-                    const glm::vec3 rayPos = pos + shift.x * rayRight + shift.y * rayUp;
-                    //m_wayPointNode->addLine(glm::vec4(0.f, 1.f, 0.f, 1.f), {rayPos, rayPos + rayDir * distance}, {}, false);
-                }
+                rays.push_back(utils::Ray(pos + shift.x * rayRight + shift.y * rayUp, rayDir));
+                distances.push_back(distance);
             }
         }
         else
@@ -147,33 +166,45 @@ ClosestWayPoints Level::findClosestWayPoints(const glm::vec3& pos, const std::ve
         }
     }
 
+    // all the rays of all the way points are traced by one batch
+    auto hits = std::make_unique<bool[]>(rays.size());
+    m_wallsRayQuery->occluded(rays.size(), rays.data(), distances.data(), hits.get());
+
+    for (size_t i = 0; i < candidates.size(); ++i)
+    {
+        const bool *wayPointHits = hits.get() + i * rayShifts.size();
+        if (std::none_of(wayPointHits, wayPointHits + rayShifts.size(), [](bool hit) { return hit; }))
+            result.insert({candidates[i].second, candidates[i].first});
+    }
+
     return result;
 }
 
 WayPointPath Level::buildRoute(const glm::vec3& startPoint, const glm::vec3& endPoint, const std::vector<glm::vec2>& rayShifts) const
 {
-    auto startWayPoint = std::make_shared<WayPoint>(startPoint);
-    auto endWayPoint = std::make_shared<WayPoint>(endPoint);
+    // the navigation mesh is already searched by the path finder, so the fallback doesn't search it again on the main thread
 
-    for (auto wayPoint : {startWayPoint, endWayPoint})
-    {
-        for (auto closestWayPoint : findClosestWayPoints(wayPoint->position, rayShifts))
-            m_wayPointSystem->insertTwoSided(wayPoint, closestWayPoint.second);
-    }
-
-    auto route = m_wayPointSystem->findPath(startWayPoint, endWayPoint);
+    // the end point is tested together with the way points, the graph itself isn't edited for the query
+    auto endWayPoint = std::make_shared<WayPoint>(endPoint);
+    auto startCandidates = m_wayPointSystem->compiledGraph()->wayPoints();
+    startCandidates.push_back(endWayPoint);
 
-    //const_cast<Level*>(this)->updateGraphics();
-    m_wayPointSystem->remove(startWayPoint);
-    m_wayPointSystem->remove(endWayPoint);
+    auto startWayPoints = findVisibleWayPoints(startPoint, startCandidates, rayShifts);
+    float directDistance = std::numeric_limits<float>::max();
+    for (auto it = startWayPoints.begin(); it != startWayPoints.end(); ++it)
+        if (it->second == endWayPoint)
+        {
+            directDistance = it->first;
+            startWayPoints.erase(it);
+            break;
+        }
 
-    if (!route.empty())
-    {
-        route.erase(route.begin());
-        route.erase(--(route.end()));
-    }
+    const auto endWayPoints = findClosestWayPoints(endPoint, rayShifts);
 
-    return route;
+    // routes are built on the main thread by the path finder callbacks, and only if the navigation mesh has no path,
+    // so the scratch isn't kept between them
+    WayPointSystem::Query query;
+    return m_wayPointSystem->findPath(startWayPoints, endPoint, endWayPoints, directDistance, query);
 }
 
 void Level::updateGraphics()
@@ -18,6 +18,9 @@ namespace game
 {
 
 class WayPointSystem;
+class NavMesh;
+class PathFinder;
+class Crowd;
 
 class Level : public Scene
 {
@@ -28,17 +31,26 @@ public:
     WayPointSystem& wayPointSystem();
     const WayPointSystem& wayPointSystem() const;
 
+    PathFinder& pathFinder();
+    std::shared_ptr<Crowd> crowd();
+
     ClosestWayPoints findClosestWayPoints(const glm::vec3&, const std::vector<glm::vec2>&) const;
-    WayPointPath buildRoute(const glm::vec3&, const glm::vec3&, const std::vector<glm::vec2>&) const;
+    WayPointPath buildRoute(const glm::vec3&, const glm::vec3&, const std::vector<glm::vec2>&) const; // over the way points only
 
     std::shared_ptr<const core::Node> floorNode() const { return m_floorNode; }
 
     void updateGraphics();
 
 protected:
+    ClosestWayPoints findVisibleWayPoints(const glm::vec3&, const std::vector<std::shared_ptr<WayPoint>>&, const std::vector<glm::vec2>&) const;
+
     std::shared_ptr<core::ModelNode> m_floorNode, m_wallsNode;
     std::shared_ptr<core::PrimitiveNode> m_wayPointNode;
     std::unique_ptr<WayPointSystem> m_wayPointSystem;
+    std::unique_ptr<core::RayQuery> m_wallsRayQuery;
+    std::shared_ptr<NavMesh> m_navMesh;
+    std::unique_ptr<PathFinder> m_pathFinder;
+    std::shared_ptr<Crowd> m_crowd;
 
 };
 
@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <limits>
+
+#include <glm/vec2.hpp>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include "navmesh.h"
+
+namespace trash
+{
+namespace game
+{
+
+const uint32_t NavMesh::invalidId = std::numeric_limits<uint32_t>::max();
+
+NavMesh::NavMesh()
+    : m_polygonsFirstVertex(1u, 0u)
+    , m_polygonsFirstPortal(1u, 0u)
+    , m_gridOrigin(0.f)
+    , m_cellSize(1.f)
+    , m_cellHeight(1.f)
+    , m_gridWidth(0u)
+    , m_gridDepth(0u)
+    , m_columnsFirstCell(1u, 0u)
+{
+}
+
+uint32_t NavMesh::findPolygon(const glm::vec3& point, glm::vec3& result) const
+{
+    static const int32_t maxSearchRadius = 8; // in cells
+
+    const auto cx = static_cast<int32_t>(glm::floor((point.x - m_gridOrigin.x) / m_cellSize));
+    const auto cz = static_cast<int32_t>(glm::floor((point.z - m_gridOrigin.z) / m_cellSize));
+
+    uint32_t bestPolygon = invalidId;
+    float bestDistance = std::numeric_limits<float>::max();
+
+    for (int32_t r = 0; r <= maxSearchRadius; ++r)
+    {
+        // cells of the ring are farther than (r - 1) cells in the (x, z) plane
+        const float ringDistance = static_cast<float>(glm::max(r - 1, 0)) * m_cellSize;
+        if (ringDistance * ringDistance > bestDistance)
+            break;
+
+        for (int32_t z = cz - r; z <= cz + r; ++z)
+        {
+            if ((z < 0) || (z >= static_cast<int32_t>(m_gridDepth)))
+                continue;
+
+            const bool isRingRow = (z == cz - r) || (z == cz + r);
+            for (int32_t x = cx - r; x <= cx + r; x += (isRingRow || (r == 0)) ? 1 : 2 * r)
+            {
+                if ((x < 0) || (x >= static_cast<int32_t>(m_gridWidth)))
+                    continue;
+
+                const glm::vec2 cellMin(m_gridOrigin.x + static_cast<float>(x) * m_cellSize, m_gridOrigin.z + static_cast<float>(z) * m_cellSize);
+                const glm::vec2 closest = glm::clamp(glm::vec2(point.x, point.z), cellMin, cellMin + glm::vec2(m_cellSize));
+
+                const uint32_t column = static_cast<uint32_t>(z) * m_gridWidth + static_cast<uint32_t>(x);
+                for (uint32_t cell = m_columnsFirstCell[column]; cell < m_columnsFirstCell[column + 1u]; ++cell)
+                {
+                    const glm::vec3 cellPoint(closest.x, m_cellsFloors[cell], closest.y);
+                    const glm::vec3 delta = cellPoint - point;
+                    const float distance = glm::dot(delta, delta);
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        bestPolygon = m_cellsPolygons[cell];
+                        result = cellPoint;
+                    }
+                }
+            }
+        }
+    }
+
+    return bestPolygon;
+}
+
+bool NavMesh::findPath(const glm::vec3& start, const glm::vec3& end, std::vector<glm::vec3>& path, Query& query) const
+{
+    path.clear();
+
+    glm::vec3 startPoint, endPoint;
+    const uint32_t startPolygon = findPolygon(start, startPoint);
+    const uint32_t endPolygon = findPolygon(end, endPoint);
+    if ((startPolygon == invalidId) || (endPolygon == invalidId))
+        return false;
+
+    if (startPolygon == endPolygon)
+    {
+        path.push_back(startPoint);
+        path.push_back(endPoint);
+        return true;
+    }
+
+    auto polygonLinks = [this](uint32_t polygon, const glm::vec3& point, WayPointSearch::Links& links) {
+        links.clear();
+        for (uint32_t i = m_polygonsFirstPortal[polygon]; i < m_polygonsFirstPortal[polygon + 1u]; ++i)
+        {
+            const uint32_t portal = m_polygonsPortals[i];
+            links.push_back({portal, glm::distance(point, m_portalsGraph->position(portal))});
+        }
+    };
+
+    polygonLinks(startPolygon, startPoint, query.startLinks);
+    polygonLinks(endPolygon, endPoint, query.endLinks);
+
+    if (!query.search.find(*m_portalsGraph, query.startLinks, endPoint, query.endLinks, std::numeric_limits<float>::max(), query.portals))
+        return false;
+
+    stringPull(startPoint, endPoint, startPolygon, query, path);
+    return !path.empty();
+}
+
+bool NavMesh::findPath(const glm::vec3& start, const glm::vec3& end, std::vector<glm::vec3>& path) const
+{
+    return findPath(start, end, path, m_query);
+}
+
+void NavMesh::buildPortals()
+{
+    const uint32_t numPolygons = this->numPolygons();
+
+    m_polygonsFirstPortal.assign(numPolygons + 1u, 0u);
+    for (const auto& portal : m_portals)
+    {
+        ++m_polygonsFirstPortal[portal.polygons[0] + 1u];
+        ++m_polygonsFirstPortal[portal.polygons[1] + 1u];
+    }
+    for (uint32_t i = 0; i < numPolygons; ++i)
+        m_polygonsFirstPortal[i + 1u] += m_polygonsFirstPortal[i];
+
+    m_polygonsPortals.resize(m_polygonsFirstPortal.back());
+    std::vector<uint32_t> heads(m_polygonsFirstPortal.begin(), m_polygonsFirstPortal.end() - 1);
+    for (uint32_t id = 0; id < m_portals.size(); ++id)
+    {
+        m_polygonsPortals[heads[m_portals[id].polygons[0]]++] = id;
+        m_polygonsPortals[heads[m_portals[id].polygons[1]]++] = id;
+    }
+
+    std::vector<std::shared_ptr<WayPoint>> wayPoints;
+    wayPoints.reserve(m_portals.size());
+    for (const auto& portal : m_portals)
+        wayPoints.push_back(std::make_shared<WayPoint>(.5f * (portal.points[0] + portal.points[1])));
+
+    // a polygon is convex, so any of its portals is reachable from another one straightly
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    for (uint32_t polygon = 0; polygon < numPolygons; ++polygon)
+        for (uint32_t i = m_polygonsFirstPortal[polygon]; i < m_polygonsFirstPortal[polygon + 1u]; ++i)
+            for (uint32_t j = m_polygonsFirstPortal[polygon]; j < m_polygonsFirstPortal[polygon + 1u]; ++j)
+                if (i != j)
+                    edges.push_back({m_polygonsPortals[i], m_polygonsPortals[j]});
+
+    m_portalsGraph = std::make_shared<WayPointGraph>(wayPoints, edges, 0u);
+}
+
+void NavMesh::stringPull(const glm::vec3& start, const glm::vec3& end, uint32_t startPolygon, Query& query, std::vector<glm::vec3>& path) const
+{
+    auto touches = [this](uint32_t portal, uint32_t polygon) {
+        return (m_portals[portal].polygons[0] == polygon) || (m_portals[portal].polygons[1] == polygon);
+    };
+
+    // twice the signed area of the triangle in the (x, z) plane, it is positive if c is on the left of the line from a to b
+    auto area = [](const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+        return (b.x - a.x) * (c.z - a.z) - (b.z - a.z) * (c.x - a.x);
+    };
+
+    auto equal = [](const glm::vec3& a, const glm::vec3& b) {
+        static const float eps = 1e-6f;
+        const glm::vec3 delta = a - b;
+        return glm::dot(delta, delta) < eps * eps;
+    };
+
+    auto& corridor = query.corridor;
+    corridor.clear();
+    corridor.push_back({start, start});
+
+    uint32_t current = startPolygon;
+    const auto& portals = query.portals;
+    for (size_t k = 0; k < portals.size(); ++k)
+    {
+        // the search may pass through the corner of several polygons, such portals are not crossed actually
+        if ((k + 1u < portals.size()) && touches(portals[k + 1u], current))
+            continue;
+
+        const auto& portal = m_portals[portals[k]];
+        if (portal.polygons[0] == current)
+        {
+            corridor.push_back({portal.points[1], portal.points[0]});
+            current = portal.polygons[1];
+        }
+        else if (portal.polygons[1] == current)
+        {
+            corridor.push_back({portal.points[0], portal.points[1]});
+            current = portal.polygons[0];
+        }
+        else
+            return;
+    }
+
+    corridor.push_back({end, end});
+
+    // funnel algorithm
+    path.push_back(start);
+
+    glm::vec3 apex = start, left = corridor[0].first, right = corridor[0].second;
+    size_t apexIndex = 0u, leftIndex = 0u, rightIndex = 0u;
+
+    for (size_t i = 1u; i < corridor.size(); ++i)
+    {
+        const glm::vec3& newLeft = corridor[i].first;
+        const glm::vec3& newRight = corridor[i].second;
+
+        if (area(apex, right, newRight) >= 0.f)
+        {
+            if (equal(apex, right) || (area(apex, left, newRight) < 0.f))
+            {
+                right = newRight;
+                rightIndex = i;
+            }
+            else
+            {
+                // the right side crosses the left one, so the left point is a corner of the path
+                if (!equal(path.back(), left))
+                    path.push_back(left);
+                apex = right = left;
+                apexIndex = rightIndex = leftIndex;
+                i = apexIndex;
+                continue;
+            }
+        }
+
+        if (area(apex, left, newLeft) <= 0.f)
+        {
+            if (equal(apex, left) || (area(apex, right, newLeft) > 0.f))
+            {
+                left = newLeft;
+                leftIndex = i;
+            }
+            else
+            {
+                if (!equal(path.back(), right))
+                    path.push_back(right);
+                apex = left = right;
+                apexIndex = leftIndex = rightIndex;
+                i = apexIndex;
+                continue;
+            }
+        }
+    }
+
+    if (!equal(path.back(), end))
+        path.push_back(end);
+}
+
+} // namespace
+} // namespace
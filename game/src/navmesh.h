@@ -0,0 +1,84 @@
+#ifndef NAVMESH_H
+#define NAVMESH_H
+
+#include <memory>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "waypointgraph.h"
+
+namespace trash
+{
+namespace game
+{
+
+class NavMeshBuilder;
+
+// Convex polygons of walkable surfaces. Polygons are wound counterclockwise in the (x, z) plane.
+// Paths are searched over the graph of portals (edges shared by polygons) and are string pulled by the funnel algorithm.
+// Polygons are found through the grid of the voxels the mesh was built from, so the lookup doesn't depend on the number of polygons.
+class NavMesh
+{
+public:
+    static const uint32_t invalidId;
+
+    uint32_t numPolygons() const { return static_cast<uint32_t>(m_polygonsFirstVertex.size() - 1u); }
+    uint32_t numPolygonVertices(uint32_t id) const { return m_polygonsFirstVertex[id + 1u] - m_polygonsFirstVertex[id]; }
+    const glm::vec3& polygonVertex(uint32_t id, uint32_t index) const { return m_vertices[m_polygonsVertices[m_polygonsFirstVertex[id] + index]]; }
+    uint32_t numPortals() const { return static_cast<uint32_t>(m_portals.size()); }
+
+    // polygon under the point or the closest one around it (invalidId if there is no one) and the point moved onto the polygon
+    uint32_t findPolygon(const glm::vec3&, glm::vec3&) const;
+
+    // scratch of path searches, one per thread
+    struct Query
+    {
+        WayPointSearch search;
+        WayPointSearch::Links startLinks, endLinks;
+        std::vector<uint32_t> portals;
+        std::vector<std::pair<glm::vec3, glm::vec3>> corridor; // left and right points of the crossed portals
+    };
+
+    // corners of the path from the start to the end point including both of them, which are moved onto the mesh
+    bool findPath(const glm::vec3&, const glm::vec3&, std::vector<glm::vec3>&, Query&) const;
+    bool findPath(const glm::vec3&, const glm::vec3&, std::vector<glm::vec3>&) const; // by the own scratch, so from one thread only
+
+private:
+    struct Portal
+    {
+        uint32_t polygons[2];
+        glm::vec3 points[2]; // in the winding of the first polygon
+    };
+
+    NavMesh();
+
+    void buildPortals();
+    void stringPull(const glm::vec3&, const glm::vec3&, uint32_t, Query&, std::vector<glm::vec3>&) const;
+
+    std::vector<glm::vec3> m_vertices;
+    std::vector<uint32_t> m_polygonsVertices;
+    std::vector<uint32_t> m_polygonsFirstVertex; // number of polygons + 1
+
+    std::vector<Portal> m_portals;
+    std::vector<uint32_t> m_polygonsPortals;
+    std::vector<uint32_t> m_polygonsFirstPortal; // number of polygons + 1
+    std::shared_ptr<WayPointGraph> m_portalsGraph; // nodes are the middle points of the portals
+
+    // point location grid. Cells of a column are sorted by their floors.
+    glm::vec3 m_gridOrigin;
+    float m_cellSize, m_cellHeight;
+    uint32_t m_gridWidth, m_gridDepth;
+    std::vector<uint32_t> m_columnsFirstCell; // width * depth + 1
+    std::vector<float> m_cellsFloors;
+    std::vector<uint32_t> m_cellsPolygons;
+
+    mutable Query m_query;
+
+    friend class NavMeshBuilder;
+};
+
+} // namespace
+} // namespace
+
+#endif // NAVMESH_H
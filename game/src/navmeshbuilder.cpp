@@ -0,0 +1,765 @@
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <tuple>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include "navmeshbuilder.h"
+#include "navmesh.h"
+
+namespace trash
+{
+namespace game
+{
+
+namespace
+{
+
+const int32_t maxHeight = std::numeric_limits<int32_t>::max() / 4;
+const int32_t directionsX[4] = {-1, 0, 1, 0};
+const int32_t directionsZ[4] = {0, 1, 0, -1};
+
+// splits the convex polygon by the plane orthogonal to the axis, points equal to the cut go to both parts
+void dividePolygon(const glm::vec3 *in, uint32_t numIn, glm::vec3 *below, uint32_t& numBelow, glm::vec3 *above, uint32_t& numAbove, float cut, int axis)
+{
+    float distances[12];
+    for (uint32_t i = 0; i < numIn; ++i)
+        distances[i] = cut - in[i][axis];
+
+    numBelow = numAbove = 0u;
+    for (uint32_t i = 0, j = numIn - 1u; i < numIn; j = i, ++i)
+    {
+        const bool isBelowJ = distances[j] >= 0.f;
+        const bool isBelowI = distances[i] >= 0.f;
+        if (isBelowJ != isBelowI)
+        {
+            const float s = distances[j] / (distances[j] - distances[i]);
+            below[numBelow++] = above[numAbove++] = in[j] + (in[i] - in[j]) * s;
+            if (distances[i] > 0.f)
+                below[numBelow++] = in[i];
+            else if (distances[i] < 0.f)
+                above[numAbove++] = in[i];
+        }
+        else
+        {
+            if (distances[i] >= 0.f)
+            {
+                below[numBelow++] = in[i];
+                if (distances[i] != 0.f)
+                    continue;
+            }
+            above[numAbove++] = in[i];
+        }
+    }
+}
+
+int32_t area(const glm::ivec2& a, const glm::ivec2& b, const glm::ivec2& c)
+{
+    return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+}
+
+std::shared_ptr<NavMesh> NavMeshBuilder::build(const std::vector<glm::vec3>& vertices, const std::vector<uint32_t>& indices, const NavMeshConfig& config)
+{
+    NavMeshBuilder builder(config);
+    builder.rasterize(vertices, indices);
+    builder.filterSpans();
+    builder.buildCells();
+    builder.erodeCells();
+    builder.buildRegions();
+    builder.mergePolygons();
+    return builder.buildNavMesh();
+}
+
+NavMeshBuilder::NavMeshBuilder(const NavMeshConfig& config)
+    : m_config(config)
+    , m_walkableHeight(static_cast<int32_t>(glm::ceil(config.agentHeight / config.cellHeight)))
+    , m_walkableClimb(static_cast<int32_t>(glm::floor(config.agentMaxClimb / config.cellHeight)))
+    , m_walkableRadius(static_cast<int32_t>(glm::ceil(config.agentRadius / config.cellSize)))
+    , m_origin(0.f)
+    , m_width(0u)
+    , m_depth(0u)
+{
+}
+
+void NavMeshBuilder::rasterize(const std::vector<glm::vec3>& vertices, const std::vector<uint32_t>& indices)
+{
+    if (indices.size() < 3u)
+        return;
+
+    glm::vec3 boundsMin(std::numeric_limits<float>::max()), boundsMax(-std::numeric_limits<float>::max());
+    for (auto index : indices)
+    {
+        boundsMin = glm::min(boundsMin, vertices[index]);
+        boundsMax = glm::max(boundsMax, vertices[index]);
+    }
+
+    const float cellSize = m_config.cellSize;
+    const float cellHeight = m_config.cellHeight;
+    const float walkableThreshold = glm::cos(m_config.agentMaxSlope);
+
+    m_origin = boundsMin;
+    m_width = glm::max(1u, static_cast<uint32_t>(glm::ceil((boundsMax.x - boundsMin.x) / cellSize)));
+    m_depth = glm::max(1u, static_cast<uint32_t>(glm::ceil((boundsMax.z - boundsMin.z) / cellSize)));
+    m_columnsSpans.assign(m_width * m_depth, std::vector<Span>());
+
+    glm::vec3 in[12], rest[12], row[12], cell[12];
+    uint32_t numIn, numRest, numRow, numCell;
+
+    for (size_t t = 0; t + 2u < indices.size(); t += 3u)
+    {
+        const glm::vec3& v0 = vertices[indices[t]];
+        const glm::vec3& v1 = vertices[indices[t + 1u]];
+        const glm::vec3& v2 = vertices[indices[t + 2u]];
+
+        const glm::vec3 normal = glm::cross(v1 - v0, v2 - v0);
+        const float normalLength = glm::length(normal);
+        if (normalLength <= 0.f)
+            continue;
+
+        const bool isWalkable = normal.y / normalLength >= walkableThreshold;
+
+        const glm::vec3 triangleMin = glm::min(v0, glm::min(v1, v2));
+        const glm::vec3 triangleMax = glm::max(v0, glm::max(v1, v2));
+
+        const int32_t lastX = static_cast<int32_t>(m_width) - 1, lastZ = static_cast<int32_t>(m_depth) - 1;
+        const int32_t z0 = glm::clamp(static_cast<int32_t>(glm::floor((triangleMin.z - m_origin.z) / cellSize)), 0, lastZ);
+        const int32_t z1 = glm::clamp(static_cast<int32_t>(glm::floor((triangleMax.z - m_origin.z) / cellSize)), 0, lastZ);
+
+        in[0] = v0; in[1] = v1; in[2] = v2;
+        numIn = 3u;
+
+        for (int32_t z = z0; z <= z1; ++z)
+        {
+            const float cutZ = m_origin.z + static_cast<float>(z + 1) * cellSize;
+            dividePolygon(in, numIn, row, numRow, rest, numRest, cutZ, 2);
+            std::copy(rest, rest + numRest, in);
+            numIn = numRest;
+            if (numRow < 3u)
+                continue;
+
+            float rowMinX = row[0].x, rowMaxX = row[0].x;
+            for (uint32_t i = 1; i < numRow; ++i)
+            {
+                rowMinX = glm::min(rowMinX, row[i].x);
+                rowMaxX = glm::max(rowMaxX, row[i].x);
+            }
+
+            const int32_t x0 = glm::clamp(static_cast<int32_t>(glm::floor((rowMinX - m_origin.x) / cellSize)), 0, lastX);
+            const int32_t x1 = glm::clamp(static_cast<int32_t>(glm::floor((rowMaxX - m_origin.x) / cellSize)), 0, lastX);
+
+            for (int32_t x = x0; x <= x1; ++x)
+            {
+                const float cutX = m_origin.x + static_cast<float>(x + 1) * cellSize;
+                dividePolygon(row, numRow, cell, numCell, rest, numRest, cutX, 0);
+                std::copy(rest, rest + numRest, row);
+                numRow = numRest;
+                if (numCell < 3u)
+                    continue;
+
+                float cellMinY = cell[0].y, cellMaxY = cell[0].y;
+                for (uint32_t i = 1; i < numCell; ++i)
+                {
+                    cellMinY = glm::min(cellMinY, cell[i].y);
+                    cellMaxY = glm::max(cellMaxY, cell[i].y);
+                }
+
+                const int32_t spanMin = static_cast<int32_t>(glm::floor((cellMinY - m_origin.y) / cellHeight));
+                const int32_t spanMax = glm::max(static_cast<int32_t>(glm::ceil((cellMaxY - m_origin.y) / cellHeight)), spanMin + 1);
+                addSpan(static_cast<uint32_t>(z) * m_width + static_cast<uint32_t>(x), spanMin, spanMax, isWalkable);
+            }
+        }
+    }
+}
+
+void NavMeshBuilder::addSpan(uint32_t column, int32_t min, int32_t max, bool isWalkable)
+{
+    auto& spans = m_columnsSpans[column];
+    Span span{min, max, isWalkable};
+
+    auto first = spans.begin();
+    while ((first != spans.end()) && (first->max < span.min))
+        ++first;
+
+    // overlapped spans are merged, the top of the result is walkable if the top of any walkable merged span is close to it
+    auto last = first;
+    while ((last != spans.end()) && (last->min <= span.max))
+    {
+        const int32_t top = glm::max(span.max, last->max);
+        span.walkable = (span.walkable && (span.max + m_walkableClimb >= top)) || (last->walkable && (last->max + m_walkableClimb >= top));
+        span.min = glm::min(span.min, last->min);
+        span.max = top;
+        ++last;
+    }
+
+    spans.insert(spans.erase(first, last), span);
+}
+
+void NavMeshBuilder::filterSpans()
+{
+    // low obstacles (curbs, stairs) over walkable spans can be stepped on
+    for (auto& spans : m_columnsSpans)
+    {
+        bool isPreviousWalkable = false;
+        int32_t previousMax = 0;
+        for (auto& span : spans)
+        {
+            const bool isWalkable = span.walkable;
+            if (!isWalkable && isPreviousWalkable && (span.max - previousMax <= m_walkableClimb))
+                span.walkable = true;
+            isPreviousWalkable = isWalkable;
+            previousMax = span.max;
+        }
+    }
+
+    // spans with a drop deeper than the climb to any neighbor are ledges
+    for (uint32_t z = 0; z < m_depth; ++z)
+        for (uint32_t x = 0; x < m_width; ++x)
+        {
+            auto& spans = m_columnsSpans[z * m_width + x];
+            for (size_t i = 0; i < spans.size(); ++i)
+            {
+                if (!spans[i].walkable)
+                    continue;
+
+                const int32_t bottom = spans[i].max;
+                const int32_t top = (i + 1u < spans.size()) ? spans[i + 1u].min : maxHeight;
+
+                int32_t minDrop = maxHeight;
+                int32_t accessibleMin = bottom, accessibleMax = bottom;
+
+                for (uint32_t direction = 0; direction < 4u; ++direction)
+                {
+                    const int32_t nx = static_cast<int32_t>(x) + directionsX[direction];
+                    const int32_t nz = static_cast<int32_t>(z) + directionsZ[direction];
+                    if ((nx < 0) || (nz < 0) || (nx >= static_cast<int32_t>(m_width)) || (nz >= static_cast<int32_t>(m_depth)))
+                    {
+                        minDrop = glm::min(minDrop, -m_walkableClimb - bottom);
+                        continue;
+                    }
+
+                    const auto& neighborSpans = m_columnsSpans[static_cast<uint32_t>(nz) * m_width + static_cast<uint32_t>(nx)];
+
+                    int32_t neighborBottom = -m_walkableClimb;
+                    int32_t neighborTop = neighborSpans.empty() ? maxHeight : neighborSpans.front().min;
+                    if (glm::min(top, neighborTop) - glm::max(bottom, neighborBottom) > m_walkableHeight)
+                        minDrop = glm::min(minDrop, neighborBottom - bottom);
+
+                    for (size_t j = 0; j < neighborSpans.size(); ++j)
+                    {
+                        neighborBottom = neighborSpans[j].max;
+                        neighborTop = (j + 1u < neighborSpans.size()) ? neighborSpans[j + 1u].min : maxHeight;
+                        if (glm::min(top, neighborTop) - glm::max(bottom, neighborBottom) > m_walkableHeight)
+                        {
+                            minDrop = glm::min(minDrop, neighborBottom - bottom);
+                            if (glm::abs(neighborBottom - bottom) <= m_walkableClimb)
+                            {
+                                accessibleMin = glm::min(accessibleMin, neighborBottom);
+                                accessibleMax = glm::max(accessibleMax, neighborBottom);
+                            }
+                        }
+                    }
+                }
+
+                if ((minDrop < -m_walkableClimb) || (accessibleMax - accessibleMin > m_walkableClimb))
+                    spans[i].walkable = false;
+            }
+        }
+
+    // the agent doesn't fit under the next span
+    for (auto& spans : m_columnsSpans)
+        for (size_t i = 0; i + 1u < spans.size(); ++i)
+            if (spans[i + 1u].min - spans[i].max <= m_walkableHeight)
+                spans[i].walkable = false;
+}
+
+void NavMeshBuilder::buildCells()
+{
+    m_columnsFirstCell.assign(m_width * m_depth + 1u, 0u);
+    m_cells.clear();
+
+    for (uint32_t column = 0; column < m_columnsSpans.size(); ++column)
+    {
+        const auto& spans = m_columnsSpans[column];
+        for (size_t i = 0; i < spans.size(); ++i)
+        {
+            if (!spans[i].walkable)
+                continue;
+
+            const int32_t top = (i + 1u < spans.size()) ? spans[i + 1u].min : maxHeight;
+            m_cells.push_back(Cell{spans[i].max, top - spans[i].max, {}, NavMesh::invalidId});
+        }
+        m_columnsFirstCell[column + 1u] = static_cast<uint32_t>(m_cells.size());
+    }
+
+    m_columnsSpans.clear();
+    m_columnsSpans.shrink_to_fit();
+
+    connectCells();
+}
+
+void NavMeshBuilder::connectCells()
+{
+    for (uint32_t z = 0; z < m_depth; ++z)
+        for (uint32_t x = 0; x < m_width; ++x)
+        {
+            const uint32_t column = z * m_width + x;
+            for (uint32_t c = m_columnsFirstCell[column]; c < m_columnsFirstCell[column + 1u]; ++c)
+            {
+                auto& cell = m_cells[c];
+                for (uint32_t direction = 0; direction < 4u; ++direction)
+                {
+                    cell.neighbors[direction] = NavMesh::invalidId;
+
+                    const int32_t nx = static_cast<int32_t>(x) + directionsX[direction];
+                    const int32_t nz = static_cast<int32_t>(z) + directionsZ[direction];
+                    if ((nx < 0) || (nz < 0) || (nx >= static_cast<int32_t>(m_width)) || (nz >= static_cast<int32_t>(m_depth)))
+                        continue;
+
+                    const uint32_t neighborColumn = static_cast<uint32_t>(nz) * m_width + static_cast<uint32_t>(nx);
+                    for (uint32_t n = m_columnsFirstCell[neighborColumn]; n < m_columnsFirstCell[neighborColumn + 1u]; ++n)
+                    {
+                        const auto& neighbor = m_cells[n];
+                        const int32_t bottom = glm::max(cell.floor, neighbor.floor);
+                        const int32_t top = glm::min(cell.floor + cell.height, neighbor.floor + neighbor.height);
+                        if ((top - bottom >= m_walkableHeight) && (glm::abs(neighbor.floor - cell.floor) <= m_walkableClimb))
+                        {
+                            cell.neighbors[direction] = n;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+}
+
+void NavMeshBuilder::erodeCells()
+{
+    if (m_walkableRadius <= 0)
+        return;
+
+    static const uint32_t maxDistance = std::numeric_limits<uint16_t>::max();
+    static const uint32_t none = NavMesh::invalidId;
+
+    // chamfer distances to the borders with the weights 2 and 3 for the straight and diagonal steps
+    std::vector<uint32_t> distances(m_cells.size(), maxDistance);
+    for (uint32_t c = 0; c < m_cells.size(); ++c)
+        for (auto neighbor : m_cells[c].neighbors)
+            if (neighbor == none)
+                distances[c] = 0u;
+
+    auto relax = [&](uint32_t c, uint32_t direction, uint32_t diagonalDirection) {
+        const uint32_t a = m_cells[c].neighbors[direction];
+        if (a == none)
+            return;
+
+        distances[c] = glm::min(distances[c], distances[a] + 2u);
+        const uint32_t b = m_cells[a].neighbors[diagonalDirection];
+        if (b != none)
+            distances[c] = glm::min(distances[c], distances[b] + 3u);
+    };
+
+    for (uint32_t c = 0; c < m_cells.size(); ++c)
+    {
+        relax(c, 0u, 3u);
+        relax(c, 3u, 2u);
+    }
+
+    for (auto c = static_cast<uint32_t>(m_cells.size()); c-- > 0u;)
+    {
+        relax(c, 2u, 1u);
+        relax(c, 1u, 0u);
+    }
+
+    const auto threshold = static_cast<uint32_t>(2 * m_walkableRadius);
+
+    std::vector<Cell> cells;
+    cells.reserve(m_cells.size());
+    for (uint32_t column = 0; column < m_width * m_depth; ++column)
+    {
+        for (uint32_t c = m_columnsFirstCell[column]; c < m_columnsFirstCell[column + 1u]; ++c)
+            if (distances[c] >= threshold)
+                cells.push_back(m_cells[c]);
+        m_columnsFirstCell[column] = static_cast<uint32_t>(cells.size());
+    }
+
+    // first cells were overwritten by the ends of the columns
+    for (uint32_t column = m_width * m_depth; column > 0u; --column)
+        m_columnsFirstCell[column] = m_columnsFirstCell[column - 1u];
+    m_columnsFirstCell[0] = 0u;
+
+    m_cells.swap(cells);
+    connectCells();
+}
+
+void NavMeshBuilder::buildRegions()
+{
+    static const uint32_t none = NavMesh::invalidId;
+
+    struct Rectangle
+    {
+        glm::ivec2 origin;
+        uint32_t width, height;
+        size_t firstCell;
+    };
+
+    std::vector<Rectangle> rectangles;
+    std::vector<uint32_t> rectanglesCells; // row by row
+
+    // greedy rectangles are convex by construction, they are grown along +x and then along +z
+    for (uint32_t z = 0; z < m_depth; ++z)
+        for (uint32_t x = 0; x < m_width; ++x)
+        {
+            const uint32_t column = z * m_width + x;
+            for (uint32_t c = m_columnsFirstCell[column]; c < m_columnsFirstCell[column + 1u]; ++c)
+            {
+                if (m_cells[c].region != none)
+                    continue;
+
+                const auto region = static_cast<uint32_t>(rectangles.size());
+                const size_t firstCell = rectanglesCells.size();
+
+                uint32_t width = 0u;
+                for (uint32_t n = c; (n != none) && (m_cells[n].region == none); n = m_cells[n].neighbors[2])
+                {
+                    m_cells[n].region = region;
+                    rectanglesCells.push_back(n);
+                    ++width;
+                }
+
+                uint32_t height = 1u;
+                for (;;)
+                {
+                    const size_t previousRow = rectanglesCells.size() - width;
+
+                    bool isRowFree = true;
+                    for (uint32_t i = 0; i < width; ++i)
+                    {
+                        const uint32_t n = m_cells[rectanglesCells[previousRow + i]].neighbors[1];
+                        if ((n == none) || (m_cells[n].region != none) || ((i > 0u) && (m_cells[rectanglesCells.back()].neighbors[2] != n)))
+                        {
+                            isRowFree = false;
+                            break;
+                        }
+                        rectanglesCells.push_back(n);
+                    }
+
+                    if (!isRowFree)
+                    {
+                        rectanglesCells.resize(previousRow + width);
+                        break;
+                    }
+
+                    for (uint32_t i = 0; i < width; ++i)
+                        m_cells[rectanglesCells[previousRow + width + i]].region = region;
+                    ++height;
+                }
+
+                rectangles.push_back({glm::ivec2(x, z), width, height, firstCell});
+            }
+        }
+
+    // contours are wound counterclockwise, a vertex is inserted wherever the region behind a side changes
+    m_polygons.resize(rectangles.size());
+    for (uint32_t region = 0; region < rectangles.size(); ++region)
+    {
+        const auto& rectangle = rectangles[region];
+        auto& polygon = m_polygons[region];
+
+        auto cellAt = [&](uint32_t row, uint32_t col) {
+            return rectanglesCells[rectangle.firstCell + row * rectangle.width + col];
+        };
+
+        auto addSide = [&](const glm::ivec2& start, const glm::ivec2& step, uint32_t count, uint32_t direction, auto cellOfSide) {
+            uint32_t previousRegion = none;
+            for (uint32_t k = 0; k < count; ++k)
+            {
+                const uint32_t neighbor = m_cells[cellOfSide(k)].neighbors[direction];
+                const uint32_t neighborRegion = (neighbor != none) ? m_cells[neighbor].region : none;
+                if ((k == 0u) || (neighborRegion != previousRegion))
+                {
+                    polygon.vertices.push_back(start + step * static_cast<int32_t>(k));
+                    polygon.neighbors.push_back(neighborRegion);
+                }
+                previousRegion = neighborRegion;
+            }
+        };
+
+        const glm::ivec2 origin = rectangle.origin;
+        const auto w = static_cast<int32_t>(rectangle.width), h = static_cast<int32_t>(rectangle.height);
+
+        addSide(origin, glm::ivec2(1, 0), rectangle.width, 3u, [&](uint32_t k) { return cellAt(0u, k); });
+        addSide(origin + glm::ivec2(w, 0), glm::ivec2(0, 1), rectangle.height, 2u, [&](uint32_t k) { return cellAt(k, rectangle.width - 1u); });
+        addSide(origin + glm::ivec2(w, h), glm::ivec2(-1, 0), rectangle.width, 1u, [&](uint32_t k) { return cellAt(rectangle.height - 1u, rectangle.width - 1u - k); });
+        addSide(origin + glm::ivec2(0, h), glm::ivec2(0, -1), rectangle.height, 0u, [&](uint32_t k) { return cellAt(rectangle.height - 1u - k, 0u); });
+    }
+
+    m_regionsParents.resize(m_polygons.size());
+    for (uint32_t region = 0; region < m_regionsParents.size(); ++region)
+        m_regionsParents[region] = region;
+}
+
+void NavMeshBuilder::mergePolygons()
+{
+    static const uint32_t none = NavMesh::invalidId;
+
+    struct Merge
+    {
+        uint32_t edge, other, otherEdge;
+        int32_t length;
+    };
+
+    bool isMerged = true;
+    while (isMerged)
+    {
+        isMerged = false;
+
+        for (uint32_t a = 0; a < m_polygons.size(); ++a)
+        {
+            // the polygon takes its neighbors with the longest shared edges while the result stays convex
+            for (;;)
+            {
+                const auto& polygon = m_polygons[a];
+                const auto numVertices = static_cast<uint32_t>(polygon.vertices.size());
+                if (numVertices == 0u)
+                    break;
+
+                Merge best{none, none, none, 0};
+                for (uint32_t i = 0; i < numVertices; ++i)
+                {
+                    if (polygon.neighbors[i] == none)
+                        continue;
+
+                    const uint32_t b = findRegion(polygon.neighbors[i]);
+                    const auto& other = m_polygons[b];
+                    const auto numOtherVertices = static_cast<uint32_t>(other.vertices.size());
+                    if ((b == a) || (numVertices + numOtherVertices - 2u > m_config.maxPolygonVertices))
+                        continue;
+
+                    const glm::ivec2& va = polygon.vertices[i];
+                    const glm::ivec2& vb = polygon.vertices[(i + 1u) % numVertices];
+
+                    uint32_t j = 0u;
+                    while ((j < numOtherVertices) && ((other.vertices[j] != vb) || (other.vertices[(j + 1u) % numOtherVertices] != va)))
+                        ++j;
+                    if (j == numOtherVertices)
+                        continue;
+
+                    if ((area(polygon.vertices[(i + numVertices - 1u) % numVertices], va, other.vertices[(j + 2u) % numOtherVertices]) < 0) ||
+                        (area(other.vertices[(j + numOtherVertices - 1u) % numOtherVertices], vb, polygon.vertices[(i + 2u) % numVertices]) < 0))
+                        continue;
+
+                    const glm::ivec2 edge = vb - va;
+                    const int32_t length = edge.x * edge.x + edge.y * edge.y;
+                    if (length > best.length)
+                        best = Merge{i, b, j, length};
+                }
+
+                if (best.edge == none)
+                    break;
+
+                const auto& other = m_polygons[best.other];
+                const auto numOtherVertices = static_cast<uint32_t>(other.vertices.size());
+
+                Polygon merged;
+                for (uint32_t i = 0; i + 1u < numVertices; ++i)
+                {
+                    const uint32_t index = (best.edge + 1u + i) % numVertices;
+                    merged.vertices.push_back(polygon.vertices[index]);
+                    merged.neighbors.push_back(polygon.neighbors[index]);
+                }
+                for (uint32_t i = 0; i + 1u < numOtherVertices; ++i)
+                {
+                    const uint32_t index = (best.otherEdge + 1u + i) % numOtherVertices;
+                    merged.vertices.push_back(other.vertices[index]);
+                    merged.neighbors.push_back(other.neighbors[index]);
+                }
+
+                m_polygons[a] = std::move(merged);
+                m_polygons[best.other] = Polygon();
+                m_regionsParents[best.other] = a;
+                isMerged = true;
+
+                // collinear vertices between the edges shared with the same polygon are not needed anymore on the both sides
+                simplifyPolygon(a);
+                for (auto neighbor : std::vector<uint32_t>(m_polygons[a].neighbors))
+                    if (neighbor != none)
+                        simplifyPolygon(findRegion(neighbor));
+            }
+        }
+    }
+}
+
+void NavMeshBuilder::simplifyPolygon(uint32_t region)
+{
+    static const uint32_t none = NavMesh::invalidId;
+
+    auto& polygon = m_polygons[region];
+
+    bool isChanged = true;
+    while (isChanged && (polygon.vertices.size() > 3u))
+    {
+        isChanged = false;
+
+        const auto numVertices = static_cast<uint32_t>(polygon.vertices.size());
+        for (uint32_t i = 0; i < numVertices; ++i)
+        {
+            const uint32_t previous = (i + numVertices - 1u) % numVertices;
+            const uint32_t previousNeighbor = (polygon.neighbors[previous] != none) ? findRegion(polygon.neighbors[previous]) : none;
+            const uint32_t neighbor = (polygon.neighbors[i] != none) ? findRegion(polygon.neighbors[i]) : none;
+
+            if ((previousNeighbor == neighbor) &&
+                (area(polygon.vertices[previous], polygon.vertices[i], polygon.vertices[(i + 1u) % numVertices]) == 0))
+            {
+                polygon.vertices.erase(polygon.vertices.begin() + i);
+                polygon.neighbors.erase(polygon.neighbors.begin() + i);
+                isChanged = true;
+                break;
+            }
+        }
+    }
+}
+
+uint32_t NavMeshBuilder::findRegion(uint32_t region)
+{
+    while (m_regionsParents[region] != region)
+    {
+        m_regionsParents[region] = m_regionsParents[m_regionsParents[region]];
+        region = m_regionsParents[region];
+    }
+    return region;
+}
+
+std::shared_ptr<NavMesh> NavMeshBuilder::buildNavMesh()
+{
+    static const uint32_t none = NavMesh::invalidId;
+
+    auto navMesh = std::shared_ptr<NavMesh>(new NavMesh());
+
+    std::vector<uint32_t> polygonsIds(m_polygons.size(), none);
+    uint32_t numPolygons = 0u;
+    for (uint32_t region = 0; region < m_polygons.size(); ++region)
+        if (!m_polygons[region].vertices.empty())
+            polygonsIds[region] = numPolygons++;
+
+    auto polygonId = [&](uint32_t region) {
+        return (region != none) ? polygonsIds[findRegion(region)] : none;
+    };
+
+    // a vertex is lifted to the highest floor of the polygon cells around it
+    auto vertexFloor = [&](uint32_t region, const glm::ivec2& vertex) {
+        int32_t result = std::numeric_limits<int32_t>::min();
+        for (int32_t z = vertex.y - 1; z <= vertex.y; ++z)
+            for (int32_t x = vertex.x - 1; x <= vertex.x; ++x)
+            {
+                if ((x < 0) || (z < 0) || (x >= static_cast<int32_t>(m_width)) || (z >= static_cast<int32_t>(m_depth)))
+                    continue;
+
+                const uint32_t column = static_cast<uint32_t>(z) * m_width + static_cast<uint32_t>(x);
+                for (uint32_t c = m_columnsFirstCell[column]; c < m_columnsFirstCell[column + 1u]; ++c)
+                    if (findRegion(m_cells[c].region) == region)
+                        result = glm::max(result, m_cells[c].floor);
+            }
+        return result;
+    };
+
+    auto toWorld = [this](const glm::ivec2& vertex, int32_t floor) {
+        return m_origin + glm::vec3(static_cast<float>(vertex.x) * m_config.cellSize,
+                                    static_cast<float>(floor) * m_config.cellHeight,
+                                    static_cast<float>(vertex.y) * m_config.cellSize);
+    };
+
+    std::map<std::tuple<int32_t, int32_t, int32_t>, uint32_t> verticesIds;
+    std::vector<std::vector<uint32_t>> polygonsVertices(numPolygons);
+
+    for (uint32_t region = 0; region < m_polygons.size(); ++region)
+    {
+        const uint32_t id = polygonsIds[region];
+        if (id == none)
+            continue;
+
+        for (const auto& vertex : m_polygons[region].vertices)
+        {
+            const int32_t floor = vertexFloor(region, vertex);
+            auto it = verticesIds.insert({std::make_tuple(vertex.x, vertex.y, floor), static_cast<uint32_t>(navMesh->m_vertices.size())});
+            if (it.second)
+                navMesh->m_vertices.push_back(toWorld(vertex, floor));
+            polygonsVertices[id].push_back(it.first->second);
+        }
+    }
+
+    for (const auto& vertices : polygonsVertices)
+    {
+        navMesh->m_polygonsVertices.insert(navMesh->m_polygonsVertices.end(), vertices.begin(), vertices.end());
+        navMesh->m_polygonsFirstVertex.push_back(static_cast<uint32_t>(navMesh->m_polygonsVertices.size()));
+    }
+
+    // one portal per pair of polygons, consecutive edges shared with the same polygon are joined
+    for (uint32_t region = 0; region < m_polygons.size(); ++region)
+    {
+        const uint32_t id = polygonsIds[region];
+        if (id == none)
+            continue;
+
+        const auto& neighbors = m_polygons[region].neighbors;
+        const auto& vertices = polygonsVertices[id];
+        const auto numEdges = static_cast<uint32_t>(neighbors.size());
+
+        uint32_t first = 0u;
+        while ((first < numEdges) && (polygonId(neighbors[first]) == polygonId(neighbors[(first + numEdges - 1u) % numEdges])))
+            ++first;
+        if (first == numEdges)
+            continue;
+
+        for (uint32_t k = 0; k < numEdges;)
+        {
+            const uint32_t runStart = (first + k) % numEdges;
+            const uint32_t other = polygonId(neighbors[runStart]);
+
+            uint32_t runEnd = runStart;
+            while ((k + 1u < numEdges) && (polygonId(neighbors[(first + k + 1u) % numEdges]) == other))
+            {
+                ++k;
+                runEnd = (first + k) % numEdges;
+            }
+            ++k;
+
+            if ((other != none) && (other > id))
+            {
+                NavMesh::Portal portal;
+                portal.polygons[0] = id;
+                portal.polygons[1] = other;
+                portal.points[0] = navMesh->m_vertices[vertices[runStart]];
+                portal.points[1] = navMesh->m_vertices[vertices[(runEnd + 1u) % numEdges]];
+                navMesh->m_portals.push_back(portal);
+            }
+        }
+    }
+
+    navMesh->m_gridOrigin = m_origin;
+    navMesh->m_cellSize = m_config.cellSize;
+    navMesh->m_cellHeight = m_config.cellHeight;
+    navMesh->m_gridWidth = m_width;
+    navMesh->m_gridDepth = m_depth;
+    navMesh->m_columnsFirstCell = m_columnsFirstCell;
+    if (navMesh->m_columnsFirstCell.empty())
+        navMesh->m_columnsFirstCell.assign(m_width * m_depth + 1u, 0u);
+
+    navMesh->m_cellsFloors.reserve(m_cells.size());
+    navMesh->m_cellsPolygons.reserve(m_cells.size());
+    for (const auto& cell : m_cells)
+    {
+        navMesh->m_cellsFloors.push_back(m_origin.y + static_cast<float>(cell.floor) * m_config.cellHeight);
+        navMesh->m_cellsPolygons.push_back(polygonId(cell.region));
+    }
+
+    navMesh->buildPortals();
+
+    return navMesh;
+}
+
+} // namespace
+} // namespace
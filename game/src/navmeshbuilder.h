@@ -0,0 +1,88 @@
+#ifndef NAVMESHBUILDER_H
+#define NAVMESHBUILDER_H
+
+#include <memory>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/trigonometric.hpp>
+
+namespace trash
+{
+namespace game
+{
+
+class NavMesh;
+
+struct NavMeshConfig
+{
+    float cellSize = .1f;
+    float cellHeight = .05f;
+    float agentHeight = 1.5f;
+    float agentRadius = .25f;
+    float agentMaxClimb = .25f;
+    float agentMaxSlope = glm::radians(45.f);
+    uint32_t maxPolygonVertices = 32u;
+};
+
+// Builds a navigation mesh from triangles wound counterclockwise (seen from their front side):
+// triangles are rasterized into a heightfield of solid spans, walkable spans are filtered by the agent size and eroded by its radius,
+// walkable cells are split into rectangles which are merged greedily into convex polygons.
+class NavMeshBuilder
+{
+public:
+    static std::shared_ptr<NavMesh> build(const std::vector<glm::vec3>&, const std::vector<uint32_t>&, const NavMeshConfig& = NavMeshConfig());
+
+private:
+    struct Span
+    {
+        int32_t min, max;
+        bool walkable;
+    };
+
+    struct Cell
+    {
+        int32_t floor, height;
+        uint32_t neighbors[4]; // -x, +z, +x, -z
+        uint32_t region;
+    };
+
+    struct Polygon
+    {
+        std::vector<glm::ivec2> vertices;
+        std::vector<uint32_t> neighbors; // regions behind the edges from the vertices to the next ones
+    };
+
+    NavMeshBuilder(const NavMeshConfig&);
+
+    void rasterize(const std::vector<glm::vec3>&, const std::vector<uint32_t>&);
+    void addSpan(uint32_t, int32_t, int32_t, bool);
+    void filterSpans();
+    void buildCells();
+    void connectCells();
+    void erodeCells();
+    void buildRegions();
+    void mergePolygons();
+    void simplifyPolygon(uint32_t);
+    uint32_t findRegion(uint32_t);
+    std::shared_ptr<NavMesh> buildNavMesh();
+
+    NavMeshConfig m_config;
+    int32_t m_walkableHeight, m_walkableClimb, m_walkableRadius;
+
+    glm::vec3 m_origin;
+    uint32_t m_width, m_depth;
+    std::vector<std::vector<Span>> m_columnsSpans;
+
+    std::vector<uint32_t> m_columnsFirstCell;
+    std::vector<Cell> m_cells;
+
+    std::vector<Polygon> m_polygons; // by regions, merged polygons are empty
+    std::vector<uint32_t> m_regionsParents;
+};
+
+} // namespace
+} // namespace
+
+#endif // NAVMESHBUILDER_H
@@ -0,0 +1,24 @@
+#include "object.h"
+#include "scene.h"
+#include "entitystore.h"
+
+namespace trash
+{
+namespace game
+{
+
+const utils::Transform& Object::transform() const
+{
+    return m_scene ? m_scene->entities().transform(m_entity) : m_graphicsNode->transform();
+}
+
+void Object::setTransform(const utils::Transform& value)
+{
+    if (m_scene)
+        m_scene->entities().setTransform(m_entity, value);
+    else
+        m_graphicsNode->setTransform(value);
+}
+
+} // namespace
+} // namespace
@@ -3,6 +3,7 @@
 
 #include <utils/enumclass.h>
 #include <utils/noncopyble.h>
+#include <utils/forwarddecl.h>
 #include <core/node.h>
 
 namespace trash
@@ -26,7 +27,7 @@ class Object : public std::enable_shared_from_this<Object>
     NONCOPYBLE(Object)
 
 public:
-    Object(std::shared_ptr<ObjectUserData> objectData = nullptr) : m_scene(nullptr) , m_graphicsNode(std::make_shared<core::Node>()) {
+    Object(std::shared_ptr<ObjectUserData> objectData = nullptr) : m_scene(nullptr) , m_graphicsNode(std::make_shared<core::Node>()) , m_spatialIndexProxy(0u) , m_entity(0u) {
         m_graphicsNode->setUserData(objectData);
     }
     virtual ~Object() = default;
@@ -35,12 +36,18 @@ public:
         return m_graphicsNode;
     }
 
+    // the transform is kept by the entity store of the scene while the object is attached to it
+    const utils::Transform& transform() const;
+    void setTransform(const utils::Transform&);
+
 protected:
     virtual void doUpdate(uint64_t, uint64_t) {}
 
 protected:
     Scene *m_scene;
     std::shared_ptr<core::Node> m_graphicsNode;
+    uint32_t m_spatialIndexProxy;
+    uint32_t m_entity;
 
     void update(uint64_t time, uint64_t dt) {
         //
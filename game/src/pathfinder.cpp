@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <chrono>
+
+#include <glm/common.hpp>
+
+#include "pathfinder.h"
+#include "navmesh.h"
+
+namespace trash
+{
+namespace game
+{
+
+const float PathFinder::s_pointsQuantum = .1f;
+const size_t PathFinder::s_cacheSize = 256u;
+
+bool PathFinder::Key::operator ==(const Key& other) const
+{
+    return std::equal(coords, coords + 6, other.coords);
+}
+
+size_t PathFinder::KeyHash::operator ()(const Key& key) const
+{
+    size_t result = 0u;
+    for (auto coord : key.coords)
+        result = result * 0x9E3779B1u + std::hash<int32_t>()(coord);
+    return result;
+}
+
+PathFinder::PathFinder(std::shared_ptr<const NavMesh> navMesh, uint32_t numThreads)
+    : m_navMesh(navMesh)
+    , m_version(0u)
+    , m_budget(0)
+    , m_isStopping(false)
+{
+    for (uint32_t i = 0; i < glm::max(numThreads, 1u); ++i)
+        m_workers.emplace_back(&PathFinder::workerLoop, this);
+}
+
+PathFinder::~PathFinder()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_isStopping = true;
+    }
+    m_condition.notify_all();
+
+    for (auto& worker : m_workers)
+        worker.join();
+}
+
+void PathFinder::setNavMesh(std::shared_ptr<const NavMesh> navMesh)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_navMesh = navMesh;
+    ++m_version;
+    m_cache.clear();
+    m_cacheUsage.clear();
+
+    // requests already queued for the old mesh are not merged with the new ones
+    m_pendingRequests.clear();
+}
+
+uint64_t PathFinder::version() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_version;
+}
+
+std::shared_future<PathFinder::PathPtr> PathFinder::findPath(const glm::vec3& start, const glm::vec3& end)
+{
+    return request(start, end, nullptr)->future;
+}
+
+void PathFinder::findPath(const glm::vec3& start, const glm::vec3& end, Callback callback)
+{
+    request(start, end, callback);
+}
+
+void PathFinder::update(uint64_t timeBudget)
+{
+    std::vector<std::shared_ptr<Request>> finishedRequests;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_budget = static_cast<int64_t>(timeBudget);
+        finishedRequests.swap(m_finishedRequests);
+    }
+    m_condition.notify_all();
+
+    // finished requests aren't pending anymore, so nobody adds callbacks to them
+    for (auto& req : finishedRequests)
+        for (auto& callback : req->callbacks)
+            callback(req->result);
+}
+
+size_t PathFinder::numQueuedRequests() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queue.size();
+}
+
+std::shared_ptr<PathFinder::Request> PathFinder::request(const glm::vec3& start, const glm::vec3& end, Callback callback)
+{
+    Key key;
+    for (glm::length_t k = 0; k < 3; ++k)
+    {
+        key.coords[k] = static_cast<int32_t>(glm::floor(start[k] / s_pointsQuantum));
+        key.coords[3 + k] = static_cast<int32_t>(glm::floor(end[k] / s_pointsQuantum));
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto pendingIt = m_pendingRequests.find(key);
+    if (pendingIt != m_pendingRequests.end())
+    {
+        if (callback)
+            pendingIt->second->callbacks.push_back(callback);
+        return pendingIt->second;
+    }
+
+    auto req = std::make_shared<Request>();
+    req->key = key;
+    req->start = start;
+    req->end = end;
+    req->navMesh = m_navMesh;
+    req->version = m_version;
+    req->future = req->promise.get_future().share();
+    if (callback)
+        req->callbacks.push_back(callback);
+
+    auto cacheIt = m_cache.find(key);
+    if (cacheIt != m_cache.end())
+    {
+        m_cacheUsage.splice(m_cacheUsage.begin(), m_cacheUsage, cacheIt->second.usage);
+        req->result = cacheIt->second.path;
+        req->promise.set_value(req->result);
+        if (callback)
+            m_finishedRequests.push_back(req);
+        return req;
+    }
+
+    m_pendingRequests.insert({key, req});
+    m_queue.push_back(req);
+    m_condition.notify_one();
+
+    return req;
+}
+
+void PathFinder::workerLoop()
+{
+    NavMesh::Query query;
+
+    while (true)
+    {
+        std::shared_ptr<Request> req;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return m_isStopping || (!m_queue.empty() && (m_budget > 0)); });
+            if (m_isStopping)
+                return;
+
+            req = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        const auto startTime = std::chrono::steady_clock::now();
+
+        std::shared_ptr<Path> path;
+        if (req->navMesh)
+        {
+            path = std::make_shared<Path>();
+            if (!req->navMesh->findPath(req->start, req->end, *path, query))
+                path = nullptr;
+        }
+
+        const auto spentTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_budget -= static_cast<int64_t>(spentTime);
+
+        auto pendingIt = m_pendingRequests.find(req->key);
+        if ((pendingIt != m_pendingRequests.end()) && (pendingIt->second == req))
+            m_pendingRequests.erase(pendingIt);
+
+        // results searched over a replaced mesh are delivered but not cached
+        if ((req->version == m_version) && (m_cache.find(req->key) == m_cache.end()))
+        {
+            if (m_cache.size() >= s_cacheSize)
+            {
+                m_cache.erase(m_cacheUsage.back());
+                m_cacheUsage.pop_back();
+            }
+            m_cacheUsage.push_front(req->key);
+            m_cache.insert({req->key, CacheEntry{path, m_cacheUsage.begin()}});
+        }
+
+        // the promise is set under the lock, so a request is not pending anymore once its future is ready
+        req->result = path;
+        req->promise.set_value(path);
+        if (!req->callbacks.empty())
+            m_finishedRequests.push_back(req);
+    }
+}
+
+} // namespace
+} // namespace
@@ -0,0 +1,109 @@
+#ifndef PATHFINDER_H
+#define PATHFINDER_H
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <glm/vec3.hpp>
+
+#include <utils/noncopyble.h>
+
+namespace trash
+{
+namespace game
+{
+
+class NavMesh;
+
+// Answers path requests over a navigation mesh on its own worker threads.
+// Requests with the same (quantized) start and end points are merged and recent results are cached until the mesh is replaced.
+// Workers start new searches only while the time budget of the current frame isn't spent, the budget is renewed by update().
+// Results are delivered through futures or through callbacks which are called by update() on the thread calling it.
+class PathFinder
+{
+    NONCOPYBLE(PathFinder)
+
+public:
+    using Path = std::vector<glm::vec3>; // corners from the start to the end point including both of them
+    using PathPtr = std::shared_ptr<const Path>; // nullptr if there is no path
+    using Callback = std::function<void(PathPtr)>;
+
+    PathFinder(std::shared_ptr<const NavMesh>, uint32_t = 1u);
+    ~PathFinder();
+
+    void setNavMesh(std::shared_ptr<const NavMesh>);
+    uint64_t version() const;
+
+    std::shared_future<PathPtr> findPath(const glm::vec3&, const glm::vec3&);
+    void findPath(const glm::vec3&, const glm::vec3&, Callback);
+
+    void update(uint64_t); // time budget in microseconds for the next frame
+
+    size_t numQueuedRequests() const;
+
+private:
+    struct Key
+    {
+        int32_t coords[6];
+        bool operator ==(const Key&) const;
+    };
+
+    struct KeyHash
+    {
+        size_t operator ()(const Key&) const;
+    };
+
+    struct Request
+    {
+        Key key;
+        glm::vec3 start, end;
+        std::shared_ptr<const NavMesh> navMesh;
+        uint64_t version;
+        std::promise<PathPtr> promise;
+        std::shared_future<PathPtr> future;
+        std::vector<Callback> callbacks;
+        PathPtr result;
+    };
+
+    struct CacheEntry
+    {
+        PathPtr path;
+        std::list<Key>::iterator usage;
+    };
+
+    std::shared_ptr<Request> request(const glm::vec3&, const glm::vec3&, Callback);
+    void workerLoop();
+
+    std::vector<std::thread> m_workers;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+
+    std::shared_ptr<const NavMesh> m_navMesh;
+    uint64_t m_version;
+
+    std::deque<std::shared_ptr<Request>> m_queue;
+    std::unordered_map<Key, std::shared_ptr<Request>, KeyHash> m_pendingRequests; // queued and being searched
+    std::vector<std::shared_ptr<Request>> m_finishedRequests; // their callbacks are waiting for update()
+
+    std::unordered_map<Key, CacheEntry, KeyHash> m_cache;
+    std::list<Key> m_cacheUsage; // the most recently used first
+
+    int64_t m_budget; // microseconds
+    bool m_isStopping;
+
+    static const float s_pointsQuantum;
+    static const size_t s_cacheSize;
+};
+
+} // namespace
+} // namespace
+
+#endif // PATHFINDER_H
@@ -7,6 +7,9 @@
 #include <core/textnode.h>
 
 #include "person.h"
+#include "crowd.h"
+#include "scene.h"
+#include "entitystore.h"
 
 namespace trash
 {
@@ -37,13 +40,18 @@ float PersonTaskRun::velocity() const
 
 const float Person::s_walkVelocity = 1.1f;
 const float Person::s_runVelocity = 3.3f;
+const uint64_t Person::s_animationCrossFadeTime = 250;
+const float Person::s_crowdAgentRadius = .3f;
 
 Person::Person(const std::string &modelFilename)
     : Object(std::make_shared<ObjectUserData>(*this))
     , m_taskProcessingStartTime(static_cast<uint64_t>(-1))
+    , m_crowdAgent(Crowd::invalidId)
 {
     m_modelNode = std::make_shared<core::ModelNode>(modelFilename);
     m_modelNode->setTransform(utils::Transform::fromScale(1.f / 200.f));
+    m_modelNode->setAnimationCrossFadeTime(s_animationCrossFadeTime);
+    m_modelNode->setSkinningType(core::SkinningType::DualQuaternion);
 
     m_graphicsNode->attach(m_modelNode);
 
@@ -57,6 +65,11 @@ Person::Person(const std::string &modelFilename)
     autoTransform->attach(m_textNode);
 }
 
+Person::~Person()
+{
+    setCrowd(nullptr);
+}
+
 const std::string &Person::name() const
 {
     return m_name;
@@ -76,10 +89,44 @@ void Person::clearTasks()
 {
     while(!m_tasks.empty())
         m_tasks.pop();
+
+    if (m_scene && m_scene->entities().ais().has(m_entity))
+        m_scene->entities().ais().erase(m_entity);
+}
+
+void Person::setCrowd(std::shared_ptr<Crowd> crowd)
+{
+    if (m_crowd && (m_crowdAgent != Crowd::invalidId))
+        m_crowd->removeAgent(m_crowdAgent);
+
+    m_crowd = crowd;
+    m_crowdAgent = Crowd::invalidId;
 }
 
 void Person::doUpdate(uint64_t time, uint64_t dt)
 {
+    if (m_crowd)
+    {
+        // the agent is added lazily, so the person may be placed anywhere before
+        auto currentTransform = transform();
+        if (m_crowdAgent == Crowd::invalidId)
+        {
+            m_crowdAgent = m_crowd->addAgent(glm::vec2(currentTransform.translation.x, currentTransform.translation.z), s_crowdAgentRadius, s_runVelocity);
+        }
+        else
+        {
+            const glm::vec2& position = m_crowd->agentPosition(m_crowdAgent);
+            if (position != glm::vec2(currentTransform.translation.x, currentTransform.translation.z))
+            {
+                currentTransform.translation.x = position.x;
+                currentTransform.translation.z = position.y;
+                setTransform(currentTransform);
+            }
+        }
+
+        m_crowd->setAgentPreferredVelocity(m_crowdAgent, glm::vec2(0.f));
+    }
+
     bool isProcessed = false;
 
     while (!isProcessed)
@@ -103,8 +150,7 @@ void Person::doUpdate(uint64_t time, uint64_t dt)
             }
             else
             {
-                const uint64_t animFrame = time - m_taskProcessingStartTime;
-                m_modelNode->setAnimationFrame("idle", animFrame);
+                setAnimation("idle", m_taskProcessingStartTime);
                 isProcessed = true;
             }
             break;
@@ -115,7 +161,7 @@ void Person::doUpdate(uint64_t time, uint64_t dt)
             const uint64_t animTime =  m_modelNode->animationTime("wave");
             if (animFrame < animTime)
             {
-                m_modelNode->setAnimationFrame("wave", animFrame);
+                setAnimation("wave", m_taskProcessingStartTime);
                 isProcessed = true;
             }
             else
@@ -129,7 +175,29 @@ void Person::doUpdate(uint64_t time, uint64_t dt)
         case PersonTaskType::Travel:
         {
             auto travelTask = std::dynamic_pointer_cast<PersonTaskTravel>(currentTask);
-            auto currentTransform = m_graphicsNode->transform();
+            if (!m_crowd)
+            {
+                // the person is moved to the target by the AI and velocity systems of the scene
+                auto& ais = m_scene->entities().ais();
+                auto& ai = ais.has(m_entity) ? ais.get(m_entity) : ais.insert(m_entity);
+                if (ai.state == AIState::Arrived)
+                {
+                    ais.erase(m_entity);
+                    m_taskProcessingStartTime = time;
+                    m_tasks.pop();
+                }
+                else
+                {
+                    ai.state = AIState::Moving;
+                    ai.target = travelTask->target;
+                    ai.speed = travelTask->velocity();
+                    setAnimation(travelTask->animationName(), m_taskProcessingStartTime);
+                    isProcessed = true;
+                }
+                break;
+            }
+
+            auto currentTransform = transform();
             const glm::vec3 walkDir = travelTask->target - currentTransform.translation;
             const uint64_t requiredTime = static_cast<uint64_t>(1000 * glm::length(walkDir) / travelTask->velocity() + .5f);
             if (requiredTime >= dt)
@@ -137,12 +205,11 @@ void Person::doUpdate(uint64_t time, uint64_t dt)
                 const glm::vec3 z(glm::normalize(walkDir));
                 const glm::vec3 y(0.0f, 1.0f, 0.0f);
                 const glm::vec3 x(glm::cross(y, z));
-                currentTransform.translation += travelTask->velocity() * dt * .001f * z;
+                m_crowd->setAgentPreferredVelocity(m_crowdAgent, travelTask->velocity() * glm::vec2(z.x, z.z));
                 currentTransform.rotation = glm::quat_cast(glm::mat3x3(x, y, z));
-                m_graphicsNode->setTransform(currentTransform);
+                setTransform(currentTransform);
 
-                const uint64_t animFrame = time - m_taskProcessingStartTime;
-                m_modelNode->setAnimationFrame(travelTask->animationName(), animFrame);
+                setAnimation(travelTask->animationName(), m_taskProcessingStartTime);
 
                 isProcessed = true;
             }
@@ -152,8 +219,9 @@ void Person::doUpdate(uint64_t time, uint64_t dt)
                 const glm::vec3 y(0.0f, 1.0f, 0.0f);
                 const glm::vec3 x(glm::cross(y, z));
                 currentTransform.translation = travelTask->target;
+                m_crowd->setAgentPosition(m_crowdAgent, glm::vec2(travelTask->target.x, travelTask->target.z));
                 currentTransform.rotation = glm::quat_cast(glm::mat3x3(x, y, z));
-                m_graphicsNode->setTransform(currentTransform);
+                setTransform(currentTransform);
 
                 dt -= requiredTime;
                 m_taskProcessingStartTime = time - dt;
@@ -169,5 +237,16 @@ void Person::doUpdate(uint64_t time, uint64_t dt)
     }
 }
 
+void Person::setAnimation(const std::string& name, uint64_t startTime)
+{
+    auto& animations = m_scene->entities().animations();
+    if (!animations.has(m_entity))
+        animations.insert(m_entity).modelNode = m_modelNode;
+
+    auto& animation = animations.get(m_entity);
+    animation.name = name;
+    animation.startTime = startTime;
+}
+
 } // namespace
 } // namespace
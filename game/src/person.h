@@ -18,6 +18,8 @@ namespace trash
 namespace game
 {
 
+class Crowd;
+
 ENUMCLASS(PersonTaskType, uint32_t, Idle, Wave, Travel)
 
 class AbstractPersonTask
@@ -84,6 +86,7 @@ class Person : public Object
 {
 public:
     Person(const std::string&);
+    ~Person() override;
 
     const std::string& name() const;
     void setText(const std::string&);
@@ -91,8 +94,11 @@ public:
     void addTask(std::shared_ptr<AbstractPersonTask>);
     void clearTasks();
 
+    void setCrowd(std::shared_ptr<Crowd>); // the person is moved by the crowd avoiding the other agents
+
 protected:
     void doUpdate(uint64_t, uint64_t) override;
+    void setAnimation(const std::string&, uint64_t); // name and start time
 
 protected:
     std::string m_name;
@@ -103,9 +109,14 @@ protected:
     std::queue<std::shared_ptr<AbstractPersonTask>> m_tasks;
     uint64_t m_taskProcessingStartTime;
 
+    std::shared_ptr<Crowd> m_crowd;
+    uint32_t m_crowdAgent;
+
 private:
     static const float s_walkVelocity;
     static const float s_runVelocity;
+    static const uint64_t s_animationCrossFadeTime;
+    static const float s_crowdAgentRadius;
 };
 
 } // namespace
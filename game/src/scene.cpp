@@ -5,8 +5,13 @@
 #include <core/graphicscontroller.h>
 #include <core/scenerootnode.h>
 
+#include <utils/boundingbox.h>
+#include <utils/frustum.h>
+
 #include "scene.h"
 #include "object.h"
+#include "spatialindex.h"
+#include "entitystore.h"
 
 namespace trash
 {
@@ -21,8 +26,25 @@ public:
     Scene &thisScene;
 };
 
+namespace
+{
+
+utils::BoundingBox objectBoundingBox(const Object& object)
+{
+    auto node = object.graphicsNode();
+    const auto& box = node->boundingBox();
+    const auto& transform = node->globalTransform();
+
+    // objects without geometry are kept as points at their origins
+    return box.empty() ? utils::BoundingBox(transform.translation, transform.translation) : transform * box;
+}
+
+}
+
 Scene::Scene()
     : m_scene(std::make_shared<core::Scene>())
+    , m_entities(std::make_unique<EntityStore>())
+    , m_spatialIndex(std::make_unique<SpatialIndex>())
 {
     auto& graphicsController = core::Core::instance().graphicsController();
     graphicsController.setMainScene(m_scene);
@@ -49,6 +71,8 @@ void Scene::detachObject(std::shared_ptr<Object> object)
     assert(object->m_scene == this);
 
     object->m_graphicsNode->parent()->detach(object->m_graphicsNode);
+    m_spatialIndex->destroyProxy(object->m_spatialIndexProxy);
+    m_entities->destroyEntity(object->m_entity);
     m_objects.erase(object);
     object->m_scene = nullptr;
 }
@@ -68,12 +92,34 @@ void Scene::attachObject(std::shared_ptr<Object> object, std::shared_ptr<core::N
     m_objects.insert(object);
     object->m_scene = this;
     parentNode->attach(object->m_graphicsNode);
+    object->m_entity = m_entities->createEntity(object->m_graphicsNode);
+    object->m_spatialIndexProxy = m_spatialIndex->createProxy(objectBoundingBox(*object), object.get());
+}
+
+EntityStore& Scene::entities()
+{
+    return *m_entities;
+}
+
+const EntityStore& Scene::entities() const
+{
+    return *m_entities;
 }
 
 void Scene::update(uint64_t time , uint64_t dt)
 {
     for (auto object : m_objects)
         object->update(time, dt);
+
+    m_entities->update(time, dt);
+}
+
+void Scene::present(uint64_t time, float alpha)
+{
+    m_entities->present(time, alpha);
+
+    for (auto object : m_objects)
+        m_spatialIndex->moveProxy(object->m_spatialIndexProxy, objectBoundingBox(*object));
 }
 
 std::shared_ptr<Object> Scene::findObject(std::shared_ptr<core::Node> node)
@@ -91,5 +137,36 @@ std::shared_ptr<Object> Scene::findObject(std::shared_ptr<core::Node> node)
     return data->thisObject.shared_from_this();
 }
 
+void Scene::findObjects(const utils::BoundingBox& box, std::vector<std::shared_ptr<Object>>& result) const
+{
+    m_spatialIndex->findObjects(box, m_foundObjects);
+    copyFoundObjects(result);
+}
+
+void Scene::findObjects(const glm::vec3& center, float radius, std::vector<std::shared_ptr<Object>>& result) const
+{
+    m_spatialIndex->findObjects(center, radius, m_foundObjects);
+    copyFoundObjects(result);
+}
+
+void Scene::findObjects(const utils::Frustum& frustum, std::vector<std::shared_ptr<Object>>& result) const
+{
+    m_spatialIndex->findObjects(frustum, m_foundObjects);
+    copyFoundObjects(result);
+}
+
+void Scene::findClosestObjects(const glm::vec3& point, size_t count, std::vector<std::shared_ptr<Object>>& result) const
+{
+    m_spatialIndex->findClosestObjects(point, count, m_foundObjects);
+    copyFoundObjects(result);
+}
+
+void Scene::copyFoundObjects(std::vector<std::shared_ptr<Object>>& result) const
+{
+    result.clear();
+    for (auto object : m_foundObjects)
+        result.push_back(object->shared_from_this());
+}
+
 } // namespace
 } // namespace
@@ -3,9 +3,13 @@
 
 #include <memory>
 #include <unordered_set>
+#include <vector>
+
+#include <glm/vec3.hpp>
 
 #include <core/forwarddecl.h>
 #include <utils/noncopyble.h>
+#include <utils/forwarddecl.h>
 
 namespace trash
 {
@@ -13,6 +17,8 @@ namespace game
 {
 
 class Object;
+class SpatialIndex;
+class EntityStore;
 
 class Scene
 {
@@ -28,13 +34,29 @@ public:
     void detachObject(std::shared_ptr<Object>);
     void attachObject(std::shared_ptr<Object>, std::shared_ptr<core::Node> = nullptr);
 
-    void update(uint64_t, uint64_t);
+    EntityStore& entities();
+    const EntityStore& entities() const;
+
+    void update(uint64_t, uint64_t); // a simulation step
+    void present(uint64_t, float); // time and interpolation factor between the two latest steps
 
     static std::shared_ptr<Object> findObject(std::shared_ptr<core::Node>);
 
+    // the objects are found by their world bounding boxes, the result buffers are cleared before filling
+    void findObjects(const utils::BoundingBox&, std::vector<std::shared_ptr<Object>>&) const;
+    void findObjects(const glm::vec3&, float, std::vector<std::shared_ptr<Object>>&) const; // center and radius
+    void findObjects(const utils::Frustum&, std::vector<std::shared_ptr<Object>>&) const;
+    void findClosestObjects(const glm::vec3&, size_t, std::vector<std::shared_ptr<Object>>&) const; // sorted by the distance
+
 protected:
     std::unordered_set<std::shared_ptr<Object>> m_objects;
     std::shared_ptr<core::Scene> m_scene;
+    std::unique_ptr<EntityStore> m_entities;
+    std::unique_ptr<SpatialIndex> m_spatialIndex;
+    mutable std::vector<Object*> m_foundObjects;
+
+private:
+    void copyFoundObjects(std::vector<std::shared_ptr<Object>>&) const;
 
 };
 
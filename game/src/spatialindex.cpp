@@ -0,0 +1,381 @@
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include "spatialindex.h"
+
+namespace trash
+{
+namespace game
+{
+
+namespace
+{
+
+float surfaceArea(const utils::BoundingBox& box)
+{
+    const glm::vec3 size = box.maxPoint - box.minPoint;
+    return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+bool overlaps(const utils::BoundingBox& a, const utils::BoundingBox& b)
+{
+    return glm::all(glm::lessThanEqual(a.minPoint, b.maxPoint)) && glm::all(glm::lessThanEqual(b.minPoint, a.maxPoint));
+}
+
+bool contains(const utils::BoundingBox& a, const utils::BoundingBox& b)
+{
+    return glm::all(glm::lessThanEqual(a.minPoint, b.minPoint)) && glm::all(glm::lessThanEqual(b.maxPoint, a.maxPoint));
+}
+
+float distanceSq(const utils::BoundingBox& box, const glm::vec3& point)
+{
+    const glm::vec3 delta = box.closestPoint(point) - point;
+    return glm::dot(delta, delta);
+}
+
+}
+
+const uint32_t SpatialIndex::invalidId = std::numeric_limits<uint32_t>::max();
+
+SpatialIndex::SpatialIndex(float margin)
+    : m_root(invalidId)
+    , m_freeNode(invalidId)
+    , m_margin(margin)
+{
+}
+
+uint32_t SpatialIndex::createProxy(const utils::BoundingBox& box, Object *object)
+{
+    const uint32_t id = allocateNode();
+    auto& node = m_nodes[id];
+    node.box = utils::BoundingBox(box.minPoint - glm::vec3(m_margin), box.maxPoint + glm::vec3(m_margin));
+    node.objectBox = box;
+    node.object = object;
+    node.height = 0;
+
+    insertLeaf(id);
+    return id;
+}
+
+void SpatialIndex::destroyProxy(uint32_t id)
+{
+    removeLeaf(id);
+    freeNode(id);
+}
+
+bool SpatialIndex::moveProxy(uint32_t id, const utils::BoundingBox& box)
+{
+    m_nodes[id].objectBox = box;
+    if (contains(m_nodes[id].box, box))
+        return false;
+
+    removeLeaf(id);
+    m_nodes[id].box = utils::BoundingBox(box.minPoint - glm::vec3(m_margin), box.maxPoint + glm::vec3(m_margin));
+    insertLeaf(id);
+    return true;
+}
+
+void SpatialIndex::findObjects(const utils::BoundingBox& box, std::vector<Object*>& result) const
+{
+    traverse([&box](const utils::BoundingBox& nodeBox) { return overlaps(nodeBox, box); },
+             [&box](const utils::BoundingBox& objectBox) { return overlaps(objectBox, box); },
+             result);
+}
+
+void SpatialIndex::findObjects(const glm::vec3& center, float radius, std::vector<Object*>& result) const
+{
+    const float radiusSq = radius * radius;
+    auto test = [&center, radiusSq](const utils::BoundingBox& box) { return distanceSq(box, center) <= radiusSq; };
+    traverse(test, test, result);
+}
+
+void SpatialIndex::findObjects(const utils::Frustum& frustum, std::vector<Object*>& result) const
+{
+    auto test = [&frustum](const utils::BoundingBox& box) { return frustum.contain(box); };
+    traverse(test, test, result);
+}
+
+void SpatialIndex::findClosestObjects(const glm::vec3& point, size_t count, std::vector<Object*>& result) const
+{
+    result.clear();
+    if ((m_root == invalidId) || (count == 0u))
+        return;
+
+    // best first search, nodes are opened by the distance to their boxes until they are farther than the found objects
+    using Item = std::pair<float, uint32_t>;
+    const std::greater<Item> closerFirst;
+    const std::less<Item> fartherFirst;
+
+    m_openNodes.clear();
+    m_closestLeaves.clear();
+    m_openNodes.push_back({distanceSq(m_nodes[m_root].box, point), m_root});
+
+    while (!m_openNodes.empty())
+    {
+        std::pop_heap(m_openNodes.begin(), m_openNodes.end(), closerFirst);
+        const Item item = m_openNodes.back();
+        m_openNodes.pop_back();
+
+        if ((m_closestLeaves.size() == count) && (item.first >= m_closestLeaves.front().first))
+            break;
+
+        const auto& node = m_nodes[item.second];
+        if (isLeaf(item.second))
+        {
+            const float objectDistance = distanceSq(node.objectBox, point);
+            if (m_closestLeaves.size() < count)
+            {
+                m_closestLeaves.push_back({objectDistance, item.second});
+                std::push_heap(m_closestLeaves.begin(), m_closestLeaves.end(), fartherFirst);
+            }
+            else if (objectDistance < m_closestLeaves.front().first)
+            {
+                std::pop_heap(m_closestLeaves.begin(), m_closestLeaves.end(), fartherFirst);
+                m_closestLeaves.back() = {objectDistance, item.second};
+                std::push_heap(m_closestLeaves.begin(), m_closestLeaves.end(), fartherFirst);
+            }
+            continue;
+        }
+
+        for (auto child : node.children)
+        {
+            m_openNodes.push_back({distanceSq(m_nodes[child].box, point), child});
+            std::push_heap(m_openNodes.begin(), m_openNodes.end(), closerFirst);
+        }
+    }
+
+    std::sort_heap(m_closestLeaves.begin(), m_closestLeaves.end(), fartherFirst);
+    for (const auto& leaf : m_closestLeaves)
+        result.push_back(m_nodes[leaf.second].object);
+}
+
+uint32_t SpatialIndex::allocateNode()
+{
+    uint32_t id;
+    if (m_freeNode != invalidId)
+    {
+        id = m_freeNode;
+        m_freeNode = m_nodes[id].parent;
+    }
+    else
+    {
+        id = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.emplace_back();
+    }
+
+    auto& node = m_nodes[id];
+    node.object = nullptr;
+    node.parent = invalidId;
+    node.children[0] = node.children[1] = invalidId;
+    node.height = 0;
+    return id;
+}
+
+void SpatialIndex::freeNode(uint32_t id)
+{
+    m_nodes[id].parent = m_freeNode;
+    m_nodes[id].height = -1;
+    m_freeNode = id;
+}
+
+void SpatialIndex::insertLeaf(uint32_t leaf)
+{
+    if (m_root == invalidId)
+    {
+        m_root = leaf;
+        m_nodes[leaf].parent = invalidId;
+        return;
+    }
+
+    // the sibling is chosen by the surface area heuristic
+    const utils::BoundingBox leafBox = m_nodes[leaf].box;
+    uint32_t index = m_root;
+    while (!isLeaf(index))
+    {
+        const auto& node = m_nodes[index];
+        const float area = surfaceArea(node.box);
+        const float combinedArea = surfaceArea(node.box + leafBox);
+
+        const float cost = 2.f * combinedArea; // of a new parent for this node and the leaf
+        const float inheritanceCost = 2.f * (combinedArea - area); // of pushing the leaf further down
+
+        float childrenCosts[2];
+        for (uint32_t k = 0; k < 2u; ++k)
+        {
+            const auto& child = m_nodes[node.children[k]];
+            childrenCosts[k] = surfaceArea(child.box + leafBox) + inheritanceCost;
+            if (!isLeaf(node.children[k]))
+                childrenCosts[k] -= surfaceArea(child.box);
+        }
+
+        if ((cost < childrenCosts[0]) && (cost < childrenCosts[1]))
+            break;
+
+        index = node.children[(childrenCosts[0] < childrenCosts[1]) ? 0u : 1u];
+    }
+
+    const uint32_t sibling = index;
+    const uint32_t oldParent = m_nodes[sibling].parent;
+    const uint32_t newParent = allocateNode();
+
+    m_nodes[newParent].parent = oldParent;
+    m_nodes[newParent].box = leafBox + m_nodes[sibling].box;
+    m_nodes[newParent].height = m_nodes[sibling].height + 1;
+    m_nodes[newParent].children[0] = sibling;
+    m_nodes[newParent].children[1] = leaf;
+    m_nodes[sibling].parent = newParent;
+    m_nodes[leaf].parent = newParent;
+
+    if (oldParent != invalidId)
+    {
+        auto& children = m_nodes[oldParent].children;
+        children[(children[0] == sibling) ? 0u : 1u] = newParent;
+    }
+    else
+    {
+        m_root = newParent;
+    }
+
+    refit(m_nodes[leaf].parent);
+}
+
+void SpatialIndex::removeLeaf(uint32_t leaf)
+{
+    if (leaf == m_root)
+    {
+        m_root = invalidId;
+        return;
+    }
+
+    const uint32_t parent = m_nodes[leaf].parent;
+    const uint32_t grandParent = m_nodes[parent].parent;
+    const uint32_t sibling = m_nodes[parent].children[(m_nodes[parent].children[0] == leaf) ? 1u : 0u];
+
+    if (grandParent != invalidId)
+    {
+        auto& children = m_nodes[grandParent].children;
+        children[(children[0] == parent) ? 0u : 1u] = sibling;
+        m_nodes[sibling].parent = grandParent;
+        freeNode(parent);
+        refit(grandParent);
+    }
+    else
+    {
+        m_root = sibling;
+        m_nodes[sibling].parent = invalidId;
+        freeNode(parent);
+    }
+}
+
+void SpatialIndex::refit(uint32_t index)
+{
+    while (index != invalidId)
+    {
+        index = balance(index);
+
+        auto& node = m_nodes[index];
+        const auto& child0 = m_nodes[node.children[0]];
+        const auto& child1 = m_nodes[node.children[1]];
+        node.height = 1 + glm::max(child0.height, child1.height);
+        node.box = child0.box + child1.box;
+
+        index = node.parent;
+    }
+}
+
+uint32_t SpatialIndex::balance(uint32_t iA)
+{
+    auto& a = m_nodes[iA];
+    if (isLeaf(iA) || (a.height < 2))
+        return iA;
+
+    // the higher child is rotated up if the heights of the children differ by more than one
+    const int32_t heightDifference = m_nodes[a.children[1]].height - m_nodes[a.children[0]].height;
+    if (glm::abs(heightDifference) <= 1)
+        return iA;
+
+    const uint32_t higherSide = (heightDifference > 0) ? 1u : 0u;
+    const uint32_t lowerSide = 1u - higherSide;
+
+    const uint32_t iB = a.children[higherSide];
+    const uint32_t iC = a.children[lowerSide];
+    auto& b = m_nodes[iB];
+    auto& c = m_nodes[iC];
+
+    const uint32_t iD = b.children[0];
+    const uint32_t iE = b.children[1];
+    auto& d = m_nodes[iD];
+    auto& e = m_nodes[iE];
+
+    // B takes the place of A, A becomes a child of B
+    b.children[0] = iA;
+    b.parent = a.parent;
+    a.parent = iB;
+
+    if (b.parent != invalidId)
+    {
+        auto& children = m_nodes[b.parent].children;
+        children[(children[0] == iA) ? 0u : 1u] = iB;
+    }
+    else
+    {
+        m_root = iB;
+    }
+
+    // the higher grandchild stays at B, the lower one goes to A instead of B
+    const bool isDHigher = d.height > e.height;
+    const uint32_t iStay = isDHigher ? iD : iE;
+    const uint32_t iMove = isDHigher ? iE : iD;
+    auto& stay = m_nodes[iStay];
+    auto& move = m_nodes[iMove];
+
+    b.children[1] = iStay;
+    a.children[higherSide] = iMove;
+    move.parent = iA;
+
+    a.box = c.box + move.box;
+    b.box = a.box + stay.box;
+    a.height = 1 + glm::max(c.height, move.height);
+    b.height = 1 + glm::max(a.height, stay.height);
+
+    return iB;
+}
+
+template <typename NodeTest, typename ObjectTest>
+void SpatialIndex::traverse(NodeTest nodeTest, ObjectTest objectTest, std::vector<Object*>& result) const
+{
+    result.clear();
+    if (m_root == invalidId)
+        return;
+
+    m_stack.clear();
+    m_stack.push_back(m_root);
+
+    while (!m_stack.empty())
+    {
+        const uint32_t index = m_stack.back();
+        m_stack.pop_back();
+
+        const auto& node = m_nodes[index];
+        if (!nodeTest(node.box))
+            continue;
+
+        if (isLeaf(index))
+        {
+            if (objectTest(node.objectBox))
+                result.push_back(node.object);
+        }
+        else
+        {
+            m_stack.push_back(node.children[0]);
+            m_stack.push_back(node.children[1]);
+        }
+    }
+}
+
+} // namespace
+} // namespace
@@ -0,0 +1,75 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include <utils/noncopyble.h>
+#include <utils/boundingbox.h>
+#include <utils/frustum.h>
+
+namespace trash
+{
+namespace game
+{
+
+class Object;
+
+// Dynamic bounding volume tree of objects. Leaves keep boxes enlarged by a margin, so small moves don't change the tree,
+// and the tree is kept balanced by rotations on insertions and removals. Results are written to the given buffers, which keep their
+// capacity between queries. Queries share traversal scratch, so they must be called from one thread.
+class SpatialIndex
+{
+    NONCOPYBLE(SpatialIndex)
+
+public:
+    static const uint32_t invalidId;
+
+    SpatialIndex(float = .1f); // margin
+
+    uint32_t createProxy(const utils::BoundingBox&, Object*);
+    void destroyProxy(uint32_t);
+    bool moveProxy(uint32_t, const utils::BoundingBox&); // returns true if the tree has been changed
+
+    void findObjects(const utils::BoundingBox&, std::vector<Object*>&) const;
+    void findObjects(const glm::vec3&, float, std::vector<Object*>&) const; // center and radius
+    void findObjects(const utils::Frustum&, std::vector<Object*>&) const;
+    void findClosestObjects(const glm::vec3&, size_t, std::vector<Object*>&) const; // sorted by the distance
+
+private:
+    struct Node
+    {
+        utils::BoundingBox box; // enlarged for leaves
+        utils::BoundingBox objectBox;
+        Object *object;
+        uint32_t parent; // the next free node for free nodes
+        uint32_t children[2];
+        int32_t height; // 0 for leaves, -1 for free nodes
+    };
+
+    bool isLeaf(uint32_t id) const { return m_nodes[id].children[0] == invalidId; }
+
+    uint32_t allocateNode();
+    void freeNode(uint32_t);
+    void insertLeaf(uint32_t);
+    void removeLeaf(uint32_t);
+    void refit(uint32_t);
+    uint32_t balance(uint32_t);
+
+    template <typename NodeTest, typename ObjectTest>
+    void traverse(NodeTest, ObjectTest, std::vector<Object*>&) const;
+
+    std::vector<Node> m_nodes;
+    uint32_t m_root;
+    uint32_t m_freeNode;
+    float m_margin;
+
+    mutable std::vector<uint32_t> m_stack;
+    mutable std::vector<std::pair<float, uint32_t>> m_openNodes, m_closestLeaves;
+};
+
+} // namespace
+} // namespace
+
+#endif // SPATIALINDEX_H
@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <limits>
+
+#include <glm/geometric.hpp>
+
+#include "waypointgraph.h"
+
+namespace trash
+{
+namespace game
+{
+
+const uint32_t WayPointGraph::invalidId = std::numeric_limits<uint32_t>::max();
+
+WayPointGraph::WayPointGraph(const std::multimap<std::shared_ptr<WayPoint>, std::shared_ptr<WayPoint>>& edges, uint64_t version)
+    : m_version(version)
+{
+    auto addWayPoint = [this](const std::shared_ptr<WayPoint>& wayPoint) {
+        auto it = m_ids.find(wayPoint.get());
+        if (it != m_ids.end())
+            return it->second;
+
+        const auto id = static_cast<uint32_t>(m_wayPoints.size());
+        m_ids.insert({wayPoint.get(), id});
+        m_wayPoints.push_back(wayPoint);
+        m_positions.push_back(wayPoint->position);
+        return id;
+    };
+
+    std::vector<std::pair<uint32_t, uint32_t>> edgesIds;
+    edgesIds.reserve(edges.size());
+    for (const auto& edge : edges)
+    {
+        const auto from = addWayPoint(edge.first);
+        edgesIds.push_back({from, addWayPoint(edge.second)});
+    }
+
+    buildEdges(edgesIds);
+}
+
+WayPointGraph::WayPointGraph(const std::vector<std::shared_ptr<WayPoint>>& wayPoints, const std::vector<std::pair<uint32_t, uint32_t>>& edges, uint64_t version)
+    : m_wayPoints(wayPoints)
+    , m_version(version)
+{
+    m_positions.reserve(m_wayPoints.size());
+    for (uint32_t id = 0; id < m_wayPoints.size(); ++id)
+    {
+        m_ids.insert({m_wayPoints[id].get(), id});
+        m_positions.push_back(m_wayPoints[id]->position);
+    }
+
+    buildEdges(edges);
+}
+
+uint32_t WayPointGraph::nodeId(const std::shared_ptr<WayPoint>& wayPoint) const
+{
+    auto it = m_ids.find(wayPoint.get());
+    return (it != m_ids.end()) ? it->second : invalidId;
+}
+
+void WayPointGraph::buildEdges(const std::vector<std::pair<uint32_t, uint32_t>>& edges)
+{
+    const auto numNodes = m_wayPoints.size();
+    m_offsets.assign(numNodes + 1u, 0u);
+    for (const auto& edge : edges)
+        ++m_offsets[edge.first + 1u];
+    for (size_t i = 0; i < numNodes; ++i)
+        m_offsets[i + 1u] += m_offsets[i];
+
+    m_targets.resize(edges.size());
+    m_costs.resize(edges.size());
+    std::vector<uint32_t> heads(m_offsets.begin(), m_offsets.end() - 1);
+    for (const auto& edge : edges)
+    {
+        const uint32_t index = heads[edge.first]++;
+        m_targets[index] = edge.second;
+        m_costs[index] = glm::distance(m_positions[edge.first], m_positions[edge.second]);
+    }
+}
+
+WayPointSearch::WayPointSearch()
+    : m_generation(0u)
+    , m_numExpandedNodes(0u)
+{
+}
+
+bool WayPointSearch::find(const WayPointGraph& graph,
+                          const Links& starts,
+                          const glm::vec3& endPosition,
+                          const Links& ends,
+                          float directCost,
+                          std::vector<uint32_t>& path)
+{
+    static const float maxCost = std::numeric_limits<float>::max();
+
+    path.clear();
+    m_heap.clear();
+    m_numExpandedNodes = 0u;
+
+    const uint32_t numNodes = graph.numNodes();
+    const uint32_t endId = numNodes;
+    if (m_states.size() < numNodes + 1u)
+        m_states.resize(numNodes + 1u, NodeState{maxCost, maxCost, maxCost, WayPointGraph::invalidId, WayPointGraph::invalidId, 0u});
+
+    if (++m_generation == 0u)
+    {
+        for (auto& nodeState : m_states)
+            nodeState.generation = 0u;
+        m_generation = 1u;
+    }
+
+    for (const auto& end : ends)
+    {
+        auto& endCost = state(end.first).endCost;
+        endCost = glm::min(endCost, end.second);
+    }
+
+    for (const auto& start : starts)
+        relax(start.first, start.second, glm::distance(graph.position(start.first), endPosition), WayPointGraph::invalidId);
+
+    if (directCost < maxCost)
+        relax(endId, directCost, 0.f, WayPointGraph::invalidId);
+
+    while (!m_heap.empty())
+    {
+        const uint32_t current = pop();
+        if (current == endId)
+        {
+            for (uint32_t id = state(endId).parent; id != WayPointGraph::invalidId; id = state(id).parent)
+                path.push_back(id);
+            std::reverse(path.begin(), path.end());
+            return true;
+        }
+
+        ++m_numExpandedNodes;
+        const float currentCost = state(current).cost;
+
+        for (uint32_t edge = graph.edgesBegin(current); edge < graph.edgesEnd(current); ++edge)
+        {
+            const uint32_t next = graph.edgeTarget(edge);
+            const float nextCost = currentCost + graph.edgeCost(edge);
+            if (nextCost < state(next).cost)
+                relax(next, nextCost, glm::distance(graph.position(next), endPosition), current);
+        }
+
+        const float endCost = state(current).endCost;
+        if (endCost < maxCost)
+            relax(endId, currentCost + endCost, 0.f, current);
+    }
+
+    return false;
+}
+
+WayPointSearch::NodeState& WayPointSearch::state(uint32_t id)
+{
+    auto& result = m_states[id];
+    if (result.generation != m_generation)
+    {
+        result.cost = std::numeric_limits<float>::max();
+        result.priority = std::numeric_limits<float>::max();
+        result.endCost = std::numeric_limits<float>::max();
+        result.parent = WayPointGraph::invalidId;
+        result.heapIndex = WayPointGraph::invalidId;
+        result.generation = m_generation;
+    }
+    return result;
+}
+
+void WayPointSearch::relax(uint32_t id, float cost, float heuristic, uint32_t parent)
+{
+    auto& nodeState = state(id);
+    if (cost >= nodeState.cost)
+        return;
+
+    nodeState.cost = cost;
+    nodeState.priority = cost + heuristic;
+    nodeState.parent = parent;
+
+    // nodes are reopened if they are reached cheaper after expanding, so the result stays optimal for any start and end costs
+    if (nodeState.heapIndex == WayPointGraph::invalidId)
+    {
+        nodeState.heapIndex = static_cast<uint32_t>(m_heap.size());
+        m_heap.push_back(id);
+    }
+    siftUp(nodeState.heapIndex);
+}
+
+void WayPointSearch::siftUp(uint32_t index)
+{
+    const uint32_t id = m_heap[index];
+    const float priority = m_states[id].priority;
+
+    while (index > 0u)
+    {
+        const uint32_t parentIndex = (index - 1u) / 2u;
+        const uint32_t parentId = m_heap[parentIndex];
+        if (m_states[parentId].priority <= priority)
+            break;
+
+        m_heap[index] = parentId;
+        m_states[parentId].heapIndex = index;
+        index = parentIndex;
+    }
+
+    m_heap[index] = id;
+    m_states[id].heapIndex = index;
+}
+
+void WayPointSearch::siftDown(uint32_t index)
+{
+    const auto size = static_cast<uint32_t>(m_heap.size());
+    const uint32_t id = m_heap[index];
+    const float priority = m_states[id].priority;
+
+    for (;;)
+    {
+        uint32_t childIndex = 2u * index + 1u;
+        if (childIndex >= size)
+            break;
+
+        if ((childIndex + 1u < size) && (m_states[m_heap[childIndex + 1u]].priority < m_states[m_heap[childIndex]].priority))
+            ++childIndex;
+
+        const uint32_t childId = m_heap[childIndex];
+        if (priority <= m_states[childId].priority)
+            break;
+
+        m_heap[index] = childId;
+        m_states[childId].heapIndex = index;
+        index = childIndex;
+    }
+
+    m_heap[index] = id;
+    m_states[id].heapIndex = index;
+}
+
+uint32_t WayPointSearch::pop()
+{
+    const uint32_t result = m_heap.front();
+    m_states[result].heapIndex = WayPointGraph::invalidId;
+
+    const uint32_t last = m_heap.back();
+    m_heap.pop_back();
+    if (!m_heap.empty())
+    {
+        m_heap.front() = last;
+        siftDown(0u);
+    }
+
+    return result;
+}
+
+} // namespace
+} // namespace
@@ -0,0 +1,96 @@
+#ifndef WAYPOINTGRAPH_H
+#define WAYPOINTGRAPH_H
+
+#include <memory>
+#include <map>
+#include <vector>
+#include <unordered_map>
+
+#include <glm/vec3.hpp>
+
+#include "typesprivate.h"
+
+namespace trash
+{
+namespace game
+{
+
+// Immutable snapshot of the way points graph in compressed sparse row form.
+// Edges of the node i are [edgesBegin(i), edgesEnd(i)), their costs are the distances between the way points.
+class WayPointGraph
+{
+public:
+    static const uint32_t invalidId;
+
+    WayPointGraph(const std::multimap<std::shared_ptr<WayPoint>, std::shared_ptr<WayPoint>>&, uint64_t);
+    WayPointGraph(const std::vector<std::shared_ptr<WayPoint>>&, const std::vector<std::pair<uint32_t, uint32_t>>&, uint64_t); // node ids are the indices of the way points
+
+    uint64_t version() const { return m_version; }
+
+    uint32_t numNodes() const { return static_cast<uint32_t>(m_wayPoints.size()); }
+    uint32_t nodeId(const std::shared_ptr<WayPoint>&) const; // invalidId if the way point is not in the graph
+    const std::shared_ptr<WayPoint>& wayPoint(uint32_t id) const { return m_wayPoints[id]; }
+    const std::vector<std::shared_ptr<WayPoint>>& wayPoints() const { return m_wayPoints; }
+    const glm::vec3& position(uint32_t id) const { return m_positions[id]; }
+
+    uint32_t edgesBegin(uint32_t id) const { return m_offsets[id]; }
+    uint32_t edgesEnd(uint32_t id) const { return m_offsets[id + 1u]; }
+    uint32_t edgeTarget(uint32_t edge) const { return m_targets[edge]; }
+    float edgeCost(uint32_t edge) const { return m_costs[edge]; }
+
+private:
+    void buildEdges(const std::vector<std::pair<uint32_t, uint32_t>>&);
+
+    std::vector<std::shared_ptr<WayPoint>> m_wayPoints;
+    std::vector<glm::vec3> m_positions;
+    std::unordered_map<const WayPoint*, uint32_t> m_ids;
+    std::vector<uint32_t> m_offsets;
+    std::vector<uint32_t> m_targets;
+    std::vector<float> m_costs;
+    uint64_t m_version;
+};
+
+// A* over a compiled graph with the Euclidean distance to the end point as the heuristic. The search starts from several nodes
+// with given costs and finishes at a virtual end node linked from several nodes, so points off the graph need no temporary way points.
+// States of the nodes are kept between searches and are reset lazily by the search generation, so a search neither clears nor
+// allocates anything once the scratch has grown to the graph size. The open set is a binary heap indexed by node.
+class WayPointSearch
+{
+public:
+    using Links = std::vector<std::pair<uint32_t, float>>; // node ids and costs of moving between them and the point off the graph
+
+    WayPointSearch();
+
+    // starts, end point, ends, cost of the direct move from the start to the end point (max float if there is no one) and the result
+    // nodes from the first to the last one. The result is empty if the direct move is the shortest.
+    bool find(const WayPointGraph&, const Links&, const glm::vec3&, const Links&, float, std::vector<uint32_t>&);
+
+    uint32_t numExpandedNodes() const { return m_numExpandedNodes; } // of the last search
+
+private:
+    struct NodeState
+    {
+        float cost;
+        float priority;
+        float endCost;
+        uint32_t parent;
+        uint32_t heapIndex;
+        uint32_t generation;
+    };
+
+    NodeState& state(uint32_t);
+    void relax(uint32_t, float, float, uint32_t);
+    void siftUp(uint32_t);
+    void siftDown(uint32_t);
+    uint32_t pop();
+
+    std::vector<NodeState> m_states;
+    std::vector<uint32_t> m_heap;
+    uint32_t m_generation;
+    uint32_t m_numExpandedNodes;
+};
+
+} // namespace
+} // namespace
+
+#endif // WAYPOINTGRAPH_H
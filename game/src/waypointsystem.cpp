@@ -1,4 +1,4 @@
-#include <glm/geometric.hpp>
+#include <limits>
 
 #include "waypointsystem.h"
 
@@ -8,6 +8,8 @@ namespace game
 {
 
 WayPointSystem::WayPointSystem()
+    : m_version(0u)
+    , m_compiledGraph()
 {
 }
 
@@ -38,6 +40,7 @@ void WayPointSystem::insert(std::shared_ptr<trash::game::WayPoint> p1, std::shar
                 return;
 
     m_graph.insert({p1, p2});
+    dirty();
 }
 
 void WayPointSystem::insertTwoSided(std::shared_ptr<WayPoint> p1, std::shared_ptr<WayPoint> p2)
@@ -57,6 +60,7 @@ void WayPointSystem::remove(std::shared_ptr<WayPoint> p1, std::shared_ptr<WayPoi
             if (it->second == p2)
             {
                 m_graph.erase(it);
+                dirty();
                 break;
             }
 }
@@ -72,66 +76,69 @@ void WayPointSystem::remove(std::shared_ptr<WayPoint> p)
     if (!p)
         return;
 
+    bool isRemoved = false;
     for (auto it = m_graph.begin(); it != m_graph.end(); )
     {
         if (it->first == p || it->second == p)
+        {
             it = m_graph.erase(it);
+            isRemoved = true;
+        }
         else
             ++it;
     }
+
+    if (isRemoved)
+        dirty();
 }
 
-WayPointPath WayPointSystem::findPath(std::shared_ptr<WayPoint> start, std::shared_ptr<WayPoint> end) const
+std::shared_ptr<const WayPointGraph> WayPointSystem::compiledGraph() const
 {
-    std::multimap<float, std::shared_ptr<WayPoint>> frontier;
-    frontier.insert({0.0f, start});
-
-    std::map<std::shared_ptr<WayPoint>, std::shared_ptr<WayPoint>> cameFrom;
-    cameFrom.insert({start, nullptr});
-
-    std::map<std::shared_ptr<WayPoint>, float> costSoFar;
-    costSoFar.insert({start, 0.0f});
+    std::lock_guard<std::mutex> lock(m_compiledGraphMutex);
+    if (!m_compiledGraph)
+        m_compiledGraph = std::make_shared<WayPointGraph>(m_graph, m_version);
+    return m_compiledGraph;
+}
 
-    while (!frontier.empty())
-    {
-        auto current = frontier.begin()->second;
-        frontier.erase(frontier.begin());
+WayPointPath WayPointSystem::findPath(std::shared_ptr<WayPoint> start, std::shared_ptr<WayPoint> end, Query& query) const
+{
+    if (!start || !end)
+        return WayPointPath();
 
-        if (current == end)
-            break;
+    return findPath(ClosestWayPoints{{0.0f, start}}, end->position, ClosestWayPoints{{0.0f, end}}, std::numeric_limits<float>::max(), query);
+}
 
-        auto iters = m_graph.equal_range(current);
-        if (iters.first != m_graph.end())
-            for (auto next = iters.first; next != iters.second; ++next)
-            {
-                float newCost = costSoFar[current] + glm::distance(current->position, next->second->position);
-                auto it = costSoFar.find(next->second);
-                if (it == costSoFar.end())
-                    costSoFar.insert({next->second, std::numeric_limits<float>::max()});
-                if (newCost < costSoFar[next->second])
-                {
-                    costSoFar[next->second] = newCost;
-                    float priority = newCost + glm::distance(current->position, next->second->position);
-                    frontier.insert({priority, next->second});
-                    cameFrom[next->second] = current;
-                }
-            }
-    }
+WayPointPath WayPointSystem::findPath(const ClosestWayPoints& starts, const glm::vec3& endPosition, const ClosestWayPoints& ends, float directCost, Query& query) const
+{
+    auto graph = compiledGraph();
+
+    auto toLinks = [&graph](const ClosestWayPoints& wayPoints, WayPointSearch::Links& links) {
+        links.clear();
+        for (const auto& wayPoint : wayPoints)
+        {
+            const auto id = graph->nodeId(wayPoint.second);
+            if (id != WayPointGraph::invalidId)
+                links.push_back({id, wayPoint.first});
+        }
+    };
+    toLinks(starts, query.startLinks);
+    toLinks(ends, query.endLinks);
+
+    WayPointPath result;
+    if (query.search.find(*graph, query.startLinks, endPosition, query.endLinks, directCost, query.pathIds))
+        for (auto id : query.pathIds)
+            result.push_back(graph->wayPoint(id));
 
-    if (cameFrom.find(end) == cameFrom.end())
-        return WayPointPath();
+    return result;
+}
 
-    WayPointPath path{end};
-    std::shared_ptr<WayPoint> wp = end;
-    while (wp != start)
-    {
-        wp = cameFrom[wp];
-        path.push_front(wp);
-    }
+void WayPointSystem::dirty()
+{
+    ++m_version;
 
-    return path;
+    std::lock_guard<std::mutex> lock(m_compiledGraphMutex);
+    m_compiledGraph = nullptr;
 }
 
-
 } // namespace
 } // namespace
@@ -4,10 +4,13 @@
 #include <memory>
 #include <map>
 #include <set>
+#include <vector>
+#include <mutex>
 
 #include <glm/vec3.hpp>
 
 #include "typesprivate.h"
+#include "waypointgraph.h"
 
 namespace trash
 {
@@ -28,10 +31,31 @@ public:
     void removeTwoSided(std::shared_ptr<WayPoint>, std::shared_ptr<WayPoint>);
     void remove(std::shared_ptr<WayPoint>);
 
-    WayPointPath findPath(std::shared_ptr<WayPoint>, std::shared_ptr<WayPoint>) const;
+    uint64_t version() const { return m_version; } // changed by every edit of the graph
+    std::shared_ptr<const WayPointGraph> compiledGraph() const; // compiled on the first use after edits, the snapshot isn't changed by later edits
+
+    // scratch of path searches, one per thread
+    struct Query
+    {
+        WayPointSearch search;
+        WayPointSearch::Links startLinks, endLinks;
+        std::vector<uint32_t> pathIds;
+    };
+
+    WayPointPath findPath(std::shared_ptr<WayPoint>, std::shared_ptr<WayPoint>, Query&) const;
+
+    // way points reachable from the start point with their costs, end point, way points it is reachable from with their costs
+    // and cost of the direct move. The result is the way points between the start and end points.
+    WayPointPath findPath(const ClosestWayPoints&, const glm::vec3&, const ClosestWayPoints&, float, Query&) const;
 
 private:
+    void dirty();
+
     std::multimap<std::shared_ptr<WayPoint>, std::shared_ptr<WayPoint>> m_graph;
+    uint64_t m_version;
+
+    mutable std::mutex m_compiledGraphMutex;
+    mutable std::shared_ptr<const WayPointGraph> m_compiledGraph;
 
     friend class Level;
 };
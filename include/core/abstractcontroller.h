@@ -27,11 +27,13 @@ public:
     void sendMessage(std::shared_ptr<Message>);
     void process();
 
+    static uint64_t numProcessedMessages(); // by all controllers
+
 protected:
     AbstractController(AbstractControllerPrivate *);
     virtual ~AbstractController() = default;
 
-    virtual void doWork(std::shared_ptr<Message>) {}
+    virtual void doWork(const std::shared_ptr<Message>&) {}
 
     std::unique_ptr<AbstractControllerPrivate> m_;
 };
@@ -50,7 +52,7 @@ private:
 };
 
 template <class T>
-inline std::shared_ptr<T> msg_cast(std::shared_ptr<AbstractController::Message> msg) {
+inline std::shared_ptr<T> msg_cast(const std::shared_ptr<AbstractController::Message>& msg) {
     return (msg->type() == T::messageType()) ? std::static_pointer_cast<T>(msg) : nullptr;
 }
 
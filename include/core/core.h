@@ -35,7 +35,7 @@ public:
     void setGame(std::shared_ptr<AbstractGame>);
 
 protected:
-    void doWork(std::shared_ptr<Message>) override;
+    void doWork(const std::shared_ptr<Message>&) override;
 
 private:
     Core();
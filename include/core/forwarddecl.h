@@ -27,6 +27,7 @@ class Camera;
 class Scene;
 class Light;
 class NodeVisitor;
+class RayQuery;
 
 struct PickData;
 struct IntersectionData;
@@ -27,7 +27,7 @@ public:
     std::shared_ptr<const Scene> mainScene() const;
 
 protected:
-    void doWork(std::shared_ptr<Message>) override;
+    void doWork(const std::shared_ptr<Message>&) override;
 
 private:
     GraphicsController();
@@ -4,6 +4,7 @@
 #include <string>
 
 #include <core/node.h>
+#include <core/types.h>
 
 namespace trash
 {
@@ -25,6 +26,13 @@ public:
     void setAnimationFrame(const std::string&, uint64_t);
     uint64_t animationTime(const std::string&) const;
 
+    void setAnimationCrossFadeTime(uint64_t);
+    void setAnimationLayer(uint32_t, const std::string&, uint64_t, float, bool additive = false, const std::string& maskRootBone = "");
+    void removeAnimationLayer(uint32_t);
+
+    void setSkinningType(SkinningType);
+    SkinningType skinningType() const;
+
 };
 
 } // namespace
@@ -0,0 +1,45 @@
+#ifndef NODEGEOMETRYVISITOR_H
+#define NODEGEOMETRYVISITOR_H
+
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include <utils/forwarddecl.h>
+
+#include <core/coreglobal.h>
+#include <core/nodevisitor.h>
+
+namespace trash
+{
+namespace core
+{
+
+struct GeometryData
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<uint32_t> indices;
+};
+
+class NodeGeometryVisitorPrivate;
+
+// Collects world space triangles of the drawable nodes intersected by their geometry (see IntersectionMode), e.g. to build navigation data.
+// Triangles are read back from the GPU, so it's meant for loading time.
+class CORESHARED_EXPORT NodeGeometryVisitor : public NodeVisitor
+{
+public:
+    NodeGeometryVisitor();
+    ~NodeGeometryVisitor() override;
+
+    bool visit(std::shared_ptr<Node>) override;
+
+    const GeometryData& geometryData() const;
+
+private:
+    std::unique_ptr<NodeGeometryVisitorPrivate> m_;
+};
+
+} // namespace
+} // namespace
+
+#endif // NODEGEOMETRYVISITOR_H
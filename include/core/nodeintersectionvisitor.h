@@ -2,6 +2,7 @@
 #define NODEINTERSECTIONVISITOR_H
 
 #include <map>
+#include <limits>
 
 #include <utils/forwarddecl.h>
 #include <utils/pimpl.h>
@@ -21,10 +22,12 @@ struct IntersectionData
 
 class NodeRayIntersectionVisitorPrivate;
 
+// Collects the closest hit of each drawable node before the max distance.
+// In the any hit mode the traversal stops at the first found hit, which is reported at zero distance.
 class CORESHARED_EXPORT NodeRayIntersectionVisitor : public NodeVisitor
 {
 public:
-    NodeRayIntersectionVisitor(const utils::Ray&);
+    NodeRayIntersectionVisitor(const utils::Ray&, float = std::numeric_limits<float>::max(), bool = false);
     ~NodeRayIntersectionVisitor() override;
 
     bool visit(std::shared_ptr<Node>) override;
@@ -26,6 +26,7 @@ public:
     public:
         virtual ~AbstractEmitter() = default;
         virtual glm::vec3 operator ()() = 0;
+        virtual void emit(uint32_t, glm::vec3*); // fills positions of several new particles at once
 
         static std::shared_ptr<AbstractEmitter> buildPointEmitter();
         static std::shared_ptr<AbstractEmitter> buildQuadEmitter();
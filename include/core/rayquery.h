@@ -0,0 +1,46 @@
+#ifndef RAYQUERY_H
+#define RAYQUERY_H
+
+#include <memory>
+
+#include <utils/forwarddecl.h>
+#include <utils/noncopyble.h>
+
+#include <core/coreglobal.h>
+#include <core/forwarddecl.h>
+
+namespace trash
+{
+namespace core
+{
+
+class RayQueryPrivate;
+
+// Batched ray queries against the drawable nodes of a subtree.
+// A top level hierarchy over the meshes of the nodes is built at construction, call rebuild() after the subtree has been changed or moved.
+// Rays are reordered into coherent packets internally, results are written in the order of the given rays.
+class CORESHARED_EXPORT RayQuery
+{
+    NONCOPYBLE(RayQuery)
+
+public:
+    RayQuery(std::shared_ptr<Node>);
+    ~RayQuery();
+
+    void rebuild();
+    size_t numInstances() const;
+
+    // number of rays, rays, max distances and the closest hit distances (the max distance if a ray hits nothing)
+    void intersect(size_t, const utils::Ray*, const float*, float*) const;
+
+    // number of rays, rays, max distances and flags of hits before the max distances
+    void occluded(size_t, const utils::Ray*, const float*, bool*) const;
+
+private:
+    std::unique_ptr<RayQueryPrivate> m_;
+};
+
+} // namespace
+} // namespace
+
+#endif // RAYQUERY_H
@@ -35,7 +35,10 @@ public:
     Scene();
     virtual ~Scene();
 
-    PickData pickScene(int32_t, int32_t) const;
+    PickData pickScene(int32_t, int32_t) const; // rendered on the GPU and read back at once, cancels the requested pick
+    void requestPickScene(int32_t, int32_t) const; // rendered on the GPU and read back a frame or two later
+    bool pickSceneResult(PickData&) const; // false until the requested pick is read back
+    PickData intersectScene(int32_t, int32_t) const; // immediate, by the ray intersection with the nodes (see IntersectionMode)
     utils::Ray throwRay(int32_t, int32_t) const;
 
     std::shared_ptr<SceneRootNode> rootNode();
@@ -19,6 +19,8 @@ ENUMCLASS(LightType, uint32_t, Point, Direction, Spot)
 
 ENUMCLASS(TextNodeAlignment, uint8_t, Negative, Center, Positive)
 
+ENUMCLASS(SkinningType, uint32_t, LinearBlend, DualQuaternion)
+
 namespace MouseButton {
     const uint32_t LeftButton = 1 << 0;
     const uint32_t MiddleButton = 1 << 1;
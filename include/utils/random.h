@@ -1,19 +1,63 @@
 #ifndef RANDOM_H
 #define RANDOM_H
 
-#include <random>
+#include <cstdint>
+#include <atomic>
 
 namespace trash
 {
 namespace utils
 {
 
-inline float random(const float from = 0.f, const float to = 1.f)
+// xoshiro128+ generator. The state is seeded by splitmix64, floats are built from the upper 24 bits of the output.
+class Random
+{
+public:
+    explicit Random(uint64_t seed = 0x9e3779b97f4a7c15ull) { setSeed(seed); }
+
+    void setSeed(uint64_t seed) {
+        for (uint32_t i = 0; i < 4; i += 2)
+        {
+            uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            z = z ^ (z >> 31);
+            m_state[i] = static_cast<uint32_t>(z);
+            m_state[i + 1] = static_cast<uint32_t>(z >> 32);
+        }
+    }
+
+    uint32_t next() {
+        const uint32_t result = m_state[0] + m_state[3];
+        const uint32_t t = m_state[1] << 9;
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = (m_state[3] << 11) | (m_state[3] >> 21);
+        return result;
+    }
+
+    float operator ()(const float from = 0.f, const float to = 1.f) {
+        return from + (to - from) * (static_cast<float>(next() >> 8) * (1.f / 16777216.f));
+    }
+
+private:
+    uint32_t m_state[4];
+};
+
+// Seeds of generators in the order of their creation, so runs are reproducible
+inline uint64_t nextRandomSeed()
 {
-    static std::uniform_real_distribution<float> unifom(0.f, 1.f);
-    static std::default_random_engine generator;
+    static std::atomic<uint64_t> counter(0u);
+    return counter++;
+}
 
-    return from + (to - from) * unifom(generator);
+inline float random(const float from = 0.f, const float to = 1.f)
+{
+    static Random generator;
+    return generator(from, to);
 }
 
 } // namespace